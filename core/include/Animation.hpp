@@ -0,0 +1,166 @@
+#pragma once
+
+#include "Config.hpp"
+#include "Math.hpp"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+class SceneNode;
+
+
+enum AnimationInterpolation
+{
+    ANIM_NLERP = 0,     // normalized lerp (fast, vectorized)
+    ANIM_SLERP = 1      // constant angular velocity
+};
+
+
+// Keys for one node. Every channel has its own time line and the values are
+// stored structure-of-arrays so the sampler can stream them.
+struct CORE_PUBLIC AnimationTrack
+{
+    std::string target;     // node name
+
+    std::vector<float> posTimes;
+    std::vector<float> posX, posY, posZ;
+
+    std::vector<float> rotTimes;
+    std::vector<float> rotX, rotY, rotZ, rotW;
+
+    std::vector<float> sclTimes;
+    std::vector<float> sclX, sclY, sclZ;
+
+    // keys must be added in increasing time
+    void AddPositionKey(float time, const Vec3 &position);
+    void AddRotationKey(float time, const Quaternion &rotation);
+    void AddScaleKey(float time, const Vec3 &scale);
+
+    float GetEndTime() const;
+};
+
+
+class CORE_PUBLIC AnimationClip
+{
+public:
+    AnimationClip(const std::string &name, float duration = 0.0f);
+
+    AnimationTrack *AddTrack(const std::string &target);
+    AnimationTrack *GetTrack(u32 index);
+    AnimationTrack *FindTrack(const std::string &target);
+    u32 GetTrackCount() const { return (u32)m_tracks.size(); }
+
+    const std::string &GetName() const { return m_name; }
+    float GetDuration() const { return m_duration; }
+    void SetDuration(float duration) { m_duration = duration; }
+    // duration = last key of every track
+    void CalculateDuration();
+
+private:
+    std::string m_name;
+    float m_duration;
+    std::deque<AnimationTrack> m_tracks;   // deque: track pointers stay valid
+};
+
+
+// Plays one clip on a node hierarchy. Tracks are bound by name to the root
+// and its descendants when the animator is created.
+class CORE_PUBLIC Animator
+{
+public:
+    Animator(AnimationClip *clip, SceneNode *root);
+    ~Animator();
+
+    void Play();
+    void Stop();
+    void Pause() { m_playing = false; }
+    bool IsPlaying() const { return m_playing; }
+
+    void SetLoop(bool loop) { m_loop = loop; }
+    void SetSpeed(float speed) { m_speed = speed; }
+    void SetTime(float time);
+    float GetTime() const { return m_time; }
+    void SetInterpolation(AnimationInterpolation mode) { m_interpolation = mode; }
+
+    AnimationClip *GetClip() const { return m_clip; }
+    u32 GetBoundCount() const { return (u32)m_targets.size(); }
+
+    // Advance + Sample + Apply in one go
+    void Update(float dt);
+
+    // Advances the clock, false when nothing has to be sampled
+    bool Advance(float dt);
+    // Computes the local matrices for the current time (no scene access, thread safe)
+    void Sample();
+    // Same for the tracks [begin, end); begin must be a multiple of 4.
+    // Disjoint ranges can run on different threads.
+    void Sample(u32 begin, u32 end);
+    // Writes the sampled matrices into the bound nodes (main thread)
+    void Apply();
+    // Drops the tracks bound to node or to its children (the node is being deleted)
+    void Unbind(SceneNode *node);
+
+private:
+    struct Binding
+    {
+        const AnimationTrack *track;
+        SceneNode *node;
+        Vec3 restPosition;
+        Quaternion restRotation;
+        Vec3 restScale;
+    };
+    struct Cursor
+    {
+        u32 pos;
+        u32 rot;
+        u32 scl;
+    };
+
+    void bind(SceneNode *root);
+
+    AnimationClip *m_clip;
+    std::vector<Binding> m_targets;
+    std::vector<Cursor> m_cursors;
+    std::vector<Mat4> m_locals;
+
+    // SoA scratch: a = key before, b = key after, t = factor
+    std::vector<float> m_pa[3], m_pb[3], m_pt;
+    std::vector<float> m_ra[4], m_rb[4], m_rt;
+    std::vector<float> m_sa[3], m_sb[3], m_st;
+    std::vector<float> m_pos[3], m_rot[4], m_scl[3];
+
+    float m_time;
+    float m_speed;
+    bool m_loop;
+    bool m_playing;
+    bool m_sampled;
+    AnimationInterpolation m_interpolation;
+};
+
+
+class CORE_PUBLIC AnimationManager
+{
+public:
+    static AnimationManager &Instance();
+    static AnimationManager *InstancePtr();
+
+    AnimationClip *Create(const std::string &name, float duration = 0.0f);
+    bool Exists(const std::string &name);
+    AnimationClip *Get(const std::string &name);
+    AnimationClip *Get(u32 index);
+    u32 GetCount() const { return (u32)m_clips.size(); }
+    void Clear();
+
+private:
+    AnimationManager() {}
+    ~AnimationManager();
+    AnimationManager(const AnimationManager &) = delete;
+    AnimationManager &operator=(const AnimationManager &) = delete;
+    AnimationManager(AnimationManager &&) = delete;
+    AnimationManager &operator=(AnimationManager &&) = delete;
+
+    std::vector<AnimationClip *> m_clips;
+    std::unordered_map<std::string, AnimationClip *> m_clipsByName;
+};
@@ -1,5 +1,8 @@
 #pragma once
 #include <vector>
+#include <list>
+#include <string>
+#include <unordered_map>
 #include "Config.hpp"
 #include "Math.hpp"
 #include "glad/glad.h"
@@ -8,27 +11,55 @@
 
 
 
-struct VertexBuffer 
+const int BATCH_MAX_SEGMENTS = 8;
+const int BATCH_MAX_QUADS = 16384;      // 65536 vertices, the reach of the shared u16 quad IBO
+const int BATCH_MAX_TEXTURES = 8;       // texture units bound per draw call
+const u32 FONT_LAYOUT_CACHE = 256;      // strings kept laid out by each Font
+
+// Interleaved batch vertex: position, uv, rgba8, texture slot (28 bytes)
+struct BatchVertex
 {
-    int elementCount;          
-    std::vector<float>  vertices;        
-    std::vector<float>  texcoords;           
-    std::vector<unsigned char> colors;     
-    std::vector<unsigned int>  indices;    
-    unsigned int vaoId;         
-    unsigned int vboId[4];
-} ;
+    float x, y, z;
+    float u, v;
+    u8 r, g, b, a;
+    u8 slot;            // unit of the draw call texture, picked in the 2DShader
+    u8 pad[3];
+};
+
+// One sprite/glyph of the instanced path (32 bytes), the SpriteShader
+// expands it from a static unit quad
+struct BatchInstance
+{
+    float x, y, width, height;
+    u16 u0, v0, u1, v1;         // uv rect, 0..65535
+    u8 r, g, b, a;
+    u16 rotation;               // turns around the center, 0..65535
+    u8 slot;
+    u8 pad;
+};
 
 struct DrawCall 
 {
     int mode;                   
     int vertexCount;          
     int vertexAlignment;       
-   unsigned int textureId;
+   unsigned int textureId;      // current texture
+   unsigned int textures[BATCH_MAX_TEXTURES];  // bound to units 0..textureCount-1
+   int textureCount;
 };
 
 
 
+// Debug primitives tested against the SetMatrix frustum
+struct CORE_PUBLIC BatchCullStats
+{
+    u32 accepted;
+    u32 rejected;
+    BatchCullStats() { Reset(); }
+    void Reset() { accepted = rejected = 0; }
+};
+
+
 class  CORE_PUBLIC  RenderBatch  
 {
 public:
@@ -39,6 +70,7 @@ public:
     void Release();
     
 
+    // numBuffers segments (at least 3) of bufferElements quads in one ring VBO
     void Init(int numBuffers = 1, int bufferElements = 10000);
  
 
@@ -85,12 +117,39 @@ public:
     void Quad(Texture2D *texture, const FloatRect &src,float x, float y,float width, float height);
     void Quad(u32 texture, float x, float y,float width, float height);
 
+    // Axis aligned quads of the current texture are one instance each when
+    // the SpriteShader exists; rotation in degrees around the center.
+    // Inside Begin/EndTransform, with uvs out of 0..1 or with a custom
+    // shader (SetShader) they are 4 vertices.
+    void Sprite(float x, float y, float width, float height, float u0, float v0, float u1, float v1, float rotation = 0.0f);
+    void Sprite(Texture2D *texture, const FloatRect &src, float x, float y, float width, float height, float rotation = 0.0f);
+    // quad sampled as a distance field (alpha = coverage) by the "SDFShader"
+    void DistanceFieldQuad(unsigned int texture, float x, float y, float width, float height,
+                           float u0, float v0, float u1, float v1);
+    void SetInstancing(bool enable) { instancing = enable; }
+    // program of the vertex path (2DShader layout), nullptr = the 2DShader.
+    // What is queued is drawn first with the previous one.
+    void SetShader(Shader *program);
+    Shader *GetShader() const { return shader; }
+    bool IsInstancing() const { return instancing && spriteVaoId != 0 && shader == defaultShader; }
+
     void BeginTransform(const Mat4 &transform);
     void EndTransform();
 
    
     void Render();
 
+    // Retained batches: what is drawn between BeginStatic/EndStatic goes to a
+    // GPU buffer instead of the screen, DrawStatic replays it without any CPU
+    // work. Pass an existing handle to BeginStatic to re-record it in place.
+    // Textures are kept by id and quads become triangles; no instancing.
+    void BeginStatic(u32 handle = 0);
+    u32 EndStatic();
+    void DrawStatic(u32 handle, const Mat4 &transform);
+    void InvalidateStatic(u32 handle);
+    bool IsStaticValid(u32 handle) const;
+    void ReleaseStatic(u32 handle);
+
     void SetMode(int mode);                        
        
 
@@ -104,15 +163,41 @@ public:
     void SetTexture(Texture2D *texture);
 
     void SetMatrix(const Mat4 &matrix);
+    const Mat4 &GetMatrix() const { return viewMatrix; }
+
+    // Line3D, Box, Cube, Sphere, Cone, Cylinder, Capsule and the 3D triangles
+    // are dropped by their bounds before any vertex is made when they are
+    // outside the SetMatrix view-projection. Stats add up until reset.
+    void SetCulling(bool enable) { culling = enable; }
+    bool IsCulling() const { return culling; }
+    const BatchCullStats &GetCullStats() const { return cullStats; }
+    void ResetCullStats() { cullStats.Reset(); }
 
 
     private:
         bool CheckRenderBatchLimit(int vCount);
-
-
-    int bufferCount;            
-    int currentBuffer;         
+        void flush();
+        void captureStatic();
+        bool cullBox(const Vec3 &min, const Vec3 &max);
+        bool cullSphere(const Vec3 &center, float radius);
+        const Frustum &getFrustum();
+        void emitPrimitive(const float *points, int count, int mode, const Vec3 &position, const Vec3 &scale);
+        void setInstanceAttributes(GLintptr offset);
+        void setDrawState(int mode, unsigned int textureId);
+        void resetDraw(DrawCall &draw, int mode, unsigned int textureId);
+        bool bindSlot(DrawCall &draw, unsigned int textureId);
+        void uploadSegment();
+        void updateTextureUnits();
+        static void acquireQuadIndices();
+        static void releaseQuadIndices();
+
+
+    int bufferCount;            // ring segments
+    int currentBuffer;          // segment written by the next flush
+    int elementCount;           // quads per segment
     int drawCounter;           
+    int textureUnits;           // textures per draw call, 1 with single sampler shaders
+    u8 textureSlot;             // written in every vertex
     float currentDepth;         
     int vertexCounter;
     s32 defaultTextureId;
@@ -123,8 +208,52 @@ public:
 
     Texture2D m_defaultTexture;
 
-    std::vector<DrawCall*> draws;
-    std::vector<VertexBuffer*> vertexBuffer;
+    std::vector<DrawCall> draws;        // contiguous, grows instead of flushing
+
+    std::vector<BatchVertex> vertices;  // CPU side of one segment
+    unsigned int vaoId;
+    unsigned int vboId;
+
+    std::vector<BatchInstance> instances;   // CPU side of one instance segment
+    int instanceCounter;
+    bool instancing;
+    unsigned int spriteVaoId;
+    unsigned int cornerVboId;           // static unit quad
+    unsigned int instanceVboId;         // ring, same segments as the vertices
+    Shader *spriteShader;
+    Shader *sdfShader;
+    Shader *defaultShader;              // 2DShader, the only one instanced sprites match
+
+    struct StaticDraw
+    {
+        int mode;               // LINES, TRIANGLES or SDF_QUAD (as triangles)
+        int first;
+        int count;
+        unsigned int textures[BATCH_MAX_TEXTURES];
+        int textureCount;
+    };
+    struct StaticBatch
+    {
+        unsigned int vao;
+        unsigned int vbo;
+        std::vector<StaticDraw> draws;
+        bool used;
+        bool valid;             // false after InvalidateStatic
+    };
+    std::vector<StaticBatch> statics;           // handle = index + 1
+    std::vector<BatchVertex> staticVertices;    // recording
+    std::vector<StaticDraw> staticDraws;
+    u32 recordHandle;
+    bool recordingStatic;
+
+    bool culling;
+    bool frustumDirty;          // viewMatrix changed since the last build
+    Frustum frustum;
+    BatchCullStats cullStats;
+    GLsync fences[BATCH_MAX_SEGMENTS];  // GPU done with the segment
+
+    static unsigned int s_quadIBO;      // shared by every batch
+    static int s_quadIBOUsers;
 
     float texcoordx, texcoordy;         
     u8 colorr, colorg, colorb, colora;
@@ -141,6 +270,9 @@ private:
 
 
 
+// UTF-8 decode, codepointSize gets the bytes used (Batch.cpp)
+int GetCodepointNext(const char *text, int *codepointSize);
+
 struct  Glyph
 {
     int value;    
@@ -169,10 +301,16 @@ class  CORE_PUBLIC  Font
          void    Print (const char *text, float x, float y);
          void    Print (float x, float y, const char *text, ...);
         
-        void SetTexture(Texture2D *texture) {this->texture = texture;}
+        void SetTexture(Texture2D *texture) {this->texture = texture; clearLayouts();}
         void SetBatch(RenderBatch *batch) {this->batch = batch;}
         void SetFontSize(float size) {this->fontSize = size;}
 
+        // Print/GetTextSize keep the layout of the last strings (LRU), keyed
+        // by text, font size and spacing; 0 lays out every call
+        void SetLayoutCacheSize(u32 count);
+        u32 GetLayoutCacheHits() const { return m_layoutHits; }
+        u32 GetLayoutCacheMisses() const { return m_layoutMisses; }
+
 
         bool LoadDefaultFont();
 
@@ -193,6 +331,22 @@ class  CORE_PUBLIC  Font
             u16 yoffset;
           };
 
+        struct LayoutGlyph
+        {
+            FloatRect src;                  // pixels in the font texture
+            float x, y, width, height;      // from the text origin
+            float u0, v0, u1, v1;
+        };
+        struct TextLayout
+        {
+            u64 key;
+            std::string text;
+            float fontSize;
+            float spacing;
+            std::vector<LayoutGlyph> glyphs;
+            Vec2 size;                      // GetTextSize
+        };
+
         Font(const Font& other) = delete;
         Font& operator=(const Font& other) = delete;
 
@@ -216,8 +370,131 @@ class  CORE_PUBLIC  Font
         std::vector<Glyph> m_glyphs;   
         int textLineSpacing{15};
 
+        // codepoint -> glyph index, -1 when missing: Latin-1 direct, the
+        // rest in 256 codepoint pages allocated on demand
+        s32 m_latin[256];
+        std::unordered_map<int, std::vector<s32>> m_glyphPages;
+        int m_fallbackGlyph;     // '?' or 0
+
+        std::list<TextLayout> m_layouts;    // most recent first
+        std::unordered_map<u64, std::list<TextLayout>::iterator> m_layoutIndex;
+        TextLayout m_scratchLayout;         // cache disabled
+        u32 m_layoutCapacity;
+        u32 m_layoutHits;
+        u32 m_layoutMisses;
+
         void drawTextCodepoint(int codepoint,float x, float y);
+        void buildGlyphLookup();
+        void buildLayout(const char *text, TextLayout &layout);
+        const TextLayout &getLayout(const char *text);
+        void clearLayouts();
         int  getGlyphIndex( int codepoint);
         void drawTexture(const FloatRect &src,float x, float y,float w, float h);
 
-};
\ No newline at end of file
+};
+
+// Big 2D map split in chunkSize x chunkSize chunks. Each chunk is a static
+// batch baked from the tileset and only rebuilt after SetTile touches it;
+// Render draws the chunks that overlap the orthographic view.
+// Tile t is the t-th tileWidth x tileHeight cell of the tileset (row major),
+// -1 is empty.
+class CORE_PUBLIC TileMapLayer
+{
+public:
+    TileMapLayer(RenderBatch *batch, Texture2D *tileset, int tileWidth, int tileHeight);
+    ~TileMapLayer();
+
+    bool Create(int width, int height, int chunkSize = 32);
+    void Release();
+
+    void SetTile(int x, int y, s32 tile);
+    s32 GetTile(int x, int y) const;
+    void Fill(s32 tile);
+
+    // world position of tile (0, 0)
+    void SetPosition(float x, float y) { posX = x; posY = y; }
+
+    // view: the world rect shown by the batch matrix. Chunks are baked with
+    // the current batch color.
+    void Render(const FloatRect &view);
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+    int GetChunkCount() const { return chunksX * chunksY; }
+    int GetVisibleChunks() const { return visibleChunks; }    // last Render
+    int GetRebuiltChunks() const { return rebuiltChunks; }    // last Render
+
+private:
+    TileMapLayer(const TileMapLayer &) = delete;
+    TileMapLayer &operator=(const TileMapLayer &) = delete;
+
+    void buildChunk(int cx, int cy);
+
+    RenderBatch *batch;
+    Texture2D *tileset;
+    int tileWidth;
+    int tileHeight;
+    int width;
+    int height;
+    int chunkSize;
+    int chunksX;
+    int chunksY;
+    float posX;
+    float posY;
+    std::vector<s32> tiles;
+    std::vector<u32> chunks;    // static batch handles, 0 = never built
+    int visibleChunks;
+    int rebuiltChunks;
+};
+
+// UI drawn once into its own RGBA target and then composited as one quad.
+// Record only when Begin() returns true (first use, MarkDirty or Create):
+//
+//     if (hud.Begin()) { font.Print(...); batch.Quad(...); hud.End(); }
+//     hud.Render();
+//
+// Inside Begin/End the batch draws in layer pixels (0,0 top left). The target
+// holds premultiplied alpha, Render composites it with (ONE, ONE_MINUS_SRC_ALPHA)
+// and puts back the usual (SRC_ALPHA, ONE_MINUS_SRC_ALPHA). No depth buffer.
+class CORE_PUBLIC UILayer
+{
+public:
+    UILayer(RenderBatch *batch);
+    ~UILayer();
+
+    bool Create(int width, int height);
+    void Release();
+
+    void SetPosition(float x, float y) { posX = x; posY = y; }
+    void MarkDirty() { dirty = true; }
+    bool IsDirty() const { return dirty; }
+
+    bool Begin();
+    void End();
+    // with the batch matrix of the screen
+    void Render();
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+    u32 GetTexture() const { return texture; }
+    u32 GetRedraws() const { return redraws; }     // times the layer was recorded
+
+private:
+    UILayer(const UILayer &) = delete;
+    UILayer &operator=(const UILayer &) = delete;
+
+    RenderBatch *batch;
+    u32 fbo;
+    u32 texture;
+    int width;
+    int height;
+    float posX;
+    float posY;
+    bool dirty;
+    bool recording;
+    u32 redraws;
+    // restored by End
+    Mat4 screenMatrix;
+    s32 screenFBO;
+    s32 screenViewport[4];
+};
@@ -15,4 +15,7 @@
 #include "Device.hpp"
 #include "Camera.hpp"
 #include "Scene.hpp"
+#include "Animation.hpp"
+#include "Crowd.hpp"
+#include "SDFFont.hpp"
 
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Config.hpp"
+#include "Math.hpp"
+
+#include <vector>
+#include <string>
+
+class Mesh;
+class Model;
+class Shader;
+class Texture;
+class Texture2D;
+class AnimationClip;
+
+
+const u32 VAT_MAX_WIDTH = 2048;             // vertices per texture row (GLES 3 minimum size)
+const u32 VAT_POSITION_UNIT = 4;            // texture units used by the crowd shader
+const u32 VAT_NORMAL_UNIT = 5;
+const u32 CROWD_ATTRIBUTE_BASE = 10;        // mat4 10..13, animation 14
+
+
+// Frames of one clip inside the baked textures
+struct CORE_PUBLIC VATClip
+{
+    std::string name;
+    u32 firstFrame;
+    u32 frameCount;
+    float duration;
+    bool loop;
+};
+
+
+// Vertex animation textures: skinned positions/normals sampled offline.
+// Texel (v % width, frame * rowsPerFrame + v / width) holds vertex v.
+class CORE_PUBLIC VertexAnimationTexture
+{
+public:
+    VertexAnimationTexture();
+    ~VertexAnimationTexture();
+
+    // Plays every clip on the skinned model and skins mesh meshIndex at frameRate.
+    // The mesh must still have its CPU data; the model pose is restored after.
+    bool Bake(Model *model, u32 meshIndex, const std::vector<AnimationClip *> &clips, float frameRate = 30.0f);
+    void Release();
+
+    u32 GetClipCount() const { return (u32)m_clips.size(); }
+    const VATClip &GetClip(u32 index) const { return m_clips[index]; }
+    s32 FindClip(const std::string &name) const;
+    void SetClipLoop(u32 index, bool loop);
+
+    Mesh *GetMesh() const { return m_mesh; }
+    Texture2D *GetPositionTexture() const { return m_positions; }
+    Texture2D *GetNormalTexture() const { return m_normals; }
+
+    u32 GetVertexCount() const { return m_vertexCount; }
+    u32 GetFrameCount() const { return m_frameCount; }
+    u32 GetWidth() const { return m_width; }
+    u32 GetRowsPerFrame() const { return m_rowsPerFrame; }
+    float GetFrameRate() const { return m_frameRate; }
+    // model space bounds of every baked frame
+    const BoundingBox &GetBounds() const { return m_bounds; }
+
+private:
+    VertexAnimationTexture(const VertexAnimationTexture &) = delete;
+    VertexAnimationTexture &operator=(const VertexAnimationTexture &) = delete;
+
+    Mesh *m_mesh;
+    Texture2D *m_positions;
+    Texture2D *m_normals;
+    std::vector<VATClip> m_clips;
+    u32 m_vertexCount;
+    u32 m_frameCount;
+    u32 m_width;
+    u32 m_rowsPerFrame;
+    float m_frameRate;
+    BoundingBox m_bounds;
+};
+
+
+// Thousands of VAT animated instances in one instanced draw. Each instance
+// only stores its transform and (clip, start time, rate); the frame is
+// computed in the vertex shader from "crowdTime", so playing costs nothing
+// on the CPU and the instance buffer is only touched when something changes.
+class CORE_PUBLIC Crowd
+{
+public:
+    Crowd(VertexAnimationTexture *vat, u32 capacity = 256);
+    ~Crowd();
+
+    u32 AddInstance(const Mat4 &transform, u32 clip, float speed = 1.0f, float timeOffset = 0.0f);
+    void SetTransform(u32 instance, const Mat4 &transform);
+    // restarts the instance on a clip at the current crowd time
+    void Play(u32 instance, u32 clip, float speed = 1.0f, float timeOffset = 0.0f);
+    void RemoveInstance(u32 instance);      // swaps with the last one
+    void Clear();
+    u32 GetCount() const { return (u32)m_instances.size(); }
+
+    void SetTexture(Texture *texture) { m_texture = texture; }
+
+    void Update(float dt) { m_time += dt; }
+    float GetTime() const { return m_time; }
+
+    // expects a shader like "CrowdShader" in use with view/proj set
+    void Render(Shader *shader);
+
+private:
+    struct Instance
+    {
+        float model[16];
+        float anim[4];      // first frame, frame count (negative = clamp), start time, frames per second
+    };
+
+    void markDirty(u32 instance);
+    void setAnimation(Instance &instance, u32 clip, float speed, float timeOffset);
+    void createVAO();
+
+    VertexAnimationTexture *m_vat;
+    Texture *m_texture;
+    std::vector<Instance> m_instances;
+    u32 m_vao;
+    u32 m_instanceVBO;
+    u32 m_capacity;         // instances allocated on the GPU
+    u32 m_dirtyBegin;
+    u32 m_dirtyEnd;
+    float m_time;
+
+    Crowd(const Crowd &) = delete;
+    Crowd &operator=(const Crowd &) = delete;
+};
@@ -4,12 +4,20 @@
 #include <SDL2/SDL.h>
 #include "Config.hpp"
 
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 
 class  CORE_PUBLIC  Device 
 {
 public:
   
     bool Create(int width, int height,const char* title,bool vzync=false);
+    // before Create: GPU uploads on a loader thread (see GpuUploader)
+    void SetUploadThread(bool enable) { m_uploadThread = enable; }
  
     bool Run();
 
@@ -59,6 +67,7 @@ private:
     double m_target;
     bool m_ready;
     Sint32 m_closekey;
+    bool m_uploadThread;
 
     Device();
     ~Device();
@@ -71,4 +80,66 @@ private:
 };
 
 
+// Loader thread with its own GL context, shared with the main one, that runs
+// texture/buffer uploads off the render thread. Each upload is followed by a
+// fence and its done callback runs on the main thread from Poll once the fence
+// has signaled, so the render thread never waits on the loader. Without
+// context sharing (or with Device::SetUploadThread off) the uploads run on
+// the main thread in Poll instead. Only shared objects (textures, buffers,
+// syncs) can be made there: VAOs and FBOs must be built in done.
+class CORE_PUBLIC GpuUploader
+{
+public:
+    static GpuUploader &Instance();
+    static GpuUploader *InstancePtr();
+
+    // Device::Create, with the main context current
+    bool Start(SDL_Window *window);
+    void Stop();
+    bool IsThreaded() const { return m_context != nullptr; }
+
+    // returns the job id for Wait/Cancel
+    u32 Submit(const std::function<void()> &upload, const std::function<void()> &done);
+    // Main thread, once per frame (Device::Run)
+    void Poll();
+    // Main thread: blocks until everything submitted is uploaded and done
+    void Finish();
+    // Main thread: blocks until that job is uploaded and runs its done (the
+    // rest of the queue keeps going). Not started yet: uploaded right here.
+    void Wait(u32 job);
+    // Main thread: drops the job if the loader did not start it, done is not called
+    bool Cancel(u32 job);
+    u32 GetPending() const { return m_pending; }
 
+private:
+    struct Job
+    {
+        std::function<void()> upload;
+        std::function<void()> done;
+        void *fence;        // GLsync
+        u32 id;
+        bool uploaded;
+    };
+
+    void loaderLoop();
+
+    SDL_Window *m_window;           // hidden, the loader context is current on it
+    SDL_GLContext m_context;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_uploaded;
+    std::deque<Job> m_queue;        // for the loader
+    std::deque<Job> m_fenced;       // uploaded, waiting for their fence
+    u32 m_busy;                     // jobs the loader is running
+    u32 m_running;                  // id of that job
+    u32 m_pending;                  // submitted, done not called yet
+    u32 m_nextId;
+    int m_state;                    // loader startup: 0 starting, 1 running, -1 failed
+    bool m_quit;
+
+    GpuUploader();
+    ~GpuUploader();
+    GpuUploader(const GpuUploader &) = delete;
+    GpuUploader &operator=(const GpuUploader &) = delete;
+};
\ No newline at end of file
@@ -2428,9 +2428,10 @@ public:
     }
     bool SphereInside(Vec3 pos, float rad) const
     {
+        // signed distance, the planes point outwards
         for (u32 i = 0; i < 6; ++i)
         {
-            if (m_planes[i].distanceToPoint(pos) > rad) return true;
+            if (Vec3::Dot(m_planes[i].normal, pos) + m_planes[i].dist > rad) return true;
         }
 
         return false;
@@ -2446,7 +2447,7 @@ public:
             if (n.y <= 0) positive.y = b.max.y;
             if (n.z <= 0) positive.z = b.max.z;
 
-            if (m_planes[i].distanceToPoint(positive) > 0) return true;
+            if (Vec3::Dot(n, positive) + m_planes[i].dist > 0) return true;
         }
 
         return false;
@@ -5,8 +5,12 @@
 #include "Config.hpp"
 #include "Texture.hpp"
 #include "Device.hpp"
+#include "Meshlet.hpp"
 #include "glad/glad.h"
 
+#include <atomic>
+#include <functional>
+#include <memory>
 
 class SceneNode;
 class Scene;
@@ -24,6 +28,11 @@ const int VBO_TEXCOORD0 = 0x00000080;
 const int VBO_TEXCOORD1 = 0x00000100;
 const int VBO_INDICES = 0x00000200;
 
+const u32 MAX_GPU_MORPH_TARGETS = 4;    // targets blended in the vertex shader
+const u32 MORPH_ATTRIBUTE_BASE = 8;     // 8..11 position deltas, 12..15 normal deltas
+
+const u32 MAX_MESH_RING = 4;            // VBOs cycled by a double buffered mesh
+
 
 
 class CORE_PUBLIC Material 
@@ -96,6 +105,32 @@ private:
 };
 
 
+enum MorphMode
+{
+    MORPH_CPU = 0,      // sparse SIMD accumulation + partial VBO updates
+    MORPH_GPU = 1       // strongest targets as extra attribute streams
+};
+
+
+// Streams handed to the worker of Mesh::UpdateAsync
+struct CORE_PUBLIC DynamicVertices
+{
+    const Vec3* previous;   // positions on screen now (read only)
+    Vec3* positions;        // next frame, every vertex must be written
+    Vec3* normals;          // null when the mesh has no normals
+    u32 count;
+};
+
+
+// What stays in system memory after a mesh is uploaded to the GPU
+enum MeshResidency
+{
+    RESIDENCY_KEEP_ALL = 0,     // every CPU stream is kept (editable mesh)
+    RESIDENCY_COLLISION = 1,    // keep positions + indices (+ blend data) only (picking/physics/CPU skinning)
+    RESIDENCY_GPU_ONLY = 2      // drop every CPU stream, mesh lives only in VRAM
+};
+
+
 enum PrimitiveType
 {
     TRIANGLES = GL_TRIANGLES,
@@ -115,6 +150,16 @@ public:
     int GetMaterial() const { return m_material; }
     void SetMaterial(u32 material) { m_material = material; }
 
+    // === SUBMESHES ===
+    // One VAO, several materials: without submeshes the whole mesh uses
+    // GetMaterial(), with them only the listed ranges are drawn.
+    s32 AddSubMesh(u32 indexStart, u32 indexCount, u32 material);
+    // Opens a submesh at the end of the indices, AddFace grows it
+    s32 BeginSubMesh(u32 material);
+    u32 GetSubMeshCount() const { return (u32)m_subMeshes.size(); }
+    const SubMesh& GetSubMesh(u32 index) const { return m_subMeshes[index]; }
+    void ClearSubMeshes();
+
     void Render(u32 mode, u32 count);
     void Render(u32 mode);
     void Render();
@@ -165,6 +210,71 @@ public:
     void VertexTexCoord(u32 index, const Vec2& texCoord);
     void VertexTexCoord(u32 index, float u, float v);
 
+    // Up to 4 joint influences per vertex (weights should sum to 1)
+    void VertexBlend(u32 index, const u8 joints[4], const Vec4& weights);
+    bool HasSkin() const { return m_hasSkin; }
+
+    // Linear blend skinning of vertices [begin, end) with a joint palette.
+    // outNormals can be null. Safe to call from worker threads.
+    void Skin(const Mat4* palette, u32 paletteSize, u32 begin, u32 end,
+              Vec3* outPositions, Vec3* outNormals) const;
+    // same, skinning other rest positions/normals (a morphed copy of this mesh)
+    void Skin(const Mat4* palette, u32 paletteSize, u32 begin, u32 end,
+              const Vec3* inPositions, const Vec3* inNormals,
+              Vec3* outPositions, Vec3* outNormals) const;
+
+    // === MORPH TARGETS ===
+    // Sparse deltas for the listed vertices; normals/tangents can be null
+    s32 AddMorphTarget(const std::string& name, const std::vector<u32>& vertices,
+                       const std::vector<Vec3>& positionDeltas,
+                       const std::vector<Vec3>* normalDeltas = nullptr,
+                       const std::vector<Vec3>* tangentDeltas = nullptr);
+    // Builds the sparse target from a full posed copy of the mesh, keeping
+    // only the vertices that move more than epsilon
+    s32 AddMorphTargetFromShape(const std::string& name, const std::vector<Vec3>& shapePositions,
+                                const std::vector<Vec3>* shapeNormals = nullptr, float epsilon = 1e-5f);
+    u32 GetMorphTargetCount() const { return (u32)m_morphTargets.size(); }
+    s32 FindMorphTarget(const std::string& name) const;
+
+    // switching to GPU restores the base shape on the CPU streams
+    void SetMorphMode(MorphMode mode);
+    MorphMode GetMorphMode() const { return m_morphMode; }
+
+    // CPU path: rebuilds only the vertices touched by the current or the
+    // previous weights and uploads just those ranges
+    void ApplyMorphWeights(const float* weights, u32 count);
+    // CPU path into a copy owned by the caller (one per model instance), the
+    // mesh is not written. touched keeps the vertices moved by the previous
+    // weights between calls. False when every weight is 0 (draw the base).
+    bool MorphInto(const float* weights, u32 count, std::vector<Vec3>& outPositions,
+                   std::vector<Vec3>& outNormals, std::vector<u32>& touched) const;
+
+    // === DOUBLE BUFFERING ===
+    // Positions/normals are written by a worker into a back buffer while the
+    // GPU draws the front one. ringSize VBOs are cycled so the upload never
+    // touches a buffer still in flight (1 = orphan the same VBO every time).
+    void SetDoubleBuffered(bool enable, u32 ringSize = 3);
+    bool IsDoubleBuffered() const { return m_doubleBuffer != nullptr; }
+    // Runs job on the ThreadPool. False while the last one is not swapped yet;
+    // nothing else may change the vertices until then.
+    bool UpdateAsync(const std::function<void(DynamicVertices&)>& job);
+    // Frame boundary (Device::Run): uploads a finished back buffer, never waits
+    bool SwapBuffers();
+    void WaitUpdate() const;
+
+    // === MESHLETS ===
+    // Reorders the indices into clusters of connected triangles and keeps a
+    // bounding sphere + normal cone per cluster. Needs the CPU data.
+    u32 BuildMeshlets(u32 maxVertices = MESHLET_MAX_VERTICES, u32 maxTriangles = MESHLET_MAX_TRIANGLES);
+    u32 GetMeshletCount() const { return m_meshlets.GetCount(); }
+    // false once the indices changed after BuildMeshlets
+    bool HasMeshlets() const { return m_meshlets.GetCount() > 0 && m_meshlets.GetIndexCount() == GetIndexCount(); }
+    // Frustum + backface cone test in model space, no GL calls.
+    // Builds the draw ranges used by RenderMeshlets, returns the visible meshlets.
+    u32 CullMeshlets(const Mat4& modelView, const Mat4& proj, bool backface, MeshletStats* stats = nullptr);
+    // Draws the ranges of the last CullMeshlets
+    void RenderMeshlets();
+
     int AddFace(u32 v0, u32 v1, u32 v2);
 
     void SetName(const std::string& name) { m_name = name; }
@@ -176,7 +286,24 @@ public:
 
     void Init();
     void Upload();
+    // Upload on the GpuUploader: Render skips the mesh until the buffers are
+    // in and nothing may change the CPU data meanwhile. False if not dirty.
+    bool UploadAsync();
+    bool IsUploading() const { return m_uploading; }
+    bool IsDirty() const { return isDirty; }
     void Release();
+    // VAO that takes positions/normals from other VBOs (0 = none) and the rest from this mesh
+    u32 CreateOverrideVAO(u32 positionVBO, u32 normalVBO) const;
+
+    // Residency policy applied at the end of every Upload()
+    void SetResidency(MeshResidency residency) { m_residency = residency; }
+    MeshResidency GetResidency() const { return m_residency; }
+    // Drops the CPU copies now; keepCollision keeps positions + indices
+    void ReleaseCPUData(bool keepCollision);
+    bool IsCPUResident() const { return !m_cpuReleased; }
+
+    u64 GetCPUBytes() const;
+    u64 GetGPUBytes() const;
 
     void CalculateNormals();
 
@@ -193,8 +320,9 @@ public:
 
     void Clear();
 
-    u32 GetVertexCount() const { return (u32)positions.size(); }
-    u32 GetIndexCount() const { return (u32)indices.size(); }
+    u32 GetVertexCount() const { return m_cpuReleased ? m_vertexCount : (u32)positions.size(); }
+    bool HasNormals() const { return !positions.empty() && normals.size() == positions.size(); }
+    u32 GetIndexCount() const { return m_cpuReleased ? m_indexCount : (u32)indices.size(); }
 
 
 private:
@@ -204,16 +332,61 @@ private:
         s32 size;
         s32 usage;
         unsigned int id;
+        u32 attribute;
+        u64 bytes;
         VertexBuffer()
         {
             size = 0;
             usage = 0;
             id = 0;
+            attribute = 0;
+            bytes = 0;
             name = "";
         }
     };
     void AddBuffer(VertexBuffer* buffer) { this->buffers.push_back(buffer); }
 
+    struct MorphTarget
+    {
+        std::string name;
+        std::vector<u32> vertices;      // sorted
+        std::vector<float> positions;   // 4 floats per entry (xyz, 0)
+        std::vector<float> normals;     // empty or 4 per entry
+        std::vector<float> tangents;    // empty or 4 per entry
+        u32 positionVBO;                // dense streams for the GPU path
+        u32 normalVBO;
+    };
+    void captureMorphBase();
+    void buildMorphStreams(MorphTarget* target);
+    void uploadMorphRanges(const std::vector<u32>& sorted);
+    VertexBuffer* findBuffer(s32 usage) const;
+    // GPU path: binds the strongest targets, returns their weights
+    void bindMorphStreams(const float* weights, u32 count, float outWeights[4]);
+    void releaseMorphTargets();
+    u64 getMorphCPUBytes() const;
+
+    struct DoubleBuffer
+    {
+        std::vector<Vec3> positions;
+        std::vector<Vec3> normals;
+        BoundingBox bounds;
+        std::atomic<u32> state;             // idle, running, ready
+        u32 positionVBO[MAX_MESH_RING];
+        u32 normalVBO[MAX_MESH_RING];
+        u32 capacity[MAX_MESH_RING];        // vertices allocated in each slot
+        u32 ringSize;
+        u32 slot;
+    };
+    void uploadRing(u32 usage, u32 vbo, const Vec3* data, bool resize);
+    u32 prepareUpload();
+    void uploadBuffers(u32 streams);
+    void finishUpload();
+    void waitUpload();
+    void releaseDoubleBuffer();
+
+    // visible ranges inside [indexStart, indexStart + indexCount), VAO already bound
+    void drawMeshlets(u32 indexStart, u32 indexCount) const;
+
 private:
     friend class Scene;
     u32 m_material;
@@ -224,6 +397,36 @@ private:
     std::string m_name;
     BoundingBox m_boundingBox;
     bool m_castsShadows;
+    MeshResidency m_residency;
+    bool m_cpuReleased;
+    bool m_uploading;       // UploadAsync in flight
+    struct AsyncUpload
+    {
+        Mesh *mesh;
+        u32 streams;
+        bool cancelled;     // released or uploaded again before done ran
+    };
+    std::shared_ptr<AsyncUpload> m_asyncUpload;
+    u32 m_uploadJob;        // GpuUploader job of m_asyncUpload
+    u32 m_vertexCount;
+    u32 m_indexCount;
+    u64 m_indexBytes;
+    bool m_hasSkin;
+
+    std::vector<MorphTarget*> m_morphTargets;
+    std::vector<float> m_morphBase[3];      // positions, normals, tangents (4 floats per vertex)
+    std::vector<float> m_morphAccum[3];
+    std::vector<u32> m_morphTouched;        // vertices that differ from the base
+    std::vector<u32> m_morphDirty;
+    std::vector<u8> m_morphMark;
+    std::vector<float> m_morphWeights;      // last applied on the CPU
+    MorphMode m_morphMode;
+    s32 m_morphSlots[MAX_GPU_MORPH_TARGETS];   // targets bound in the VAO
+
+    DoubleBuffer* m_doubleBuffer;
+    std::vector<SubMesh> m_subMeshes;
+    bool m_subMeshOpen;                     // AddFace grows the last submesh
+    MeshletSet m_meshlets;
 
 
     VertexFormat m_vertexFormat;
@@ -234,6 +437,8 @@ private:
     std::vector<Vec4> tangents;
 
     std::vector<unsigned char> colors;
+    std::vector<Vec4> blendWeights;
+    std::vector<u8> blendIndices;   // 4 per vertex
     std::vector<unsigned int> indices;
     std::vector<VertexBuffer*> buffers;
 
@@ -242,6 +447,7 @@ private:
 
     friend class Model;
     friend class Scene;
+    friend class MeshManager;
 
 };
 
@@ -277,13 +483,37 @@ public:
 
 
     bool Add(Mesh* mesh, const std::string& name);
+    bool Remove(Mesh* mesh);    // deletes the mesh
     void Clear();
     bool Exists(const std::string& name);
     Mesh* Get(const std::string& name);
     Mesh* Get(u32 index);
 
+    // Policy given to meshes created after this call
+    void SetDefaultResidency(MeshResidency residency) { m_defaultResidency = residency; }
+    MeshResidency GetDefaultResidency() const { return m_defaultResidency; }
+
+    u64 GetCPUBytes() const;
+    u64 GetGPUBytes() const;
+    void LogMemoryUsage() const;
+
+    // Quadric error edge collapse down to ratio of the triangles. targetError
+    // is the max deviation as a fraction of the mesh size; uv/normal seams and
+    // open borders stay in place. The new mesh is registered as name.
+    Mesh* Simplify(Mesh* mesh, float ratio, float targetError = 0.01f, const std::string& name = "");
+    // Up to levels meshes ("<name>_LOD1"...), each keeping reduction of the
+    // previous triangle count. Stops early when the error limit is reached.
+    u32 GenerateLODs(Mesh* mesh, u32 levels, std::vector<Mesh*>& lods, float reduction = 0.5f, float targetError = 0.01f);
+    // One mesh with a submesh per source mesh (material = source GetMaterial()).
+    // All meshes need the same vertex format and their CPU data.
+    Mesh* Merge(const std::vector<Mesh*>& meshes, const std::string& name);
+
+    // Swaps every double buffered mesh with a finished update, once per frame
+    void SwapBuffers();
+
 private:
-    MeshManager() {};
+    friend class Mesh;
+    MeshManager() { m_defaultResidency = RESIDENCY_KEEP_ALL; };
     ~MeshManager() {};
     MeshManager(const MeshManager&) = delete;
     MeshManager& operator=(const MeshManager&) = delete;
@@ -292,4 +522,6 @@ private:
 
     std::vector<Mesh*> m_meshes;
     std::unordered_map<std::string, Mesh*> m_meshesByName;
+    std::vector<Mesh*> m_doubleBuffered;
+    MeshResidency m_defaultResidency;
 };
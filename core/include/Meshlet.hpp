@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Config.hpp"
+#include "Math.hpp"
+
+#include <vector>
+
+
+const u32 MESHLET_MAX_VERTICES = 64;    // default cluster limits
+const u32 MESHLET_MAX_TRIANGLES = 124;
+
+
+// Range of the shared index buffer drawn with one material of the model
+struct CORE_PUBLIC SubMesh
+{
+    u32 indexStart;
+    u32 indexCount;
+    u32 material;
+};
+
+
+// Counters of the last CullMeshlets calls (accumulated by the scene per frame)
+struct CORE_PUBLIC MeshletStats
+{
+    u32 meshlets;
+    u32 frustumCulled;
+    u32 coneCulled;
+    u32 triangles;
+    u32 frustumTriangles;   // triangles rejected by the frustum test
+    u32 coneTriangles;      // triangles rejected by the normal cone test
+    u32 draws;              // glDrawElements calls after merging
+    MeshletStats() { Reset(); }
+    void Reset() { meshlets = frustumCulled = coneCulled = triangles = frustumTriangles = coneTriangles = draws = 0; }
+};
+
+
+// Clusters of an indexed triangle list and their culling. No GL here: Mesh
+// keeps one over its CPU arrays and draws the ranges left by Cull.
+class CORE_PUBLIC MeshletSet
+{
+public:
+    MeshletSet();
+
+    // Reorders indices (and the submesh ranges) so every cluster is one contiguous run.
+    // Triangles outside every submesh are clustered after the last range.
+    u32 Build(const std::vector<Vec3> &positions, std::vector<unsigned int> &indices, std::vector<SubMesh> &subMeshes,
+              u32 maxVertices = MESHLET_MAX_VERTICES, u32 maxTriangles = MESHLET_MAX_TRIANGLES);
+    // Frustum and normal cone test in model space, returns the visible clusters
+    u32 Cull(const Mat4 &modelView, const Mat4 &proj, bool backface, MeshletStats *stats = nullptr);
+    // one draw for the whole buffer (clusters missing or stale)
+    void DrawAll(u32 indexCount);
+    void Clear();
+    void Release();
+
+    u32 GetCount() const { return (u32)m_meshlets.size(); }
+    // index count the clusters were built for
+    u32 GetIndexCount() const { return m_indexCount; }
+    void Invalidate() { m_indexCount = 0; }
+    // (first index, count) of the visible runs
+    const std::vector<u32> &GetDraws() const { return m_draws; }
+    u64 GetBytes() const;
+
+private:
+    struct Meshlet
+    {
+        u32 indexOffset;
+        u32 triangleCount;
+        Vec3 center;        // bounding sphere
+        float radius;
+        Vec3 coneAxis;      // average facing
+        float coneCutoff;   // sin of the cone half angle, 1 = never backfacing
+        u32 subMesh;        // clusters never cross a submesh
+    };
+    std::vector<Meshlet> m_meshlets;
+    std::vector<u32> m_draws;
+    u32 m_indexCount;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Config.hpp"
+#include "Math.hpp"
+#include "Texture.hpp"
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+class RenderBatch;
+
+
+const int SDF_GLYPH_SIZE = 32;      // line height (ascent - descent) of the baked glyphs, pixels
+const int SDF_SPREAD = 4;           // distance range around the outline, pixels
+const int SDF_PAGE_SIZE = 512;      // R8 pages, skyline packed
+const int SDF_MAX_PAGES = 8;
+
+
+// Signed distance field text from a TrueType (.ttf) file. Glyphs are baked
+// the first time they are printed and packed by size into R8 atlas pages;
+// pages are added up to the limit, then the page of the least recently printed
+// glyph is emptied and reused. One bake size serves every font size through
+// the "SDFShader".
+// Simple and composite glyf outlines, cmap formats 4 and 12; no kerning and
+// no hinting. Static batches that captured glyphs may see them evicted.
+class CORE_PUBLIC SDFFont
+{
+public:
+    SDFFont();
+    ~SDFFont();
+
+    bool Load(const char *fileName);
+    bool LoadFromMemory(const u8 *data, u32 size);     // data is copied
+    void Release();
+
+    void SetBatch(RenderBatch *batch) { m_batch = batch; }
+    void SetFontSize(float size) { m_fontSize = size; }
+    float GetFontSize() const { return m_fontSize; }
+    void SetMaxPages(int pages) { m_maxPages = pages < 1 ? 1 : pages; }
+
+    // y is the top of the first line, the color is the batch color
+    void Print(const char *text, float x, float y);
+    // advances only, does not bake nor touch the cache
+    Vec2 GetTextSize(const char *text) const;
+    float GetLineHeight() const;
+
+    u32 GetGlyphCount() const { return (u32)m_glyphs.size(); }
+    u32 GetPageCount() const { return (u32)m_pages.size(); }
+    u32 GetEvictions() const { return m_evictions; }
+
+private:
+    SDFFont(const SDFFont &) = delete;
+    SDFFont &operator=(const SDFFont &) = delete;
+
+    // baked glyph, pixels at SDF_GLYPH_SIZE from the pen on the baseline (y down)
+    struct Glyph
+    {
+        float advance;
+        float offsetX;
+        float offsetY;
+        int width;
+        int height;
+        s32 page;           // -1 for blank glyphs
+        int x;              // texels in the page
+        int y;
+        std::list<int>::iterator use;   // in m_lru when baked
+    };
+    struct Page
+    {
+        Texture2D *texture;
+        SkylinePacker packer;
+    };
+    struct Edge
+    {
+        float x0, y0, x1, y1;
+    };
+
+    bool parseTables();
+    // offset of the table, 0 when missing, out of the file or shorter than minSize
+    u32 findTable(const char *tag, u32 minSize = 0) const;
+    u32 glyphIndex(int codepoint) const;
+    bool glyphRange(u32 glyph, u32 &offset, u32 &length) const;
+    float glyphAdvance(u32 glyph) const;
+    void glyphEdges(u32 glyph, const float *transform, std::vector<Edge> &edges, int depth) const;
+
+    Glyph *getGlyph(int codepoint);
+    bool bakeGlyph(int codepoint, Glyph &glyph);
+    bool allocRect(int width, int height, s32 &page, int &x, int &y);
+    bool addPage();
+    void evictPage(s32 page);
+
+    std::vector<u8> m_data;
+    u32 m_cmap;             // chosen subtable
+    u16 m_cmapFormat;       // 4 or 12
+    u32 m_loca;
+    u32 m_glyf;
+    u32 m_hmtx;
+    u32 m_numGlyphs;
+    u32 m_numHMetrics;
+    bool m_longLoca;
+    float m_scale;          // font units to baked pixels
+    float m_ascent;         // baked pixels
+    float m_descent;
+    float m_lineGap;
+
+    RenderBatch *m_batch;
+    float m_fontSize;
+    int m_maxPages;
+    std::vector<Page> m_pages;
+    std::unordered_map<int, Glyph> m_glyphs;
+    std::list<int> m_lru;               // baked codepoints, least recently printed first
+    std::vector<Edge> m_edges;          // scratch
+    std::vector<u8> m_pixels;           // scratch
+    u32 m_evictions;
+};
@@ -7,6 +7,7 @@
 #include "Device.hpp"
 #include "glad/glad.h"
 #include "Math.hpp"
+#include "Mesh.hpp"
 
 #include <vector>
 #include <string>
@@ -17,6 +18,18 @@ class Scene;
 class Model;
 class Material;
 class Shader;
+class Joint;
+class Animator;
+class AnimationClip;
+
+const u32 MAX_SKIN_JOINTS = 128;        // tamanho do palette no uniform buffer
+const u32 SKIN_PALETTE_BINDING = 0;     // binding point do bloco "JointPalette"
+
+enum SkinningMode
+{
+    SKINNING_GPU = 0,   // vertex shader skinning (palette UBO), only the palette is updated
+    SKINNING_CPU = 1    // everything skinned on the CPU worker threads
+};
 
 struct SceneNodeTypes
 {
@@ -46,6 +59,9 @@ public:
 	void GetTransform( Vec3 &trans, Vec3 &rot, Vec3 &scale ) const; 	
     void SetTransform( Vec3 trans, Vec3 rot, Vec3 scale );
 	void SetTransform( const Mat4 &mat );
+	// Like SetTransform but only flags the tree, world matrices are rebuilt
+	// later by Scene::UpdateNodes (for batch writers such as Animator)
+	void SetTransformDeferred( const Mat4 &mat );
 	void GetTransMatrices( const float **relMat, const float **absMat ) const;
 
     void SetName( const std::string &name ) { _name = name; }
@@ -162,6 +178,26 @@ public:
     void invalidateCache() { _cacheValid = false; }
     void markChildrenDirty();
 	friend class Scene;
+	friend class Model;
+};
+
+
+class CORE_PUBLIC Joint : public SceneNode
+{
+public:
+    Joint(Model *model, u32 index, const Mat4 &invBindMatrix);
+
+    u32 GetIndex() const { return _jointIndex; }
+    Model *GetModel() const { return _parentModel; }
+    const Mat4 &GetInvBindMatrix() const { return _invBindMat; }
+
+private:
+    Model *_parentModel;
+    u32 _jointIndex;
+    Mat4 _invBindMat;
+
+    friend class SceneNode;
+    friend class Model;
 };
 
 
@@ -179,14 +215,33 @@ public:
     Model* CreateModel(const std::string& name="Model");
     SceneNode* CreateNode(const std::string& name="Node");
 
+    // Animators are owned by the scene and updated in Scene::Update
+    Animator* CreateAnimator(AnimationClip* clip, SceneNode* root);
+    void RemoveAnimator(Animator* animator);
+
     void Clear();
     
     void Update(float dt);
     void Render();
+    // every caster at LOD 0, nothing culled
     void RenderDepth(Shader* shader);
+    // Shadow pass seen from a light: LOD, size culling and frustum culling
+    // use lightView/lightProj (ortho or perspective) over mapSize pixels.
+    // The camera LOD of the models is left alone.
+    void RenderDepth(Shader* shader, const Mat4 &lightView, const Mat4 &lightProj, float mapSize);
 
     void SetShader( Shader *shader ) { m_defaultShader = shader; }
 
+    // Camera used by the models to pick a LOD from their size on screen and
+    // to cull meshlets. Until this is called every model draws LOD 0, whole.
+    void SetView( const Mat4 &view, const Mat4 &proj, float viewportHeight );
+    void ClearView() { _viewEnabled = false; }
+    bool GetView( Mat4 &view, Mat4 &proj ) const;
+    bool GetLODView( Vec3 &eye, float &pixelScale ) const;
+
+    // meshlet culling counters of the last Render
+    const MeshletStats &GetMeshletStats() const { return _meshletStats; }
+
     static Scene& Instance();
     static Scene* InstancePtr();
 
@@ -196,10 +251,47 @@ public:
     
     private:
 
+    void updateAnimators(float dt);
+    void updateSkinning();
+    void gatherSkinned(SceneNode *node);
+
+    struct AnimJob
+    {
+        Animator *animator;
+        u32 begin;
+        u32 end;
+    };
+    std::vector<Animator *> _animators;
+    std::vector<Animator *> _activeAnimators;
+    std::vector<AnimJob> _animJobs;
+
+    struct SkinJob
+    {
+        Model *model;
+        u32 mesh;
+        u32 begin;
+        u32 end;
+    };
+    std::vector<Model *> _skinnedModels;
+    std::vector<SkinJob> _skinJobs;
+
 
     Shader *m_defaultShader;
     Material *m_defaultMaterial;
 
+    Mat4 _view;
+    Mat4 _proj;
+    Vec3 _lodEye;
+    float _lodPixelScale;   // pixels per (diameter / distance)
+    bool _viewEnabled;
+    // light of the RenderDepth in progress
+    Frustum _depthFrustum;
+    Vec3 _depthEye;
+    float _depthPixelScale; // ortho: pixels per world unit
+    bool _depthOrtho;
+    bool _depthViewEnabled;
+    MeshletStats _meshletStats;
+
 
     std::vector< SceneNode * > _nodes;    
     std::vector< SceneNode * > _nodes_to_add;  
@@ -207,6 +299,8 @@ public:
  
 
 
+    friend class Model;
+
     Scene();
     ~Scene();
 
@@ -233,10 +327,119 @@ public:
     void SetMaterial(u32 index, Material *mat);
     void SetTexture(u32 index,u32 layer, Texture* texture);
 
+    Mesh* GetMesh(u32 index) const { return index < _meshes.size() ? _meshes[index] : nullptr; }
     u32 GetMeshCount() const { return (u32)_meshes.size(); }
     u32 GetMaterialCount() const { return (u32)_materials.size(); }
 
+    // === SKINNING ===
+    // parent = nullptr attaches the joint to the model itself
+    Joint* AddJoint(const std::string& name, const Mat4& invBindMatrix, SceneNode* parent = nullptr);
+    Joint* GetJoint(u32 index) const;
+    Joint* FindJoint(const std::string& name) const;
+    u32 GetJointCount() const { return (u32)_joints.size(); }
+    bool IsSkinned() const { return !_joints.empty(); }
+
+    void SetSkinningMode(SkinningMode mode);
+    SkinningMode GetSkinningMode() const { return _skinningMode; }
+    // GPU mode: also skin a CPU copy every frame, for picking and depth
+    // shaders without the palette block. Off by default.
+    void SetCPUSkinning(bool enable);
+    bool GetCPUSkinning() const { return _cpuSkinning; }
+
+    // model space skin matrices (joint abs * inverse bind)
+    const std::vector<Mat4>& GetSkinPalette() const { return _palette; }
+    // palette from the current joint pose now, without the scene update (bakers)
+    void UpdateSkinPalette();
+
+    bool CheckIntersection(const Vec3 &rayOrig, const Vec3 &rayDir, Vec3 &intsPos) const;
+
+    // === LOD ===
+    // Level 0 are the meshes from AddMesh. Extra levels have one mesh per slot
+    // (null = slot not drawn) and are used below screenSize pixels.
+    u32 AddLOD(const std::vector<Mesh*>& meshes, float screenSize);
+    // Builds the levels with MeshManager::GenerateLODs, screenSize halves per level
+    u32 GenerateLODs(u32 levels, float screenSize = 256.0f, float reduction = 0.5f, float targetError = 0.01f);
+    // fraction of the threshold to cross before switching back (avoids popping)
+    void SetLODHysteresis(float fraction) { _lodHysteresis = fraction; }
+    // smaller than this (pixels) the model is not drawn at all
+    void SetCullScreenSize(float pixels) { _cullScreenSize = pixels; }
+    u32 GetLODCount() const { return (u32)_lods.size() + 1; }
+    u32 GetCurrentLOD() const { return _currentLOD; }
+    float GetScreenSize() const { return _screenSize; }
+    bool IsScreenCulled() const { return _lodCulled; }
+
+    // === MORPH TARGETS ===
+    // Per instance weights. CPU morphs go to a copy owned by the model, the
+    // shared mesh keeps its base shape.
+    void SetMorphWeight(u32 mesh, u32 target, float weight);
+    float GetMorphWeight(u32 mesh, u32 target) const;
+
 private:
+    // per instance copy of the positions/normals of one mesh (skinned or morphed)
+    struct SkinInstance
+    {
+        std::vector<Vec3> positions;
+        std::vector<Vec3> normals;
+        std::vector<u32> touched;   // morph: vertices moved by the current weights
+        u32 vao;
+        u32 positionVBO;
+        u32 normalVBO;
+        bool needsUpload;
+        bool morphDirty;            // morph: weights changed
+        bool morphed;               // morph: some weight is not 0
+    };
+
+    void updatePalette();
+    SkinInstance* prepareSkin(u32 index);
+    void skinMesh(u32 index, u32 begin, u32 end);
+    void uploadInstance(SkinInstance* instance, Mesh* mesh);
+    void releaseInstances(std::vector<SkinInstance*>& instances);
+    void releaseSkinning();
+    bool bindPalette(Shader* shader);
+    void bindMaterial(u32 material);
+    // mesh VAO or a skin VAO, every submesh with its material
+    void drawMesh(Mesh* mesh, u32 vao, bool meshlets);
+    // morphed copy of mesh index, null when it draws the shared mesh
+    SkinInstance* applyMorph(u32 index);
+    bool bindMorph(u32 index, Shader* shader);
+    void selectLOD();
+    void selectDepthLOD();
+    // next level from the current one, with hysteresis
+    u32 stepLOD(u32 lod, float screenSize) const;
+    const BoundingBox& localBounds();
+
+    struct LODLevel
+    {
+        std::vector<Mesh*> meshes;
+        float screenSize;
+    };
+
     std::vector<Mesh*> _meshes;
     std::vector<Material*> _materials;
+
+    std::vector<Joint*> _joints;
+    std::vector<Mat4> _palette;
+    std::vector<SkinInstance*> _skins;
+    u32 _paletteUBO;
+    bool _skinningDirty;
+    bool _paletteDirty;
+    SkinningMode _skinningMode;
+    bool _cpuSkinning;
+
+    std::vector<std::vector<float>> _morphWeights;   // [mesh][target]
+    std::vector<SkinInstance*> _morphs;              // CPU morphed rest pose per mesh
+
+    std::vector<LODLevel> _lods;    // sorted by screenSize, largest first
+    u32 _currentLOD;
+    float _lodHysteresis;
+    float _cullScreenSize;
+    float _screenSize;
+    bool _lodCulled;
+    u32 _depthLOD;          // shadow pass, own hysteresis
+    bool _depthCulled;
+    BoundingBox _localBounds;
+    bool _boundsDirty;
+
+    friend class Scene;
+    friend class SceneNode;
 };
\ No newline at end of file
@@ -41,6 +41,10 @@ public:
     void SetFloat(const std::string& name, float x, float y, float z);
     void SetFloat(const std::string& name, float x, float y, float z, float w);
 
+    // Binds a uniform block to a binding point, false if the shader has no such block
+    bool SetUniformBlock(const std::string& name, u32 binding);
+    bool HasUniformBlock(const std::string& name);
+
 
     void Release();
 
@@ -78,6 +82,9 @@ private:
 
     std::map<std::string, int> m_uniforms;
     std::map<std::string, int> m_attributes;
+    std::map<std::string, u32> m_blocks;
+
+    u32 getUniformBlockIndex(const std::string& name);
 };
 
 
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Config.hpp"
+#include <math.h>
+
+// Tiny 4-wide float wrapper used by the hot CPU loops (skinning, animation,
+// morphs...). SSE on desktop, NEON on ARM, plain floats everywhere else.
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CORE_SIMD_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CORE_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+
+#if defined(CORE_SIMD_SSE)
+
+typedef __m128 simd4f;
+
+inline simd4f Simd_Load(const float *p) { return _mm_loadu_ps(p); }
+inline void Simd_Store(float *p, simd4f v) { _mm_storeu_ps(p, v); }
+inline simd4f Simd_Set1(float v) { return _mm_set1_ps(v); }
+inline simd4f Simd_Set(float x, float y, float z, float w) { return _mm_set_ps(w, z, y, x); }
+inline simd4f Simd_Zero() { return _mm_setzero_ps(); }
+inline simd4f Simd_Add(simd4f a, simd4f b) { return _mm_add_ps(a, b); }
+inline simd4f Simd_Sub(simd4f a, simd4f b) { return _mm_sub_ps(a, b); }
+inline simd4f Simd_Mul(simd4f a, simd4f b) { return _mm_mul_ps(a, b); }
+// a * b + c
+inline simd4f Simd_MulAdd(simd4f a, simd4f b, simd4f c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline simd4f Simd_Min(simd4f a, simd4f b) { return _mm_min_ps(a, b); }
+inline simd4f Simd_Max(simd4f a, simd4f b) { return _mm_max_ps(a, b); }
+inline simd4f Simd_Sqrt(simd4f a) { return _mm_sqrt_ps(a); }
+inline simd4f Simd_Div(simd4f a, simd4f b) { return _mm_div_ps(a, b); }
+
+#elif defined(CORE_SIMD_NEON)
+
+typedef float32x4_t simd4f;
+
+inline simd4f Simd_Load(const float *p) { return vld1q_f32(p); }
+inline void Simd_Store(float *p, simd4f v) { vst1q_f32(p, v); }
+inline simd4f Simd_Set1(float v) { return vdupq_n_f32(v); }
+inline simd4f Simd_Set(float x, float y, float z, float w)
+{
+    const float v[4] = {x, y, z, w};
+    return vld1q_f32(v);
+}
+inline simd4f Simd_Zero() { return vdupq_n_f32(0.0f); }
+inline simd4f Simd_Add(simd4f a, simd4f b) { return vaddq_f32(a, b); }
+inline simd4f Simd_Sub(simd4f a, simd4f b) { return vsubq_f32(a, b); }
+inline simd4f Simd_Mul(simd4f a, simd4f b) { return vmulq_f32(a, b); }
+inline simd4f Simd_MulAdd(simd4f a, simd4f b, simd4f c) { return vmlaq_f32(c, a, b); }
+inline simd4f Simd_Min(simd4f a, simd4f b) { return vminq_f32(a, b); }
+inline simd4f Simd_Max(simd4f a, simd4f b) { return vmaxq_f32(a, b); }
+inline simd4f Simd_Sqrt(simd4f a)
+{
+    const float v[4] = {sqrtf(vgetq_lane_f32(a, 0)), sqrtf(vgetq_lane_f32(a, 1)),
+                        sqrtf(vgetq_lane_f32(a, 2)), sqrtf(vgetq_lane_f32(a, 3))};
+    return vld1q_f32(v);
+}
+inline simd4f Simd_Div(simd4f a, simd4f b)
+{
+    simd4f r = vrecpeq_f32(b);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    return vmulq_f32(a, r);
+}
+
+#else
+
+struct simd4f
+{
+    float v[4];
+};
+
+inline simd4f Simd_Load(const float *p)
+{
+    simd4f r;
+    r.v[0] = p[0]; r.v[1] = p[1]; r.v[2] = p[2]; r.v[3] = p[3];
+    return r;
+}
+inline void Simd_Store(float *p, simd4f a) { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+inline simd4f Simd_Set(float x, float y, float z, float w)
+{
+    simd4f r;
+    r.v[0] = x; r.v[1] = y; r.v[2] = z; r.v[3] = w;
+    return r;
+}
+inline simd4f Simd_Set1(float v) { return Simd_Set(v, v, v, v); }
+inline simd4f Simd_Zero() { return Simd_Set1(0.0f); }
+#define SIMD_SCALAR_OP(name, expr)                         \
+    inline simd4f name(simd4f a, simd4f b)                 \
+    {                                                      \
+        simd4f r;                                          \
+        for (int i = 0; i < 4; ++i) r.v[i] = (expr);       \
+        return r;                                          \
+    }
+SIMD_SCALAR_OP(Simd_Add, a.v[i] + b.v[i])
+SIMD_SCALAR_OP(Simd_Sub, a.v[i] - b.v[i])
+SIMD_SCALAR_OP(Simd_Mul, a.v[i] * b.v[i])
+SIMD_SCALAR_OP(Simd_Div, a.v[i] / b.v[i])
+SIMD_SCALAR_OP(Simd_Min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+SIMD_SCALAR_OP(Simd_Max, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+#undef SIMD_SCALAR_OP
+inline simd4f Simd_MulAdd(simd4f a, simd4f b, simd4f c) { return Simd_Add(Simd_Mul(a, b), c); }
+inline simd4f Simd_Sqrt(simd4f a)
+{
+    simd4f r;
+    for (int i = 0; i < 4; ++i) r.v[i] = sqrtf(a.v[i]);
+    return r;
+}
+
+#endif
@@ -4,6 +4,13 @@
 #include "Config.hpp"
 #include "Math.hpp"
 #include "Utils.hpp"
+#include "TextureCodec.hpp"
+
+#include <atomic>
+#include <memory>
+
+const u32 TEXTURE_UPLOAD_BYTES = 4 * 1024 * 1024;    // default async upload budget per frame
+const float TEXTURE_UPLOAD_MS = 2.0f;
 
 enum PixelFormat
 {
@@ -216,6 +223,7 @@ class  CORE_PUBLIC Texture2D  : public Texture
 {
     public:
     Texture2D();
+    ~Texture2D();
 
     
     Texture2D(int w, int h,u16 components);
@@ -225,13 +233,34 @@ class  CORE_PUBLIC Texture2D  : public Texture
     bool Load(const Pixmap &pixmap);
     bool Load(const char* file_name);
     bool LoadFromMemory(const unsigned char *buffer,u16 components, int width, int height);
+    // 32 bit float texels (R32F..RGBA32F), nearest filtering and no mipmaps
+    bool LoadFloat(const float *data, u16 components, int width, int height);
+    // KTX/KTX2 with its own mips (Load(file_name) picks it by extension): uploaded
+    // compressed when the GPU samples the format, else decoded to RGBA8
+    bool LoadKTX(const char* file_name);
+    bool Load(const CompressedImage &image);
+    static bool IsFormatSupported(TextureFormat format, bool srgb = false);
     u32 GetID() {return id;}
 
- 
+    // packed in a TextureAtlas page: GetID() is the page, the image is GetAtlasUV()
+    bool IsAtlased() const {return m_atlased;}
+    const FloatRect &GetAtlasUV() const {return m_atlasUV;}
+    Vec2 MapUV(float u, float v) const {return Vec2(m_atlasUV.x + u * m_atlasUV.width, m_atlasUV.y + v * m_atlasUV.height);}
+
+    // TextureManager::LoadAsync still decoding/uploading (drawn as the default texture at first)
+    bool IsLoading() const {return m_loading;}
+
+    virtual void Release();
 
     private:
         friend class Texture;
+        friend class TextureAtlas;
+        friend class TextureManager;
         s32 components{0};     
+        bool m_atlased{false};
+        bool m_loading{false};
+        bool m_placeholder{false};  // id borrowed from the default texture
+        FloatRect m_atlasUV{0.0f, 0.0f, 1.0f, 1.0f};
         static Texture2D * defaultTexture;
      
 };
@@ -261,6 +290,77 @@ private:
 };
 
 
+// Bottom-left skyline packing of rectangles into a size x size area. No GL:
+// TextureAtlas and SDFFont keep one per page. Space is only given back by Reset.
+class CORE_PUBLIC SkylinePacker
+{
+public:
+    SkylinePacker(int size = 0);
+
+    void Reset(int size);
+    void Reset() { Reset(m_size); }
+    // top-left corner of a free width x height rect, false when the area is full
+    bool Pack(int width, int height, int &x, int &y);
+
+    int GetSize() const { return m_size; }
+    int GetUsedArea() const { return m_usedArea; }
+
+private:
+    struct Node
+    {
+        int x, y, width;
+    };
+
+    int fit(u32 index, int width, int height) const;
+
+    int m_size;
+    int m_usedArea;
+    std::vector<Node> m_nodes;
+};
+
+
+const int ATLAS_PAGE_SIZE = 1024;
+const int ATLAS_PADDING = 1;        // edge pixels repeated around each image, no bleeding with linear filtering
+
+
+// Packs small images into shared RGBA pages (skyline, bottom-left) so the
+// RenderBatch can draw them without changing texture. Add() returns a view:
+// a Texture2D with the page id and the image UV rect, the pages stay owned
+// by the atlas and must outlive the views. No mipmaps, no repeat wrapping.
+class CORE_PUBLIC TextureAtlas
+{
+public:
+    TextureAtlas(int pageSize = ATLAS_PAGE_SIZE, int padding = ATLAS_PADDING);
+    ~TextureAtlas();
+
+    // nullptr if the image does not fit in an empty page
+    Texture2D *Add(const Pixmap &pixmap);
+    void Clear();
+
+    int GetPageSize() const { return m_pageSize; }
+    u32 GetPageCount() const { return (u32)m_pages.size(); }
+    Texture2D *GetPage(u32 index) const { return index < m_pages.size() ? m_pages[index].texture : nullptr; }
+    // used area of all pages, 0..1
+    float GetOccupancy() const;
+
+private:
+    struct Page
+    {
+        Texture2D *texture;
+        SkylinePacker packer;
+    };
+
+    bool addPage();
+
+    int m_pageSize;
+    int m_padding;
+    std::vector<Page> m_pages;
+
+    TextureAtlas(const TextureAtlas &) = delete;
+    TextureAtlas &operator=(const TextureAtlas &) = delete;
+};
+
+
 class TextureManager 
 {
     public:
@@ -286,9 +386,24 @@ class TextureManager
 
     Texture2D *Load(const char *name);//use texture path
     Texture2D *Load(const std::string &path, const std::string &name);
+    // name without extension: the first of name.astc.ktx2, name.bc7.ktx2, name.bc3.ktx2,
+    // name.bc1.ktx2, name.etc2.ktx2 (or .ktx) the GPU can sample, then any of them
+    Texture2D *LoadCompressed(const char *name);//use texture path
 
     bool LoadTexture(const char *name);
 
+    // Returns at once a texture that draws as the default one. The file is
+    // decoded and mipmapped on the ThreadPool, then UpdateAsync uploads it.
+    Texture2D *LoadAsync(const char *name);//use texture path
+    // Main thread, once per frame (Device::Run): uploads decoded textures,
+    // smallest mip first, until the byte or time budget is spent. The texture
+    // is swapped in with its first mip and sharpens as the others arrive.
+    // With a GpuUploader thread the whole chain goes there instead, no budget.
+    void UpdateAsync();
+    void SetUploadBudget(u32 maxBytes, float maxMilliseconds) {m_uploadBytes = maxBytes; m_uploadMilliseconds = maxMilliseconds;}
+    u32 GetPendingLoads() const {return (u32)m_asyncLoads.size();}
+    u32 GetLastUploadBytes() const {return m_lastUploadBytes;}
+
     Texture2D *Get(const char* file_name);
 
 
@@ -306,16 +421,45 @@ class TextureManager
 
     Texture2D *GetDefault() {return m_defaultTexture;}
 
+    // small images go to the shared atlas, big ones (more than half a page) get their own texture
+    Texture2D *AddToAtlas(const Pixmap &pixmap, const char *name);
+    Texture2D *LoadToAtlas(const char *file_name);
+    TextureAtlas *GetAtlas();
+
 
     static TextureManager& Instance();
     static TextureManager* InstancePtr();
     
     private:
+        struct AsyncLoad
+        {
+            std::string path;
+            Texture2D *texture;
+            std::atomic<u32> state;                 // decoding, decoded, failed
+            int width;
+            int height;
+            int components;
+            std::vector<std::vector<u8>> levels;    // mip 0 first
+            int level;                              // uploading, from the last one down to 0
+            int row;                                // rows of that level already uploaded
+            u32 id;                                 // made by the GpuUploader loader
+            bool cancelled;
+        };
+
+        bool uploadAsync(AsyncLoad &load, u32 &bytes, u32 maxBytes);
+        void submitAsync(const std::shared_ptr<AsyncLoad> &load);
+        void finishAsync(AsyncLoad &load);
+        void cancelAsync(Texture2D *texture);
 
         Texture2D * m_defaultTexture;
+        TextureAtlas *m_atlas;
         std::map<std::string,Texture2D*> m_textures;
         std::vector<Texture2D*> m_loadedTextures;
         std::string m_texturePath;
+        std::vector<std::shared_ptr<AsyncLoad>> m_asyncLoads;
+        u32 m_uploadBytes;
+        float m_uploadMilliseconds;
+        u32 m_lastUploadBytes;
  
      
     TextureManager(const TextureManager&) = delete;
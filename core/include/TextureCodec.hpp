@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Config.hpp"
+
+#include <vector>
+
+class Pixmap;
+
+
+// Block compressed texture data and the CPU side codecs. Nothing here
+// touches GL: Texture2D::Load(const CompressedImage &) does the upload.
+enum TextureFormat
+{
+    TEXTURE_FORMAT_UNKNOWN = 0,
+    TEXTURE_FORMAT_RGBA8,
+    TEXTURE_FORMAT_RGB8,
+    TEXTURE_FORMAT_ETC1,            // subset of ETC2, uploaded as ETC2 RGB
+    TEXTURE_FORMAT_ETC2_RGB,
+    TEXTURE_FORMAT_ETC2_RGB_A1,     // punchthrough alpha
+    TEXTURE_FORMAT_ETC2_RGBA,       // EAC alpha
+    TEXTURE_FORMAT_BC1,
+    TEXTURE_FORMAT_BC1_A1,
+    TEXTURE_FORMAT_BC3,
+    TEXTURE_FORMAT_BC4,
+    TEXTURE_FORMAT_BC5,
+    TEXTURE_FORMAT_BC7,
+    TEXTURE_FORMAT_ASTC             // LDR, block size in the image
+};
+
+// what the GPU must support to sample a format
+enum TextureFamily
+{
+    TEXTURE_FAMILY_NONE = 0,        // uncompressed
+    TEXTURE_FAMILY_ETC,             // core in GLES 3
+    TEXTURE_FAMILY_S3TC,            // BC1, BC3
+    TEXTURE_FAMILY_RGTC,            // BC4, BC5
+    TEXTURE_FAMILY_BPTC,            // BC7
+    TEXTURE_FAMILY_ASTC
+};
+
+
+struct CORE_PUBLIC CompressedLevel
+{
+    int width;
+    int height;
+    u32 offset;     // in CompressedImage::data
+    u32 size;
+};
+
+
+struct CORE_PUBLIC CompressedImage
+{
+    TextureFormat format;
+    bool srgb;
+    int blockWidth;         // 1x1 for RGBA8/RGB8
+    int blockHeight;
+    int blockBytes;         // bytes per block (per pixel when uncompressed)
+    int width;
+    int height;
+    std::vector<CompressedLevel> levels;    // mip 0 first
+    std::vector<u8> data;
+
+    CompressedImage();
+    void Clear();
+
+    bool IsCompressed() const { return format != TEXTURE_FORMAT_RGBA8 && format != TEXTURE_FORMAT_RGB8; }
+    // internal format for glCompressedTexImage2D (glTexImage2D when uncompressed)
+    u32 GetGLFormat() const;
+    const u8 *GetLevelData(u32 level) const { return data.data() + levels[level].offset; }
+    u32 GetLevelSize(int width, int height) const;
+};
+
+
+const char *GetTextureFormatName(TextureFormat format);
+TextureFamily GetTextureFamily(TextureFormat format);
+
+// KTX 1.1 or KTX2 (no supercompression) in memory, 2D textures only
+bool ParseKTX(const u8 *data, u32 size, CompressedImage &image);
+// KTX 1.1, or KTX2 with a basic DFD; the data is written as is
+bool WriteKTX(const CompressedImage &image, std::vector<u8> &file, bool ktx2 = false);
+
+// software fallback: ETC1/ETC2/EAC and BC1/BC3/BC4/BC5 to RGBA8 (no ASTC, no BC7)
+bool CanDecodeTexture(TextureFormat format);
+bool DecodeTextureLevel(const CompressedImage &image, u32 level, std::vector<u8> &rgba);
+
+// ETC2 RGB, or ETC2 RGBA (EAC) when the pixmap has some alpha below 255.
+// Offline quality: individual/differential modes with a full table search.
+bool EncodeETC2(const Pixmap &pixmap, bool mipmaps, CompressedImage &image);
+void EncodeETC2(const u8 *pixels, int width, int height, int components, bool alpha, std::vector<u8> &blocks);
+
+// next mip, 2x2 box filter (odd sizes repeat the last row/column)
+void DownsampleImage(const u8 *src, int width, int height, int components, std::vector<u8> &dst);
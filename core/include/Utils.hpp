@@ -1,6 +1,13 @@
 #pragma once
 
 #include "Config.hpp"
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #define ARRAY_SIZE_IN_ELEMENTS(a) (sizeof(a) / sizeof(a[0]))
 
 
@@ -111,3 +118,45 @@ private:
     System(System &&) = delete;
     System &operator=(System &&) = delete;
 };
+
+
+// Small worker pool for CPU jobs (skinning, animation, decoding...).
+// Threads are created on first use; the calling thread also works on ParallelFor.
+class CORE_PUBLIC ThreadPool {
+public:
+    static ThreadPool &Instance();
+    static ThreadPool *InstancePtr();
+
+    // 0 = number of cores - 1
+    void Init(u32 threadCount = 0);
+    void Shutdown();
+
+    u32 GetThreadCount() const { return (u32)m_threads.size(); }
+
+    void Submit(const std::function<void()> &job);
+
+    // Runs fn(begin, end) over [0, count) in chunks of at least minBatch items and
+    // returns when every chunk is done. Small ranges run inline.
+    void ParallelFor(u32 count, u32 minBatch, const std::function<void(u32, u32)> &fn);
+
+    // Blocks until the queue is empty and no job is running
+    void Wait();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    u32 m_running;
+    bool m_quit;
+
+    ThreadPool();
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ThreadPool(ThreadPool &&) = delete;
+    ThreadPool &operator=(ThreadPool &&) = delete;
+};
@@ -0,0 +1,579 @@
+#include "pch.h"
+#include "Animation.hpp"
+#include "Scene.hpp"
+#include "Simd.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+
+
+//*******************************************************
+// AnimationTrack
+//*******************************************************
+
+void AnimationTrack::AddPositionKey(float time, const Vec3 &position)
+{
+    posTimes.push_back(time);
+    posX.push_back(position.x);
+    posY.push_back(position.y);
+    posZ.push_back(position.z);
+}
+
+void AnimationTrack::AddRotationKey(float time, const Quaternion &rotation)
+{
+    rotTimes.push_back(time);
+    rotX.push_back(rotation.x);
+    rotY.push_back(rotation.y);
+    rotZ.push_back(rotation.z);
+    rotW.push_back(rotation.w);
+}
+
+void AnimationTrack::AddScaleKey(float time, const Vec3 &scale)
+{
+    sclTimes.push_back(time);
+    sclX.push_back(scale.x);
+    sclY.push_back(scale.y);
+    sclZ.push_back(scale.z);
+}
+
+float AnimationTrack::GetEndTime() const
+{
+    float end = 0.0f;
+    if (!posTimes.empty()) end = std::max(end, posTimes.back());
+    if (!rotTimes.empty()) end = std::max(end, rotTimes.back());
+    if (!sclTimes.empty()) end = std::max(end, sclTimes.back());
+    return end;
+}
+
+//*******************************************************
+// AnimationClip
+//*******************************************************
+
+AnimationClip::AnimationClip(const std::string &name, float duration)
+{
+    m_name = name;
+    m_duration = duration;
+}
+
+AnimationTrack *AnimationClip::AddTrack(const std::string &target)
+{
+    AnimationTrack track;
+    track.target = target;
+    m_tracks.push_back(track);
+    return &m_tracks.back();
+}
+
+AnimationTrack *AnimationClip::GetTrack(u32 index)
+{
+    if (index < m_tracks.size())
+    {
+        return &m_tracks[index];
+    }
+    return nullptr;
+}
+
+AnimationTrack *AnimationClip::FindTrack(const std::string &target)
+{
+    for (auto &track : m_tracks)
+    {
+        if (track.target == target)
+        {
+            return &track;
+        }
+    }
+    return nullptr;
+}
+
+void AnimationClip::CalculateDuration()
+{
+    m_duration = 0.0f;
+    for (auto &track : m_tracks)
+    {
+        m_duration = std::max(m_duration, track.GetEndTime());
+    }
+}
+
+//*******************************************************
+// Sampling helpers
+//*******************************************************
+
+// Key pair around time. The cursor from the previous sample is tried first
+// (and the next key), then a binary search.
+static inline void FindKeys(const std::vector<float> &times, float time, u32 &cursor,
+                            u32 &k0, u32 &k1, float &t)
+{
+    const u32 count = (u32)times.size();
+    if (count == 1 || time <= times[0])
+    {
+        k0 = k1 = 0;
+        t = 0.0f;
+        cursor = 0;
+        return;
+    }
+    if (time >= times[count - 1])
+    {
+        k0 = k1 = count - 1;
+        t = 0.0f;
+        return;
+    }
+
+    u32 k = cursor < count - 1 ? cursor : 0;
+    if (!(times[k] <= time && time < times[k + 1]))
+    {
+        if (k + 2 < count && times[k + 1] <= time && time < times[k + 2])
+        {
+            k = k + 1;
+        } else
+        {
+            const float *begin = times.data();
+            const float *it = std::upper_bound(begin, begin + count, time);
+            k = (u32)(it - begin) - 1;
+        }
+    }
+    cursor = k;
+    k0 = k;
+    k1 = k + 1;
+    const float span = times[k1] - times[k0];
+    t = span > 0.0f ? (time - times[k0]) / span : 0.0f;
+}
+
+static inline void LerpSoA(const std::vector<float> *a, const std::vector<float> *b, const std::vector<float> &t,
+                           std::vector<float> *out, u32 channels, u32 begin, u32 end)
+{
+    for (u32 i = begin; i < end; i += 4)
+    {
+        const simd4f vt = Simd_Load(&t[i]);
+        for (u32 c = 0; c < channels; ++c)
+        {
+            const simd4f va = Simd_Load(&a[c][i]);
+            const simd4f vb = Simd_Load(&b[c][i]);
+            Simd_Store(&out[c][i], Simd_MulAdd(Simd_Sub(vb, va), vt, va));
+        }
+    }
+}
+
+// Same math as Quaternion::nlerp, 4 joints per iteration. The shortest path
+// sign is already folded into b.
+static inline void NlerpSoA(const std::vector<float> *a, const std::vector<float> *b, const std::vector<float> &t,
+                            std::vector<float> *out, u32 begin, u32 end)
+{
+    const simd4f one = Simd_Set1(1.0f);
+    for (u32 i = begin; i < end; i += 4)
+    {
+        const simd4f vt = Simd_Load(&t[i]);
+        simd4f q[4];
+        simd4f len2 = Simd_Zero();
+        for (u32 c = 0; c < 4; ++c)
+        {
+            const simd4f va = Simd_Load(&a[c][i]);
+            q[c] = Simd_MulAdd(Simd_Sub(Simd_Load(&b[c][i]), va), vt, va);
+            len2 = Simd_MulAdd(q[c], q[c], len2);
+        }
+        const simd4f invLen = Simd_Div(one, Simd_Sqrt(len2));
+        for (u32 c = 0; c < 4; ++c)
+        {
+            Simd_Store(&out[c][i], Simd_Mul(q[c], invLen));
+        }
+    }
+}
+
+// T * R * S
+static inline void ComposeTRS(Mat4 &m, float px, float py, float pz,
+                              float qx, float qy, float qz, float qw,
+                              float sx, float sy, float sz)
+{
+    const float x2 = qx + qx, y2 = qy + qy, z2 = qz + qz;
+    const float xx = qx * x2, xy = qx * y2, xz = qx * z2;
+    const float yy = qy * y2, yz = qy * z2, zz = qz * z2;
+    const float wx = qw * x2, wy = qw * y2, wz = qw * z2;
+
+    m.c[0][0] = (1 - (yy + zz)) * sx;
+    m.c[0][1] = (xy + wz) * sx;
+    m.c[0][2] = (xz - wy) * sx;
+    m.c[0][3] = 0;
+    m.c[1][0] = (xy - wz) * sy;
+    m.c[1][1] = (1 - (xx + zz)) * sy;
+    m.c[1][2] = (yz + wx) * sy;
+    m.c[1][3] = 0;
+    m.c[2][0] = (xz + wy) * sz;
+    m.c[2][1] = (yz - wx) * sz;
+    m.c[2][2] = (1 - (xx + yy)) * sz;
+    m.c[2][3] = 0;
+    m.c[3][0] = px;
+    m.c[3][1] = py;
+    m.c[3][2] = pz;
+    m.c[3][3] = 1;
+}
+
+static Quaternion RotationFromMatrix(const Mat4 &m, const Vec3 &scale)
+{
+    // R[row][col] = c[col][row] / scale[col]
+    const float r00 = m.c[0][0] / scale.x, r01 = m.c[1][0] / scale.y, r02 = m.c[2][0] / scale.z;
+    const float r10 = m.c[0][1] / scale.x, r11 = m.c[1][1] / scale.y, r12 = m.c[2][1] / scale.z;
+    const float r20 = m.c[0][2] / scale.x, r21 = m.c[1][2] / scale.y, r22 = m.c[2][2] / scale.z;
+
+    Quaternion q;
+    const float trace = r00 + r11 + r22;
+    if (trace > 0.0f)
+    {
+        const float s = sqrtf(trace + 1.0f) * 2.0f;
+        q.w = 0.25f * s;
+        q.x = (r21 - r12) / s;
+        q.y = (r02 - r20) / s;
+        q.z = (r10 - r01) / s;
+    } else if (r00 > r11 && r00 > r22)
+    {
+        const float s = sqrtf(1.0f + r00 - r11 - r22) * 2.0f;
+        q.w = (r21 - r12) / s;
+        q.x = 0.25f * s;
+        q.y = (r01 + r10) / s;
+        q.z = (r02 + r20) / s;
+    } else if (r11 > r22)
+    {
+        const float s = sqrtf(1.0f + r11 - r00 - r22) * 2.0f;
+        q.w = (r02 - r20) / s;
+        q.x = (r01 + r10) / s;
+        q.y = 0.25f * s;
+        q.z = (r12 + r21) / s;
+    } else
+    {
+        const float s = sqrtf(1.0f + r22 - r00 - r11) * 2.0f;
+        q.w = (r10 - r01) / s;
+        q.x = (r02 + r20) / s;
+        q.y = (r12 + r21) / s;
+        q.z = 0.25f * s;
+    }
+    return Quaternion::Normalize(q);
+}
+
+static void CollectNodes(SceneNode *node, std::unordered_map<std::string, SceneNode *> &nodes)
+{
+    nodes.emplace(node->GetName(), node);
+    for (auto child : node->GetChildren())
+    {
+        CollectNodes(child, nodes);
+    }
+}
+
+//*******************************************************
+// Animator
+//*******************************************************
+
+Animator::Animator(AnimationClip *clip, SceneNode *root)
+{
+    m_clip = clip;
+    m_time = 0.0f;
+    m_speed = 1.0f;
+    m_loop = true;
+    m_playing = false;
+    m_sampled = false;
+    m_interpolation = ANIM_NLERP;
+    bind(root);
+}
+
+Animator::~Animator()
+{
+}
+
+void Animator::bind(SceneNode *root)
+{
+    m_targets.clear();
+    if (!m_clip || !root) return;
+
+    std::unordered_map<std::string, SceneNode *> nodes;
+    CollectNodes(root, nodes);
+
+    for (u32 i = 0; i < m_clip->GetTrackCount(); ++i)
+    {
+        AnimationTrack *track = m_clip->GetTrack(i);
+        auto it = nodes.find(track->target);
+        if (it == nodes.end())
+        {
+            LogWarning("[ANIMATION] %s: node '%s' not found", m_clip->GetName().c_str(), track->target.c_str());
+            continue;
+        }
+
+        Binding binding;
+        binding.track = track;
+        binding.node = it->second;
+
+        // rest pose for the channels the track does not animate
+        const Mat4 &rel = binding.node->GetRelTrans();
+        binding.restPosition = Vec3(rel.c[3][0], rel.c[3][1], rel.c[3][2]);
+        binding.restScale.x = sqrtf(rel.c[0][0] * rel.c[0][0] + rel.c[0][1] * rel.c[0][1] + rel.c[0][2] * rel.c[0][2]);
+        binding.restScale.y = sqrtf(rel.c[1][0] * rel.c[1][0] + rel.c[1][1] * rel.c[1][1] + rel.c[1][2] * rel.c[1][2]);
+        binding.restScale.z = sqrtf(rel.c[2][0] * rel.c[2][0] + rel.c[2][1] * rel.c[2][1] + rel.c[2][2] * rel.c[2][2]);
+        if (binding.restScale.x > 0.0f && binding.restScale.y > 0.0f && binding.restScale.z > 0.0f)
+            binding.restRotation = RotationFromMatrix(rel, binding.restScale);
+
+        m_targets.push_back(binding);
+    }
+
+    // scratch padded to 4 so the SIMD loops never need a tail
+    const u32 count = (u32)m_targets.size();
+    const u32 padded = (count + 3) & ~3u;
+    for (u32 c = 0; c < 3; ++c)
+    {
+        m_pa[c].assign(padded, 0.0f);
+        m_pb[c].assign(padded, 0.0f);
+        m_sa[c].assign(padded, 1.0f);
+        m_sb[c].assign(padded, 1.0f);
+        m_pos[c].assign(padded, 0.0f);
+        m_scl[c].assign(padded, 1.0f);
+    }
+    for (u32 c = 0; c < 4; ++c)
+    {
+        const float v = c == 3 ? 1.0f : 0.0f;
+        m_ra[c].assign(padded, v);
+        m_rb[c].assign(padded, v);
+        m_rot[c].assign(padded, v);
+    }
+    m_pt.assign(padded, 0.0f);
+    m_rt.assign(padded, 0.0f);
+    m_st.assign(padded, 0.0f);
+
+    Cursor cursor = {0, 0, 0};
+    m_cursors.assign(count, cursor);
+    m_locals.assign(count, Mat4());
+}
+
+void Animator::Play()
+{
+    m_playing = true;
+}
+
+void Animator::Stop()
+{
+    m_playing = false;
+    SetTime(0.0f);
+}
+
+void Animator::SetTime(float time)
+{
+    m_time = time;
+    m_sampled = false;
+}
+
+bool Animator::Advance(float dt)
+{
+    if (!m_clip || m_targets.empty()) return false;
+    if (!m_playing) return !m_sampled;
+
+    const float duration = m_clip->GetDuration();
+    m_time += dt * m_speed;
+    if (duration > 0.0f)
+    {
+        if (m_loop)
+        {
+            m_time = fmodf(m_time, duration);
+            if (m_time < 0.0f) m_time += duration;
+        } else if (m_time >= duration || m_time <= 0.0f)
+        {
+            m_time = m_time >= duration ? duration : 0.0f;
+            m_playing = false;
+        }
+    }
+    return true;
+}
+
+void Animator::Sample()
+{
+    Sample(0, (u32)m_targets.size());
+}
+
+void Animator::Sample(u32 begin, u32 end)
+{
+    const u32 count = std::min(end, (u32)m_targets.size());
+    // SIMD blocks of 4, the scratch is padded so the last block is safe
+    begin &= ~3u;
+    const u32 padded = (count + 3) & ~3u;
+    const float time = m_time;
+
+    // gather: key pairs into the SoA scratch
+    for (u32 i = begin; i < count; ++i)
+    {
+        const Binding &binding = m_targets[i];
+        const AnimationTrack &track = *binding.track;
+        Cursor &cursor = m_cursors[i];
+        u32 k0, k1;
+        float t;
+
+        if (!track.posTimes.empty())
+        {
+            FindKeys(track.posTimes, time, cursor.pos, k0, k1, t);
+            m_pa[0][i] = track.posX[k0]; m_pb[0][i] = track.posX[k1];
+            m_pa[1][i] = track.posY[k0]; m_pb[1][i] = track.posY[k1];
+            m_pa[2][i] = track.posZ[k0]; m_pb[2][i] = track.posZ[k1];
+            m_pt[i] = t;
+        } else
+        {
+            m_pa[0][i] = m_pb[0][i] = binding.restPosition.x;
+            m_pa[1][i] = m_pb[1][i] = binding.restPosition.y;
+            m_pa[2][i] = m_pb[2][i] = binding.restPosition.z;
+            m_pt[i] = 0.0f;
+        }
+
+        if (!track.rotTimes.empty())
+        {
+            FindKeys(track.rotTimes, time, cursor.rot, k0, k1, t);
+            const float ax = track.rotX[k0], ay = track.rotY[k0], az = track.rotZ[k0], aw = track.rotW[k0];
+            float bx = track.rotX[k1], by = track.rotY[k1], bz = track.rotZ[k1], bw = track.rotW[k1];
+            // shortest path
+            if (ax * bx + ay * by + az * bz + aw * bw < 0.0f)
+            {
+                bx = -bx; by = -by; bz = -bz; bw = -bw;
+            }
+            m_ra[0][i] = ax; m_ra[1][i] = ay; m_ra[2][i] = az; m_ra[3][i] = aw;
+            m_rb[0][i] = bx; m_rb[1][i] = by; m_rb[2][i] = bz; m_rb[3][i] = bw;
+            m_rt[i] = t;
+        } else
+        {
+            const Quaternion &q = binding.restRotation;
+            m_ra[0][i] = m_rb[0][i] = q.x;
+            m_ra[1][i] = m_rb[1][i] = q.y;
+            m_ra[2][i] = m_rb[2][i] = q.z;
+            m_ra[3][i] = m_rb[3][i] = q.w;
+            m_rt[i] = 0.0f;
+        }
+
+        if (!track.sclTimes.empty())
+        {
+            FindKeys(track.sclTimes, time, cursor.scl, k0, k1, t);
+            m_sa[0][i] = track.sclX[k0]; m_sb[0][i] = track.sclX[k1];
+            m_sa[1][i] = track.sclY[k0]; m_sb[1][i] = track.sclY[k1];
+            m_sa[2][i] = track.sclZ[k0]; m_sb[2][i] = track.sclZ[k1];
+            m_st[i] = t;
+        } else
+        {
+            m_sa[0][i] = m_sb[0][i] = binding.restScale.x;
+            m_sa[1][i] = m_sb[1][i] = binding.restScale.y;
+            m_sa[2][i] = m_sb[2][i] = binding.restScale.z;
+            m_st[i] = 0.0f;
+        }
+    }
+
+    // blend across joints
+    LerpSoA(m_pa, m_pb, m_pt, m_pos, 3, begin, padded);
+    LerpSoA(m_sa, m_sb, m_st, m_scl, 3, begin, padded);
+    if (m_interpolation == ANIM_NLERP)
+    {
+        NlerpSoA(m_ra, m_rb, m_rt, m_rot, begin, padded);
+    } else
+    {
+        for (u32 i = begin; i < count; ++i)
+        {
+            const Quaternion a(m_ra[0][i], m_ra[1][i], m_ra[2][i], m_ra[3][i]);
+            const Quaternion b(m_rb[0][i], m_rb[1][i], m_rb[2][i], m_rb[3][i]);
+            const Quaternion q = Quaternion::Slerp(a, b, m_rt[i]);
+            m_rot[0][i] = q.x; m_rot[1][i] = q.y; m_rot[2][i] = q.z; m_rot[3][i] = q.w;
+        }
+    }
+
+    for (u32 i = begin; i < count; ++i)
+    {
+        ComposeTRS(m_locals[i], m_pos[0][i], m_pos[1][i], m_pos[2][i],
+                   m_rot[0][i], m_rot[1][i], m_rot[2][i], m_rot[3][i],
+                   m_scl[0][i], m_scl[1][i], m_scl[2][i]);
+    }
+}
+
+void Animator::Apply()
+{
+    for (u32 i = 0; i < m_targets.size(); ++i)
+    {
+        if (m_targets[i].node)
+        {
+            m_targets[i].node->SetTransformDeferred(m_locals[i]);
+        }
+    }
+    m_sampled = true;
+}
+
+void Animator::Unbind(SceneNode *node)
+{
+    // the slot stays so the SoA ranges keep their layout, it is just not written
+    for (u32 i = 0; i < m_targets.size(); ++i)
+    {
+        for (SceneNode *n = m_targets[i].node; n; n = n->GetParent())
+        {
+            if (n == node)
+            {
+                m_targets[i].node = nullptr;
+                break;
+            }
+        }
+    }
+}
+
+void Animator::Update(float dt)
+{
+    if (!Advance(dt)) return;
+    Sample();
+    Apply();
+}
+
+//*******************************************************
+// AnimationManager
+//*******************************************************
+
+AnimationManager &AnimationManager::Instance()
+{
+    static AnimationManager instance;
+    return instance;
+}
+
+AnimationManager *AnimationManager::InstancePtr()
+{
+    return &Instance();
+}
+
+AnimationManager::~AnimationManager()
+{
+    Clear();
+}
+
+AnimationClip *AnimationManager::Create(const std::string &name, float duration)
+{
+    if (Exists(name))
+    {
+        LogWarning("[ANIMATION] Clip %s already exists", name.c_str());
+        return m_clipsByName[name];
+    }
+    AnimationClip *clip = new AnimationClip(name, duration);
+    m_clips.push_back(clip);
+    m_clipsByName[name] = clip;
+    return clip;
+}
+
+bool AnimationManager::Exists(const std::string &name)
+{
+    return m_clipsByName.find(name) != m_clipsByName.end();
+}
+
+AnimationClip *AnimationManager::Get(const std::string &name)
+{
+    auto it = m_clipsByName.find(name);
+    if (it != m_clipsByName.end())
+    {
+        return it->second;
+    }
+    return nullptr;
+}
+
+AnimationClip *AnimationManager::Get(u32 index)
+{
+    if (index < m_clips.size())
+    {
+        return m_clips[index];
+    }
+    return nullptr;
+}
+
+void AnimationManager::Clear()
+{
+    for (auto clip : m_clips)
+    {
+        delete clip;
+    }
+    m_clips.clear();
+    m_clipsByName.clear();
+}
@@ -1,13 +1,16 @@
 #include "pch.h"
 #include "Batch.hpp"
+#include "Simd.hpp"
 
 
-#define BATCH_DRAWCALLS 256
+#define BATCH_DRAWCALLS 256     // initial draw array size, it grows as needed
 
 
 #define LINES 0x0001
 #define TRIANGLES 0x0004
 #define QUAD 0x0008
+#define SPRITE 0x0010     // instanced quads, vertexCount counts instances
+#define SDF_QUAD 0x0020   // quads drawn with the distance field shader
 
 
 RenderBatch::RenderBatch()
@@ -24,7 +27,28 @@ RenderBatch::RenderBatch()
     currentDepth = -1.0f;
     defaultTextureId = 0;
     bufferCount = 0;
+    elementCount = 0;
+    vaoId = 0;
+    vboId = 0;
+    instanceCounter = 0;
+    instancing = true;
+    spriteVaoId = 0;
+    cornerVboId = 0;
+    instanceVboId = 0;
+    spriteShader = nullptr;
+    sdfShader = nullptr;
+    defaultShader = nullptr;
+    recordHandle = 0;
+    recordingStatic = false;
+    culling = false;
+    frustumDirty = true;
+    for (int i = 0; i < BATCH_MAX_SEGMENTS; i++)
+    {
+        fences[i] = 0;
+    }
     drawCounter = 1;
+    textureUnits = 1;
+    textureSlot = 0;
     use_matrix = false;
     modelMatrix.identity();
 }
@@ -32,178 +56,159 @@ void RenderBatch::Init(int numBuffers, int bufferElements)
 {
 
     shader= ShaderManager::Instance().Get("2DShader");
+    defaultShader = shader;
 
     Texture2D* m_defaultTexture = TextureManager::Instance().GetDefault();
-    defaultTextureId = m_defaultTexture->GetID();
-
-
-    
+    defaultTextureId = m_defaultTexture ? m_defaultTexture->GetID() : 0;
 
-    for (int i = 0; i < numBuffers; i++)
+    // 3 segments: the CPU fills one while the GPU may still read the other two
+    bufferCount = numBuffers < 3 ? 3 : (numBuffers > BATCH_MAX_SEGMENTS ? BATCH_MAX_SEGMENTS : numBuffers);
+    elementCount = bufferElements;
+    if (elementCount > BATCH_MAX_QUADS)
     {
-        vertexBuffer.push_back(new VertexBuffer());
+        LogWarning("[BATCH] %d quads per flush, clamped to %d", bufferElements, BATCH_MAX_QUADS);
+        elementCount = BATCH_MAX_QUADS;
     }
-
     vertexCounter = 0;
     currentBuffer = 0;
 
-
-    for (int i = 0; i < numBuffers; i++)
+    vertices.resize((size_t)elementCount * 4);
+    for (int i = 0; i < BATCH_MAX_SEGMENTS; i++)
     {
-        vertexBuffer[i]->elementCount = bufferElements;
-
-        int k = 0;
-
-
-        for (int j = 0; j <= bufferElements; j++)
-        {
-
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->texcoords.push_back(0.0f);
-            vertexBuffer[i]->texcoords.push_back(0.0f);
-            vertexBuffer[i]->colors.push_back(colorr);
-            vertexBuffer[i]->colors.push_back(colorg);
-            vertexBuffer[i]->colors.push_back(colorb);
-            vertexBuffer[i]->colors.push_back(colora);
-
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->texcoords.push_back(0.0f);
-            vertexBuffer[i]->texcoords.push_back(0.0f);
-            vertexBuffer[i]->colors.push_back(colorr);
-            vertexBuffer[i]->colors.push_back(colorg);
-            vertexBuffer[i]->colors.push_back(colorb);
-            vertexBuffer[i]->colors.push_back(colora);
-
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->texcoords.push_back(0.0f);
-            vertexBuffer[i]->texcoords.push_back(0.0f);
-            vertexBuffer[i]->colors.push_back(colorr);
-            vertexBuffer[i]->colors.push_back(colorg);
-            vertexBuffer[i]->colors.push_back(colorb);
-            vertexBuffer[i]->colors.push_back(colora);
+        fences[i] = 0;
+    }
 
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->vertices.push_back(0.0f);
-            vertexBuffer[i]->texcoords.push_back(0.0f);
-            vertexBuffer[i]->texcoords.push_back(0.0f);
-            vertexBuffer[i]->colors.push_back(colorr);
-            vertexBuffer[i]->colors.push_back(colorg);
-            vertexBuffer[i]->colors.push_back(colorb);
-            vertexBuffer[i]->colors.push_back(colora);
+    glGenVertexArrays(1, &vaoId);
+    glBindVertexArray(vaoId);
 
+    glGenBuffers(1, &vboId);
+    glBindBuffer(GL_ARRAY_BUFFER, vboId);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertices.size() * sizeof(BatchVertex) * bufferCount, nullptr, GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
 
-            vertexBuffer[i]->indices.push_back(k);
-            vertexBuffer[i]->indices.push_back(k + 1);
-            vertexBuffer[i]->indices.push_back(k + 2);
-            vertexBuffer[i]->indices.push_back(k);
-            vertexBuffer[i]->indices.push_back(k + 2);
-            vertexBuffer[i]->indices.push_back(k + 3);
+    acquireQuadIndices();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, s_quadIBO);
 
+    // instanced sprites: unit quad + per instance attributes 1..5 (pointers set per draw)
+    spriteShader = ShaderManager::Instance().Get("SpriteShader");
+    instanceCounter = 0;
+    if (spriteShader)
+    {
+        static const float corners[8] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f};
+        instances.resize((size_t)elementCount);
+
+        glGenVertexArrays(1, &spriteVaoId);
+        glBindVertexArray(spriteVaoId);
+        glGenBuffers(1, &cornerVboId);
+        glBindBuffer(GL_ARRAY_BUFFER, cornerVboId);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
 
-            k += 4;
+        glGenBuffers(1, &instanceVboId);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVboId);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)instances.size() * sizeof(BatchInstance) * bufferCount, nullptr, GL_DYNAMIC_DRAW);
+        for (int i = 1; i <= 5; i++)
+        {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 1);
         }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, s_quadIBO);
     }
 
-
-    for (int i = 0; i < numBuffers; i++)
-    {
-        glGenVertexArrays(1, &vertexBuffer[i]->vaoId);
-        glBindVertexArray(vertexBuffer[i]->vaoId);
-
-        glGenBuffers(1, &vertexBuffer[i]->vboId[0]);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId[0]);
-        glBufferData(GL_ARRAY_BUFFER,
-                     vertexBuffer[i]->vertices.size() * sizeof(float),
-                     vertexBuffer[i]->vertices.data(), GL_DYNAMIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, 0, 0, 0);
-
-        glGenBuffers(1, &vertexBuffer[i]->vboId[1]);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId[1]);
-        glBufferData(GL_ARRAY_BUFFER,
-                     vertexBuffer[i]->texcoords.size() * sizeof(float),
-                     vertexBuffer[i]->texcoords.data(), GL_DYNAMIC_DRAW);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, 0, 0, 0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 
-        glGenBuffers(1, &vertexBuffer[i]->vboId[2]);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[i]->vboId[2]);
-        glBufferData(GL_ARRAY_BUFFER,
-                     vertexBuffer[i]->colors.size() * sizeof(unsigned char),
-                     vertexBuffer[i]->colors.data(), GL_DYNAMIC_DRAW);
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+    // distance field text, same vertices and samplers as the 2D shader
+    sdfShader = ShaderManager::Instance().Get("SDFShader");
 
+    updateTextureUnits();
 
-        glGenBuffers(1, &vertexBuffer[i]->vboId[3]);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexBuffer[i]->vboId[3]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                     vertexBuffer[i]->indices.size() * sizeof(unsigned int),
-                     vertexBuffer[i]->indices.data(), GL_STATIC_DRAW);
-    }
+    draws.reserve(BATCH_DRAWCALLS);
+    draws.resize(1);
+    resetDraw(draws[0], QUAD, defaultTextureId);
+    textureSlot = 0;
 
+    drawCounter = 1; // Reset draws counter
+    currentDepth = -1.0f; // Reset depth value
+}
 
-    glBindVertexArray(0);
+unsigned int RenderBatch::s_quadIBO = 0;
+int RenderBatch::s_quadIBOUsers = 0;
 
+void RenderBatch::acquireQuadIndices()
+{
+    if (s_quadIBOUsers++ > 0) return;
 
-    for (int i = 0; i < BATCH_DRAWCALLS; i++)
+    std::vector<u16> indices((size_t)BATCH_MAX_QUADS * 6);
+    for (int i = 0, k = 0; i < BATCH_MAX_QUADS; i++, k += 4)
     {
-        draws.push_back(new DrawCall());
-        draws[i]->mode = QUAD;
-        draws[i]->vertexCount = 0;
-        draws[i]->vertexAlignment = 0;
-        draws[i]->textureId = defaultTextureId;
+        u16 *quad = &indices[(size_t)i * 6];
+        quad[0] = (u16)k;
+        quad[1] = (u16)(k + 1);
+        quad[2] = (u16)(k + 2);
+        quad[3] = (u16)k;
+        quad[4] = (u16)(k + 2);
+        quad[5] = (u16)(k + 3);
     }
-
-    bufferCount = numBuffers; // Record buffer count
-    drawCounter = 1; // Reset draws counter
-    currentDepth = -1.0f; // Reset depth value
+    glGenBuffers(1, &s_quadIBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, s_quadIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indices.size() * sizeof(u16), indices.data(), GL_STATIC_DRAW);
 }
 
-
-void UnloadVertexArray(unsigned int vaoId)
+void RenderBatch::releaseQuadIndices()
 {
-    glBindVertexArray(0);
-    glDeleteVertexArrays(1, &vaoId);
+    if (s_quadIBOUsers <= 0 || --s_quadIBOUsers > 0) return;
+    glDeleteBuffers(1, &s_quadIBO);
+    s_quadIBO = 0;
 }
 
 
 void RenderBatch::Release()
 {
-    if (vertexBuffer.size() == 0) return;
+    if (vaoId == 0) return;
 
-    for (int i = 0; i < (int)vertexBuffer.size(); i++)
+    for (int i = 0; i < BATCH_MAX_SEGMENTS; i++)
     {
-        glDeleteBuffers(1, &vertexBuffer[i]->vboId[0]);
-        glDeleteBuffers(1, &vertexBuffer[i]->vboId[1]);
-        glDeleteBuffers(1, &vertexBuffer[i]->vboId[2]);
-        glDeleteBuffers(1, &vertexBuffer[i]->vboId[3]);
-        UnloadVertexArray(vertexBuffer[i]->vaoId);
+        if (fences[i]) glDeleteSync(fences[i]);
+        fences[i] = 0;
     }
-    for (int i = 0; i < (int)draws.size(); i++)
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &vaoId);
+    glDeleteBuffers(1, &vboId);
+    vaoId = 0;
+    vboId = 0;
+    if (spriteVaoId != 0)
     {
-
-        delete draws[i];
+        glDeleteVertexArrays(1, &spriteVaoId);
+        glDeleteBuffers(1, &cornerVboId);
+        glDeleteBuffers(1, &instanceVboId);
+        spriteVaoId = 0;
+        cornerVboId = 0;
+        instanceVboId = 0;
     }
-    for (int i = 0; i < (int)vertexBuffer.size(); i++)
+    std::vector<BatchInstance>().swap(instances);
+    instanceCounter = 0;
+    for (u32 i = 0; i < statics.size(); i++)
     {
-        vertexBuffer[i]->vertices.clear();
-        vertexBuffer[i]->texcoords.clear();
-        vertexBuffer[i]->colors.clear();
-        vertexBuffer[i]->indices.clear();
-
-        delete vertexBuffer[i];
+        ReleaseStatic(i + 1);
     }
-    draws.clear();
-    vertexBuffer.clear();
+    statics.clear();
+    std::vector<BatchVertex>().swap(staticVertices);
+    std::vector<StaticDraw>().swap(staticDraws);
+    recordingStatic = false;
+    spriteShader = nullptr;
+    sdfShader = nullptr;
+    defaultShader = nullptr;
+    releaseQuadIndices();
+
+    std::vector<DrawCall>().swap(draws);
+    std::vector<BatchVertex>().swap(vertices);
     m_defaultTexture.Release();
     shader=nullptr;
     LogInfo("Render batch  unloaded successfully from VRAM (GPU)");
@@ -212,198 +217,256 @@ void RenderBatch::Release()
 RenderBatch::~RenderBatch() { Release(); }
 
 
-// void RenderBatch::Render()
-// {
-//         shader.Use();
-
-
-//         shader.SetMatrix4("mvp", viewMatrix.x);
-
-//         if (vertexCounter > 0)
-//         {
-//             glBindVertexArray(vertexBuffer[currentBuffer]->vaoId);
-
-//             glBindBuffer(GL_ARRAY_BUFFER,
-//             vertexBuffer[currentBuffer]->vboId[0]);
-//             glBufferSubData(GL_ARRAY_BUFFER, 0,
-//             vertexCounter*3*sizeof(float),
-//             vertexBuffer[currentBuffer]->vertices.data());
-
-//             glBindBuffer(GL_ARRAY_BUFFER,
-//             vertexBuffer[currentBuffer]->vboId[1]);
-//             glBufferSubData(GL_ARRAY_BUFFER, 0,
-//             vertexCounter*2*sizeof(float),
-//             vertexBuffer[currentBuffer]->texcoords.data());
-
-//             glBindBuffer(GL_ARRAY_BUFFER,
-//             vertexBuffer[currentBuffer]->vboId[2]);
-//             glBufferSubData(GL_ARRAY_BUFFER, 0,
-//             vertexCounter*4*sizeof(unsigned char),
-//             vertexBuffer[currentBuffer]->colors.data());
-
-//             glBindVertexArray(0);
-//         }
-//         if (vertexCounter > 0)
-//         {
-
-//             glBindVertexArray(vertexBuffer[currentBuffer]->vaoId);
-//             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
-//             vertexBuffer[currentBuffer]->vboId[3]);
-//             glActiveTexture(GL_TEXTURE0);
-
-
-//             for (int i = 0, vertexOffset = 0; i < drawCounter; i++)
-//             {
-
-//                glBindTexture(GL_TEXTURE_2D, draws[i]->textureId);
-//                 int mode =GL_LINES;
-//                 if (draws[i]->mode == LINES) mode = GL_LINES;
-//                 else if (draws[i]->mode == TRIANGLES) mode = GL_TRIANGLES;
-//                 else if (draws[i]->mode == QUAD) mode = GL_TRIANGLES;
-
-
-//                if ((draws[i]->mode == LINES) || (draws[i]->mode ==
-//                TRIANGLES))
-//                {
-//                    glDrawArrays(mode, vertexOffset, draws[i]->vertexCount);
-//                }
-//                else
-//                {
-//                   glDrawElements(GL_TRIANGLES, draws[i]->vertexCount/4*6,
-//                   GL_UNSIGNED_INT,(GLvoid *)(vertexOffset/4*6*sizeof(int)));
-//                }
-
-//                vertexOffset += (draws[i]->vertexCount +
-//                draws[i]->vertexAlignment);
-//             }
-//             glBindBuffer(GL_ARRAY_BUFFER, 0);
-//             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-//             glBindTexture(GL_TEXTURE_2D, 0);
-//         }
-
-//     glBindVertexArray(0); // Unbind VAO
-//     vertexCounter = 0;
-//     currentDepth = -1.0f;
-//     for (int i = 0; i < BATCH_DRAWCALLS; i++)
-//     {
-//         draws[i]->mode =QUAD;
-//         draws[i]->vertexCount = 0;
-//         draws[i]->textureId = defaultTextureId;
-//     }
-//     drawCounter = 1;
-//     currentBuffer++;
-//     if (currentBuffer >= bufferCount) currentBuffer = 0;
+// unsynchronized: the segment fence already guarantees the range is free
+static void uploadRange(unsigned int buffer, GLintptr offset, GLsizeiptr bytes, const void *data)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    void *dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (dst)
+    {
+        memcpy(dst, data, (size_t)bytes);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    else
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
+    }
+}
 
-// }
+void RenderBatch::uploadSegment()
+{
+    // the segment was last drawn bufferCount flushes ago, normally long done
+    GLsync &fence = fences[currentBuffer];
+    if (fence)
+    {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
 
+    if (instanceCounter > 0)
+    {
+        const GLintptr offset = (GLintptr)currentBuffer * (GLintptr)instances.size() * sizeof(BatchInstance);
+        uploadRange(instanceVboId, offset, (GLsizeiptr)instanceCounter * sizeof(BatchInstance), instances.data());
+    }
+    if (vertexCounter == 0) return;
+
+    const GLintptr offset = (GLintptr)currentBuffer * (GLintptr)vertices.size() * sizeof(BatchVertex);
+    uploadRange(vboId, offset, (GLsizeiptr)vertexCounter * sizeof(BatchVertex), vertices.data());
+
+    // attributes start at the segment, so quads always index from 0
+    glBindVertexArray(vaoId);
+    const GLsizei stride = (GLsizei)sizeof(BatchVertex);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(BatchVertex, x)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(BatchVertex, u)));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)(offset + offsetof(BatchVertex, r)));
+    glVertexAttribPointer(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, stride, (void *)(offset + offsetof(BatchVertex, slot)));
+}
 
-void RenderBatch::Render()
+// no base instance in GLES 3, every sprite draw points at its first instance
+void RenderBatch::setInstanceAttributes(GLintptr offset)
 {
+    const GLsizei stride = (GLsizei)sizeof(BatchInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVboId);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void *)(offset + offsetof(BatchInstance, x)));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)(offset + offsetof(BatchInstance, u0)));
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)(offset + offsetof(BatchInstance, r)));
+    glVertexAttribPointer(4, 1, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)(offset + offsetof(BatchInstance, rotation)));
+    glVertexAttribPointer(5, 1, GL_UNSIGNED_BYTE, GL_FALSE, stride, (void *)(offset + offsetof(BatchInstance, slot)));
+}
 
-    if (vertexCounter > 0)
+
+// shaders with one sampler keep one texture per draw call
+void RenderBatch::updateTextureUnits()
+{
+    textureUnits = 1;
+    if (shader && shader->ContainsUniform("textures[1]"))
     {
-        glBindVertexArray(vertexBuffer[currentBuffer]->vaoId);
+        GLint units = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+        textureUnits = std::max(1, std::min(BATCH_MAX_TEXTURES, (int)units));
+    }
+}
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[0]);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCounter * 3 * sizeof(float),
-                        vertexBuffer[currentBuffer]->vertices.data());
+void RenderBatch::SetShader(Shader *program)
+{
+    if (!program) program = defaultShader;
+    if (program == shader) return;
+    Render();
+    shader = program;
+    updateTextureUnits();
+}
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[1]);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCounter * 2 * sizeof(float),
-                        vertexBuffer[currentBuffer]->texcoords.data());
+void RenderBatch::Render()
+{
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer[currentBuffer]->vboId[2]);
-        glBufferSubData(GL_ARRAY_BUFFER, 0,
-                        vertexCounter * 4 * sizeof(unsigned char),
-                        vertexBuffer[currentBuffer]->colors.data());
+    if (recordingStatic)
+    {
+        captureStatic();
+    }
+    else if (vertexCounter > 0 || instanceCounter > 0)
+    {
+        uploadSegment();
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glActiveTexture(GL_TEXTURE0);
+        if (instanceCounter > 0)
+        {
+            spriteShader->Use();
+            spriteShader->SetMatrix4("mvp", viewMatrix.x);
+            spriteShader->SetFloat("depth", currentDepth);
+        }
         if (shader)
         {
         shader->Use();
         shader->SetMatrix4("mvp", viewMatrix.x);
         }
-
-        unsigned int currentTex = 0xFFFFFFFFu;
+        glBindVertexArray(vaoId);
+        Shader *program = shader;
+        bool sprites = false;
+        int instanceOffset = 0;
+        const GLintptr instanceBase = (GLintptr)currentBuffer * (GLintptr)instances.size() * sizeof(BatchInstance);
+
+        unsigned int bound[BATCH_MAX_TEXTURES];
+        int usedUnits = 0;
+        for (int t = 0; t < BATCH_MAX_TEXTURES; ++t) bound[t] = 0xFFFFFFFFu;
         for (int i = 0, vertexOffset = 0; i < drawCounter; ++i)
         {
             // bind de textura só quando muda
-            if (draws[i]->textureId != currentTex)
+            for (int t = 0; t < draws[i].textureCount; ++t)
             {
-                currentTex = draws[i]->textureId;
-                glBindTexture(GL_TEXTURE_2D, currentTex);
+                if (draws[i].textures[t] != bound[t])
+                {
+                    bound[t] = draws[i].textures[t];
+                    glActiveTexture(GL_TEXTURE0 + t);
+                    glBindTexture(GL_TEXTURE_2D, bound[t]);
+                }
             }
+            usedUnits = std::max(usedUnits, draws[i].textureCount);
 
-            const int mode = (draws[i]->mode == LINES) ? GL_LINES
-                : (draws[i]->mode == TRIANGLES)
+            // troca de programa/VAO so entre sprites e vertices
+            if ((draws[i].mode == SPRITE) != sprites)
+            {
+                sprites = !sprites;
+                if (sprites)
+                {
+                    spriteShader->Use();
+                    glBindVertexArray(spriteVaoId);
+                }
+                else
+                {
+                    program = nullptr;
+                    glBindVertexArray(vaoId);
+                }
+            }
+            if (!sprites)
+            {
+                Shader *wanted = (draws[i].mode == SDF_QUAD) ? sdfShader : shader;
+                if (wanted != program && wanted)
+                {
+                    program = wanted;
+                    program->Use();
+                    if (program == sdfShader) program->SetMatrix4("mvp", viewMatrix.x);
+                }
+            }
+            if (sprites)
+            {
+                if (draws[i].vertexCount > 0)
+                {
+                    setInstanceAttributes(instanceBase + (GLintptr)instanceOffset * sizeof(BatchInstance));
+                    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (GLvoid *)0, draws[i].vertexCount);
+                    instanceOffset += draws[i].vertexCount;
+                }
+                continue;
+            }
+
+            const int mode = (draws[i].mode == LINES) ? GL_LINES
+                : (draws[i].mode == TRIANGLES)
                 ? GL_TRIANGLES
                 : GL_TRIANGLES; // QUAD -> indices
 
-            if (draws[i]->mode == LINES || draws[i]->mode == TRIANGLES)
+            if (draws[i].mode == LINES || draws[i].mode == TRIANGLES)
             {
-                glDrawArrays(mode, vertexOffset, draws[i]->vertexCount);
+                glDrawArrays(mode, vertexOffset, draws[i].vertexCount);
             }
             else
             { // QUAD
                 const int firstIndex = (vertexOffset / 4) * 6;
-                const int count = (draws[i]->vertexCount / 4) * 6;
-                glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT,
-                               (GLvoid *)(firstIndex * sizeof(unsigned int)));
+                const int count = (draws[i].vertexCount / 4) * 6;
+                glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT,
+                               (GLvoid *)(firstIndex * sizeof(u16)));
             }
 
-            vertexOffset += (draws[i]->vertexCount + draws[i]->vertexAlignment);
+            vertexOffset += (draws[i].vertexCount + draws[i].vertexAlignment);
         }
+        fences[currentBuffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
-        glBindTexture(GL_TEXTURE_2D, 0);
+        for (int t = usedUnits - 1; t >= 0; --t)
+        {
+            glActiveTexture(GL_TEXTURE0 + t);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
         glBindVertexArray(0);
-        if (shader)
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (shader || instanceCounter > 0)
         {
           
-            shader->Use(false);
+            glUseProgram(0);
         }
+        if (++currentBuffer >= bufferCount) currentBuffer = 0;
     }
 
     // reset do batch
     vertexCounter = 0;
+    instanceCounter = 0;
     currentDepth = -1.0f;
-    for (int i = 0; i < BATCH_DRAWCALLS; ++i)
+    // so as entradas usadas, as seguintes sao iniciadas ao abrir
+    for (int i = 0; i < drawCounter; ++i)
     {
-        draws[i]->mode = QUAD;
-        draws[i]->vertexCount = 0;
-        draws[i]->textureId = defaultTextureId;
+        resetDraw(draws[i], QUAD, defaultTextureId);
     }
     drawCounter = 1;
-
-    if (++currentBuffer >= bufferCount) currentBuffer = 0;
+    textureSlot = 0;
 }
 
 void RenderBatch::Line3D(float startX, float startY, float startZ, float endX,
                          float endY, float endZ)
 {
+    if (culling && cullBox(Vec3(std::min(startX, endX), std::min(startY, endY), std::min(startZ, endZ)),
+                           Vec3(std::max(startX, endX), std::max(startY, endY), std::max(startZ, endZ))))
+    {
+        return;
+    }
     SetMode(LINES);
     Vertex3f(startX, startY, startZ);
     Vertex3f(endX, endY, endZ);
 }
 
+// Render and keep the mode and texture of the last draw so we can continue adding vertices
+void RenderBatch::flush()
+{
+    const int currentMode = draws[drawCounter - 1].mode;
+    const unsigned int currentTexture = draws[drawCounter - 1].textureId;
+
+    Render();
+
+    resetDraw(draws[drawCounter - 1], currentMode, currentTexture);
+}
+
 bool RenderBatch::CheckRenderBatchLimit(int vCount)
 {
     bool overflow = false;
 
 
-    if ((vertexCounter + vCount)>= (vertexBuffer[currentBuffer]->elementCount * 4))
+    if ((vertexCounter + vCount)>= (elementCount * 4))
     {
         overflow = true;
 
-        // Store current primitive drawing mode and texture id
-        int currentMode = draws[drawCounter - 1]->mode;
-        int currentTexture = draws[drawCounter - 1]->textureId;
-
-        Render();
-
-        // Restore state of last batch so we can continue adding vertices
-        draws[drawCounter - 1]->mode = currentMode;
-        draws[drawCounter - 1]->textureId = currentTexture;
+        flush();
     }
 
 
@@ -413,36 +476,306 @@ bool RenderBatch::CheckRenderBatchLimit(int vCount)
 
 void RenderBatch::SetMode(int mode)
 {
-    if (draws[drawCounter - 1]->mode != mode)
+    if (draws[drawCounter - 1].mode != mode)
     {
-        if (draws[drawCounter - 1]->vertexCount > 0)
+        setDrawState(mode, defaultTextureId);
+    }
+}
+
+void RenderBatch::resetDraw(DrawCall &draw, int mode, unsigned int textureId)
+{
+    draw.mode = mode;
+    draw.vertexCount = 0;
+    draw.vertexAlignment = 0;
+    draw.textureId = textureId;
+    draw.textures[0] = textureId;
+    draw.textureCount = 1;
+}
+
+// Selects textureId inside the draw, taking a free unit if needed.
+// False when every unit already holds another texture.
+bool RenderBatch::bindSlot(DrawCall &draw, unsigned int textureId)
+{
+    int slot = 0;
+    while (slot < draw.textureCount && draw.textures[slot] != textureId)
+    {
+        ++slot;
+    }
+    if (slot == draw.textureCount)
+    {
+        if (draw.textureCount >= textureUnits) return false;
+        draw.textures[draw.textureCount++] = textureId;
+    }
+    draw.textureId = textureId;
+    textureSlot = (u8)slot;
+    return true;
+}
+
+// Opens a draw for (mode, texture). Empty draws are reused and a draw that
+// goes back to the mode of the one before it (with a free or matching unit)
+// is merged into it, so the array only grows on real state changes and
+// never forces a flush.
+void RenderBatch::setDrawState(int mode, unsigned int textureId)
+{
+    DrawCall *draw = &draws[drawCounter - 1];
+    if (draw->vertexCount == 0)
+    {
+        if (drawCounter > 1)
         {
-            if (draws[drawCounter - 1]->mode == LINES)
-                draws[drawCounter - 1]->vertexAlignment =
-                    ((draws[drawCounter - 1]->vertexCount < 4)
-                         ? draws[drawCounter - 1]->vertexCount
-                         : draws[drawCounter - 1]->vertexCount % 4);
-            else if (draws[drawCounter - 1]->mode == TRIANGLES)
-                draws[drawCounter - 1]->vertexAlignment =
-                    ((draws[drawCounter - 1]->vertexCount < 4)
-                         ? 1
-                         : (4 - (draws[drawCounter - 1]->vertexCount % 4)));
-            else
-                draws[drawCounter - 1]->vertexAlignment = 0;
+            DrawCall &previous = draws[drawCounter - 2];
+            if (previous.mode == mode && bindSlot(previous, textureId))
+            {
+                vertexCounter -= previous.vertexAlignment;
+                previous.vertexAlignment = 0;
+                resetDraw(*draw, QUAD, defaultTextureId);
+                drawCounter--;
+                return;
+            }
+        }
+        resetDraw(*draw, mode, textureId);
+        textureSlot = 0;
+        return;
+    }
+
+    if (draw->mode == LINES)
+        draw->vertexAlignment = ((draw->vertexCount < 4) ? draw->vertexCount : draw->vertexCount % 4);
+    else if (draw->mode == TRIANGLES)
+        draw->vertexAlignment = ((draw->vertexCount < 4) ? 1 : (4 - (draw->vertexCount % 4)));
+    else
+        draw->vertexAlignment = 0;
+
+    if (!CheckRenderBatchLimit(draw->vertexAlignment))
+    {
+        vertexCounter += draw->vertexAlignment;
+        drawCounter++;
+        if (drawCounter > (int)draws.size())
+        {
+            draws.push_back(DrawCall());
+        }
+    }
+
+    resetDraw(draws[drawCounter - 1], mode, textureId);
+    textureSlot = 0;
+}
+
+
+//*****************************************************************************
+// Static batches
+//*****************************************************************************
+
+// Called by Render while recording: moves the pending draws to the static
+// staging, quads as 2 triangles and without the alignment padding.
+void RenderBatch::captureStatic()
+{
+    for (int i = 0, vertexOffset = 0; i < drawCounter; ++i)
+    {
+        const DrawCall &draw = draws[i];
+        const int first = vertexOffset;
+        vertexOffset += draw.vertexCount + draw.vertexAlignment;
+        if (draw.vertexCount == 0 || draw.mode == SPRITE) continue;
+
+        const int mode = (draw.mode == LINES) ? LINES : (draw.mode == SDF_QUAD) ? SDF_QUAD : TRIANGLES;
+        const int start = (int)staticVertices.size();
+        if (draw.mode == QUAD || draw.mode == SDF_QUAD)
+        {
+            for (int q = 0; q + 3 < draw.vertexCount; q += 4)
+            {
+                const BatchVertex *quad = &vertices[first + q];
+                staticVertices.push_back(quad[0]);
+                staticVertices.push_back(quad[1]);
+                staticVertices.push_back(quad[2]);
+                staticVertices.push_back(quad[0]);
+                staticVertices.push_back(quad[2]);
+                staticVertices.push_back(quad[3]);
+            }
+        }
+        else
+        {
+            staticVertices.insert(staticVertices.end(), vertices.begin() + first, vertices.begin() + first + draw.vertexCount);
+        }
+        const int count = (int)staticVertices.size() - start;
+
+        // same primitive and textures: one draw
+        if (!staticDraws.empty())
+        {
+            StaticDraw &last = staticDraws.back();
+            if (last.mode == mode && last.textureCount == draw.textureCount
+                && memcmp(last.textures, draw.textures, sizeof(unsigned int) * draw.textureCount) == 0)
+            {
+                last.count += count;
+                continue;
+            }
+        }
+        StaticDraw record;
+        record.mode = mode;
+        record.first = start;
+        record.count = count;
+        memcpy(record.textures, draw.textures, sizeof(record.textures));
+        record.textureCount = draw.textureCount;
+        staticDraws.push_back(record);
+    }
+}
+
+void RenderBatch::BeginStatic(u32 handle)
+{
+    if (recordingStatic)
+    {
+        LogWarning("[BATCH] BeginStatic while recording, ignored");
+        return;
+    }
+    // what is pending belongs to the screen
+    Render();
 
-            if (!CheckRenderBatchLimit(draws[drawCounter - 1]->vertexAlignment))
+    if (handle == 0 || handle > statics.size() || !statics[handle - 1].used)
+    {
+        handle = 0;
+        for (u32 i = 0; i < statics.size(); i++)
+        {
+            if (!statics[i].used)
+            {
+                handle = i + 1;
+                break;
+            }
+        }
+        if (handle == 0)
+        {
+            statics.push_back(StaticBatch());
+            handle = (u32)statics.size();
+        }
+        StaticBatch &batch = statics[handle - 1];
+        batch.vao = 0;
+        batch.vbo = 0;
+        batch.draws.clear();
+        batch.used = true;
+        batch.valid = false;
+    }
+    recordHandle = handle;
+    recordingStatic = true;
+    staticVertices.clear();
+    staticDraws.clear();
+}
+
+u32 RenderBatch::EndStatic()
+{
+    if (!recordingStatic) return 0;
+    Render();
+    recordingStatic = false;
+
+    StaticBatch &batch = statics[recordHandle - 1];
+    if (batch.vao == 0)
+    {
+        glGenVertexArrays(1, &batch.vao);
+        glGenBuffers(1, &batch.vbo);
+        glBindVertexArray(batch.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
+        const GLsizei stride = (GLsizei)sizeof(BatchVertex);
+        for (int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(i);
+        }
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(BatchVertex, x));
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(BatchVertex, u));
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)offsetof(BatchVertex, r));
+        glVertexAttribPointer(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, stride, (void *)offsetof(BatchVertex, slot));
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)staticVertices.size() * sizeof(BatchVertex),
+                 staticVertices.empty() ? nullptr : staticVertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    batch.draws = staticDraws;
+    batch.valid = true;
+    LogInfo("[BATCH] Static %u: %u vertices, %u draws", recordHandle, (u32)staticVertices.size(), (u32)staticDraws.size());
+    staticVertices.clear();
+    staticDraws.clear();
+
+    const u32 handle = recordHandle;
+    recordHandle = 0;
+    return handle;
+}
+
+void RenderBatch::DrawStatic(u32 handle, const Mat4 &transform)
+{
+    if (handle == 0 || handle > statics.size() || !statics[handle - 1].used || statics[handle - 1].vao == 0)
+    {
+        return;
+    }
+    if (recordingStatic)
+    {
+        LogWarning("[BATCH] DrawStatic while recording, ignored");
+        return;
+    }
+    const StaticBatch &batch = statics[handle - 1];
+    if (batch.draws.empty()) return;
+
+    // keep the order with the dynamic content
+    Render();
+
+    glBindVertexArray(batch.vao);
+    const Mat4 mvp = viewMatrix * transform;
+    Shader *program = nullptr;
+    unsigned int bound[BATCH_MAX_TEXTURES];
+    int usedUnits = 0;
+    for (int t = 0; t < BATCH_MAX_TEXTURES; ++t) bound[t] = 0xFFFFFFFFu;
+    for (u32 i = 0; i < batch.draws.size(); ++i)
+    {
+        const StaticDraw &draw = batch.draws[i];
+        Shader *wanted = (draw.mode == SDF_QUAD && sdfShader) ? sdfShader : shader;
+        if (wanted != program && wanted)
+        {
+            program = wanted;
+            program->Use();
+            program->SetMatrix4("mvp", mvp.x);
+        }
+        for (int t = 0; t < draw.textureCount; ++t)
+        {
+            if (draw.textures[t] != bound[t])
             {
-                vertexCounter += draws[drawCounter - 1]->vertexAlignment;
-                drawCounter++;
+                bound[t] = draw.textures[t];
+                glActiveTexture(GL_TEXTURE0 + t);
+                glBindTexture(GL_TEXTURE_2D, bound[t]);
             }
         }
+        usedUnits = std::max(usedUnits, draw.textureCount);
+        glDrawArrays(draw.mode == LINES ? GL_LINES : GL_TRIANGLES, draw.first, draw.count);
+    }
+    for (int t = usedUnits - 1; t >= 0; --t)
+    {
+        glActiveTexture(GL_TEXTURE0 + t);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glBindVertexArray(0);
+    if (program) program->Use(false);
+}
 
-        if (drawCounter >= BATCH_DRAWCALLS) Render();
+void RenderBatch::InvalidateStatic(u32 handle)
+{
+    if (handle > 0 && handle <= statics.size())
+    {
+        statics[handle - 1].valid = false;
+    }
+}
 
-        draws[drawCounter - 1]->mode = mode;
-        draws[drawCounter - 1]->vertexCount = 0;
-        draws[drawCounter - 1]->textureId = defaultTextureId;
+bool RenderBatch::IsStaticValid(u32 handle) const
+{
+    return handle > 0 && handle <= statics.size() && statics[handle - 1].used && statics[handle - 1].valid;
+}
+
+void RenderBatch::ReleaseStatic(u32 handle)
+{
+    if (handle == 0 || handle > statics.size()) return;
+    StaticBatch &batch = statics[handle - 1];
+    if (batch.vao != 0)
+    {
+        glDeleteVertexArrays(1, &batch.vao);
+        glDeleteBuffers(1, &batch.vbo);
     }
+    batch.vao = 0;
+    batch.vbo = 0;
+    batch.draws.clear();
+    batch.used = false;
+    batch.valid = false;
 }
 
 
@@ -453,7 +786,11 @@ void RenderBatch::BeginTransform(const Mat4 &transform)
     modelMatrix = transform;
 }
 
-void RenderBatch::SetMatrix(const Mat4 &matrix) { viewMatrix = matrix; }
+void RenderBatch::SetMatrix(const Mat4 &matrix)
+{
+    viewMatrix = matrix;
+    frustumDirty = true;
+}
 
 
 void RenderBatch::EndTransform() { use_matrix = false; }
@@ -474,41 +811,39 @@ void RenderBatch::Vertex3f(float x, float y, float z)
             + modelMatrix.x[14];
     }
 
-    if (vertexCounter > (vertexBuffer[currentBuffer]->elementCount * 4 - 4))
+    if (vertexCounter > (elementCount * 4 - 4))
     {
-        if ((draws[drawCounter - 1]->mode == LINES)
-            && (draws[drawCounter - 1]->vertexCount % 2 == 0))
+        if ((draws[drawCounter - 1].mode == LINES)
+            && (draws[drawCounter - 1].vertexCount % 2 == 0))
         {
             CheckRenderBatchLimit(2 + 1);
         }
-        else if ((draws[drawCounter - 1]->mode == TRIANGLES)
-                 && (draws[drawCounter - 1]->vertexCount % 3 == 0))
+        else if ((draws[drawCounter - 1].mode == TRIANGLES)
+                 && (draws[drawCounter - 1].vertexCount % 3 == 0))
         {
             CheckRenderBatchLimit(3 + 1);
         }
-        else if ((draws[drawCounter - 1]->mode == QUAD)
-                 && (draws[drawCounter - 1]->vertexCount % 4 == 0))
+        else if ((draws[drawCounter - 1].mode == QUAD || draws[drawCounter - 1].mode == SDF_QUAD)
+                 && (draws[drawCounter - 1].vertexCount % 4 == 0))
         {
             CheckRenderBatchLimit(4 + 1);
         }
     }
 
-    vertexBuffer[currentBuffer]->vertices[3 * vertexCounter] = tx;
-    vertexBuffer[currentBuffer]->vertices[3 * vertexCounter + 1] = ty;
-    vertexBuffer[currentBuffer]->vertices[3 * vertexCounter + 2] = tz;
-
-
-    vertexBuffer[currentBuffer]->texcoords[2 * vertexCounter] = texcoordx;
-    vertexBuffer[currentBuffer]->texcoords[2 * vertexCounter + 1] = texcoordy;
-
-
-    vertexBuffer[currentBuffer]->colors[4 * vertexCounter] = colorr;
-    vertexBuffer[currentBuffer]->colors[4 * vertexCounter + 1] = colorg;
-    vertexBuffer[currentBuffer]->colors[4 * vertexCounter + 2] = colorb;
-    vertexBuffer[currentBuffer]->colors[4 * vertexCounter + 3] = colora;
+    BatchVertex *v = &vertices[vertexCounter];
+    v->x = tx;
+    v->y = ty;
+    v->z = tz;
+    v->u = texcoordx;
+    v->v = texcoordy;
+    v->r = colorr;
+    v->g = colorg;
+    v->b = colorb;
+    v->a = colora;
+    v->slot = textureSlot;
 
     vertexCounter++;
-    draws[drawCounter - 1]->vertexCount++;
+    draws[drawCounter - 1].vertexCount++;
 }
 
 
@@ -564,42 +899,19 @@ void RenderBatch::SetTexture(unsigned int id)
 {
     if (id == 0)
     {
-        if (vertexCounter >= vertexBuffer[currentBuffer]->elementCount * 4)
+        if (vertexCounter >= elementCount * 4)
         {
             Render();
         }
     }
     else
     {
-        if (draws[drawCounter - 1]->textureId != id)
+        // another unit of the same draw while there is one free,
+        // an empty draw just takes the new texture
+        DrawCall &draw = draws[drawCounter - 1];
+        if (draw.textureId != id && (draw.vertexCount == 0 || !bindSlot(draw, id)))
         {
-            if (draws[drawCounter - 1]->vertexCount > 0)
-            {
-                if (draws[drawCounter - 1]->mode == LINES)
-                    draws[drawCounter - 1]->vertexAlignment =
-                        ((draws[drawCounter - 1]->vertexCount < 4)
-                             ? draws[drawCounter - 1]->vertexCount
-                             : draws[drawCounter - 1]->vertexCount % 4);
-                else if (draws[drawCounter - 1]->mode == TRIANGLES)
-                    draws[drawCounter - 1]->vertexAlignment =
-                        ((draws[drawCounter - 1]->vertexCount < 4)
-                             ? 1
-                             : (4 - (draws[drawCounter - 1]->vertexCount % 4)));
-                else
-                    draws[drawCounter - 1]->vertexAlignment = 0;
-
-                if (!CheckRenderBatchLimit(
-                        draws[drawCounter - 1]->vertexAlignment))
-                {
-                    vertexCounter += draws[drawCounter - 1]->vertexAlignment;
-                    drawCounter++;
-                }
-            }
-
-            if (drawCounter >= BATCH_DRAWCALLS) Render();
-
-            draws[drawCounter - 1]->textureId = id;
-            draws[drawCounter - 1]->vertexCount = 0;
+            setDrawState(draw.mode, id);
         }
     }
 }
@@ -697,402 +1009,456 @@ void RenderBatch::Rectangle(int posX, int posY, int width, int height,
 
 void RenderBatch::Line3D(const Vec3 &start, const Vec3 &end)
 {
-    SetMode(LINES);
-    Vertex3f(start.x, start.y, start.z);
-    Vertex3f(end.x, end.y, end.z);
+    Line3D(start.x, start.y, start.z, end.x, end.y, end.z);
 }
 
 
+// same 12 edges as the wire cube template, from min to max
 void RenderBatch::Box(const BoundingBox &box)
 {
-    SetMode(LINES);
-
-    Line3D(box.min.x, box.min.y, box.min.z, box.max.x, box.min.y, box.min.z);
-    Line3D(box.max.x, box.min.y, box.min.z, box.max.x, box.max.y, box.min.z);
-    Line3D(box.max.x, box.max.y, box.min.z, box.min.x, box.max.y, box.min.z);
-    Line3D(box.min.x, box.max.y, box.min.z, box.min.x, box.min.y, box.min.z);
+    Cube(box.min, box.max.x - box.min.x, box.max.y - box.min.y, box.max.z - box.min.z, true);
+}
 
-    Line3D(box.min.x, box.min.y, box.max.z, box.max.x, box.min.y, box.max.z);
-    Line3D(box.max.x, box.min.y, box.max.z, box.max.x, box.max.y, box.max.z);
-    Line3D(box.max.x, box.max.y, box.max.z, box.min.x, box.max.y, box.max.z);
-    Line3D(box.min.x, box.max.y, box.max.z, box.min.x, box.min.y, box.max.z);
+//*****************************************************************************
+// Culling of the debug primitives
+//*****************************************************************************
 
-    Line3D(box.min.x, box.min.y, box.min.z, box.min.x, box.min.y, box.max.z);
-    Line3D(box.max.x, box.min.y, box.min.z, box.max.x, box.min.y, box.max.z);
-    Line3D(box.max.x, box.max.y, box.min.z, box.max.x, box.max.y, box.max.z);
-    Line3D(box.min.x, box.max.y, box.min.z, box.min.x, box.max.y, box.max.z);
+const Frustum &RenderBatch::getFrustum()
+{
+    if (frustumDirty)
+    {
+        // viewMatrix is the whole view-projection: planes in world space
+        frustum.build(Mat4(), viewMatrix);
+        frustumDirty = false;
+    }
+    return frustum;
 }
 
-void RenderBatch::Cube(const Vec3 &position, float w, float h, float d,
-                       bool wire)
+// true when the box (before modelMatrix) is outside the view
+bool RenderBatch::cullBox(const Vec3 &min, const Vec3 &max)
 {
-    float x = position.x;
-    float y = position.y;
-    float z = position.z;
-
-    if (wire)
+    BoundingBox box(min, max);
+    if (use_matrix)
     {
-        SetMode(LINES);
-        Line3D(x, y, z, x + w, y, z);
-        Line3D(x + w, y, z, x + w, y + h, z);
-        Line3D(x + w, y + h, z, x, y + h, z);
-        Line3D(x, y + h, z, x, y, z);
-
-        Line3D(x, y, z + d, x + w, y, z + d);
-        Line3D(x + w, y, z + d, x + w, y + h, z + d);
-        Line3D(x + w, y + h, z + d, x, y + h, z + d);
-        Line3D(x, y + h, z + d, x, y, z + d);
-
-        Line3D(x, y, z, x, y, z + d);
-        Line3D(x + w, y, z, x + w, y, z + d);
-        Line3D(x + w, y + h, z, x + w, y + h, z + d);
-        Line3D(x, y + h, z, x, y + h, z + d);
+        box.Transform(modelMatrix);
     }
-    else
+    if (getFrustum().BoxInside(box))
     {
-        SetMode(TRIANGLES);
-        Vertex3f(x - w / 2, y - h / 2, z + d / 2); // Bottom Left
-        Vertex3f(x + w / 2, y - h / 2, z + d / 2); // Bottom Right
-        Vertex3f(x - w / 2, y + h / 2, z + d / 2); // Top Left
-
-        Vertex3f(x + w / 2, y + h / 2, z + d / 2); // Top Right
-        Vertex3f(x - w / 2, y + h / 2, z + d / 2); // Top Left
-        Vertex3f(x + w / 2, y - h / 2, z + d / 2); // Bottom Right
-
-        // Back face
-        Vertex3f(x - w / 2, y - h / 2, z - d / 2); // Bottom Left
-        Vertex3f(x - w / 2, y + h / 2, z - d / 2); // Top Left
-        Vertex3f(x + w / 2, y - h / 2, z - d / 2); // Bottom Right
-
-        Vertex3f(x + w / 2, y + h / 2, z - d / 2); // Top Right
-        Vertex3f(x + w / 2, y - h / 2, z - d / 2); // Bottom Right
-        Vertex3f(x - w / 2, y + h / 2, z - d / 2); // Top Left
+        cullStats.rejected++;
+        return true;
+    }
+    cullStats.accepted++;
+    return false;
+}
 
-        // Top face
-        Vertex3f(x - w / 2, y + h / 2, z - d / 2); // Top Left
-        Vertex3f(x - w / 2, y + h / 2, z + d / 2); // Bottom Left
-        Vertex3f(x + w / 2, y + h / 2, z + d / 2); // Bottom Right
+bool RenderBatch::cullSphere(const Vec3 &center, float radius)
+{
+    Vec3 position = center;
+    if (use_matrix)
+    {
+        position = modelMatrix * center;
+        const float *m = modelMatrix.x;
+        const float scale = std::max(m[0] * m[0] + m[1] * m[1] + m[2] * m[2],
+                            std::max(m[4] * m[4] + m[5] * m[5] + m[6] * m[6],
+                                     m[8] * m[8] + m[9] * m[9] + m[10] * m[10]));
+        radius *= sqrtf(scale);
+    }
+    if (getFrustum().SphereInside(position, fabsf(radius)))
+    {
+        cullStats.rejected++;
+        return true;
+    }
+    cullStats.accepted++;
+    return false;
+}
 
-        Vertex3f(x + w / 2, y + h / 2, z - d / 2); // Top Right
-        Vertex3f(x - w / 2, y + h / 2, z - d / 2); // Top Left
-        Vertex3f(x + w / 2, y + h / 2, z + d / 2); // Bottom Right
+//*****************************************************************************
+// Primitive templates: unit shapes built once per (shape, detail, wire),
+// every call only scales/moves them into the batch
+//*****************************************************************************
 
-        // Bottom face
-        Vertex3f(x - w / 2, y - h / 2, z - d / 2); // Top Left
-        Vertex3f(x + w / 2, y - h / 2, z + d / 2); // Bottom Right
-        Vertex3f(x - w / 2, y - h / 2, z + d / 2); // Bottom Left
+enum PrimitiveShape
+{
+    PRIMITIVE_CUBE = 1,
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_HEMISPHERE,
+    PRIMITIVE_HEMISPHERE_DOWN,
+    PRIMITIVE_CONE,
+    PRIMITIVE_CYLINDER,
+};
+
+struct PrimitiveTemplate
+{
+    int mode;                   // LINES or TRIANGLES
+    std::vector<float> points;  // x, y, z, 1
+    int count() const { return (int)points.size() / 4; }
+    void add(float x, float y, float z)
+    {
+        points.push_back(x);
+        points.push_back(y);
+        points.push_back(z);
+        points.push_back(1.0f);
+    }
+    void add(const Vec3 &p) { add(p.x, p.y, p.z); }
+};
 
-        Vertex3f(x + w / 2, y - h / 2, z - d / 2); // Top Right
-        Vertex3f(x + w / 2, y - h / 2, z + d / 2); // Bottom Right
-        Vertex3f(x - w / 2, y - h / 2, z - d / 2); // Top Left
+static std::unordered_map<u64, PrimitiveTemplate> s_primitives;
 
-        // Right face
-        Vertex3f(x + w / 2, y - h / 2, z - d / 2); // Bottom Right
-        Vertex3f(x + w / 2, y + h / 2, z - d / 2); // Top Right
-        Vertex3f(x + w / 2, y + h / 2, z + d / 2); // Top Left
+static Vec3 spherePoint(float theta, float phi)
+{
+    return Vec3(sinf(theta) * cosf(phi), sinf(theta) * sinf(phi), cosf(theta));
+}
 
-        Vertex3f(x + w / 2, y - h / 2, z + d / 2); // Bottom Left
-        Vertex3f(x + w / 2, y - h / 2, z - d / 2); // Bottom Right
-        Vertex3f(x + w / 2, y + h / 2, z + d / 2); // Top Left
+// y up, pole at theta 0, equator at pi/2
+static Vec3 hemispherePoint(float theta, float phi)
+{
+    return Vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+}
 
-        // Left face
-        Vertex3f(x - w / 2, y - h / 2, z - d / 2); // Bottom Right
-        Vertex3f(x - w / 2, y + h / 2, z + d / 2); // Top Left
-        Vertex3f(x - w / 2, y + h / 2, z - d / 2); // Top Right
+static Vec3 circlePoint(int i, int segments, float y)
+{
+    const float theta = i * TwoPi / segments;
+    return Vec3(cosf(theta), y, sinf(theta));
+}
 
-        Vertex3f(x - w / 2, y - h / 2, z + d / 2); // Bottom Left
-        Vertex3f(x - w / 2, y + h / 2, z + d / 2); // Top Left
-        Vertex3f(x - w / 2, y - h / 2, z - d / 2); // Bottom Right
+static void buildCube(PrimitiveTemplate &t, bool wire)
+{
+    if (wire)
+    {
+        // corner at the origin, like the old Line3D version
+        static const float edges[12][6] = {
+            {0, 0, 0, 1, 0, 0}, {1, 0, 0, 1, 1, 0}, {1, 1, 0, 0, 1, 0}, {0, 1, 0, 0, 0, 0},
+            {0, 0, 1, 1, 0, 1}, {1, 0, 1, 1, 1, 1}, {1, 1, 1, 0, 1, 1}, {0, 1, 1, 0, 0, 1},
+            {0, 0, 0, 0, 0, 1}, {1, 0, 0, 1, 0, 1}, {1, 1, 0, 1, 1, 1}, {0, 1, 0, 0, 1, 1}};
+        for (int i = 0; i < 12; i++)
+        {
+            t.add(edges[i][0], edges[i][1], edges[i][2]);
+            t.add(edges[i][3], edges[i][4], edges[i][5]);
+        }
+        return;
+    }
+    // centered, 2 triangles per face: front, back, top, bottom, right, left
+    static const float faces[36][3] = {
+        {-1, -1, 1}, {1, -1, 1}, {-1, 1, 1}, {1, 1, 1}, {-1, 1, 1}, {1, -1, 1},
+        {-1, -1, -1}, {-1, 1, -1}, {1, -1, -1}, {1, 1, -1}, {1, -1, -1}, {-1, 1, -1},
+        {-1, 1, -1}, {-1, 1, 1}, {1, 1, 1}, {1, 1, -1}, {-1, 1, -1}, {1, 1, 1},
+        {-1, -1, -1}, {1, -1, 1}, {-1, -1, 1}, {1, -1, -1}, {1, -1, 1}, {-1, -1, -1},
+        {1, -1, -1}, {1, 1, -1}, {1, 1, 1}, {1, -1, 1}, {1, -1, -1}, {1, 1, 1},
+        {-1, -1, -1}, {-1, 1, 1}, {-1, 1, -1}, {-1, -1, 1}, {-1, 1, 1}, {-1, -1, -1}};
+    for (int i = 0; i < 36; i++)
+    {
+        t.add(faces[i][0] * 0.5f, faces[i][1] * 0.5f, faces[i][2] * 0.5f);
     }
 }
 
-
-void RenderBatch::Sphere(const Vec3 &position, float radius, int rings,
-                         int slices, bool wire)
+static void buildSphere(PrimitiveTemplate &t, int rings, int slices, bool wire)
 {
-    float x = position.x;
-    float y = position.y;
-    float z = position.z;
-
-    //  float const R = 1./(float)(rings-1);
-    //   float const S = 1./(float)(slices-1);
-
     if (wire)
     {
-        SetMode(LINES);
-
-
         for (int i = 0; i < rings; ++i)
         {
-            float theta = i * M_PI / rings;
+            const float theta = i * Pi / rings;
             for (int j = 0; j < slices; ++j)
             {
-                float phi1 = j * 2 * M_PI / slices;
-                float phi2 = (j + 1) * 2 * M_PI / slices;
-
-                Vec3 v1 = Vec3(x + radius * sin(theta) * cos(phi1),
-                               y + radius * sin(theta) * sin(phi1),
-                               z + radius * cos(theta));
-
-                Vec3 v2 = Vec3(x + radius * sin(theta) * cos(phi2),
-                               y + radius * sin(theta) * sin(phi2),
-                               z + radius * cos(theta));
-
-                Line3D(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z);
+                t.add(spherePoint(theta, j * TwoPi / slices));
+                t.add(spherePoint(theta, (j + 1) * TwoPi / slices));
             }
         }
-
-        // Desenhar linhas verticais
         for (int j = 0; j < slices; ++j)
         {
-            float phi = j * 2 * M_PI / slices;
+            const float phi = j * TwoPi / slices;
             for (int i = 0; i < rings; ++i)
             {
-                float theta1 = i * M_PI / rings;
-                float theta2 = (i + 1) * M_PI / rings;
-
-                Vec3 v1 = Vec3(x + radius * sin(theta1) * cos(phi),
-                               y + radius * sin(theta1) * sin(phi),
-                               z + radius * cos(theta1));
-
-                Vec3 v2 = Vec3(x + radius * sin(theta2) * cos(phi),
-                               y + radius * sin(theta2) * sin(phi),
-                               z + radius * cos(theta2));
-
-                Line3D(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z);
+                t.add(spherePoint(i * Pi / rings, phi));
+                t.add(spherePoint((i + 1) * Pi / rings, phi));
             }
         }
+        return;
     }
-    else
+    for (int i = 0; i < rings; ++i)
     {
-
-        SetMode(TRIANGLES);
-        for (int i = 0; i < rings; ++i)
+        for (int j = 0; j < slices; ++j)
         {
-            for (int j = 0; j < slices; ++j)
-            {
-                // Calcular os v�rtices da esfera
-                float theta1 = i * M_PI / rings;
-                float theta2 = (i + 1) * M_PI / rings;
-                float phi1 = j * 2 * M_PI / slices;
-                float phi2 = (j + 1) * 2 * M_PI / slices;
-
-                Vec3 v1 = Vec3(x + radius * sin(theta1) * cos(phi1),
-                               y + radius * sin(theta1) * sin(phi1),
-                               z + radius * cos(theta1));
-
-                Vec3 v2 = Vec3(x + radius * sin(theta1) * cos(phi2),
-                               y + radius * sin(theta1) * sin(phi2),
-                               z + radius * cos(theta1));
-
-                Vec3 v3 = Vec3(x + radius * sin(theta2) * cos(phi1),
-                               y + radius * sin(theta2) * sin(phi1),
-                               z + radius * cos(theta2));
-
-                Vec3 v4 = Vec3(x + radius * sin(theta2) * cos(phi2),
-                               y + radius * sin(theta2) * sin(phi2),
-                               z + radius * cos(theta2));
-
-                // Desenhar os tri�ngulos da esfera
-                Vertex3f(v1.x, v1.y, v1.z);
-                Vertex3f(v2.x, v2.y, v2.z);
-                Vertex3f(v3.x, v3.y, v3.z);
-
-                Vertex3f(v2.x, v2.y, v2.z);
-                Vertex3f(v4.x, v4.y, v4.z);
-                Vertex3f(v3.x, v3.y, v3.z);
-            }
+            const float theta1 = i * Pi / rings;
+            const float theta2 = (i + 1) * Pi / rings;
+            const float phi1 = j * TwoPi / slices;
+            const float phi2 = (j + 1) * TwoPi / slices;
+            const Vec3 v1 = spherePoint(theta1, phi1);
+            const Vec3 v2 = spherePoint(theta1, phi2);
+            const Vec3 v3 = spherePoint(theta2, phi1);
+            const Vec3 v4 = spherePoint(theta2, phi2);
+            t.add(v1); t.add(v2); t.add(v3);
+            t.add(v2); t.add(v4); t.add(v3);
         }
     }
 }
 
-void RenderBatch::Cone(const Vec3 &position, float radius, float height,
-                       int segments, bool wire)
+// wound like the sphere and the cylinder. down: pole at y -1, mirrored with the
+// same facing (a -y scale would flip the winding)
+static void buildHemisphere(PrimitiveTemplate &t, int rings, int slices, bool wire, bool down)
 {
-    float x = position.x;
-    float y = position.y;
-    float z = position.z;
-
+    const float step = Pi * 0.5f / rings;
+    auto point = [down](float theta, float phi)
+    {
+        Vec3 p = hemispherePoint(theta, phi);
+        if (down) p.y = -p.y;
+        return p;
+    };
     if (wire)
     {
-        SetMode(LINES);
-
-        // Desenhar linhas que formam a base do cone
-        for (int i = 0; i < segments; ++i)
+        for (int i = 1; i <= rings; ++i)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
-
-            Vec3 v1 =
-                Vec3(x + radius * cos(theta1), y, z + radius * sin(theta1));
-
-            Vec3 v2 =
-                Vec3(x + radius * cos(theta2), y, z + radius * sin(theta2));
-
-            Line3D(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z);
+            for (int j = 0; j < slices; ++j)
+            {
+                t.add(point(i * step, j * TwoPi / slices));
+                t.add(point(i * step, (j + 1) * TwoPi / slices));
+            }
         }
-
-        // Desenhar linhas que conectam a base ao v�rtice do cone
-        Vec3 vertex = Vec3(x, y + height, z);
-        for (int i = 0; i < segments; ++i)
+        for (int j = 0; j < slices; ++j)
         {
-            float theta = i * 2 * M_PI / segments;
-
-            Vec3 base =
-                Vec3(x + radius * cos(theta), y, z + radius * sin(theta));
-
-            Line3D(base.x, base.y, base.z, vertex.x, vertex.y, vertex.z);
+            for (int i = 0; i < rings; ++i)
+            {
+                t.add(point(i * step, j * TwoPi / slices));
+                t.add(point((i + 1) * step, j * TwoPi / slices));
+            }
         }
+        return;
     }
-    else
+    for (int i = 0; i < rings; ++i)
     {
-        SetMode(TRIANGLES);
-        Vec3 vertex = Vec3(x, y + height, z);
-
-        // Desenhar tri�ngulos para formar as faces do cone
-        for (int i = 0; i < segments; ++i)
+        for (int j = 0; j < slices; ++j)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
-
-            Vec3 base1 =
-                Vec3(x + radius * cos(theta1), y, z + radius * sin(theta1));
-
-            Vec3 base2 =
-                Vec3(x + radius * cos(theta2), y, z + radius * sin(theta2));
-
-            // Tri�ngulo formado pela base do cone e o v�rtice
-            Vertex3f(base1.x, base1.y, base1.z);
-            Vertex3f(base2.x, base2.y, base2.z);
-            Vertex3f(vertex.x, vertex.y, vertex.z);
+            const Vec3 v1 = point(i * step, j * TwoPi / slices);
+            const Vec3 v2 = point(i * step, (j + 1) * TwoPi / slices);
+            const Vec3 v3 = point((i + 1) * step, j * TwoPi / slices);
+            const Vec3 v4 = point((i + 1) * step, (j + 1) * TwoPi / slices);
+            if (down)
+            {
+                t.add(v1); t.add(v2); t.add(v3);
+                t.add(v2); t.add(v4); t.add(v3);
+            }
+            else
+            {
+                t.add(v1); t.add(v3); t.add(v2);
+                t.add(v2); t.add(v3); t.add(v4);
+            }
         }
     }
 }
 
-
-void RenderBatch::Cylinder(const Vec3 &position, float radius, float height,
-                           int segments, bool wire)
+// base circle at y 0, apex at y 1
+static void buildCone(PrimitiveTemplate &t, int segments, bool wire)
 {
-    float x = position.x;
-    float y = position.y;
-    float z = position.z;
-
-    if (wire)
+    const Vec3 apex(0.0f, 1.0f, 0.0f);
+    for (int i = 0; i < segments; ++i)
     {
-        for (int i = 0; i < segments; ++i)
+        const Vec3 base1 = circlePoint(i, segments, 0.0f);
+        const Vec3 base2 = circlePoint(i + 1, segments, 0.0f);
+        if (wire)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
-
-            Vec3 base1 =
-                Vec3(x + radius * cos(theta1), y, z + radius * sin(theta1));
-
-            Vec3 base2 =
-                Vec3(x + radius * cos(theta2), y, z + radius * sin(theta2));
-
-            Line3D(base1.x, base1.y, base1.z, base2.x, base2.y, base2.z);
+            t.add(base1); t.add(base2);
+            t.add(base1); t.add(apex);
         }
-
-        // Desenhar linhas que formam a base superior do cilindro
-        for (int i = 0; i < segments; ++i)
+        else
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
-
-            Vec3 top1 = Vec3(x + radius * cos(theta1), y + height,
-                             z + radius * sin(theta1));
-
-            Vec3 top2 = Vec3(x + radius * cos(theta2), y + height,
-                             z + radius * sin(theta2));
-
-            Line3D(top1.x, top1.y, top1.z, top2.x, top2.y, top2.z);
+            t.add(base1); t.add(base2); t.add(apex);
         }
+    }
+}
 
-        // Desenhar linhas que conectam a base inferior � superior
-        for (int i = 0; i < segments; ++i)
+// caps at y 0 and y 1
+static void buildCylinder(PrimitiveTemplate &t, int segments, bool wire)
+{
+    for (int i = 0; i < segments; ++i)
+    {
+        const Vec3 base1 = circlePoint(i, segments, 0.0f);
+        const Vec3 base2 = circlePoint(i + 1, segments, 0.0f);
+        const Vec3 top1 = circlePoint(i, segments, 1.0f);
+        const Vec3 top2 = circlePoint(i + 1, segments, 1.0f);
+        if (wire)
+        {
+            t.add(base1); t.add(base2);
+            t.add(top1); t.add(top2);
+            t.add(base1); t.add(top1);
+        }
+        else
         {
-            float theta = i * 2 * M_PI / segments;
+            t.add(0.0f, 0.0f, 0.0f); t.add(base1); t.add(base2);
+            t.add(0.0f, 1.0f, 0.0f); t.add(top2); t.add(top1);
+            t.add(base1); t.add(base2); t.add(top2);
+            t.add(base1); t.add(top2); t.add(top1);
+        }
+    }
+}
 
-            Vec3 base =
-                Vec3(x + radius * cos(theta), y, z + radius * sin(theta));
+static const PrimitiveTemplate &getPrimitive(int shape, int a, int b, bool wire)
+{
+    const u64 key = (u64)shape | ((u64)wire << 8) | ((u64)(u32)a << 16) | ((u64)(u32)b << 40);
+    auto it = s_primitives.find(key);
+    if (it != s_primitives.end())
+    {
+        return it->second;
+    }
+    PrimitiveTemplate &t = s_primitives[key];
+    t.mode = wire ? LINES : TRIANGLES;
+    switch (shape)
+    {
+        case PRIMITIVE_CUBE: buildCube(t, wire); break;
+        case PRIMITIVE_SPHERE: buildSphere(t, a, b, wire); break;
+        case PRIMITIVE_HEMISPHERE: buildHemisphere(t, a, b, wire, false); break;
+        case PRIMITIVE_HEMISPHERE_DOWN: buildHemisphere(t, a, b, wire, true); break;
+        case PRIMITIVE_CONE: buildCone(t, a, wire); break;
+        case PRIMITIVE_CYLINDER: buildCylinder(t, a, wire); break;
+    }
+    return t;
+}
 
-            Vec3 top = Vec3(x + radius * cos(theta), y + height,
-                            z + radius * sin(theta));
+static_assert(offsetof(BatchVertex, u) == 3 * sizeof(float), "emitPrimitive stores x, y, z, u in one go");
 
-            Line3D(base.x, base.y, base.z, top.x, top.y, top.z);
+// Bulk Vertex3f: p' = modelMatrix * (position + scale * p), 4 wide. Splits
+// on whole primitives when the segment fills up.
+void RenderBatch::emitPrimitive(const float *points, int count, int mode,
+                                const Vec3 &position, const Vec3 &scale)
+{
+    // columns of the affine transform
+    float m[16] = {scale.x, 0.0f, 0.0f, 0.0f,
+                   0.0f, scale.y, 0.0f, 0.0f,
+                   0.0f, 0.0f, scale.z, 0.0f,
+                   position.x, position.y, position.z, 1.0f};
+    if (use_matrix)
+    {
+        const float *model = modelMatrix.x;
+        float combined[16];
+        for (int col = 0; col < 4; col++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                combined[col * 4 + row] = model[row] * m[col * 4] + model[4 + row] * m[col * 4 + 1]
+                    + model[8 + row] * m[col * 4 + 2] + model[12 + row] * m[col * 4 + 3];
+            }
         }
+        memcpy(m, combined, sizeof(m));
     }
-    else
+    const simd4f c0 = Simd_Load(m);
+    const simd4f c1 = Simd_Load(m + 4);
+    const simd4f c2 = Simd_Load(m + 8);
+    const simd4f c3 = Simd_Load(m + 12);
+
+    SetMode(mode);
+    const int per = (mode == LINES) ? 2 : 3;
+    while (count > 0)
     {
-        SetMode(TRIANGLES);
-
-        // Desenhar a base inferior do cilindro
-        for (int i = 0; i < segments; ++i)
+        int space = elementCount * 4 - vertexCounter;
+        space -= space % per;
+        if (space <= 0)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
-
-            Vec3 base1 =
-                Vec3(x + radius * cos(theta1), y, z + radius * sin(theta1));
-
-            Vec3 base2 =
-                Vec3(x + radius * cos(theta2), y, z + radius * sin(theta2));
-
-            Vertex3f(x, y, z); // Centro da base inferior
-            Vertex3f(base1.x, base1.y, base1.z);
-            Vertex3f(base2.x, base2.y, base2.z);
+            flush();
+            continue;
         }
-
-        // Desenhar a base superior do cilindro
-        for (int i = 0; i < segments; ++i)
+        const int n = std::min(count, space);
+        BatchVertex *v = &vertices[vertexCounter];
+        for (int i = 0; i < n; i++, points += 4)
         {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
-
-            Vec3 top1 = Vec3(x + radius * cos(theta1), y + height,
-                             z + radius * sin(theta1));
-
-            Vec3 top2 = Vec3(x + radius * cos(theta2), y + height,
-                             z + radius * sin(theta2));
-
-            Vertex3f(x, y + height, z); // Centro da base superior
-            Vertex3f(top2.x, top2.y, top2.z);
-            Vertex3f(top1.x, top1.y, top1.z);
+            const simd4f p = Simd_MulAdd(c0, Simd_Set1(points[0]),
+                             Simd_MulAdd(c1, Simd_Set1(points[1]),
+                             Simd_MulAdd(c2, Simd_Set1(points[2]), c3)));
+            // x, y, z and u are contiguous: u is written right after
+            Simd_Store(&v[i].x, p);
+            v[i].u = texcoordx;
+            v[i].v = texcoordy;
+            v[i].r = colorr;
+            v[i].g = colorg;
+            v[i].b = colorb;
+            v[i].a = colora;
+            v[i].slot = textureSlot;
         }
+        vertexCounter += n;
+        draws[drawCounter - 1].vertexCount += n;
+        count -= n;
+    }
+}
 
-        // Desenhar a superf�cie lateral do cilindro
-        for (int i = 0; i < segments; ++i)
-        {
-            float theta1 = i * 2 * M_PI / segments;
-            float theta2 = (i + 1) * 2 * M_PI / segments;
+void RenderBatch::Cube(const Vec3 &position, float w, float h, float d,
+                       bool wire)
+{
+    if (culling)
+    {
+        // wire: corner at position, solid: centered
+        const Vec3 size(w, h, d);
+        const Vec3 a = wire ? position : position - size * 0.5f;
+        const Vec3 b = wire ? position + size : position + size * 0.5f;
+        if (cullBox(a.Min(b), a.Max(b))) return;
+    }
+    const PrimitiveTemplate &t = getPrimitive(PRIMITIVE_CUBE, 0, 0, wire);
+    emitPrimitive(t.points.data(), t.count(), t.mode, position, Vec3(w, h, d));
+}
 
-            Vec3 base1 =
-                Vec3(x + radius * cos(theta1), y, z + radius * sin(theta1));
 
-            Vec3 base2 =
-                Vec3(x + radius * cos(theta2), y, z + radius * sin(theta2));
+void RenderBatch::Sphere(const Vec3 &position, float radius, int rings,
+                         int slices, bool wire)
+{
+    if (rings < 1 || slices < 1) return;
+    if (culling && cullSphere(position, radius)) return;
+    const PrimitiveTemplate &t = getPrimitive(PRIMITIVE_SPHERE, rings, slices, wire);
+    emitPrimitive(t.points.data(), t.count(), t.mode, position, Vec3(radius, radius, radius));
+}
 
-            Vec3 top1 = Vec3(x + radius * cos(theta1), y + height,
-                             z + radius * sin(theta1));
+void RenderBatch::Cone(const Vec3 &position, float radius, float height,
+                       int segments, bool wire)
+{
+    if (segments < 1) return;
+    if (culling && cullBox(Vec3(position.x - fabsf(radius), std::min(position.y, position.y + height), position.z - fabsf(radius)),
+                           Vec3(position.x + fabsf(radius), std::max(position.y, position.y + height), position.z + fabsf(radius))))
+    {
+        return;
+    }
+    const PrimitiveTemplate &t = getPrimitive(PRIMITIVE_CONE, segments, 0, wire);
+    emitPrimitive(t.points.data(), t.count(), t.mode, position, Vec3(radius, height, radius));
+}
 
-            Vec3 top2 = Vec3(x + radius * cos(theta2), y + height,
-                             z + radius * sin(theta2));
 
-            // Tri�ngulo lateral inferior
-            Vertex3f(base1.x, base1.y, base1.z);
-            Vertex3f(base2.x, base2.y, base2.z);
-            Vertex3f(top2.x, top2.y, top2.z);
+void RenderBatch::Cylinder(const Vec3 &position, float radius, float height,
+                           int segments, bool wire)
+{
+    if (segments < 1) return;
+    if (culling && cullBox(Vec3(position.x - fabsf(radius), std::min(position.y, position.y + height), position.z - fabsf(radius)),
+                           Vec3(position.x + fabsf(radius), std::max(position.y, position.y + height), position.z + fabsf(radius))))
+    {
+        return;
+    }
+    const PrimitiveTemplate &t = getPrimitive(PRIMITIVE_CYLINDER, segments, 0, wire);
+    emitPrimitive(t.points.data(), t.count(), t.mode, position, Vec3(radius, height, radius));
+}
 
-            // Tri�ngulo lateral superior
-            Vertex3f(base1.x, base1.y, base1.z);
-            Vertex3f(top2.x, top2.y, top2.z);
-            Vertex3f(top1.x, top1.y, top1.z);
-        }
+// centered on position along y, height includes the two hemispheres (like MeshManager::CreateCapsule)
+void RenderBatch::Capsule(const Vec3 &position, float radius, float height,
+                          int segments, bool wire)
+{
+    if (segments < 3) segments = 3;
+    if (culling)
+    {
+        const Vec3 extent(fabsf(radius), std::max(fabsf(height) * 0.5f, fabsf(radius)), fabsf(radius));
+        if (cullBox(position - extent, position + extent)) return;
+    }
+    const int rings = std::max(2, segments / 4);
+    const float body = std::max(height - 2.0f * radius, 0.0f);
+    const Vec3 top(position.x, position.y + body * 0.5f, position.z);
+    const Vec3 bottom(position.x, position.y - body * 0.5f, position.z);
+
+    const PrimitiveTemplate &cap = getPrimitive(PRIMITIVE_HEMISPHERE, rings, segments, wire);
+    emitPrimitive(cap.points.data(), cap.count(), cap.mode, top, Vec3(radius, radius, radius));
+    const PrimitiveTemplate &lower = getPrimitive(PRIMITIVE_HEMISPHERE_DOWN, rings, segments, wire);
+    emitPrimitive(lower.points.data(), lower.count(), lower.mode, bottom, Vec3(radius, radius, radius));
+    if (body > 0.0f)
+    {
+        const PrimitiveTemplate &side = getPrimitive(PRIMITIVE_CYLINDER, segments, 0, wire);
+        emitPrimitive(side.points.data(), side.count(), side.mode, bottom, Vec3(radius, body, radius));
     }
 }
 
 void RenderBatch::Triangle(const Vec3 &p1, const Vec3 &p2, const Vec3 &p3)
 {
+    if (culling && cullBox(p1.Min(p2).Min(p3), p1.Max(p2).Max(p3))) return;
     SetMode(QUAD);
 
     Vertex3f(p1.x, p1.y, p1.z);
@@ -1103,14 +1469,19 @@ void RenderBatch::Triangle(const Vec3 &p1, const Vec3 &p2, const Vec3 &p3)
 
 void RenderBatch::TriangleLines(const Vec3 &p1, const Vec3 &p2, const Vec3 &p3)
 {
-
-    Line3D(p1.x, p1.y, p1.z, p2.x, p2.y, p2.z);
-    Line3D(p2.x, p2.y, p2.z, p3.x, p3.y, p3.z);
-    Line3D(p3.x, p3.y, p3.z, p1.x, p1.y, p1.z);
+    if (culling && cullBox(p1.Min(p2).Min(p3), p1.Max(p2).Max(p3))) return;
+    SetMode(LINES);
+    Vertex3f(p1.x, p1.y, p1.z);
+    Vertex3f(p2.x, p2.y, p2.z);
+    Vertex3f(p2.x, p2.y, p2.z);
+    Vertex3f(p3.x, p3.y, p3.z);
+    Vertex3f(p3.x, p3.y, p3.z);
+    Vertex3f(p1.x, p1.y, p1.z);
 }
 void RenderBatch::Triangle(const Vec3 &p1, const Vec3 &p2, const Vec3 &p3,
                            const Vec2 &t1, const Vec2 &t2, const Vec2 &t3)
 {
+    if (culling && cullBox(p1.Min(p2).Min(p3), p1.Max(p2).Max(p3))) return;
     SetMode(QUAD);
 
     TexCoord2f(t1.x, t1.y);
@@ -1201,6 +1572,22 @@ void RenderBatch::Quad(const Vec2 *coords, const Vec2 *texcoords)
     Vertex2f(coords[3].x, coords[3].y);
 }
 
+void RenderBatch::DistanceFieldQuad(unsigned int texture, float x, float y, float width, float height,
+                                    float u0, float v0, float u1, float v1)
+{
+    SetMode(sdfShader ? SDF_QUAD : QUAD);
+    SetTexture(texture);
+
+    TexCoord2f(u0, v0);
+    Vertex2f(x, y);
+    TexCoord2f(u0, v1);
+    Vertex2f(x, y + height);
+    TexCoord2f(u1, v1);
+    Vertex2f(x + width, y + height);
+    TexCoord2f(u1, v0);
+    Vertex2f(x + width, y);
+}
+
 void RenderBatch::SetTexture(Texture2D *texture)
 {
     if (texture != nullptr)
@@ -1227,70 +1614,35 @@ void RenderBatch::Quad(Texture2D *texture, const Vec2 *coords,
     {
         SetTexture(defaultTextureId);
     }
+    if (texture != nullptr && texture->IsAtlased())
+    {
+        Vec2 mapped[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            mapped[i] = texture->MapUV(texcoords[i].x, texcoords[i].y);
+        }
+        Quad(coords, mapped);
+        return;
+    }
     Quad(coords, texcoords);
 }
 
 void RenderBatch::Quad(u32 texture, float x, float y, float width, float height)
 {
-
-    float left = 0;
-    float right = 1;
-    float top = 0;
-    float bottom = 1;
-
-
     SetTexture(texture);
-
-
-    float x1 = x;
-    float y1 = y;
-    float x2 = x;
-    float y2 = y + height;
-    float x3 = x + width;
-    float y3 = y + height;
-    float x4 = x + width;
-    float y4 = y;
-
-    Vec2 coords[4];
-    Vec2 texcoords[4];
-
-
-    coords[0].x = x1;
-    coords[0].y = y1;
-    coords[1].x = x2;
-    coords[1].y = y2;
-    coords[2].x = x3;
-    coords[2].y = y3;
-    coords[3].x = x4;
-    coords[3].y = y4;
-
-    texcoords[0].x = left;
-    texcoords[0].y = top;
-    texcoords[1].x = left;
-    texcoords[1].y = bottom;
-    texcoords[2].x = right;
-    texcoords[2].y = bottom;
-    texcoords[3].x = right;
-    texcoords[3].y = top;
-
-
-    Quad(coords, texcoords);
+    Sprite(x, y, width, height, 0.0f, 0.0f, 1.0f, 1.0f);
 }
 
 void RenderBatch::Quad(Texture2D *texture, float x, float y, float width,
                        float height)
 {
-
-
     float left = 0;
     float right = 1;
     float top = 0;
     float bottom = 1;
 
-
     if (texture != nullptr)
     {
-
         SetTexture(texture->GetID());
     }
     else
@@ -1298,54 +1650,33 @@ void RenderBatch::Quad(Texture2D *texture, float x, float y, float width,
         SetTexture(defaultTextureId);
     }
 
+    // imagens no atlas: o rect UV dentro da pagina
+    if (texture != nullptr && texture->IsAtlased())
+    {
+        const FloatRect &uv = texture->GetAtlasUV();
+        left = uv.x + left * uv.width;
+        right = uv.x + right * uv.width;
+        top = uv.y + top * uv.height;
+        bottom = uv.y + bottom * uv.height;
+    }
 
-    float x1 = x;
-    float y1 = y;
-    float x2 = x;
-    float y2 = y + height;
-    float x3 = x + width;
-    float y3 = y + height;
-    float x4 = x + width;
-    float y4 = y;
-
-    Vec2 coords[4];
-    Vec2 texcoords[4];
-
-
-    coords[0].x = x1;
-    coords[0].y = y1;
-    coords[1].x = x2;
-    coords[1].y = y2;
-    coords[2].x = x3;
-    coords[2].y = y3;
-    coords[3].x = x4;
-    coords[3].y = y4;
-
-    texcoords[0].x = left;
-    texcoords[0].y = top;
-    texcoords[1].x = left;
-    texcoords[1].y = bottom;
-    texcoords[2].x = right;
-    texcoords[2].y = bottom;
-    texcoords[3].x = right;
-    texcoords[3].y = top;
-
-
-    Quad(coords, texcoords);
+    Sprite(x, y, width, height, left, top, right, bottom);
 }
 
-
 void RenderBatch::Quad(Texture2D *texture, const FloatRect &src, float x,
                        float y, float width, float height)
 {
+    Sprite(texture, src, x, y, width, height);
+}
 
-
+void RenderBatch::Sprite(Texture2D *texture, const FloatRect &src, float x,
+                         float y, float width, float height, float rotation)
+{
     float left = 0;
     float right = 1;
     float top = 0;
     float bottom = 1;
 
-
     int widthTex = 1;
     int heightTex = 1;
 
@@ -1356,46 +1687,83 @@ void RenderBatch::Quad(Texture2D *texture, const FloatRect &src, float x,
         SetTexture(texture->GetID());
     }
 
-
     left = (2.0f * src.x + 1.0f) / (2.0f * widthTex);
     right = left + (src.width * 2.0f - 2.0f) / (2.0f * widthTex);
     top = (2.0f * src.y + 1.0f) / (2 * heightTex);
     bottom = top + (src.height * 2.0f - 2.0f) / (2.0f * heightTex);
 
+    // imagens no atlas: o rect UV dentro da pagina
+    if (texture != nullptr && texture->IsAtlased())
+    {
+        const FloatRect &uv = texture->GetAtlasUV();
+        left = uv.x + left * uv.width;
+        right = uv.x + right * uv.width;
+        top = uv.y + top * uv.height;
+        bottom = uv.y + bottom * uv.height;
+    }
 
-    float x1 = x;
-    float y1 = y;
-    float x2 = x;
-    float y2 = y + height;
-    float x3 = x + width;
-    float y3 = y + height;
-    float x4 = x + width;
-    float y4 = y;
-
-    Vec2 coords[4];
-    Vec2 texcoords[4];
-
+    Sprite(x, y, width, height, left, top, right, bottom, rotation);
+}
 
-    coords[0].x = x1;
-    coords[0].y = y1;
-    coords[1].x = x2;
-    coords[1].y = y2;
-    coords[2].x = x3;
-    coords[2].y = y3;
-    coords[3].x = x4;
-    coords[3].y = y4;
+static inline u16 unitToU16(float value)
+{
+    return (u16)(value * 65535.0f + 0.5f);
+}
 
-    texcoords[0].x = left;
-    texcoords[0].y = top;
-    texcoords[1].x = left;
-    texcoords[1].y = bottom;
-    texcoords[2].x = right;
-    texcoords[2].y = bottom;
-    texcoords[3].x = right;
-    texcoords[3].y = top;
+void RenderBatch::Sprite(float x, float y, float width, float height,
+                         float u0, float v0, float u1, float v1, float rotation)
+{
+    const unsigned int textureId = draws[drawCounter - 1].textureId;
+    const bool packable = u0 >= 0.0f && u0 <= 1.0f && u1 >= 0.0f && u1 <= 1.0f
+        && v0 >= 0.0f && v0 <= 1.0f && v1 >= 0.0f && v1 <= 1.0f;
 
+    if (!IsInstancing() || use_matrix || recordingStatic || !packable)
+    {
+        // 4 vertices, same corner order as the instanced unit quad
+        static const float corners[4][2] = {{0.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, 0.0f}};
+        float c = 1.0f;
+        float s = 0.0f;
+        if (rotation != 0.0f)
+        {
+            c = cosf(degToRad(rotation));
+            s = sinf(degToRad(rotation));
+        }
+        const float cx = x + width * 0.5f;
+        const float cy = y + height * 0.5f;
+        if (draws[drawCounter - 1].mode != QUAD) setDrawState(QUAD, textureId);
+        for (int i = 0; i < 4; i++)
+        {
+            const float lx = (corners[i][0] - 0.5f) * width;
+            const float ly = (corners[i][1] - 0.5f) * height;
+            TexCoord2f(u0 + (u1 - u0) * corners[i][0], v0 + (v1 - v0) * corners[i][1]);
+            Vertex2f(cx + lx * c - ly * s, cy + lx * s + ly * c);
+        }
+        return;
+    }
 
-    Quad(coords, texcoords);
+    if (draws[drawCounter - 1].mode != SPRITE) setDrawState(SPRITE, textureId);
+    if (instanceCounter >= elementCount) flush();
+
+    float turns = rotation / 360.0f;
+    turns -= floorf(turns);
+
+    BatchInstance &instance = instances[instanceCounter++];
+    instance.x = x;
+    instance.y = y;
+    instance.width = width;
+    instance.height = height;
+    instance.u0 = unitToU16(u0);
+    instance.v0 = unitToU16(v0);
+    instance.u1 = unitToU16(u1);
+    instance.v1 = unitToU16(v1);
+    instance.r = colorr;
+    instance.g = colorg;
+    instance.b = colorb;
+    instance.a = colora;
+    instance.rotation = unitToU16(turns);
+    instance.slot = textureSlot;
+    instance.pad = 0;
+    draws[drawCounter - 1].vertexCount++;
 }
 
 
@@ -1432,6 +1800,10 @@ Font::Font()
     textLineSpacing = 15;
     m_recs.clear();
     m_glyphs.clear();
+    buildGlyphLookup();
+    m_layoutCapacity = FONT_LAYOUT_CACHE;
+    m_layoutHits = 0;
+    m_layoutMisses = 0;
 
     batch = nullptr;
 }
@@ -1448,6 +1820,9 @@ void Font::Release()
     }
     m_recs.clear();
     m_glyphs.clear();
+    m_glyphCount = 0;
+    buildGlyphLookup();
+    clearLayouts();
 }
 
 void Font::SetClip(int x, int y, int w, int h)
@@ -1628,58 +2003,7 @@ int GetCodepointNext(const char *text, int *codepointSize)
 
 Vec2 Font::GetTextSize(const char *text)
 {
-
-    Vec2 textSize;
-
-
-    int size = (int)strlen(text); // Get size in bytes of text
-    int tempByteCounter = 0; // Used to count longer text line num chars
-    int byteCounter = 0;
-
-    float textWidth = 0.0f;
-    float tempTextWidth = 0.0f; // Used to count longer text line width
-
-    float textHeight = (float)m_baseSize;
-    float scaleFactor = fontSize / (float)m_baseSize;
-
-    int letter = 0; // Current character
-    int index = 0; // Index position in sprite font
-
-    for (int i = 0; i < size;)
-    {
-        byteCounter++;
-
-        int next = 0;
-        letter = GetCodepointNext(&text[i], &next);
-        index = getGlyphIndex(letter);
-
-        i += next;
-
-        if (letter != '\n')
-        {
-            if (m_glyphs[index].advanceX != 0)
-                textWidth += m_glyphs[index].advanceX;
-            else
-                textWidth += (m_recs[index].width + m_glyphs[index].offsetX);
-        }
-        else
-        {
-            if (tempTextWidth < textWidth) tempTextWidth = textWidth;
-            byteCounter = 0;
-            textWidth = 0;
-            textHeight += (float)textLineSpacing;
-        }
-
-        if (tempByteCounter < byteCounter) tempByteCounter = byteCounter;
-    }
-
-    if (tempTextWidth < textWidth) tempTextWidth = textWidth;
-
-    textSize.x =
-        tempTextWidth * scaleFactor + (float)((tempByteCounter - 1) * spacing);
-    textSize.y = textHeight * scaleFactor;
-
-    return textSize;
+    return getLayout(text).size;
 }
 
 float Font::GetTextWidth(const char *text)
@@ -1834,99 +2158,267 @@ void Font::drawTexture(const FloatRect &src, float x, float y, float width,
         }
     }
 
-    batch->Quad(coords, texcoords);
+    // clipping keeps the quad axis aligned: one instance per glyph
+    batch->Sprite(coords[0].x, coords[0].y, coords[2].x - coords[0].x, coords[2].y - coords[0].y,
+                  texcoords[0].x, texcoords[0].y, texcoords[2].x, texcoords[2].y);
 }
 
 
 void Font::Print(const char *text, float x, float y)
 {
+    if (texture == nullptr)
+    {
+        LogError("Font texture is not loaded");
+        return;
+    }
+    if (batch == nullptr)
+    {
+        LogError("RenderBatch is not set");
+        return;
+    }
+
+    const TextLayout &layout = getLayout(text);
+    if (enableClip)
+    {
+        for (u32 i = 0; i < layout.glyphs.size(); i++)
+        {
+            const LayoutGlyph &g = layout.glyphs[i];
+            drawTexture(g.src, x + g.x, y + g.y, g.width, g.height);
+        }
+        return;
+    }
+    batch->SetTexture(texture->GetID());
+    for (u32 i = 0; i < layout.glyphs.size(); i++)
+    {
+        const LayoutGlyph &g = layout.glyphs[i];
+        batch->Sprite(x + g.x, y + g.y, g.width, g.height, g.u0, g.v0, g.u1, g.v1);
+    }
+}
+
+void Font::Print(float x, float y, const char *text, ...)
+{
+    char buffer[512];
+
+    va_list args;
+    va_start(args, text);
+    va_list copy;
+    va_copy(copy, args);
+    const int length = vsnprintf(buffer, sizeof(buffer), text, args);
+    va_end(args);
+    if (length < 0)
+    {
+        va_end(copy);
+        return;
+    }
+    if (length < (int)sizeof(buffer))
+    {
+        va_end(copy);
+        Print(buffer, x, y);
+        return;
+    }
+    // does not fit: format again at full size
+    std::string longText((size_t)length + 1, '\0');
+    vsnprintf(&longText[0], longText.size(), text, copy);
+    va_end(copy);
+    Print(longText.c_str(), x, y);
+}
 
+//*****************************************************************************
+// Text layout cache
+//*****************************************************************************
 
-    int size = strlen(
-        text); // Total size in bytes of the text, scanned by codepoints in loop
+void Font::SetLayoutCacheSize(u32 count)
+{
+    m_layoutCapacity = count;
+    while (m_layouts.size() > m_layoutCapacity)
+    {
+        m_layoutIndex.erase(m_layouts.back().key);
+        m_layouts.pop_back();
+    }
+}
 
-    int textOffsetY = 0; // Offset between lines (on linebreak '\n')
-    float textOffsetX = 0.0f; // Offset X to next character to draw
+void Font::clearLayouts()
+{
+    m_layouts.clear();
+    m_layoutIndex.clear();
+}
 
-    float scaleFactor = fontSize / m_baseSize; // Character quad scaling factor
+// Glyph quads from the text origin and the GetTextSize metrics, in one pass
+void Font::buildLayout(const char *text, TextLayout &layout)
+{
+    layout.glyphs.clear();
+    layout.fontSize = fontSize;
+    layout.spacing = spacing;
+    layout.size = Vec2(0.0f, 0.0f);
+    if (m_glyphCount == 0 || m_baseSize == 0) return;
+
+    const int size = (int)strlen(text);
+    const float scaleFactor = fontSize / (float)m_baseSize;
+    const int widthTex = texture ? texture->GetWidth() : 1;
+    const int heightTex = texture ? texture->GetHeight() : 1;
+
+    // Print
+    int textOffsetY = 0;
+    float textOffsetX = 0.0f;
+    // GetTextSize
+    int tempByteCounter = 0;
+    int byteCounter = 0;
+    float textWidth = 0.0f;
+    float tempTextWidth = 0.0f;
+    float textHeight = (float)m_baseSize;
 
     for (int i = 0; i < size;)
     {
-        // Get next codepoint from byte string and glyph index in font
+        byteCounter++;
         int codepointByteCount = 0;
-        int codepoint = GetCodepointNext(&text[i], &codepointByteCount);
-        int index = getGlyphIndex(codepoint);
+        const int codepoint = GetCodepointNext(&text[i], &codepointByteCount);
+        const int index = getGlyphIndex(codepoint);
+        i += codepointByteCount;
 
         if (codepoint == '\n')
         {
-            // NOTE: Line spacing is a global variable, use SetTextLineSpacing()
-            // to setup
             textOffsetY += textLineSpacing;
             textOffsetX = 0.0f;
+
+            if (tempTextWidth < textWidth) tempTextWidth = textWidth;
+            byteCounter = 0;
+            textWidth = 0;
+            textHeight += (float)textLineSpacing;
         }
         else
         {
             if ((codepoint != ' ') && (codepoint != '\t'))
             {
-                drawTextCodepoint(codepoint, x + textOffsetX, y + textOffsetY);
+                LayoutGlyph g;
+                g.src = FloatRect(m_recs[index].x - (float)m_glyphPadding,
+                                  m_recs[index].y - (float)m_glyphPadding,
+                                  m_recs[index].width + 2.0f * m_glyphPadding,
+                                  m_recs[index].height + 2.0f * m_glyphPadding);
+                g.x = textOffsetX + m_glyphs[index].offsetX * scaleFactor - (float)m_glyphPadding * scaleFactor;
+                g.y = (float)textOffsetY + m_glyphs[index].offsetY * scaleFactor - (float)m_glyphPadding * scaleFactor;
+                g.width = g.src.width * scaleFactor;
+                g.height = g.src.height * scaleFactor;
+                // same half texel inset as drawTexture
+                g.u0 = (2.0f * g.src.x + 1.0f) / (2.0f * widthTex);
+                g.u1 = g.u0 + (g.src.width * 2.0f - 2.0f) / (2.0f * widthTex);
+                g.v0 = (2.0f * g.src.y + 1.0f) / (2.0f * heightTex);
+                g.v1 = g.v0 + (g.src.height * 2.0f - 2.0f) / (2.0f * heightTex);
+                layout.glyphs.push_back(g);
             }
 
             if (m_glyphs[index].advanceX == 0)
-                textOffsetX +=
-                    ((float)m_recs[index].width * scaleFactor + spacing);
+                textOffsetX += ((float)m_recs[index].width * scaleFactor + spacing);
+            else
+                textOffsetX += ((float)m_glyphs[index].advanceX * scaleFactor + spacing);
+
+            if (m_glyphs[index].advanceX != 0)
+                textWidth += m_glyphs[index].advanceX;
             else
-                textOffsetX +=
-                    ((float)m_glyphs[index].advanceX * scaleFactor + spacing);
+                textWidth += (m_recs[index].width + m_glyphs[index].offsetX);
         }
 
-        i += codepointByteCount;
+        if (tempByteCounter < byteCounter) tempByteCounter = byteCounter;
     }
 
-    // drawTexture(FloatRect(0,0,100,100),100,100,512,256);
+    if (tempTextWidth < textWidth) tempTextWidth = textWidth;
+    layout.size.x = tempTextWidth * scaleFactor + (float)((tempByteCounter - 1) * spacing);
+    layout.size.y = textHeight * scaleFactor;
 }
 
-void Font::Print(float x, float y, const char *text, ...)
+const Font::TextLayout &Font::getLayout(const char *text)
 {
-#define MAX_TEXTFORMAT_BUFFERS                                                 \
-    4 // Maximum number of static buffers for text formatting
+    if (m_layoutCapacity == 0)
+    {
+        m_layoutMisses++;
+        buildLayout(text, m_scratchLayout);
+        return m_scratchLayout;
+    }
 
-    static char buffers[MAX_TEXTFORMAT_BUFFERS][512] = { 0 };
-    static int index = 0;
-    char *currentBuffer = buffers[index];
+    u32 sizeBits, spacingBits;
+    memcpy(&sizeBits, &fontSize, sizeof(u32));
+    memcpy(&spacingBits, &spacing, sizeof(u32));
+    u64 key = (u64)std::hash<std::string>()(text);
+    key ^= ((u64)sizeBits << 32 | spacingBits) + 0x9E3779B97F4A7C15ull + (key << 6) + (key >> 2);
 
-    memset(currentBuffer, 0, 512); // Clear buffer before using
+    auto it = m_layoutIndex.find(key);
+    if (it != m_layoutIndex.end())
+    {
+        TextLayout &layout = *it->second;
+        if (layout.fontSize == fontSize && layout.spacing == spacing && layout.text == text)
+        {
+            m_layoutHits++;
+            m_layouts.splice(m_layouts.begin(), m_layouts, it->second);
+            return layout;
+        }
+        // hash collision: the new text takes the slot
+        m_layouts.erase(it->second);
+        m_layoutIndex.erase(it);
+    }
 
-    va_list args;
-    va_start(args, text);
-    vsprintf(currentBuffer, text, args);
-    va_end(args);
-    index += 1;
-    if (index >= MAX_TEXTFORMAT_BUFFERS) index = 0;
-    Print(currentBuffer, x, y);
+    m_layoutMisses++;
+    if (m_layouts.size() >= m_layoutCapacity)
+    {
+        // reuse the oldest entry and its glyph storage
+        m_layoutIndex.erase(m_layouts.back().key);
+        m_layouts.splice(m_layouts.begin(), m_layouts, std::prev(m_layouts.end()));
+    }
+    else
+    {
+        m_layouts.emplace_front();
+    }
+    TextLayout &layout = m_layouts.front();
+    layout.key = key;
+    layout.text = text;
+    buildLayout(text, layout);
+    m_layoutIndex[key] = m_layouts.begin();
+    return layout;
 }
 
 
-int Font::getGlyphIndex(int codepoint)
+// Called once the glyphs are loaded; the first glyph wins on duplicates
+void Font::buildGlyphLookup()
 {
-    int index = 0;
-
-    int fallbackIndex = 0; // Get index of fallback glyph '?'
-
-    // Look for character index in the unordered charset
-    for (int i = 0; i < m_glyphCount; i++)
+    for (int i = 0; i < 256; i++)
     {
-        if (m_glyphs[i].value == 63) fallbackIndex = i;
-
-        if (m_glyphs[i].value == codepoint)
+        m_latin[i] = -1;
+    }
+    m_glyphPages.clear();
+    for (int i = m_glyphCount - 1; i >= 0; i--)
+    {
+        const int codepoint = m_glyphs[i].value;
+        if (codepoint < 0) continue;
+        if (codepoint < 256)
         {
-            index = i;
-            break;
+            m_latin[codepoint] = i;
+            continue;
         }
+        std::vector<s32> &page = m_glyphPages[codepoint >> 8];
+        if (page.empty())
+        {
+            page.assign(256, -1);
+        }
+        page[codepoint & 0xFF] = i;
     }
+    m_fallbackGlyph = (m_latin['?'] >= 0) ? m_latin['?'] : 0;
+    clearLayouts();
+}
 
-    if ((index == 0) && (m_glyphs[0].value != codepoint)) index = fallbackIndex;
-
-    return index;
+int Font::getGlyphIndex(int codepoint)
+{
+    if (codepoint >= 0 && codepoint < 256)
+    {
+        const s32 index = m_latin[codepoint];
+        return (index >= 0) ? index : m_fallbackGlyph;
+    }
+    if (codepoint > 0)
+    {
+        auto it = m_glyphPages.find(codepoint >> 8);
+        if (it != m_glyphPages.end() && it->second[codepoint & 0xFF] >= 0)
+        {
+            return it->second[codepoint & 0xFF];
+        }
+    }
+    return m_fallbackGlyph;
 }
 
 
@@ -2019,8 +2511,8 @@ bool Font::Load(const char *filePath)
         m_glyphPadding = 0;
 
 
-        m_glyphs.reserve(m_glyphCount);
-        m_recs.reserve(m_glyphCount);
+        m_glyphs.resize(m_glyphCount);
+        m_recs.resize(m_glyphCount);
 
 
         texture->SetMinFilter(FilterMode::Nearest);
@@ -2046,6 +2538,7 @@ bool Font::Load(const char *filePath)
             m_glyphs[i].offsetY = c.yoffset;
             m_glyphs[i].advanceX = 0;
         }
+        buildGlyphLookup();
 
 
         m_baseSize = (int)m_recs[0].height;
@@ -2099,8 +2592,8 @@ bool Font::LoadDefaultFont()
     }
 
 
-    m_glyphs.reserve(m_glyphCount);
-    m_recs.reserve(m_glyphCount);
+    m_glyphs.resize(m_glyphCount);
+    m_recs.resize(m_glyphCount);
 
     texture = new Texture2D(pixmap);
 
@@ -2144,6 +2637,7 @@ bool Font::LoadDefaultFont()
         m_glyphs[i].offsetY = 0;
         m_glyphs[i].advanceX = 0;
     }
+    buildGlyphLookup();
 
     // pixmap.Save("font.png");
 
@@ -2157,3 +2651,256 @@ bool Font::LoadDefaultFont()
 
     return true;
 }
+
+//*****************************************************************************
+// TileMapLayer
+//*****************************************************************************
+
+TileMapLayer::TileMapLayer(RenderBatch *batch, Texture2D *tileset, int tileWidth, int tileHeight)
+{
+    this->batch = batch;
+    this->tileset = tileset;
+    this->tileWidth = std::max(tileWidth, 1);
+    this->tileHeight = std::max(tileHeight, 1);
+    width = 0;
+    height = 0;
+    chunkSize = 0;
+    chunksX = 0;
+    chunksY = 0;
+    posX = 0.0f;
+    posY = 0.0f;
+    visibleChunks = 0;
+    rebuiltChunks = 0;
+}
+
+TileMapLayer::~TileMapLayer() { Release(); }
+
+bool TileMapLayer::Create(int width, int height, int chunkSize)
+{
+    if (!batch || !tileset || width <= 0 || height <= 0 || chunkSize <= 0)
+    {
+        LogError("[TILEMAP] Invalid map %dx%d (chunk %d)", width, height, chunkSize);
+        return false;
+    }
+    Release();
+    this->width = width;
+    this->height = height;
+    this->chunkSize = chunkSize;
+    chunksX = (width + chunkSize - 1) / chunkSize;
+    chunksY = (height + chunkSize - 1) / chunkSize;
+    tiles.assign((size_t)width * height, -1);
+    chunks.assign((size_t)chunksX * chunksY, 0);
+    LogInfo("[TILEMAP] %dx%d tiles, %d chunks", width, height, chunksX * chunksY);
+    return true;
+}
+
+void TileMapLayer::Release()
+{
+    if (batch)
+    {
+        for (u32 i = 0; i < chunks.size(); i++)
+        {
+            if (chunks[i] != 0) batch->ReleaseStatic(chunks[i]);
+        }
+    }
+    chunks.clear();
+    tiles.clear();
+    width = height = 0;
+    chunksX = chunksY = 0;
+}
+
+void TileMapLayer::SetTile(int x, int y, s32 tile)
+{
+    if (x < 0 || y < 0 || x >= width || y >= height) return;
+    s32 &current = tiles[(size_t)y * width + x];
+    if (current == tile) return;
+    current = tile;
+    batch->InvalidateStatic(chunks[(y / chunkSize) * chunksX + x / chunkSize]);
+}
+
+s32 TileMapLayer::GetTile(int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= width || y >= height) return -1;
+    return tiles[(size_t)y * width + x];
+}
+
+void TileMapLayer::Fill(s32 tile)
+{
+    std::fill(tiles.begin(), tiles.end(), tile);
+    for (u32 i = 0; i < chunks.size(); i++)
+    {
+        batch->InvalidateStatic(chunks[i]);
+    }
+}
+
+// chunk vertices relative to the layer, posX/posY go in the transform
+void TileMapLayer::buildChunk(int cx, int cy)
+{
+    u32 &handle = chunks[cy * chunksX + cx];
+    const int columns = std::max(tileset->GetWidth() / tileWidth, 1);
+    const int x0 = cx * chunkSize;
+    const int y0 = cy * chunkSize;
+    const int x1 = std::min(x0 + chunkSize, width);
+    const int y1 = std::min(y0 + chunkSize, height);
+
+    batch->BeginStatic(handle);
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            const s32 tile = tiles[(size_t)y * width + x];
+            if (tile < 0) continue;
+            const FloatRect src((float)((tile % columns) * tileWidth), (float)((tile / columns) * tileHeight),
+                                (float)tileWidth, (float)tileHeight);
+            batch->Quad(tileset, src, (float)(x * tileWidth), (float)(y * tileHeight), (float)tileWidth, (float)tileHeight);
+        }
+    }
+    handle = batch->EndStatic();
+    rebuiltChunks++;
+}
+
+void TileMapLayer::Render(const FloatRect &view)
+{
+    visibleChunks = 0;
+    rebuiltChunks = 0;
+    if (chunks.empty()) return;
+
+    const float chunkWidth = (float)(chunkSize * tileWidth);
+    const float chunkHeight = (float)(chunkSize * tileHeight);
+    const int cx0 = std::max((int)floorf((view.x - posX) / chunkWidth), 0);
+    const int cy0 = std::max((int)floorf((view.y - posY) / chunkHeight), 0);
+    const int cx1 = std::min((int)floorf((view.x + view.width - posX) / chunkWidth), chunksX - 1);
+    const int cy1 = std::min((int)floorf((view.y + view.height - posY) / chunkHeight), chunksY - 1);
+
+    const Mat4 transform = Mat4::Translate(posX, posY, 0.0f);
+    for (int cy = cy0; cy <= cy1; cy++)
+    {
+        for (int cx = cx0; cx <= cx1; cx++)
+        {
+            if (!batch->IsStaticValid(chunks[cy * chunksX + cx]))
+            {
+                buildChunk(cx, cy);
+            }
+            batch->DrawStatic(chunks[cy * chunksX + cx], transform);
+            visibleChunks++;
+        }
+    }
+}
+
+//*******************************************************
+// UILayer
+//*******************************************************
+
+UILayer::UILayer(RenderBatch *batch)
+{
+    this->batch = batch;
+    fbo = 0;
+    texture = 0;
+    width = 0;
+    height = 0;
+    posX = 0.0f;
+    posY = 0.0f;
+    dirty = true;
+    recording = false;
+    redraws = 0;
+    screenFBO = 0;
+    screenViewport[0] = screenViewport[1] = screenViewport[2] = screenViewport[3] = 0;
+}
+
+UILayer::~UILayer() { Release(); }
+
+bool UILayer::Create(int width, int height)
+{
+    Release();
+    if (width <= 0 || height <= 0)
+    {
+        LogError("[UILAYER] Invalid size %dx%d", width, height);
+        return false;
+    }
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previous);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        LogError("[UILAYER] Could not create FrameBuffer (0x%x)", status);
+        Release();
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+    dirty = true;
+    return true;
+}
+
+void UILayer::Release()
+{
+    if (fbo != 0) glDeleteFramebuffers(1, &fbo);
+    if (texture != 0) glDeleteTextures(1, &texture);
+    fbo = 0;
+    texture = 0;
+    width = 0;
+    height = 0;
+    dirty = true;
+}
+
+bool UILayer::Begin()
+{
+    if (!dirty || fbo == 0 || recording) return false;
+
+    // what is pending belongs to the screen
+    batch->Render();
+    screenMatrix = batch->GetMatrix();
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &screenFBO);
+    glGetIntegerv(GL_VIEWPORT, screenViewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    // alpha accumulates as coverage, so the colors end up premultiplied
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    batch->SetMatrix(Mat4::Ortho(0.0f, (float)width, (float)height, 0.0f, -1.0f, 1.0f));
+    recording = true;
+    return true;
+}
+
+void UILayer::End()
+{
+    if (!recording) return;
+    batch->Render();
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)screenFBO);
+    glViewport(screenViewport[0], screenViewport[1], screenViewport[2], screenViewport[3]);
+    batch->SetMatrix(screenMatrix);
+    recording = false;
+    dirty = false;
+    redraws++;
+}
+
+void UILayer::Render()
+{
+    if (texture == 0 || recording) return;
+
+    batch->Render();
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    batch->SetTexture(texture);
+    // rows are bottom up in the target
+    batch->Sprite(posX, posY, (float)width, (float)height, 0.0f, 1.0f, 1.0f, 0.0f);
+    batch->Render();
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
@@ -0,0 +1,345 @@
+#include "pch.h"
+#include "Crowd.hpp"
+#include "Mesh.hpp"
+#include "Scene.hpp"
+#include "Shader.hpp"
+#include "Texture.hpp"
+#include "Animation.hpp"
+#include "glad/glad.h"
+
+//*******************************************************
+// VertexAnimationTexture
+//*******************************************************
+
+VertexAnimationTexture::VertexAnimationTexture()
+{
+    m_mesh = nullptr;
+    m_positions = nullptr;
+    m_normals = nullptr;
+    m_vertexCount = 0;
+    m_frameCount = 0;
+    m_width = 0;
+    m_rowsPerFrame = 0;
+    m_frameRate = 0.0f;
+}
+
+VertexAnimationTexture::~VertexAnimationTexture()
+{
+    Release();
+}
+
+void VertexAnimationTexture::Release()
+{
+    delete m_positions;
+    delete m_normals;
+    m_positions = nullptr;
+    m_normals = nullptr;
+    m_mesh = nullptr;
+    m_clips.clear();
+    m_vertexCount = 0;
+    m_frameCount = 0;
+}
+
+s32 VertexAnimationTexture::FindClip(const std::string &name) const
+{
+    for (u32 i = 0; i < m_clips.size(); ++i)
+    {
+        if (m_clips[i].name == name) return (s32)i;
+    }
+    return -1;
+}
+
+void VertexAnimationTexture::SetClipLoop(u32 index, bool loop)
+{
+    if (index < m_clips.size())
+    {
+        m_clips[index].loop = loop;
+    }
+}
+
+bool VertexAnimationTexture::Bake(Model *model, u32 meshIndex, const std::vector<AnimationClip *> &clips, float frameRate)
+{
+    if (!model || meshIndex >= model->GetMeshCount() || clips.empty() || frameRate <= 0.0f)
+    {
+        LogError("[VAT] Invalid bake parameters");
+        return false;
+    }
+    Mesh *mesh = model->GetMesh(meshIndex);
+    if (!model->IsSkinned() || !mesh->HasSkin() || !mesh->IsCPUResident())
+    {
+        LogError("[VAT] %s: needs a skinned model and a mesh with CPU data", mesh->GetName().c_str());
+        return false;
+    }
+
+    Release();
+
+    const u32 vertexCount = mesh->GetVertexCount();
+    const bool hasNormals = mesh->HasNormals();
+
+    u32 totalFrames = 0;
+    for (u32 i = 0; i < clips.size(); ++i)
+    {
+        VATClip clip;
+        clip.name = clips[i]->GetName();
+        clip.duration = clips[i]->GetDuration();
+        // the last frame is the end of the clip, so looping wraps onto frame 0
+        clip.frameCount = (u32)ceilf(clip.duration * frameRate) + 1;
+        clip.firstFrame = totalFrames;
+        clip.loop = true;
+        totalFrames += clip.frameCount;
+        m_clips.push_back(clip);
+    }
+
+    const u32 width = std::min(vertexCount, VAT_MAX_WIDTH);
+    const u32 rowsPerFrame = (vertexCount + width - 1) / width;
+    const u32 height = totalFrames * rowsPerFrame;
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (maxSize > 0 && height > (u32)maxSize)
+    {
+        LogError("[VAT] %s: %u frames x %u rows do not fit in a %d texture, lower the frame rate", mesh->GetName().c_str(), totalFrames, rowsPerFrame, maxSize);
+        m_clips.clear();
+        return false;
+    }
+
+    const size_t texels = (size_t)width * height;
+    std::vector<float> positionData;
+    std::vector<float> normalData;
+    positionData.resize(texels * 4);
+    normalData.resize(texels * 4);
+    std::vector<Vec3> positions(vertexCount);
+    std::vector<Vec3> normals(hasNormals ? vertexCount : 0);
+
+    // the animators move the joints: keep the current pose to put it back
+    std::vector<Mat4> pose(model->GetJointCount());
+    for (u32 j = 0; j < pose.size(); ++j)
+    {
+        pose[j] = model->GetJoint(j)->GetRelTrans();
+    }
+
+    bool first = true;
+    for (u32 c = 0; c < clips.size(); ++c)
+    {
+        const VATClip &clip = m_clips[c];
+        Animator animator(clips[c], model);
+        for (u32 f = 0; f < clip.frameCount; ++f)
+        {
+            animator.SetTime(std::min((float)f / frameRate, clip.duration));
+            animator.Sample();
+            animator.Apply();
+            model->UpdateSkinPalette();
+            const std::vector<Mat4> &palette = model->GetSkinPalette();
+            mesh->Skin(palette.data(), (u32)palette.size(), 0, vertexCount,
+                       positions.data(), hasNormals ? normals.data() : nullptr);
+
+            const size_t row = (size_t)(clip.firstFrame + f) * rowsPerFrame * width;
+            for (u32 v = 0; v < vertexCount; ++v)
+            {
+                float *p = &positionData[(row + v) * 4];
+                p[0] = positions[v].x; p[1] = positions[v].y; p[2] = positions[v].z; p[3] = 1.0f;
+                // meshes without normals get "up" so the shader stays the same
+                float *n = &normalData[(row + v) * 4];
+                const Vec3 normal = hasNormals ? normals[v] : Vec3(0.0f, 1.0f, 0.0f);
+                n[0] = normal.x; n[1] = normal.y; n[2] = normal.z; n[3] = 0.0f;
+                if (first)
+                {
+                    m_bounds.Set(positions[v], positions[v]);
+                    first = false;
+                }
+                m_bounds.AddPoint(positions[v]);
+            }
+        }
+    }
+
+    // marks the model for skinning again
+    for (u32 j = 0; j < pose.size(); ++j)
+    {
+        model->GetJoint(j)->SetTransformDeferred(pose[j]);
+    }
+    model->UpdateSkinPalette();
+
+    m_positions = new Texture2D();
+    m_positions->LoadFloat(positionData.data(), 4, width, height);
+    m_normals = new Texture2D();
+    m_normals->LoadFloat(normalData.data(), 4, width, height);
+
+    m_mesh = mesh;
+    m_vertexCount = vertexCount;
+    m_frameCount = totalFrames;
+    m_width = width;
+    m_rowsPerFrame = rowsPerFrame;
+    m_frameRate = frameRate;
+
+    LogInfo("[VAT] %s: baked %u clips, %u frames (%ux%u, %u KB)", mesh->GetName().c_str(), (u32)m_clips.size(), totalFrames, width, height,
+            (u32)((positionData.size() + normalData.size()) * sizeof(float) / 1024));
+    return true;
+}
+
+//*******************************************************
+// Crowd
+//*******************************************************
+
+Crowd::Crowd(VertexAnimationTexture *vat, u32 capacity)
+{
+    m_vat = vat;
+    m_texture = nullptr;
+    m_vao = 0;
+    m_instanceVBO = 0;
+    m_capacity = 0;
+    m_dirtyBegin = 0;
+    m_dirtyEnd = 0;
+    m_time = 0.0f;
+    m_instances.reserve(capacity);
+}
+
+Crowd::~Crowd()
+{
+    if (m_vao != 0) glDeleteVertexArrays(1, &m_vao);
+    if (m_instanceVBO != 0) glDeleteBuffers(1, &m_instanceVBO);
+}
+
+void Crowd::markDirty(u32 instance)
+{
+    if (m_dirtyBegin >= m_dirtyEnd)
+    {
+        m_dirtyBegin = instance;
+        m_dirtyEnd = instance + 1;
+        return;
+    }
+    m_dirtyBegin = std::min(m_dirtyBegin, instance);
+    m_dirtyEnd = std::max(m_dirtyEnd, instance + 1);
+}
+
+void Crowd::setAnimation(Instance &instance, u32 clip, float speed, float timeOffset)
+{
+    if (clip >= m_vat->GetClipCount())
+    {
+        LogWarning("[CROWD] Invalid clip %u", clip);
+        clip = 0;
+    }
+    const VATClip &info = m_vat->GetClip(clip);
+    instance.anim[0] = (float)info.firstFrame;
+    instance.anim[1] = info.loop ? (float)info.frameCount : -(float)info.frameCount;
+    instance.anim[2] = m_time - timeOffset;
+    instance.anim[3] = speed * m_vat->GetFrameRate();
+}
+
+u32 Crowd::AddInstance(const Mat4 &transform, u32 clip, float speed, float timeOffset)
+{
+    Instance instance;
+    memcpy(instance.model, transform.x, sizeof(instance.model));
+    setAnimation(instance, clip, speed, timeOffset);
+    m_instances.push_back(instance);
+    const u32 index = (u32)m_instances.size() - 1;
+    markDirty(index);
+    return index;
+}
+
+void Crowd::SetTransform(u32 instance, const Mat4 &transform)
+{
+    if (instance >= m_instances.size()) return;
+    memcpy(m_instances[instance].model, transform.x, sizeof(m_instances[instance].model));
+    markDirty(instance);
+}
+
+void Crowd::Play(u32 instance, u32 clip, float speed, float timeOffset)
+{
+    if (instance >= m_instances.size()) return;
+    setAnimation(m_instances[instance], clip, speed, timeOffset);
+    markDirty(instance);
+}
+
+void Crowd::RemoveInstance(u32 instance)
+{
+    if (instance >= m_instances.size()) return;
+    if (instance + 1 < m_instances.size())
+    {
+        m_instances[instance] = m_instances.back();
+        markDirty(instance);
+    }
+    m_instances.pop_back();
+}
+
+void Crowd::Clear()
+{
+    m_instances.clear();
+    m_dirtyBegin = m_dirtyEnd = 0;
+}
+
+void Crowd::createVAO()
+{
+    Mesh *mesh = m_vat->GetMesh();
+    if (mesh->IsDirty())
+    {
+        mesh->Upload();
+    }
+    // mesh streams (uv...) + IBO, positions/normals come from the textures
+    m_vao = mesh->CreateOverrideVAO(0, 0);
+    glGenBuffers(1, &m_instanceVBO);
+
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+    const GLsizei stride = (GLsizei)sizeof(Instance);
+    for (u32 i = 0; i < 4; ++i)
+    {
+        const u32 location = CROWD_ATTRIBUTE_BASE + i;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void *)(i * 4 * sizeof(float)));
+        glVertexAttribDivisor(location, 1);
+    }
+    const u32 location = CROWD_ATTRIBUTE_BASE + 4;
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(Instance, anim));
+    glVertexAttribDivisor(location, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Crowd::Render(Shader *shader)
+{
+    if (!shader || !m_vat || !m_vat->GetMesh() || m_instances.empty()) return;
+
+    if (m_vao == 0)
+    {
+        createVAO();
+    }
+
+    const u32 count = (u32)m_instances.size();
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+    if (count > m_capacity)
+    {
+        m_capacity = std::max(count, (u32)m_instances.capacity());
+        glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(Instance), nullptr, GL_DYNAMIC_DRAW);
+        m_dirtyBegin = 0;
+        m_dirtyEnd = count;
+    }
+    if (m_dirtyBegin < m_dirtyEnd)
+    {
+        const u32 end = std::min(m_dirtyEnd, count);
+        if (m_dirtyBegin < end)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, m_dirtyBegin * sizeof(Instance), (end - m_dirtyBegin) * sizeof(Instance), &m_instances[m_dirtyBegin]);
+        }
+        m_dirtyBegin = m_dirtyEnd = 0;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    shader->SetFloat("crowdTime", m_time);
+    shader->SetInt("vatWidth", (int)m_vat->GetWidth());
+    shader->SetInt("vatRowsPerFrame", (int)m_vat->GetRowsPerFrame());
+
+    Texture *texture = m_texture ? m_texture : TextureManager::Instance().GetDefault();
+    if (texture)
+    {
+        texture->Use(0);
+    }
+    m_vat->GetPositionTexture()->Use(VAT_POSITION_UNIT);
+    m_vat->GetNormalTexture()->Use(VAT_NORMAL_UNIT);
+
+    Mesh *mesh = m_vat->GetMesh();
+    glBindVertexArray(m_vao);
+    glDrawElementsInstanced(GL_TRIANGLES, mesh->GetIndexCount(), GL_UNSIGNED_INT, 0, count);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -5,6 +5,8 @@
 #include "Texture.hpp"
 #include "Shader.hpp"
 #include "Mesh.hpp"
+#include "Scene.hpp"
+#include "Crowd.hpp"
 #include "glad/glad.h"
 
 
@@ -94,6 +96,7 @@ Device::Device(): m_width(0), m_height(0)
     m_target = 0;
     m_ready = false;
     m_is_resize = false;
+    m_uploadThread = false;
 }
 
 Device::~Device()
@@ -158,41 +161,89 @@ void LoadDefaultShader()
     
 }
 
-void Load2DShader()
-{
-      const char *vShader = GLSL(
+// the batch binds up to 8 textures per draw, each vertex says which one;
+// the gradients come from outside the branches (borders between sprites)
+static const char *batchFragmentShader =
+        GLSL(
+            in vec2 TexCoord; 
+            out vec4 color; 
+            in vec4 vertexColor;
+            flat in int textureSlot;
+             uniform sampler2D textures[8];
+             vec4 sampleSlot(vec2 uv, vec2 dx, vec2 dy)
+             {
+                 if (textureSlot == 0) return textureGrad(textures[0], uv, dx, dy);
+                 if (textureSlot == 1) return textureGrad(textures[1], uv, dx, dy);
+                 if (textureSlot == 2) return textureGrad(textures[2], uv, dx, dy);
+                 if (textureSlot == 3) return textureGrad(textures[3], uv, dx, dy);
+                 if (textureSlot == 4) return textureGrad(textures[4], uv, dx, dy);
+                 if (textureSlot == 5) return textureGrad(textures[5], uv, dx, dy);
+                 if (textureSlot == 6) return textureGrad(textures[6], uv, dx, dy);
+                 return textureGrad(textures[7], uv, dx, dy);
+             }
+             void main() 
+             {
+                 color = sampleSlot(TexCoord, dFdx(TexCoord), dFdy(TexCoord)) * vertexColor;
+                 
+
+             });
+
+static const char *batchVertexShader =
+        GLSL(
 
         layout(location = 0) in vec3 position;
         layout(location = 1) in vec2 texCoord;
         layout(location = 2) in vec4 color;
+        layout(location = 3) in float slot;
 
 
         uniform mat4 mvp;
 
         out vec2 TexCoord; 
         out vec4 vertexColor; 
+        flat out int textureSlot;
         void main() 
         {
             gl_Position = mvp * vec4(position, 1.0);
             TexCoord = texCoord;
             vertexColor = color;
+            textureSlot = int(slot);
         });
 
-
-    const char *fShader =
+// distance in the red channel, 0.5 on the outline; the edge stays one
+// screen pixel wide at any scale
+static const char *sdfFragmentShader =
         GLSL(
             in vec2 TexCoord; 
             out vec4 color; 
             in vec4 vertexColor;
-             uniform sampler2D texture0; void main() 
+            flat in int textureSlot;
+             uniform sampler2D textures[8];
+             float sampleSlot(vec2 uv, vec2 dx, vec2 dy)
              {
-                 color = texture(texture0, TexCoord) * vertexColor;
-                 
-
+                 if (textureSlot == 0) return textureGrad(textures[0], uv, dx, dy).r;
+                 if (textureSlot == 1) return textureGrad(textures[1], uv, dx, dy).r;
+                 if (textureSlot == 2) return textureGrad(textures[2], uv, dx, dy).r;
+                 if (textureSlot == 3) return textureGrad(textures[3], uv, dx, dy).r;
+                 if (textureSlot == 4) return textureGrad(textures[4], uv, dx, dy).r;
+                 if (textureSlot == 5) return textureGrad(textures[5], uv, dx, dy).r;
+                 if (textureSlot == 6) return textureGrad(textures[6], uv, dx, dy).r;
+                 return textureGrad(textures[7], uv, dx, dy).r;
+             }
+             void main() 
+             {
+                 float dist = sampleSlot(TexCoord, dFdx(TexCoord), dFdy(TexCoord));
+                 float width = max(fwidth(dist), 0.0001);
+                 float alpha = smoothstep(0.5 - width, 0.5 + width, dist);
+                 color = vec4(vertexColor.rgb, vertexColor.a * alpha);
              });
 
+void Load2DShader()
+{
+    const char *vShader = batchVertexShader;
+    const char *fShader = batchFragmentShader;
+
 
-             
              if (ShaderManager::Instance().Create(vShader, fShader, "2DShader"))
              {         
                  Shader* shader = ShaderManager::Instance().Get("2DShader");
@@ -200,6 +251,10 @@ void Load2DShader()
                  
                  shader->Create(vShader, fShader);
                  shader->LoadDefaults();
+                 for (int i = 0; i < 8; i++)
+                 {
+                     shader->SetInt("textures[" + std::to_string(i) + "]", i);
+                 }
 
                  shader->Use(false);
                  Logger::Instance().Info("Batch Shader Created");
@@ -310,11 +365,310 @@ void Load3DShader()
 }
 
 
+// 3DShader + linear blend skinning, joints from the "JointPalette" uniform block.
+// Mesh layout: position, texcoord, normal, tangent, blendweights, blendindices
+void LoadSkinnedShader()
+{
+      const char *vShader = GLSL(
+
+    layout(location=0) in vec3 aPosition;
+    layout(location=1) in vec2 aTexCoord;
+    layout(location=2) in vec3 aNormal;
+    layout(location=3) in vec4 aTangent;
+    layout(location=4) in vec4 aWeights;
+    layout(location=5) in uvec4 aJoints;
+    // morph targets (Mesh MORPH_GPU), disabled streams read as zero
+    layout(location=8)  in vec3 aMorphPos0;
+    layout(location=9)  in vec3 aMorphPos1;
+    layout(location=10) in vec3 aMorphPos2;
+    layout(location=11) in vec3 aMorphPos3;
+    layout(location=12) in vec3 aMorphNrm0;
+    layout(location=13) in vec3 aMorphNrm1;
+    layout(location=14) in vec3 aMorphNrm2;
+    layout(location=15) in vec3 aMorphNrm3;
+
+    layout(std140) uniform JointPalette
+    {
+        mat4 joints[128];
+    };
+
+    uniform mat4 model;
+    uniform mat4 view;
+    uniform mat4 proj;
+    uniform int skinned;
+    uniform vec4 morphWeights;
+
+    out mediump vec2 vUV;
+    out highp   mat3 vTBN;
+
+    void main() 
+    {
+        vec3 position = aPosition + aMorphPos0 * morphWeights.x + aMorphPos1 * morphWeights.y +
+                                    aMorphPos2 * morphWeights.z + aMorphPos3 * morphWeights.w;
+        vec3 normal = aNormal + aMorphNrm0 * morphWeights.x + aMorphNrm1 * morphWeights.y +
+                                aMorphNrm2 * morphWeights.z + aMorphNrm3 * morphWeights.w;
+
+        mat4 skin = mat4(1.0);
+        if (skinned != 0)
+        {
+            skin = joints[aJoints.x] * aWeights.x +
+                   joints[aJoints.y] * aWeights.y +
+                   joints[aJoints.z] * aWeights.z +
+                   joints[aJoints.w] * aWeights.w;
+        }
+        mat4 world = model * skin;
+        mat3 Nmat = transpose(inverse(mat3(world)));
+
+        vec3 N = normalize(Nmat * normal);
+        vec3 T = normalize(Nmat * aTangent.xyz);
+        T = normalize(T - N * dot(T, N));
+        vec3 B = normalize(cross(N, T)) * aTangent.w;
+
+        vTBN = mat3(T, B, N);
+        vUV  = aTexCoord;
+
+        gl_Position = proj * view * world * vec4(position, 1.0);
+    }
+    
+    );
+
+
+    const char *fShader =
+        GLSL(
+        
+            in mediump vec2 vUV;
+            in mediump mat3 vTBN;
+
+            uniform sampler2D diffuseMap;
+            uniform sampler2D normalMap;
+            uniform vec3 lightDirWorld;
+            uniform float bumpScale;
+
+            out vec4 FragColor;
+
+            void main() 
+            {
+                vec3 albedo = texture(diffuseMap, vUV).rgb;
+                vec3 n_ts = texture(normalMap, vUV).xyz * 2.0 - 1.0;
+                n_ts.xy *= bumpScale;
+                vec3 N = normalize(vTBN * n_ts);
+                
+                float NdotL = max(dot(N, lightDirWorld), 0.0);
+                vec3 color = albedo * (0.1 + 0.9 * NdotL);
+                
+                FragColor = vec4(color, 1.0);
+            }
+
+        );
+
+
+             
+             if (ShaderManager::Instance().Create(vShader, fShader, "SkinnedShader"))
+             {         
+                 Shader* shader = ShaderManager::Instance().Get("SkinnedShader");
+                 
+                 shader->LoadDefaults();
+                 shader->SetInt("diffuseMap", 0);
+                 shader->SetInt("normalMap", 1);
+                 shader->SetInt("skinned", 0);
+                 shader->SetFloat("morphWeights", 0.0f, 0.0f, 0.0f, 0.0f);
+                 shader->SetFloat("bumpScale", 0.0f);
+                 Vec3 lightDirWorld(0.4f, 0.7f, 0.2f);
+                 lightDirWorld.normalize();
+
+                 shader->SetFloat("lightDirWorld", lightDirWorld.x, lightDirWorld.y, lightDirWorld.z);
+                 shader->SetUniformBlock("JointPalette", SKIN_PALETTE_BINDING);
+                 shader->Use(false);
+                 Logger::Instance().Info("Skinned Shader Created");
+                 
+    } else 
+    {
+        Logger::Instance().Error("Failed to create Skinned Shader");
+    }
+    
+}
+
+
+void LoadCrowdShader()
+{
+      const char *vShader = GLSL(
+
+    layout(location=1) in vec2 aTexCoord;
+    // per instance (Crowd)
+    layout(location=10) in mat4 iModel;
+    layout(location=14) in vec4 iAnim;     // first frame, frame count (< 0 = no loop), start time, fps
+
+    uniform highp sampler2D vatPositions;
+    uniform highp sampler2D vatNormals;
+    uniform int vatWidth;
+    uniform int vatRowsPerFrame;
+    uniform float crowdTime;
+
+    uniform mat4 view;
+    uniform mat4 proj;
+
+    out mediump vec2 vUV;
+    out mediump vec3 vNormal;
+
+    ivec2 vatTexel(int frame)
+    {
+        return ivec2(gl_VertexID % vatWidth, frame * vatRowsPerFrame + gl_VertexID / vatWidth);
+    }
+
+    void main() 
+    {
+        float count = abs(iAnim.y);
+        float last = count - 1.0;
+        float frame = (crowdTime - iAnim.z) * iAnim.w;
+        if (iAnim.y > 0.0)
+            frame = mod(frame, max(last, 1.0));
+        else
+            frame = clamp(frame, 0.0, last);
+
+        int f0 = int(floor(frame));
+        int f1 = min(f0 + 1, int(last));
+        float t = frame - float(f0);
+        int first = int(iAnim.x);
+
+        vec3 p0 = texelFetch(vatPositions, vatTexel(first + f0), 0).xyz;
+        vec3 p1 = texelFetch(vatPositions, vatTexel(first + f1), 0).xyz;
+        vec3 n0 = texelFetch(vatNormals, vatTexel(first + f0), 0).xyz;
+        vec3 n1 = texelFetch(vatNormals, vatTexel(first + f1), 0).xyz;
+
+        vUV = aTexCoord;
+        vNormal = normalize(mat3(iModel) * mix(n0, n1, t));
+        gl_Position = proj * view * iModel * vec4(mix(p0, p1, t), 1.0);
+    }
+    
+    );
+
+
+    const char *fShader =
+        GLSL(
+        
+            in mediump vec2 vUV;
+            in mediump vec3 vNormal;
+
+            uniform sampler2D diffuseMap;
+            uniform vec3 lightDirWorld;
+
+            out vec4 FragColor;
+
+            void main() 
+            {
+                vec3 albedo = texture(diffuseMap, vUV).rgb;
+                float NdotL = max(dot(normalize(vNormal), lightDirWorld), 0.0);
+                FragColor = vec4(albedo * (0.1 + 0.9 * NdotL), 1.0);
+            }
+
+        );
+
+
+             if (ShaderManager::Instance().Create(vShader, fShader, "CrowdShader"))
+             {         
+                 Shader* shader = ShaderManager::Instance().Get("CrowdShader");
+                 
+                 shader->LoadDefaults();
+                 shader->SetInt("diffuseMap", 0);
+                 shader->SetInt("vatPositions", VAT_POSITION_UNIT);
+                 shader->SetInt("vatNormals", VAT_NORMAL_UNIT);
+                 shader->SetFloat("crowdTime", 0.0f);
+                 Vec3 lightDirWorld(0.4f, 0.7f, 0.2f);
+                 lightDirWorld.normalize();
+
+                 shader->SetFloat("lightDirWorld", lightDirWorld.x, lightDirWorld.y, lightDirWorld.z);
+                 shader->Use(false);
+                 Logger::Instance().Info("Crowd Shader Created");
+                 
+    } else 
+    {
+        Logger::Instance().Error("Failed to create Crowd Shader");
+    }
+    
+}
+
+
+// Instanced sprites of the RenderBatch: one BatchInstance per quad,
+// expanded from the unit quad (corner) with rotation around the center
+void LoadSpriteShader()
+{
+      const char *vShader = GLSL(
+
+        layout(location = 0) in vec2 corner;
+        layout(location = 1) in vec4 rect;
+        layout(location = 2) in vec4 uvRect;
+        layout(location = 3) in vec4 color;
+        layout(location = 4) in float rotation;
+        layout(location = 5) in float slot;
+
+        uniform mat4 mvp;
+        uniform float depth;
+
+        out vec2 TexCoord; 
+        out vec4 vertexColor; 
+        flat out int textureSlot;
+        void main() 
+        {
+            vec2 extent = rect.zw * 0.5;
+            vec2 local = corner * rect.zw - extent;
+            float angle = rotation * 6.2831853;
+            float c = cos(angle);
+            float s = sin(angle);
+            vec2 position = rect.xy + extent + vec2(local.x * c - local.y * s, local.x * s + local.y * c);
+            gl_Position = mvp * vec4(position, depth, 1.0);
+            TexCoord = mix(uvRect.xy, uvRect.zw, corner);
+            vertexColor = color;
+            textureSlot = int(slot);
+        });
+
+
+    const char *fShader = batchFragmentShader;
+
+    if (ShaderManager::Instance().Create(vShader, fShader, "SpriteShader"))
+    {
+        Shader* shader = ShaderManager::Instance().Get("SpriteShader");
+        shader->LoadDefaults();
+        for (int i = 0; i < 8; i++)
+        {
+            shader->SetInt("textures[" + std::to_string(i) + "]", i);
+        }
+        shader->Use(false);
+        Logger::Instance().Info("Sprite Shader Created");
+    } else 
+    {
+        Logger::Instance().Error("Failed to create Sprite Shader");
+    }
+}
+
+
+void LoadSDFShader()
+{
+    if (ShaderManager::Instance().Create(batchVertexShader, sdfFragmentShader, "SDFShader"))
+    {
+        Shader* shader = ShaderManager::Instance().Get("SDFShader");
+        shader->LoadDefaults();
+        for (int i = 0; i < 8; i++)
+        {
+            shader->SetInt("textures[" + std::to_string(i) + "]", i);
+        }
+        shader->Use(false);
+        Logger::Instance().Info("SDF Shader Created");
+    } else 
+    {
+        Logger::Instance().Error("Failed to create SDF Shader");
+    }
+}
+
+
 void LoadDefaultShaders() 
 {
      LoadDefaultShader();
      Load2DShader();
+     LoadSpriteShader();
+     LoadSDFShader();
      Load3DShader();
+     LoadSkinnedShader();
+     LoadCrowdShader();
 }
 
 
@@ -432,6 +786,11 @@ bool Device::Create(int width, int height, const char* title, bool vzync)
     TextureManager::Instance().Init();
     LoadDefaultShaders();
 
+    if (m_uploadThread)
+    {
+        GpuUploader::Instance().Start(m_window);
+    }
+
 
 
     
@@ -499,6 +858,11 @@ bool Device::Run()
     m_update = m_current - m_previous;
     m_previous = m_current;
 
+    // frame boundary: meshes updated by workers show their new vertices
+    MeshManager::Instance().SwapBuffers();
+    GpuUploader::Instance().Poll();
+    TextureManager::Instance().UpdateAsync();
+
 
     SDL_Event event;
 
@@ -590,6 +954,9 @@ void Device::Close()
 
     m_ready = false;
 
+    ThreadPool::Instance().Shutdown();
+    GpuUploader::Instance().Finish();
+    GpuUploader::Instance().Stop();
     ShaderManager::Instance().Clear();
     TextureManager::Instance().Clear();
     MeshManager::Instance().Clear();
@@ -637,3 +1004,272 @@ void Device::Flip()
     m_is_resize = false;
 }
 
+//*******************************************************
+// GpuUploader
+//*******************************************************
+
+GpuUploader &GpuUploader::Instance()
+{
+    static GpuUploader instance;
+    return instance;
+}
+GpuUploader *GpuUploader::InstancePtr() { return &Instance(); }
+
+GpuUploader::GpuUploader()
+{
+    m_window = nullptr;
+    m_context = nullptr;
+    m_busy = 0;
+    m_running = 0;
+    m_pending = 0;
+    m_nextId = 0;
+    m_state = 0;
+    m_quit = false;
+}
+
+GpuUploader::~GpuUploader()
+{
+    Stop();
+}
+
+bool GpuUploader::Start(SDL_Window *window)
+{
+    if (m_context) return true;
+
+    SDL_GLContext mainContext = SDL_GL_GetCurrentContext();
+    if (!window || !mainContext)
+    {
+        LogWarning("[UPLOADER] No current GL context, uploads stay on the main thread");
+        return false;
+    }
+
+    // a context can only be current on one thread: the loader gets a hidden window
+    m_window = SDL_CreateWindow("", 0, 0, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if (m_window)
+    {
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+        m_context = SDL_GL_CreateContext(m_window);
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+        SDL_GL_MakeCurrent(window, mainContext);
+    }
+    if (!m_context)
+    {
+        LogWarning("[UPLOADER] No shared GL context (%s), uploads stay on the main thread", SDL_GetError());
+        if (m_window) SDL_DestroyWindow(m_window);
+        m_window = nullptr;
+        return false;
+    }
+
+    m_quit = false;
+    m_state = 0;
+    m_thread = std::thread(&GpuUploader::loaderLoop, this);
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_uploaded.wait(lock, [this] { return m_state != 0; });
+    }
+    if (m_state < 0)
+    {
+        LogWarning("[UPLOADER] Loader context could not be made current, uploads stay on the main thread");
+        Stop();
+        return false;
+    }
+    LogInfo("[UPLOADER] Loader thread started");
+    return true;
+}
+
+void GpuUploader::Stop()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+    if (m_context) SDL_GL_DeleteContext(m_context);
+    if (m_window) SDL_DestroyWindow(m_window);
+    m_context = nullptr;
+    m_window = nullptr;
+}
+
+void GpuUploader::loaderLoop()
+{
+    const bool current = SDL_GL_MakeCurrent(m_window, m_context) == 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_state = current ? 1 : -1;
+    }
+    m_uploaded.notify_all();
+    if (!current) return;
+
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+            if (m_quit && m_queue.empty()) break;
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_busy++;
+            m_running = job.id;
+        }
+
+        job.upload();
+        job.uploaded = true;
+        job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (job.fence)
+        {
+            // the fence must reach the GPU before the main thread can see it signal
+            glFlush();
+        }
+        else
+        {
+            glFinish();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_fenced.push_back(std::move(job));
+            m_busy--;
+            m_running = 0;
+        }
+        m_uploaded.notify_all();
+    }
+    SDL_GL_MakeCurrent(m_window, nullptr);
+}
+
+u32 GpuUploader::Submit(const std::function<void()> &upload, const std::function<void()> &done)
+{
+    Job job;
+    job.upload = upload;
+    job.done = done;
+    job.fence = nullptr;
+    job.uploaded = false;
+    // 0 is never a job
+    if (++m_nextId == 0) m_nextId = 1;
+    const u32 id = m_nextId;
+    job.id = id;
+    m_pending++;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(job));
+    }
+    if (m_context) m_wake.notify_one();
+    return id;
+}
+
+void GpuUploader::Poll()
+{
+    if (m_pending == 0) return;
+
+    std::deque<Job> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_context)
+        {
+            ready.swap(m_queue);
+        }
+        // in submit order: stop at the first fence still in flight
+        while (!m_fenced.empty())
+        {
+            GLsync fence = (GLsync)m_fenced.front().fence;
+            if (fence)
+            {
+                const GLenum status = glClientWaitSync(fence, 0, 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+                glDeleteSync(fence);
+            }
+            ready.push_back(std::move(m_fenced.front()));
+            m_fenced.pop_front();
+        }
+    }
+
+    for (u32 i = 0; i < ready.size(); i++)
+    {
+        // fallback: uploaded right here
+        if (!ready[i].uploaded) ready[i].upload();
+        if (ready[i].done) ready[i].done();
+        m_pending--;
+    }
+}
+
+void GpuUploader::Wait(u32 id)
+{
+    if (id == 0) return;
+
+    Job job;
+    bool found = false;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto it = m_queue.begin(); it != m_queue.end(); ++it)
+        {
+            if (it->id != id) continue;
+            job = std::move(*it);
+            m_queue.erase(it);
+            found = true;
+            break;
+        }
+        if (!found)
+        {
+            m_uploaded.wait(lock, [this, id] { return m_running != id; });
+            for (auto it = m_fenced.begin(); it != m_fenced.end(); ++it)
+            {
+                if (it->id != id) continue;
+                job = std::move(*it);
+                m_fenced.erase(it);
+                found = true;
+                break;
+            }
+        }
+    }
+    // already done
+    if (!found) return;
+
+    if (!job.uploaded)
+    {
+        job.upload();
+    }
+    else if (job.fence)
+    {
+        GLsync fence = (GLsync)job.fence;
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+        {
+        }
+        glDeleteSync(fence);
+    }
+    if (job.done) job.done();
+    m_pending--;
+}
+
+bool GpuUploader::Cancel(u32 id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it)
+    {
+        if (it->id != id) continue;
+        m_queue.erase(it);
+        m_pending--;
+        return true;
+    }
+    return false;
+}
+
+void GpuUploader::Finish()
+{
+    if (m_context)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_uploaded.wait(lock, [this] { return m_queue.empty() && m_busy == 0; });
+        for (u32 i = 0; i < m_fenced.size(); i++)
+        {
+            GLsync fence = (GLsync)m_fenced[i].fence;
+            while (fence && glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            {
+            }
+        }
+    }
+    Poll();
+}
\ No newline at end of file
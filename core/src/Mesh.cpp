@@ -2,6 +2,8 @@
 #include "pch.h"
 #include "Mesh.hpp"
 #include "Scene.hpp"
+#include "Simd.hpp"
+#include "Device.hpp"
 #include "glad/glad.h"
 
 Material::Material() 
@@ -92,6 +94,21 @@ Mesh::Mesh(const VertexFormat &vertexFormat, u32 material, bool dynamic)
     VAO=0;
     m_name = "Mesh";
     m_castsShadows = true;
+    m_residency = MeshManager::Instance().GetDefaultResidency();
+    m_cpuReleased = false;
+    m_uploading = false;
+    m_uploadJob = 0;
+    m_vertexCount = 0;
+    m_indexCount = 0;
+    m_indexBytes = 0;
+    m_hasSkin = false;
+    m_morphMode = MORPH_CPU;
+    for (u32 i = 0; i < MAX_GPU_MORPH_TARGETS; ++i)
+    {
+        m_morphSlots[i] = -1;
+    }
+    m_subMeshOpen = false;
+    m_doubleBuffer = nullptr;
     Init();
    
     
@@ -167,6 +184,7 @@ void Mesh::Init()
 
                 buffer->size  = e.size;
                 buffer->usage = e.usage;
+                buffer->attribute = j;
                 buffer->name = "POSITION";
             //    Log(1,"POSITION");
                 
@@ -184,6 +202,7 @@ void Mesh::Init()
                 glVertexAttribPointer(j, 2, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec2), 0);
                 buffer->size  = e.size;
                 buffer->usage = e.usage;
+                buffer->attribute = j;
                 buffer->name = "TEXCOORD0";
               //  Log(1,"TEXCOORD0");
                 AddBuffer(buffer);
@@ -202,6 +221,7 @@ void Mesh::Init()
                 glVertexAttribPointer(j, 2, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec2), 0);
                 buffer->size  = e.size;
                 buffer->usage = e.usage;
+                buffer->attribute = j;
                 buffer->name = "TEXCOORD1";
               //  Log(1,"TEXCOORD0");
                 AddBuffer(buffer);
@@ -219,6 +239,7 @@ void Mesh::Init()
                 glVertexAttribPointer(j, 3, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec3), 0);
                 buffer->size  = e.size;
                 buffer->usage = e.usage;
+                buffer->attribute = j;
                 buffer->name = "NORMAL";
             //   Log(1,"NORMAL");
                 AddBuffer(buffer);
@@ -237,6 +258,7 @@ void Mesh::Init()
 
                 buffer->size  = e.size;
                 buffer->usage = e.usage;
+                buffer->attribute = j;
                 buffer->name = "TANGENT";
                 
                 AddBuffer(buffer);
@@ -253,11 +275,41 @@ void Mesh::Init()
                 glVertexAttribPointer(j, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
                 buffer->size  = e.size;
                 buffer->usage = e.usage;
+                buffer->attribute = j;
                 buffer->name = "COLOR";
 
            
                 AddBuffer(buffer);
-            } 
+            } else
+            if (e.usage == VertexFormat::BLENDWEIGHTS)
+            {
+                flags |= VBO_BLENDWEIGHTS;
+                VertexBuffer * buffer = new VertexBuffer();
+                glGenBuffers(1, &buffer->id);
+                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+                glEnableVertexAttribArray(j);
+                glVertexAttribPointer(j, 4, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec4), 0);
+                buffer->size  = e.size;
+                buffer->usage = e.usage;
+                buffer->attribute = j;
+                buffer->name = "BLENDWEIGHTS";
+                AddBuffer(buffer);
+            } else
+            if (e.usage == VertexFormat::BLENDINDICES)
+            {
+                flags |= VBO_BLENDINDICES;
+                VertexBuffer * buffer = new VertexBuffer();
+                glGenBuffers(1, &buffer->id);
+                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+                glEnableVertexAttribArray(j);
+                // inteiros no shader (uvec4)
+                glVertexAttribIPointer(j, 4, GL_UNSIGNED_BYTE, 0, 0);
+                buffer->size  = e.size;
+                buffer->usage = e.usage;
+                buffer->attribute = j;
+                buffer->name = "BLENDINDICES";
+                AddBuffer(buffer);
+            }
         }
 
     glBindVertexArray(0);
@@ -265,101 +317,295 @@ void Mesh::Init()
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
-void Mesh::Upload()
+// Pads the streams to the vertex count and sizes the buffers, returns the
+// streams to send. Main thread only.
+u32 Mesh::prepareUpload()
 {
-    // Fazer bind do VAO para configurar o estado
-    glBindVertexArray(VAO);
-    
+    if (m_cpuReleased)
+    {
+        // so os streams que ainda temos no CPU podem ser reenviados
+        u32 keep = 0;
+        if (positions.size() == m_vertexCount && m_vertexCount > 0) keep |= VBO_POSITION;
+        if (indices.size() == m_indexCount && m_indexCount > 0) keep |= VBO_INDICES;
+        if ((flags & ~keep) != 0)
+        {
+            LogWarning("[MESH] %s: CPU data released, only positions/indices can be updated", m_name.c_str());
+        }
+        flags &= keep;
+    }
+
+    const size_t vcount = positions.size();
     for (u32 i = 0; i < buffers.size(); ++i)
     {
         VertexBuffer *buffer = buffers[i];
-        
+
         if (buffer->usage == VertexFormat::POSITION)
         {
-            if (flags & VBO_POSITION)
-            {
-                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
-                glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(Vec3), positions.data(), m_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
-            }
+            if (flags & VBO_POSITION) buffer->bytes = vcount * sizeof(Vec3);
         }
         else if (buffer->usage == VertexFormat::TEXCOORD0)
         {
             if (flags & VBO_TEXCOORD0)
             {
-                if (texCoords.size() != positions.size())
-                {
-                    texCoords.resize(positions.size(), Vec2(0.0f, 0.0f));
-                }
-                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
-                glBufferData(GL_ARRAY_BUFFER, texCoords.size() * sizeof(Vec2), texCoords.data(), m_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+                if (texCoords.size() != vcount) texCoords.resize(vcount, Vec2(0.0f, 0.0f));
+                buffer->bytes = texCoords.size() * sizeof(Vec2);
             }
         }
         else if (buffer->usage == VertexFormat::TEXCOORD1)
         {
             if (flags & VBO_TEXCOORD1)
             {
-                if (texCoords2.size() != positions.size())
-                {
-                    texCoords2.resize(positions.size(), Vec2(0.0f, 0.0f));
-                }
-                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
-                glBufferData(GL_ARRAY_BUFFER, texCoords2.size() * sizeof(Vec2), texCoords2.data(), m_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+                if (texCoords2.size() != vcount) texCoords2.resize(vcount, Vec2(0.0f, 0.0f));
+                buffer->bytes = texCoords2.size() * sizeof(Vec2);
             }
         }
         else if (buffer->usage == VertexFormat::NORMAL)
         {
             if (flags & VBO_NORMAL)
             {
-                if (normals.size() != positions.size())
-                {
-                    normals.resize(positions.size(), Vec3(0.0f, 0.0f, 1.0f)); // Normal padrão para cima
-                }
-                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
-                glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(Vec3), normals.data(), m_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+                if (normals.size() != vcount) normals.resize(vcount, Vec3(0.0f, 0.0f, 1.0f)); // Normal padrão para cima
+                buffer->bytes = normals.size() * sizeof(Vec3);
             }
         }
         else if (buffer->usage == VertexFormat::COLOR)
         {
-            if (flags & VBO_COLOR) // Adicionar verificação de flag
+            if (flags & VBO_COLOR)
             {
-                if ((colors.size() / 4) != positions.size())
-                {
-                    const size_t vcount = positions.size();
-                    colors.resize(vcount * 4, 255); // RGBA = 255
-                }
-                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
-                glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(unsigned char), colors.data(), m_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+                if ((colors.size() / 4) != vcount) colors.resize(vcount * 4, 255); // RGBA = 255
+                buffer->bytes = colors.size() * sizeof(unsigned char);
             }
         }
         else if (buffer->usage == VertexFormat::TANGENT)
         {
-            if (flags & VBO_TANGENT) // Verificação ANTES do upload
+            if (flags & VBO_TANGENT)
             {
-                if (tangents.size() != positions.size())
-                {
-                    tangents.resize(positions.size(), Vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Tangente padrão
-                }
-                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
-                glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(Vec4), tangents.data(), m_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+                if (tangents.size() != vcount) tangents.resize(vcount, Vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Tangente padrão
+                buffer->bytes = tangents.size() * sizeof(Vec4);
+            }
+        }
+        else if (buffer->usage == VertexFormat::BLENDWEIGHTS)
+        {
+            if (flags & VBO_BLENDWEIGHTS)
+            {
+                if (blendWeights.size() != vcount) blendWeights.resize(vcount, Vec4(1.0f, 0.0f, 0.0f, 0.0f)); // tudo no joint 0
+                buffer->bytes = blendWeights.size() * sizeof(Vec4);
+            }
+        }
+        else if (buffer->usage == VertexFormat::BLENDINDICES)
+        {
+            if (flags & VBO_BLENDINDICES)
+            {
+                if ((blendIndices.size() / 4) != vcount) blendIndices.resize(vcount * 4, 0);
+                buffer->bytes = blendIndices.size() * sizeof(u8);
             }
         }
     }
-    
-    // Upload de índices
     if (flags & VBO_INDICES)
+    {
+        m_indexBytes = indices.size() * sizeof(unsigned int);
+    }
+
+    const u32 streams = flags;
+    // Reset flags: o que mudar a partir daqui vai no proximo upload
+    flags = 0;
+    isDirty = false;
+    return streams;
+}
+
+// GL only, reads the streams: main thread or the GpuUploader loader
+void Mesh::uploadBuffers(u32 streams)
+{
+    const GLenum usage = m_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
+    for (u32 i = 0; i < buffers.size(); ++i)
+    {
+        const VertexBuffer *buffer = buffers[i];
+        const void *data = nullptr;
+        u32 stream = 0;
+        switch (buffer->usage)
+        {
+            case VertexFormat::POSITION:     stream = VBO_POSITION;     data = positions.data();    break;
+            case VertexFormat::TEXCOORD0:    stream = VBO_TEXCOORD0;    data = texCoords.data();    break;
+            case VertexFormat::TEXCOORD1:    stream = VBO_TEXCOORD1;    data = texCoords2.data();   break;
+            case VertexFormat::NORMAL:       stream = VBO_NORMAL;       data = normals.data();      break;
+            case VertexFormat::COLOR:        stream = VBO_COLOR;        data = colors.data();       break;
+            case VertexFormat::TANGENT:      stream = VBO_TANGENT;      data = tangents.data();     break;
+            case VertexFormat::BLENDWEIGHTS: stream = VBO_BLENDWEIGHTS; data = blendWeights.data(); break;
+            case VertexFormat::BLENDINDICES: stream = VBO_BLENDINDICES; data = blendIndices.data(); break;
+            default: break;
+        }
+        if (!(streams & stream)) continue;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)buffer->bytes, data, usage);
+    }
+
+    // Upload de índices
+    if (streams & VBO_INDICES)
     {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), m_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)m_indexBytes, indices.data(), usage);
     }
-    
+}
+
+void Mesh::finishUpload()
+{
+    if (m_residency != RESIDENCY_KEEP_ALL && !m_cpuReleased)
+    {
+        ReleaseCPUData(m_residency == RESIDENCY_COLLISION);
+    }
+}
+
+// a background upload still reads the streams: drop it if the loader did not
+// start it yet, else wait for that job only
+void Mesh::waitUpload()
+{
+    if (!m_uploading) return;
+    GpuUploader &uploader = GpuUploader::Instance();
+    m_asyncUpload->cancelled = true;
+    if (uploader.Cancel(m_uploadJob))
+    {
+        // never sent: the next Upload does it
+        flags |= m_asyncUpload->streams;
+        isDirty = true;
+    } else
+    {
+        uploader.Wait(m_uploadJob);
+    }
+    m_asyncUpload.reset();
+    m_uploadJob = 0;
+    m_uploading = false;
+}
+
+void Mesh::Upload()
+{
+    waitUpload();
+
+    const u32 streams = prepareUpload();
+
+    // Fazer bind do VAO para configurar o estado
+    glBindVertexArray(VAO);
+    uploadBuffers(streams);
+
     // Limpar bindings
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    
-    // Reset flags após upload bem-sucedido
-    flags = 0;
-    isDirty = false;
+
+    finishUpload();
+}
+
+bool Mesh::UploadAsync()
+{
+    if (m_uploading || !isDirty) return false;
+
+    std::shared_ptr<AsyncUpload> upload = std::make_shared<AsyncUpload>();
+    upload->mesh = this;
+    upload->streams = prepareUpload();
+    upload->cancelled = false;
+    m_asyncUpload = upload;
+    m_uploading = true;
+    // the buffers are shared with the loader context, the VAO already points at them.
+    // The mesh outlives the upload itself: waitUpload cancels or waits for it.
+    m_uploadJob = GpuUploader::Instance().Submit([upload]()
+    {
+        upload->mesh->uploadBuffers(upload->streams);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    },
+    [upload]()
+    {
+        if (upload->cancelled) return;
+        Mesh *mesh = upload->mesh;
+        mesh->m_asyncUpload.reset();
+        mesh->m_uploadJob = 0;
+        mesh->m_uploading = false;
+        mesh->finishUpload();
+    });
+    return true;
+}
+
+template <typename T>
+static void FreeVector(std::vector<T> &v)
+{
+    std::vector<T>().swap(v);
+}
+
+void Mesh::ReleaseCPUData(bool keepCollision)
+{
+    waitUpload();
+    if (isDirty)
+    {
+        Upload();
+    }
+    if (!m_cpuReleased)
+    {
+        m_vertexCount = (u32)positions.size();
+        m_indexCount = (u32)indices.size();
+    }
+    m_cpuReleased = true;
+
+    FreeVector(normals);
+    FreeVector(texCoords);
+    FreeVector(texCoords2);
+    FreeVector(tangents);
+    FreeVector(colors);
+    if (!keepCollision)
+    {
+        FreeVector(positions);
+        FreeVector(indices);
+        FreeVector(blendWeights);
+        FreeVector(blendIndices);
+    } else
+    {
+        // skinned meshes keep the blend data so picking can still skin on the CPU
+        positions.shrink_to_fit();
+        indices.shrink_to_fit();
+        blendWeights.shrink_to_fit();
+        blendIndices.shrink_to_fit();
+    }
+}
+
+u64 Mesh::GetCPUBytes() const
+{
+    return (u64)positions.capacity() * sizeof(Vec3) +
+           (u64)normals.capacity() * sizeof(Vec3) +
+           (u64)texCoords.capacity() * sizeof(Vec2) +
+           (u64)texCoords2.capacity() * sizeof(Vec2) +
+           (u64)tangents.capacity() * sizeof(Vec4) +
+           (u64)colors.capacity() * sizeof(unsigned char) +
+           (u64)blendWeights.capacity() * sizeof(Vec4) +
+           (u64)blendIndices.capacity() * sizeof(u8) +
+           (u64)indices.capacity() * sizeof(unsigned int) +
+           getMorphCPUBytes() +
+           (m_doubleBuffer ? (u64)(m_doubleBuffer->positions.capacity() + m_doubleBuffer->normals.capacity()) * sizeof(Vec3) : 0) +
+           (u64)m_subMeshes.capacity() * sizeof(SubMesh) +
+           m_meshlets.GetBytes();
+}
+
+u64 Mesh::GetGPUBytes() const
+{
+    u64 total = m_indexBytes;
+    for (u32 i = 0; i < buffers.size(); ++i)
+    {
+        total += buffers[i]->bytes;
+    }
+    // dense GPU morph streams
+    const u32 count = GetVertexCount();
+    for (u32 i = 0; i < m_morphTargets.size(); ++i)
+    {
+        if (m_morphTargets[i]->positionVBO != 0) total += (u64)count * sizeof(Vec3);
+        if (m_morphTargets[i]->normalVBO != 0) total += (u64)count * sizeof(Vec3);
+    }
+    // ring slots besides the ones in buffers
+    if (m_doubleBuffer)
+    {
+        for (u32 i = 0; i < m_doubleBuffer->ringSize; ++i)
+        {
+            if (i == m_doubleBuffer->slot) continue;
+            const u64 slotBytes = (u64)m_doubleBuffer->capacity[i] * sizeof(Vec3);
+            total += m_doubleBuffer->normalVBO[i] != 0 ? slotBytes * 2 : slotBytes;
+        }
+    }
+    return total;
 }
 
 void Mesh::FlipFaces()
@@ -484,6 +730,9 @@ void Mesh::TexturePlanarMapping(float resolutionS, float resolutionT, u8 axis, c
 
 void Mesh::Release()
 {
+    waitUpload();
+    releaseDoubleBuffer();
+    releaseMorphTargets();
 
     if (VAO != 0) 
     {
@@ -508,6 +757,8 @@ void Mesh::Release()
 
 void Mesh::Render(u32 mode,u32 count)
 {
+    // UploadAsync: nothing to draw yet
+    if (m_uploading) return;
     if (isDirty) 
     {
         Upload();
@@ -695,100 +946,1108 @@ void Mesh::VertexTexCoord(u32 index, float u, float v)
      isDirty = true;
 }
 
-int Mesh::AddFace(u32 v0, u32 v1, u32 v2)
+void Mesh::VertexBlend(u32 index, const u8 joints[4], const Vec4 &weights)
 {
-    indices.push_back(v0);
-    indices.push_back(v1);
-    indices.push_back(v2);
-    flags |= VBO_INDICES;
-     isDirty = true;
-    return (int)indices.size() - 3;
+    if (index >= positions.size()) return;
+    if (blendWeights.size() != positions.size())
+    {
+        blendWeights.resize(positions.size(), Vec4(1.0f, 0.0f, 0.0f, 0.0f));
+        blendIndices.resize(positions.size() * 4, 0);
+    }
+    blendWeights[index] = weights;
+    for (u32 k = 0; k < 4; ++k)
+    {
+        blendIndices[index * 4 + k] = joints[k];
+    }
+    m_hasSkin = true;
+    flags |= VBO_BLENDWEIGHTS | VBO_BLENDINDICES;
+    isDirty = true;
 }
 
+void Mesh::Skin(const Mat4 *palette, u32 paletteSize, u32 begin, u32 end,
+                Vec3 *outPositions, Vec3 *outNormals) const
+{
+    const Vec3 *inNormals = normals.size() == positions.size() ? normals.data() : nullptr;
+    Skin(palette, paletteSize, begin, end, positions.data(), inNormals, outPositions, outNormals);
+}
 
-
-void Mesh::CalculateNormals()
+void Mesh::Skin(const Mat4 *palette, u32 paletteSize, u32 begin, u32 end,
+                const Vec3 *inPositions, const Vec3 *inNormals,
+                Vec3 *outPositions, Vec3 *outNormals) const
 {
+    if (blendWeights.size() != positions.size() || end > positions.size()) return;
 
-    if (indices.size() > 0) 
+    const bool doNormals = outNormals != nullptr && inNormals != nullptr;
+    const simd4f zero = Simd_Zero();
+    float tmp[4];
+
+    for (u32 i = begin; i < end; ++i)
     {
+        const u8 *joint = &blendIndices[i * 4];
+        const float *weight = &blendWeights[i].x;
 
-        if (normals.size() != positions.size()) 
-        {
-            for (size_t i = 0; i < positions.size(); ++i) 
-            {
-                normals.push_back(Vec3(0.0f, 0.0f, 0.0f));
-            }
-        }
-        for (u32 i = 0; i < GetIndexCount(); i += 3)
+        // blend the palette columns: M = sum(w * P[j])
+        simd4f c0 = zero, c1 = zero, c2 = zero, c3 = zero;
+        for (u32 k = 0; k < 4; ++k)
         {
-            Plane3D plane = Plane3D(positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]]);
-          
-            Vec3 normal = plane.normal;
-            normals[indices[i]] = normal;
-            normals[indices[i + 1]] = normal;
-            normals[indices[i + 2]] = normal;
-
+            if (weight[k] == 0.0f) continue;
+            const u32 j = joint[k] < paletteSize ? joint[k] : 0;
+            const float *m = palette[j].x;
+            const simd4f w = Simd_Set1(weight[k]);
+            c0 = Simd_MulAdd(Simd_Load(m + 0), w, c0);
+            c1 = Simd_MulAdd(Simd_Load(m + 4), w, c1);
+            c2 = Simd_MulAdd(Simd_Load(m + 8), w, c2);
+            c3 = Simd_MulAdd(Simd_Load(m + 12), w, c3);
         }
 
+        const Vec3 &p = inPositions[i];
+        simd4f r = Simd_MulAdd(c0, Simd_Set1(p.x), c3);
+        r = Simd_MulAdd(c1, Simd_Set1(p.y), r);
+        r = Simd_MulAdd(c2, Simd_Set1(p.z), r);
+        Simd_Store(tmp, r);
+        outPositions[i].set(tmp[0], tmp[1], tmp[2]);
 
-         flags |= VBO_NORMAL;
-         isDirty = true;
+        if (doNormals)
+        {
+            const Vec3 &n = inNormals[i];
+            simd4f rn = Simd_Mul(c0, Simd_Set1(n.x));
+            rn = Simd_MulAdd(c1, Simd_Set1(n.y), rn);
+            rn = Simd_MulAdd(c2, Simd_Set1(n.z), rn);
+            Simd_Store(tmp, rn);
+            const float len2 = tmp[0] * tmp[0] + tmp[1] * tmp[1] + tmp[2] * tmp[2];
+            const float inv = len2 > 1e-20f ? 1.0f / sqrtf(len2) : 0.0f;
+            outNormals[i].set(tmp[0] * inv, tmp[1] * inv, tmp[2] * inv);
+        }
     }
-
-       
 }
 
-bool Mesh::CheckIntersection(const Mat4 &mat, const Vec3 &rayOrig,
-                             const Vec3 &rayDir, Vec3 &intsPos) const
+u32 Mesh::CreateOverrideVAO(u32 positionVBO, u32 normalVBO) const
 {
-    return false;
-}
+    u32 vao = 0;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
 
-void Mesh::Clear()
-{
-    positions.clear();
-    normals.clear();
-    texCoords.clear();
-    indices.clear();
-    colors.clear();
-    m_boundingBox.Clear();
+    for (u32 i = 0; i < buffers.size(); ++i)
+    {
+        const VertexBuffer *buffer = buffers[i];
+        const u32 j = buffer->attribute;
+        glEnableVertexAttribArray(j);
+        switch (buffer->usage)
+        {
+            case VertexFormat::POSITION:
+                glBindBuffer(GL_ARRAY_BUFFER, positionVBO != 0 ? positionVBO : buffer->id);
+                glVertexAttribPointer(j, 3, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec3), 0);
+                break;
+            case VertexFormat::NORMAL:
+                glBindBuffer(GL_ARRAY_BUFFER, normalVBO != 0 ? normalVBO : buffer->id);
+                glVertexAttribPointer(j, 3, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec3), 0);
+                break;
+            case VertexFormat::TEXCOORD0:
+            case VertexFormat::TEXCOORD1:
+                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+                glVertexAttribPointer(j, 2, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec2), 0);
+                break;
+            case VertexFormat::TANGENT:
+            case VertexFormat::BLENDWEIGHTS:
+                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+                glVertexAttribPointer(j, 4, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec4), 0);
+                break;
+            case VertexFormat::COLOR:
+                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+                glVertexAttribPointer(j, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+                break;
+            case VertexFormat::BLENDINDICES:
+                glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+                glVertexAttribIPointer(j, 4, GL_UNSIGNED_BYTE, 0, 0);
+                break;
+            default:
+                glDisableVertexAttribArray(j);
+                break;
+        }
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    return vao;
 }
 
+//*******************************************************
+// Morph targets
+//*******************************************************
 
- 
+// vertices closer than this are merged into one glBufferSubData
+static const u32 MORPH_RUN_GAP = 32;
 
-void Mesh::CalculateSmothNormals(bool angleWeighted)
+s32 Mesh::AddMorphTarget(const std::string &name, const std::vector<u32> &vertices,
+                         const std::vector<Vec3> &positionDeltas,
+                         const std::vector<Vec3> *normalDeltas,
+                         const std::vector<Vec3> *tangentDeltas)
 {
-    if (indices.empty()) return;
+    if (m_cpuReleased)
+    {
+        LogError("[MESH] %s: morph targets need the CPU data (add them before releasing it)", m_name.c_str());
+        return -1;
+    }
+    if (positionDeltas.size() != vertices.size() ||
+        (normalDeltas && normalDeltas->size() != vertices.size()) ||
+        (tangentDeltas && tangentDeltas->size() != vertices.size()))
+    {
+        LogError("[MESH] %s: morph target '%s' has %u vertices but the delta counts differ", m_name.c_str(), name.c_str(), (u32)vertices.size());
+        return -1;
+    }
 
- 
-    normals.assign(positions.size(), Vec3(0.0f));
+    // ordenado por vertice: acessos sequenciais e uploads em blocos contiguos
+    std::vector<u32> order(vertices.size());
+    for (u32 k = 0; k < order.size(); ++k)
+    {
+        order[k] = k;
+    }
+    std::sort(order.begin(), order.end(), [&vertices](u32 a, u32 b) { return vertices[a] < vertices[b]; });
+
+    MorphTarget *target = new MorphTarget();
+    target->name = name;
+    target->positionVBO = 0;
+    target->normalVBO = 0;
+    target->vertices.reserve(vertices.size());
+    target->positions.reserve(vertices.size() * 4);
+    if (normalDeltas) target->normals.reserve(vertices.size() * 4);
+    if (tangentDeltas) target->tangents.reserve(vertices.size() * 4);
+
+    const u32 count = (u32)positions.size();
+    u32 skipped = 0;
+    for (u32 k = 0; k < order.size(); ++k)
+    {
+        const u32 src = order[k];
+        const u32 v = vertices[src];
+        if (v >= count || (!target->vertices.empty() && target->vertices.back() == v))
+        {
+            skipped++;
+            continue;
+        }
+        target->vertices.push_back(v);
+        const Vec3 &p = positionDeltas[src];
+        target->positions.insert(target->positions.end(), {p.x, p.y, p.z, 0.0f});
+        if (normalDeltas)
+        {
+            const Vec3 &n = (*normalDeltas)[src];
+            target->normals.insert(target->normals.end(), {n.x, n.y, n.z, 0.0f});
+        }
+        if (tangentDeltas)
+        {
+            const Vec3 &t = (*tangentDeltas)[src];
+            target->tangents.insert(target->tangents.end(), {t.x, t.y, t.z, 0.0f});
+        }
+    }
+    if (skipped > 0)
+    {
+        LogWarning("[MESH] %s: morph target '%s' skipped %u invalid or duplicated vertices", m_name.c_str(), name.c_str(), skipped);
+    }
 
-    for (size_t i = 0; i < indices.size(); i += 3)
+    // os streams morphed passam a ser atualizados com frequencia
+    m_dynamic = true;
+    m_morphTargets.push_back(target);
+    return (s32)m_morphTargets.size() - 1;
+}
+
+s32 Mesh::AddMorphTargetFromShape(const std::string &name, const std::vector<Vec3> &shapePositions,
+                                  const std::vector<Vec3> *shapeNormals, float epsilon)
+{
+    const u32 count = (u32)positions.size();
+    if (shapePositions.size() != count || (shapeNormals && (shapeNormals->size() != count || normals.size() != count)))
     {
-        const u32 i0 = indices[i+0], i1 = indices[i+1], i2 = indices[i+2];
-        const Vec3 &v0 = positions[i0], &v1 = positions[i1], &v2 = positions[i2];
+        LogError("[MESH] %s: morph shape '%s' does not match the mesh vertex count", m_name.c_str(), name.c_str());
+        return -1;
+    }
 
-        // normal de face (usa NÃO normalizada p/ ponderar por área; normaliza no fim)
-        Vec3 n = Vec3::Cross(v1 - v0, v2 - v0);
-        const float len2 = n.x*n.x + n.y*n.y + n.z*n.z;
-        if (len2 < 1e-20f) continue; // triângulo degenerado
+    // deltas against the base shape, not against an already morphed one
+    const bool hasBase = m_morphBase[0].size() == (size_t)count * 4;
+    const bool hasNormalBase = m_morphBase[1].size() == (size_t)count * 4;
+    const float eps2 = epsilon * epsilon;
 
-        Vec3 w = angleWeighted ? Vec3::GetAngleWeights(v0, v1, v2) : Vec3(1.f);
+    std::vector<u32> vertices;
+    std::vector<Vec3> dPos, dNrm;
+    for (u32 v = 0; v < count; ++v)
+    {
+        const Vec3 base = hasBase ? Vec3(m_morphBase[0][v * 4], m_morphBase[0][v * 4 + 1], m_morphBase[0][v * 4 + 2]) : positions[v];
+        const Vec3 dp = shapePositions[v] - base;
+        Vec3 dn(0.0f, 0.0f, 0.0f);
+        if (shapeNormals)
+        {
+            const Vec3 baseNormal = hasNormalBase ? Vec3(m_morphBase[1][v * 4], m_morphBase[1][v * 4 + 1], m_morphBase[1][v * 4 + 2]) : normals[v];
+            dn = (*shapeNormals)[v] - baseNormal;
+        }
+        if (Vec3::Dot(dp, dp) <= eps2 && Vec3::Dot(dn, dn) <= eps2) continue;
 
-        normals[i0] += n * w.x;
-        normals[i1] += n * w.y;
-        normals[i2] += n * w.z;
+        vertices.push_back(v);
+        dPos.push_back(dp);
+        dNrm.push_back(dn);
     }
+    return AddMorphTarget(name, vertices, dPos, shapeNormals ? &dNrm : nullptr, nullptr);
+}
 
-    for (auto &nn : normals) nn = Vec3::Normalize(nn);
-
-    flags |= VBO_NORMAL;
-    isDirty = true;
+s32 Mesh::FindMorphTarget(const std::string &name) const
+{
+    for (u32 i = 0; i < m_morphTargets.size(); ++i)
+    {
+        if (m_morphTargets[i]->name == name) return (s32)i;
+    }
+    return -1;
 }
 
-void Mesh::CalculateTangents()
+void Mesh::SetMorphMode(MorphMode mode)
+{
+    if (mode == m_morphMode) return;
+    if (mode == MORPH_GPU)
+    {
+        // o shader soma os deltas: os streams voltam a forma base
+        if (!m_morphWeights.empty())
+        {
+            ApplyMorphWeights(nullptr, 0);
+        }
+    } else
+    {
+        float unused[MAX_GPU_MORPH_TARGETS];
+        bindMorphStreams(nullptr, 0, unused);
+    }
+    m_morphMode = mode;
+}
+
+void Mesh::captureMorphBase()
+{
+    const u32 count = (u32)positions.size();
+    for (u32 s = 0; s < 3; ++s)
+    {
+        m_morphBase[s].clear();
+    }
+
+    m_morphBase[0].resize((size_t)count * 4);
+    for (u32 v = 0; v < count; ++v)
+    {
+        float *b = &m_morphBase[0][v * 4];
+        b[0] = positions[v].x; b[1] = positions[v].y; b[2] = positions[v].z; b[3] = 0.0f;
+    }
+    if (normals.size() == count)
+    {
+        m_morphBase[1].resize((size_t)count * 4);
+        for (u32 v = 0; v < count; ++v)
+        {
+            float *b = &m_morphBase[1][v * 4];
+            b[0] = normals[v].x; b[1] = normals[v].y; b[2] = normals[v].z; b[3] = 0.0f;
+        }
+    }
+    if (tangents.size() == count)
+    {
+        m_morphBase[2].resize((size_t)count * 4);
+        for (u32 v = 0; v < count; ++v)
+        {
+            float *b = &m_morphBase[2][v * 4];
+            b[0] = tangents[v].x; b[1] = tangents[v].y; b[2] = tangents[v].z; b[3] = tangents[v].w;
+        }
+    }
+    for (u32 s = 0; s < 3; ++s)
+    {
+        m_morphAccum[s].resize(m_morphBase[s].size());
+    }
+    m_morphMark.assign(count, 0);
+    m_morphTouched.clear();
+}
+
+void Mesh::ApplyMorphWeights(const float *weights, u32 count)
+{
+    // meshes without CPU data can only morph on the GPU
+    if (m_morphTargets.empty() || m_cpuReleased) return;
+
+    const u32 targetCount = (u32)m_morphTargets.size();
+    bool changed = m_morphWeights.size() != targetCount;
+    for (u32 t = 0; t < targetCount && !changed; ++t)
+    {
+        const float w = (weights && t < count) ? weights[t] : 0.0f;
+        changed = w != m_morphWeights[t];
+    }
+    if (!changed) return;
+
+    bool active = false;
+    m_morphWeights.resize(targetCount);
+    for (u32 t = 0; t < targetCount; ++t)
+    {
+        m_morphWeights[t] = (weights && t < count) ? weights[t] : 0.0f;
+        active = active || m_morphWeights[t] != 0.0f;
+    }
+    if (!active && m_morphTouched.empty()) return;
+
+    if (m_morphBase[0].size() != positions.size() * 4)
+    {
+        captureMorphBase();
+    }
+
+    // vertices to rebuild: touched last time (1) + touched by the active targets (2)
+    m_morphDirty.clear();
+    for (u32 i = 0; i < m_morphTouched.size(); ++i)
+    {
+        const u32 v = m_morphTouched[i];
+        m_morphMark[v] = 1;
+        m_morphDirty.push_back(v);
+    }
+    for (u32 t = 0; t < targetCount; ++t)
+    {
+        if (m_morphWeights[t] == 0.0f) continue;
+        const std::vector<u32> &list = m_morphTargets[t]->vertices;
+        for (u32 k = 0; k < list.size(); ++k)
+        {
+            const u32 v = list[k];
+            if (m_morphMark[v] == 0) m_morphDirty.push_back(v);
+            m_morphMark[v] |= 2;
+        }
+    }
+    if (m_morphDirty.empty()) return;
+
+    const bool doNormals = !m_morphBase[1].empty();
+    const bool doTangents = !m_morphBase[2].empty();
+
+    for (u32 s = 0; s < 3; ++s)
+    {
+        if (m_morphBase[s].empty()) continue;
+        const float *base = m_morphBase[s].data();
+        float *accum = m_morphAccum[s].data();
+        for (u32 i = 0; i < m_morphDirty.size(); ++i)
+        {
+            const u32 o = m_morphDirty[i] * 4;
+            Simd_Store(accum + o, Simd_Load(base + o));
+        }
+    }
+
+    // accum[v] += w * delta, so o trabalho e proporcional aos vertices afetados
+    for (u32 t = 0; t < targetCount; ++t)
+    {
+        const float weight = m_morphWeights[t];
+        if (weight == 0.0f) continue;
+        const MorphTarget *target = m_morphTargets[t];
+        const simd4f w = Simd_Set1(weight);
+        const u32 n = (u32)target->vertices.size();
+        const u32 *list = target->vertices.data();
+
+        float *accum = m_morphAccum[0].data();
+        const float *delta = target->positions.data();
+        for (u32 k = 0; k < n; ++k)
+        {
+            float *a = accum + list[k] * 4;
+            Simd_Store(a, Simd_MulAdd(Simd_Load(delta + k * 4), w, Simd_Load(a)));
+        }
+        if (doNormals && !target->normals.empty())
+        {
+            accum = m_morphAccum[1].data();
+            delta = target->normals.data();
+            for (u32 k = 0; k < n; ++k)
+            {
+                float *a = accum + list[k] * 4;
+                Simd_Store(a, Simd_MulAdd(Simd_Load(delta + k * 4), w, Simd_Load(a)));
+            }
+        }
+        if (doTangents && !target->tangents.empty())
+        {
+            accum = m_morphAccum[2].data();
+            delta = target->tangents.data();
+            for (u32 k = 0; k < n; ++k)
+            {
+                float *a = accum + list[k] * 4;
+                Simd_Store(a, Simd_MulAdd(Simd_Load(delta + k * 4), w, Simd_Load(a)));
+            }
+        }
+    }
+
+    m_morphTouched.clear();
+    for (u32 i = 0; i < m_morphDirty.size(); ++i)
+    {
+        const u32 v = m_morphDirty[i];
+        const float *p = &m_morphAccum[0][v * 4];
+        positions[v].set(p[0], p[1], p[2]);
+        if (doNormals)
+        {
+            const float *n = &m_morphAccum[1][v * 4];
+            const float len2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+            const float inv = len2 > 1e-20f ? 1.0f / sqrtf(len2) : 0.0f;
+            normals[v].set(n[0] * inv, n[1] * inv, n[2] * inv);
+        }
+        if (doTangents)
+        {
+            const float *t = &m_morphAccum[2][v * 4];
+            const float len2 = t[0] * t[0] + t[1] * t[1] + t[2] * t[2];
+            const float inv = len2 > 1e-20f ? 1.0f / sqrtf(len2) : 0.0f;
+            tangents[v] = Vec4(t[0] * inv, t[1] * inv, t[2] * inv, t[3]);
+        }
+        if (m_morphMark[v] & 2) m_morphTouched.push_back(v);
+        m_morphMark[v] = 0;
+    }
+
+    std::sort(m_morphDirty.begin(), m_morphDirty.end());
+    uploadMorphRanges(m_morphDirty);
+}
+
+bool Mesh::MorphInto(const float *weights, u32 count, std::vector<Vec3> &outPositions,
+                     std::vector<Vec3> &outNormals, std::vector<u32> &touched) const
+{
+    const u32 vertexCount = (u32)positions.size();
+    if (m_morphTargets.empty() || m_cpuReleased || vertexCount == 0) return false;
+
+    // base shape: what ApplyMorphWeights captured, else the streams themselves
+    const bool hasBase = m_morphBase[0].size() == (size_t)vertexCount * 4;
+    const bool doNormals = normals.size() == vertexCount;
+    auto basePosition = [&](u32 v) { return hasBase ? Vec3(m_morphBase[0][v * 4], m_morphBase[0][v * 4 + 1], m_morphBase[0][v * 4 + 2]) : positions[v]; };
+    auto baseNormal = [&](u32 v) { return !m_morphBase[1].empty() ? Vec3(m_morphBase[1][v * 4], m_morphBase[1][v * 4 + 1], m_morphBase[1][v * 4 + 2]) : normals[v]; };
+
+    if (outPositions.size() != vertexCount)
+    {
+        outPositions.resize(vertexCount);
+        for (u32 v = 0; v < vertexCount; ++v) outPositions[v] = basePosition(v);
+        outNormals.resize(doNormals ? vertexCount : 0);
+        for (u32 v = 0; v < outNormals.size(); ++v) outNormals[v] = baseNormal(v);
+        touched.clear();
+    }
+
+    // so os vertices movidos da ultima vez voltam a base
+    for (u32 i = 0; i < touched.size(); ++i)
+    {
+        const u32 v = touched[i];
+        outPositions[v] = basePosition(v);
+        if (doNormals) outNormals[v] = baseNormal(v);
+    }
+    touched.clear();
+
+    for (u32 t = 0; t < m_morphTargets.size(); ++t)
+    {
+        const float weight = (weights && t < count) ? weights[t] : 0.0f;
+        if (weight == 0.0f) continue;
+        const MorphTarget *target = m_morphTargets[t];
+        const bool targetNormals = doNormals && !target->normals.empty();
+        for (u32 k = 0; k < target->vertices.size(); ++k)
+        {
+            const u32 v = target->vertices[k];
+            const float *d = &target->positions[k * 4];
+            outPositions[v] += Vec3(d[0], d[1], d[2]) * weight;
+            if (targetNormals)
+            {
+                const float *n = &target->normals[k * 4];
+                outNormals[v] += Vec3(n[0], n[1], n[2]) * weight;
+            }
+            touched.push_back(v);
+        }
+    }
+    if (touched.empty()) return false;
+
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    if (doNormals)
+    {
+        for (u32 i = 0; i < touched.size(); ++i)
+        {
+            Vec3 &n = outNormals[touched[i]];
+            const float len2 = Vec3::Dot(n, n);
+            n = len2 > 1e-20f ? n * (1.0f / sqrtf(len2)) : Vec3(0.0f, 0.0f, 0.0f);
+        }
+    }
+    return true;
+}
+
+Mesh::VertexBuffer *Mesh::findBuffer(s32 usage) const
+{
+    for (u32 i = 0; i < buffers.size(); ++i)
+    {
+        if (buffers[i]->usage == usage) return buffers[i];
+    }
+    return nullptr;
+}
+
+void Mesh::uploadMorphRanges(const std::vector<u32> &sorted)
+{
+    const u32 count = (u32)positions.size();
+    const bool doNormals = normals.size() == count;
+    const bool doTangents = tangents.size() == count;
+
+    // a full upload is pending anyway
+    if (isDirty)
+    {
+        flags |= VBO_POSITION;
+        if (doNormals) flags |= VBO_NORMAL;
+        if (doTangents) flags |= VBO_TANGENT;
+        return;
+    }
+
+    // runs [first, last] with small gaps merged
+    std::vector<std::pair<u32, u32>> runs;
+    u32 first = sorted[0];
+    u32 last = sorted[0];
+    for (u32 i = 1; i < sorted.size(); ++i)
+    {
+        if (sorted[i] > last + MORPH_RUN_GAP)
+        {
+            runs.push_back(std::make_pair(first, last));
+            first = sorted[i];
+        }
+        last = sorted[i];
+    }
+    runs.push_back(std::make_pair(first, last));
+
+    const VertexBuffer *buffer = findBuffer(VertexFormat::POSITION);
+    if (buffer)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+        for (u32 r = 0; r < runs.size(); ++r)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, runs[r].first * sizeof(Vec3), (runs[r].second - runs[r].first + 1) * sizeof(Vec3), &positions[runs[r].first]);
+        }
+    }
+    buffer = doNormals ? findBuffer(VertexFormat::NORMAL) : nullptr;
+    if (buffer)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+        for (u32 r = 0; r < runs.size(); ++r)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, runs[r].first * sizeof(Vec3), (runs[r].second - runs[r].first + 1) * sizeof(Vec3), &normals[runs[r].first]);
+        }
+    }
+    buffer = doTangents ? findBuffer(VertexFormat::TANGENT) : nullptr;
+    if (buffer)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->id);
+        for (u32 r = 0; r < runs.size(); ++r)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, runs[r].first * sizeof(Vec4), (runs[r].second - runs[r].first + 1) * sizeof(Vec4), &tangents[runs[r].first]);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::buildMorphStreams(MorphTarget *target)
+{
+    // dense copy (zero where the target does not move) so it can be a vertex attribute
+    std::vector<Vec3> dense(GetVertexCount(), Vec3(0.0f, 0.0f, 0.0f));
+    for (u32 k = 0; k < target->vertices.size(); ++k)
+    {
+        const float *d = &target->positions[k * 4];
+        dense[target->vertices[k]].set(d[0], d[1], d[2]);
+    }
+    glGenBuffers(1, &target->positionVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, target->positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, dense.size() * sizeof(Vec3), dense.data(), GL_STATIC_DRAW);
+
+    if (!target->normals.empty())
+    {
+        std::fill(dense.begin(), dense.end(), Vec3(0.0f, 0.0f, 0.0f));
+        for (u32 k = 0; k < target->vertices.size(); ++k)
+        {
+            const float *d = &target->normals[k * 4];
+            dense[target->vertices[k]].set(d[0], d[1], d[2]);
+        }
+        glGenBuffers(1, &target->normalVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, target->normalVBO);
+        glBufferData(GL_ARRAY_BUFFER, dense.size() * sizeof(Vec3), dense.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::bindMorphStreams(const float *weights, u32 count, float outWeights[MAX_GPU_MORPH_TARGETS])
+{
+    // the strongest |weight| targets win the attribute slots
+    s32 slots[MAX_GPU_MORPH_TARGETS];
+    for (u32 s = 0; s < MAX_GPU_MORPH_TARGETS; ++s)
+    {
+        slots[s] = -1;
+        outWeights[s] = 0.0f;
+    }
+    const u32 n = weights ? std::min(count, (u32)m_morphTargets.size()) : 0;
+    for (u32 t = 0; t < n; ++t)
+    {
+        const float a = fabsf(weights[t]);
+        if (a == 0.0f) continue;
+        for (u32 s = 0; s < MAX_GPU_MORPH_TARGETS; ++s)
+        {
+            if (slots[s] >= 0 && a <= fabsf(weights[slots[s]])) continue;
+            for (u32 m = MAX_GPU_MORPH_TARGETS - 1; m > s; --m)
+            {
+                slots[m] = slots[m - 1];
+            }
+            slots[s] = (s32)t;
+            break;
+        }
+    }
+
+    bool same = true;
+    for (u32 s = 0; s < MAX_GPU_MORPH_TARGETS; ++s)
+    {
+        if (slots[s] >= 0) outWeights[s] = weights[slots[s]];
+        same = same && slots[s] == m_morphSlots[s];
+    }
+    if (same) return;
+
+    glBindVertexArray(VAO);
+    for (u32 s = 0; s < MAX_GPU_MORPH_TARGETS; ++s)
+    {
+        const u32 positionAttribute = MORPH_ATTRIBUTE_BASE + s;
+        const u32 normalAttribute = MORPH_ATTRIBUTE_BASE + MAX_GPU_MORPH_TARGETS + s;
+        m_morphSlots[s] = slots[s];
+        if (slots[s] < 0)
+        {
+            glDisableVertexAttribArray(positionAttribute);
+            glDisableVertexAttribArray(normalAttribute);
+            continue;
+        }
+
+        MorphTarget *target = m_morphTargets[slots[s]];
+        if (target->positionVBO == 0)
+        {
+            buildMorphStreams(target);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, target->positionVBO);
+        glEnableVertexAttribArray(positionAttribute);
+        glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec3), 0);
+        if (target->normalVBO != 0)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, target->normalVBO);
+            glEnableVertexAttribArray(normalAttribute);
+            glVertexAttribPointer(normalAttribute, 3, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec3), 0);
+        } else
+        {
+            glDisableVertexAttribArray(normalAttribute);
+        }
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::releaseMorphTargets()
+{
+    for (u32 i = 0; i < m_morphTargets.size(); ++i)
+    {
+        MorphTarget *target = m_morphTargets[i];
+        if (target->positionVBO != 0) glDeleteBuffers(1, &target->positionVBO);
+        if (target->normalVBO != 0) glDeleteBuffers(1, &target->normalVBO);
+        delete target;
+    }
+    m_morphTargets.clear();
+    for (u32 s = 0; s < 3; ++s)
+    {
+        FreeVector(m_morphBase[s]);
+        FreeVector(m_morphAccum[s]);
+    }
+    FreeVector(m_morphTouched);
+    FreeVector(m_morphDirty);
+    FreeVector(m_morphMark);
+    m_morphWeights.clear();
+    for (u32 s = 0; s < MAX_GPU_MORPH_TARGETS; ++s)
+    {
+        m_morphSlots[s] = -1;
+    }
+}
+
+u64 Mesh::getMorphCPUBytes() const
+{
+    u64 total = 0;
+    for (u32 i = 0; i < m_morphTargets.size(); ++i)
+    {
+        const MorphTarget *target = m_morphTargets[i];
+        total += (u64)target->vertices.capacity() * sizeof(u32) +
+                 (u64)(target->positions.capacity() + target->normals.capacity() + target->tangents.capacity()) * sizeof(float);
+    }
+    for (u32 s = 0; s < 3; ++s)
+    {
+        total += (u64)(m_morphBase[s].capacity() + m_morphAccum[s].capacity()) * sizeof(float);
+    }
+    total += (u64)(m_morphTouched.capacity() + m_morphDirty.capacity()) * sizeof(u32) + m_morphMark.capacity();
+    return total;
+}
+
+//*******************************************************
+// Double buffering
+//*******************************************************
+
+enum
+{
+    DOUBLE_BUFFER_IDLE = 0,
+    DOUBLE_BUFFER_RUNNING = 1,
+    DOUBLE_BUFFER_READY = 2
+};
+
+void Mesh::SetDoubleBuffered(bool enable, u32 ringSize)
+{
+    if (!enable)
+    {
+        releaseDoubleBuffer();
+        return;
+    }
+    if (m_doubleBuffer) return;
+    if (m_cpuReleased)
+    {
+        LogError("[MESH] %s: double buffering needs the CPU positions", m_name.c_str());
+        return;
+    }
+    if (isDirty)
+    {
+        Upload();
+    }
+
+    DoubleBuffer *db = new DoubleBuffer();
+    db->state = DOUBLE_BUFFER_IDLE;
+    db->ringSize = std::max(1u, std::min(ringSize, MAX_MESH_RING));
+    db->slot = 0;
+    // slot 0 is the VBO the mesh already has
+    const VertexBuffer *position = findBuffer(VertexFormat::POSITION);
+    const VertexBuffer *normal = findBuffer(VertexFormat::NORMAL);
+    for (u32 i = 0; i < MAX_MESH_RING; ++i)
+    {
+        db->positionVBO[i] = 0;
+        db->normalVBO[i] = 0;
+        db->capacity[i] = 0;
+        if (i >= db->ringSize) continue;
+        if (i == 0)
+        {
+            db->positionVBO[0] = position ? position->id : 0;
+            db->normalVBO[0] = normal ? normal->id : 0;
+            db->capacity[0] = (u32)positions.size();
+            continue;
+        }
+        glGenBuffers(1, &db->positionVBO[i]);
+        if (normal) glGenBuffers(1, &db->normalVBO[i]);
+    }
+
+    // the worker swaps the streams, they must stay on the CPU
+    m_residency = RESIDENCY_KEEP_ALL;
+    m_dynamic = true;
+    m_doubleBuffer = db;
+    MeshManager::Instance().m_doubleBuffered.push_back(this);
+}
+
+bool Mesh::UpdateAsync(const std::function<void(DynamicVertices &)> &job)
+{
+    DoubleBuffer *db = m_doubleBuffer;
+    if (!db || m_cpuReleased) return false;
+    u32 expected = DOUBLE_BUFFER_IDLE;
+    if (!db->state.compare_exchange_strong(expected, DOUBLE_BUFFER_RUNNING)) return false;
+
+    const u32 count = (u32)positions.size();
+    const bool hasNormals = db->normalVBO[0] != 0 && normals.size() == count;
+    db->positions.resize(count);
+    db->normals.resize(hasNormals ? count : 0);
+
+    DynamicVertices vertices;
+    vertices.previous = positions.data();
+    vertices.positions = db->positions.data();
+    vertices.normals = hasNormals ? db->normals.data() : nullptr;
+    vertices.count = count;
+
+    ThreadPool::Instance().Submit([db, vertices, job]() mutable
+    {
+        job(vertices);
+        if (vertices.count > 0)
+        {
+            db->bounds.Set(vertices.positions[0], vertices.positions[0]);
+            for (u32 i = 1; i < vertices.count; ++i)
+            {
+                db->bounds.AddPoint(vertices.positions[i]);
+            }
+        }
+        db->state = DOUBLE_BUFFER_READY;
+    });
+    return true;
+}
+
+void Mesh::WaitUpdate() const
+{
+    if (!m_doubleBuffer) return;
+    while (m_doubleBuffer->state == DOUBLE_BUFFER_RUNNING)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void Mesh::uploadRing(u32 usage, u32 vbo, const Vec3 *data, bool resize)
+{
+    VertexBuffer *buffer = findBuffer((s32)usage);
+    if (!buffer || vbo == 0) return;
+    const GLsizeiptr bytes = (GLsizeiptr)positions.size() * sizeof(Vec3);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (resize || m_doubleBuffer->ringSize == 1)
+    {
+        // new storage: with one slot this orphans the buffer the GPU may still read
+        glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_DYNAMIC_DRAW);
+    } else
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+    }
+    glVertexAttribPointer(buffer->attribute, 3, GL_FLOAT, GL_FALSE, (GLint)sizeof(Vec3), 0);
+    buffer->id = vbo;
+    buffer->bytes = (u64)bytes;
+}
+
+bool Mesh::SwapBuffers()
+{
+    DoubleBuffer *db = m_doubleBuffer;
+    if (!db || db->state != DOUBLE_BUFFER_READY) return false;
+    if (db->positions.size() != positions.size())
+    {
+        LogWarning("[MESH] %s: vertex count changed during the update, dropped", m_name.c_str());
+        db->state = DOUBLE_BUFFER_IDLE;
+        return false;
+    }
+
+    positions.swap(db->positions);
+    if (!db->normals.empty())
+    {
+        normals.swap(db->normals);
+    }
+    m_boundingBox = db->bounds;
+
+    // next slot of the ring: the GPU finished with it frames ago
+    db->slot = (db->slot + 1) % db->ringSize;
+    const u32 count = (u32)positions.size();
+    const bool resize = db->capacity[db->slot] != count;
+    db->capacity[db->slot] = count;
+
+    glBindVertexArray(VAO);
+    uploadRing(VertexFormat::POSITION, db->positionVBO[db->slot], positions.data(), resize);
+    if (!db->normals.empty())
+    {
+        uploadRing(VertexFormat::NORMAL, db->normalVBO[db->slot], normals.data(), resize);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    db->state = DOUBLE_BUFFER_IDLE;
+    return true;
+}
+
+void Mesh::releaseDoubleBuffer()
+{
+    DoubleBuffer *db = m_doubleBuffer;
+    if (!db) return;
+    WaitUpdate();
+
+    // the current slot is owned by buffers and deleted with them
+    for (u32 i = 0; i < db->ringSize; ++i)
+    {
+        if (i == db->slot) continue;
+        if (db->positionVBO[i] != 0) glDeleteBuffers(1, &db->positionVBO[i]);
+        if (db->normalVBO[i] != 0) glDeleteBuffers(1, &db->normalVBO[i]);
+    }
+    std::vector<Mesh *> &meshes = MeshManager::Instance().m_doubleBuffered;
+    meshes.erase(std::remove(meshes.begin(), meshes.end(), this), meshes.end());
+    delete db;
+    m_doubleBuffer = nullptr;
+}
+
+void MeshManager::SwapBuffers()
+{
+    for (u32 i = 0; i < m_doubleBuffered.size(); ++i)
+    {
+        m_doubleBuffered[i]->SwapBuffers();
+    }
+}
+
+//*******************************************************
+// Meshlets
+//*******************************************************
+
+u32 Mesh::BuildMeshlets(u32 maxVertices, u32 maxTriangles)
+{
+    m_meshlets.Clear();
+    if (m_cpuReleased || indices.size() < 3 || positions.empty())
+    {
+        LogError("[MESH] %s: meshlets need the CPU indices and positions", m_name.c_str());
+        return 0;
+    }
+    const u32 count = m_meshlets.Build(positions, indices, m_subMeshes, maxVertices, maxTriangles);
+    flags |= VBO_INDICES;
+    isDirty = true;
+
+    LogInfo("[MESH] %s: %u meshlets (%u triangles)", m_name.c_str(), count, (u32)indices.size() / 3);
+    return count;
+}
+
+u32 Mesh::CullMeshlets(const Mat4 &modelView, const Mat4 &proj, bool backface, MeshletStats *stats)
+{
+    if (!HasMeshlets())
+    {
+        m_meshlets.DrawAll(GetIndexCount());
+        return 0;
+    }
+    return m_meshlets.Cull(modelView, proj, backface, stats);
+}
+
+void Mesh::RenderMeshlets()
+{
+    if (m_uploading) return;
+    if (isDirty)
+    {
+        Upload();
+    }
+    if (m_meshlets.GetDraws().empty()) return;
+
+    glBindVertexArray(VAO);
+    drawMeshlets(0, GetIndexCount());
+    glBindVertexArray(0);
+}
+
+void Mesh::drawMeshlets(u32 indexStart, u32 indexCount) const
+{
+    const std::vector<u32> &draws = m_meshlets.GetDraws();
+    const u32 indexEnd = indexStart + indexCount;
+    for (u32 i = 0; i < draws.size(); i += 2)
+    {
+        if (draws[i] < indexStart || draws[i] >= indexEnd) continue;
+        glDrawElements(GL_TRIANGLES, draws[i + 1], GL_UNSIGNED_INT, (void *)((size_t)draws[i] * sizeof(unsigned int)));
+    }
+}
+
+int Mesh::AddFace(u32 v0, u32 v1, u32 v2)
+{
+    indices.push_back(v0);
+    indices.push_back(v1);
+    indices.push_back(v2);
+    if (m_subMeshOpen)
+    {
+        m_subMeshes.back().indexCount += 3;
+    }
+    flags |= VBO_INDICES;
+     isDirty = true;
+    return (int)indices.size() - 3;
+}
+
+
+
+//*******************************************************
+// Submeshes
+//*******************************************************
+
+s32 Mesh::AddSubMesh(u32 indexStart, u32 indexCount, u32 material)
+{
+    if (indexStart % 3 != 0 || indexCount % 3 != 0 || indexStart + indexCount > GetIndexCount())
+    {
+        LogError("[MESH] %s: invalid submesh range %u + %u (%u indices)", m_name.c_str(), indexStart, indexCount, GetIndexCount());
+        return -1;
+    }
+    SubMesh subMesh;
+    subMesh.indexStart = indexStart;
+    subMesh.indexCount = indexCount;
+    subMesh.material = material;
+    m_subMeshes.push_back(subMesh);
+    m_subMeshOpen = false;
+    m_meshlets.Invalidate();    // clusters must be rebuilt per submesh
+    return (s32)m_subMeshes.size() - 1;
+}
+
+s32 Mesh::BeginSubMesh(u32 material)
+{
+    const s32 index = AddSubMesh(GetIndexCount(), 0, material);
+    m_subMeshOpen = index >= 0;
+    return index;
+}
+
+void Mesh::ClearSubMeshes()
+{
+    m_subMeshes.clear();
+    m_subMeshOpen = false;
+    m_meshlets.Invalidate();
+}
+
+void Mesh::CalculateNormals()
+{
+
+    if (indices.size() > 0) 
+    {
+
+        if (normals.size() != positions.size()) 
+        {
+            for (size_t i = 0; i < positions.size(); ++i) 
+            {
+                normals.push_back(Vec3(0.0f, 0.0f, 0.0f));
+            }
+        }
+        for (u32 i = 0; i < GetIndexCount(); i += 3)
+        {
+            Plane3D plane = Plane3D(positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]]);
+          
+            Vec3 normal = plane.normal;
+            normals[indices[i]] = normal;
+            normals[indices[i + 1]] = normal;
+            normals[indices[i + 2]] = normal;
+
+        }
+
+
+         flags |= VBO_NORMAL;
+         isDirty = true;
+    }
+
+       
+}
+
+bool Mesh::CheckIntersection(const Mat4 &mat, const Vec3 &rayOrig,
+                             const Vec3 &rayDir, Vec3 &intsPos) const
+{
+    return false;
+}
+
+void Mesh::Clear()
+{
+    if (m_doubleBuffer)
+    {
+        // the pending update belongs to the old vertices
+        WaitUpdate();
+        m_doubleBuffer->state = 0;
+    }
+    positions.clear();
+    normals.clear();
+    texCoords.clear();
+    indices.clear();
+    colors.clear();
+    blendWeights.clear();
+    blendIndices.clear();
+    m_hasSkin = false;
+    releaseMorphTargets();
+    m_meshlets.Release();
+    m_subMeshes.clear();
+    m_subMeshOpen = false;
+    m_boundingBox.Clear();
+    m_cpuReleased = false;
+    m_vertexCount = 0;
+    m_indexCount = 0;
+}
+
+
+ 
+
+void Mesh::CalculateSmothNormals(bool angleWeighted)
+{
+    if (indices.empty()) return;
+
+ 
+    normals.assign(positions.size(), Vec3(0.0f));
+
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const u32 i0 = indices[i+0], i1 = indices[i+1], i2 = indices[i+2];
+        const Vec3 &v0 = positions[i0], &v1 = positions[i1], &v2 = positions[i2];
+
+        // normal de face (usa NÃO normalizada p/ ponderar por área; normaliza no fim)
+        Vec3 n = Vec3::Cross(v1 - v0, v2 - v0);
+        const float len2 = n.x*n.x + n.y*n.y + n.z*n.z;
+        if (len2 < 1e-20f) continue; // triângulo degenerado
+
+        Vec3 w = angleWeighted ? Vec3::GetAngleWeights(v0, v1, v2) : Vec3(1.f);
+
+        normals[i0] += n * w.x;
+        normals[i1] += n * w.y;
+        normals[i2] += n * w.z;
+    }
+
+    for (auto &nn : normals) nn = Vec3::Normalize(nn);
+
+    flags |= VBO_NORMAL;
+    isDirty = true;
+}
+
+void Mesh::CalculateTangents()
 {
     if (indices.empty()) return;
 
@@ -881,6 +2140,23 @@ bool MeshManager::Add(Mesh *mesh, const std::string &name)
     return true;
 }
 
+bool MeshManager::Remove(Mesh *mesh)
+{
+    auto it = std::find(m_meshes.begin(), m_meshes.end(), mesh);
+    if (it == m_meshes.end()) return false;
+    m_meshes.erase(it);
+    for (auto named = m_meshesByName.begin(); named != m_meshesByName.end(); ++named)
+    {
+        if (named->second == mesh)
+        {
+            m_meshesByName.erase(named);
+            break;
+        }
+    }
+    delete mesh;
+    return true;
+}
+
 void MeshManager::Clear()
 {
     for (auto mesh : m_meshes) 
@@ -921,6 +2197,481 @@ Mesh *MeshManager::Get(u32 index)
     return nullptr;
 }
 
+u64 MeshManager::GetCPUBytes() const
+{
+    u64 total = 0;
+    for (auto mesh : m_meshes)
+    {
+        total += mesh->GetCPUBytes();
+    }
+    return total;
+}
+
+u64 MeshManager::GetGPUBytes() const
+{
+    u64 total = 0;
+    for (auto mesh : m_meshes)
+    {
+        total += mesh->GetGPUBytes();
+    }
+    return total;
+}
+
+void MeshManager::LogMemoryUsage() const
+{
+    static const char *residencyNames[] = {"keep", "collision", "gpu"};
+    for (auto &it : m_meshesByName)
+    {
+        const Mesh *mesh = it.second;
+        LogInfo("[MESH] %-16s cpu %8llu bytes  gpu %8llu bytes  (%s)", it.first.c_str(),
+                (unsigned long long)mesh->GetCPUBytes(), (unsigned long long)mesh->GetGPUBytes(), residencyNames[mesh->GetResidency()]);
+    }
+    LogInfo("[MESH] %u meshes, cpu %llu bytes, gpu %llu bytes", (u32)m_meshes.size(),
+            (unsigned long long)GetCPUBytes(), (unsigned long long)GetGPUBytes());
+}
+
+//*******************************************************
+// Simplification (quadric error edge collapse)
+//*******************************************************
+
+namespace
+{
+    // symmetric 4x4: xx xy xz xw yy yz yw zz zw ww
+    struct Quadric
+    {
+        double q[10];
+        double weight;
+    };
+
+    void QuadricAddPlane(Quadric &m, double a, double b, double c, double d, double w)
+    {
+        m.q[0] += w * a * a; m.q[1] += w * a * b; m.q[2] += w * a * c; m.q[3] += w * a * d;
+        m.q[4] += w * b * b; m.q[5] += w * b * c; m.q[6] += w * b * d;
+        m.q[7] += w * c * c; m.q[8] += w * c * d;
+        m.q[9] += w * d * d;
+        m.weight += w;
+    }
+
+    void QuadricAdd(Quadric &m, const Quadric &o)
+    {
+        for (u32 i = 0; i < 10; ++i) m.q[i] += o.q[i];
+        m.weight += o.weight;
+    }
+
+    // mean squared distance (area weighted) of p to the planes in m
+    double QuadricError(const Quadric &m, const Vec3 &p)
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        const double e = m.q[0] * x * x + 2.0 * m.q[1] * x * y + 2.0 * m.q[2] * x * z + 2.0 * m.q[3] * x +
+                         m.q[4] * y * y + 2.0 * m.q[5] * y * z + 2.0 * m.q[6] * y +
+                         m.q[7] * z * z + 2.0 * m.q[8] * z + m.q[9];
+        return (e > 0.0 && m.weight > 0.0) ? e / m.weight : 0.0;
+    }
+
+    struct Collapse
+    {
+        double cost;
+        u32 from;
+        u32 to;
+        bool operator<(const Collapse &o) const { return cost < o.cost; }
+    };
+
+    u64 PositionKey(const Vec3 &p)
+    {
+        u32 bits[3];
+        memcpy(bits, &p.x, sizeof(bits));
+        return ((u64)bits[0] * 73856093u) ^ ((u64)bits[1] * 19349663u << 16) ^ ((u64)bits[2] * 83492791u << 32);
+    }
+}
+
+Mesh *MeshManager::Simplify(Mesh *source, float ratio, float targetError, const std::string &name)
+{
+    if (!source || !source->IsCPUResident() || source->indices.size() < 3 || source->indices.size() % 3 != 0)
+    {
+        LogError("[MESH] Simplify needs a triangle mesh with CPU data");
+        return nullptr;
+    }
+    const std::vector<Vec3> &positions = source->positions;
+    const u32 vertexCount = (u32)positions.size();
+    const u32 targetCount = std::max(3u, (u32)((float)source->indices.size() * Clamp(ratio, 0.0f, 1.0f)) / 3 * 3);
+
+    // weld by position: several vertices on the same spot = uv/normal seam
+    std::vector<u32> weld(vertexCount);
+    std::vector<u32> wedges(vertexCount, 0);
+    {
+        std::unordered_multimap<u64, u32> table;
+        table.reserve(vertexCount);
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            const u64 key = PositionKey(positions[v]);
+            weld[v] = v;
+            auto range = table.equal_range(key);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (positions[it->second] == positions[v])
+                {
+                    weld[v] = it->second;
+                    break;
+                }
+            }
+            if (weld[v] == v) table.emplace(key, v);
+            wedges[weld[v]]++;
+        }
+    }
+
+    // open borders and non manifold edges (in welded space)
+    std::vector<u8> locked(vertexCount, 0);
+    {
+        std::unordered_map<u64, u32> edges;
+        edges.reserve(source->indices.size());
+        const std::vector<unsigned int> &idx = source->indices;
+        for (u32 i = 0; i < idx.size(); i += 3)
+        {
+            for (u32 e = 0; e < 3; ++e)
+            {
+                const u64 a = weld[idx[i + e]], b = weld[idx[i + (e + 1) % 3]];
+                edges[(a << 32) | b]++;
+            }
+        }
+        for (auto &it : edges)
+        {
+            const u32 a = (u32)(it.first >> 32), b = (u32)(it.first & 0xFFFFFFFFu);
+            auto reverse = edges.find(((u64)b << 32) | a);
+            if (it.second != 1 || reverse == edges.end() || reverse->second != 1)
+            {
+                locked[a] = locked[b] = 1;
+            }
+        }
+    }
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        // seams stay fixed, every wedge keeps its own attributes
+        if (wedges[weld[v]] > 1 || locked[weld[v]]) locked[v] = 1;
+    }
+
+    // submesh of every triangle, material borders stay fixed too
+    const u32 triangleCount = (u32)source->indices.size() / 3;
+    std::vector<u32> groups(triangleCount, 0xFFFFFFFF);
+    for (u32 g = 0; g < source->m_subMeshes.size(); ++g)
+    {
+        const SubMesh &subMesh = source->m_subMeshes[g];
+        const u32 last = std::min(triangleCount, (subMesh.indexStart + subMesh.indexCount) / 3);
+        for (u32 t = subMesh.indexStart / 3; t < last; ++t) groups[t] = g;
+    }
+    if (!source->m_subMeshes.empty())
+    {
+        std::vector<u32> vertexGroup(vertexCount, 0xFFFFFFFF);
+        for (u32 i = 0; i < source->indices.size(); ++i)
+        {
+            const u32 v = weld[source->indices[i]];
+            const u32 g = groups[i / 3];
+            if (vertexGroup[v] == 0xFFFFFFFF) vertexGroup[v] = g;
+            else if (vertexGroup[v] != g) locked[v] = 1;
+        }
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            if (locked[weld[v]]) locked[v] = 1;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+    std::vector<unsigned int> idx = source->indices;
+    for (u32 i = 0; i < idx.size(); i += 3)
+    {
+        const Vec3 &p0 = positions[idx[i]], &p1 = positions[idx[i + 1]], &p2 = positions[idx[i + 2]];
+        Vec3 n = Vec3::Cross(p1 - p0, p2 - p0);
+        const float len = n.length();
+        if (len <= 1e-12f) continue;
+        n = n * (1.0f / len);
+        const double d = -(double)Vec3::Dot(n, p0);
+        for (u32 k = 0; k < 3; ++k)
+        {
+            QuadricAddPlane(quadrics[idx[i + k]], n.x, n.y, n.z, d, len * 0.5);
+        }
+    }
+
+    BoundingBox box(positions[0], positions[0]);
+    for (u32 v = 1; v < vertexCount; ++v) box.AddPoint(positions[v]);
+    const double maxError = (double)targetError * (double)(box.max - box.min).length();
+    const double errorLimit = maxError * maxError;
+
+    std::vector<Collapse> candidates;
+    std::vector<u32> fanStart(vertexCount + 1);
+    std::vector<u32> fan;
+    std::vector<u8> touched(vertexCount);
+    double worst = 0.0;
+
+    for (u32 pass = 0; pass < 64 && idx.size() > targetCount; ++pass)
+    {
+        // triangles around every vertex
+        std::fill(fanStart.begin(), fanStart.end(), 0);
+        for (u32 i = 0; i < idx.size(); ++i) fanStart[idx[i] + 1]++;
+        for (u32 v = 0; v < vertexCount; ++v) fanStart[v + 1] += fanStart[v];
+        fan.resize(idx.size());
+        {
+            std::vector<u32> cursor(fanStart.begin(), fanStart.end() - 1);
+            for (u32 i = 0; i < idx.size(); ++i) fan[cursor[idx[i]]++] = i / 3;
+        }
+
+        candidates.clear();
+        for (u32 i = 0; i < idx.size(); i += 3)
+        {
+            for (u32 e = 0; e < 3; ++e)
+            {
+                const u32 a = idx[i + e], b = idx[i + (e + 1) % 3];
+                if (!locked[a]) candidates.push_back({QuadricError(quadrics[a], positions[b]), a, b});
+                if (!locked[b]) candidates.push_back({QuadricError(quadrics[b], positions[a]), b, a});
+            }
+        }
+        if (candidates.empty()) break;
+        std::sort(candidates.begin(), candidates.end());
+
+        // each collapse removes ~2 triangles; independent collapses only per pass
+        const u32 wanted = (u32)(idx.size() - targetCount) / 6 + 1;
+        std::fill(touched.begin(), touched.end(), 0);
+        u32 collapsed = 0;
+        for (u32 c = 0; c < candidates.size() && collapsed < wanted; ++c)
+        {
+            const Collapse &col = candidates[c];
+            if (col.cost > errorLimit) break;
+            if (touched[col.from] || touched[col.to]) continue;
+
+            // reject collapses that flip a remaining triangle
+            bool flips = false;
+            for (u32 f = fanStart[col.from]; f < fanStart[col.from + 1] && !flips; ++f)
+            {
+                const u32 *t = &idx[fan[f] * 3];
+                if (t[0] == col.to || t[1] == col.to || t[2] == col.to) continue;
+                Vec3 p[3], q[3];
+                for (u32 k = 0; k < 3; ++k)
+                {
+                    p[k] = positions[t[k]];
+                    q[k] = t[k] == col.from ? positions[col.to] : p[k];
+                }
+                const Vec3 before = Vec3::Cross(p[1] - p[0], p[2] - p[0]);
+                const Vec3 after = Vec3::Cross(q[1] - q[0], q[2] - q[0]);
+                flips = Vec3::Dot(before, after) <= 0.0f;
+            }
+            if (flips) continue;
+
+            for (u32 f = fanStart[col.from]; f < fanStart[col.from + 1]; ++f)
+            {
+                unsigned int *t = &idx[fan[f] * 3];
+                for (u32 k = 0; k < 3; ++k)
+                {
+                    touched[t[k]] = 1;
+                    if (t[k] == col.from) t[k] = col.to;
+                }
+            }
+            QuadricAdd(quadrics[col.to], quadrics[col.from]);
+            worst = std::max(worst, col.cost);
+            collapsed++;
+        }
+        if (collapsed == 0) break;
+
+        // drop the triangles that became degenerate
+        u32 write = 0;
+        for (u32 i = 0; i < idx.size(); i += 3)
+        {
+            if (idx[i] == idx[i + 1] || idx[i + 1] == idx[i + 2] || idx[i] == idx[i + 2]) continue;
+            groups[write / 3] = groups[i / 3];
+            idx[write++] = idx[i];
+            idx[write++] = idx[i + 1];
+            idx[write++] = idx[i + 2];
+        }
+        idx.resize(write);
+        groups.resize(write / 3);
+    }
+
+    if (idx.size() >= source->indices.size())
+    {
+        LogWarning("[MESH] Simplify %s: nothing to collapse within the error limit", source->GetName().c_str());
+        return nullptr;
+    }
+
+    // compact the vertices that are still referenced
+    Mesh *mesh = new Mesh(source->m_vertexFormat, source->m_material, false);
+    std::vector<u32> remap(vertexCount, 0xFFFFFFFFu);
+    const u32 count = vertexCount;
+    for (u32 i = 0; i < idx.size(); ++i)
+    {
+        const u32 v = idx[i];
+        if (remap[v] == 0xFFFFFFFFu)
+        {
+            remap[v] = (u32)mesh->positions.size();
+            mesh->positions.push_back(positions[v]);
+            if (source->normals.size() == count) mesh->normals.push_back(source->normals[v]);
+            if (source->texCoords.size() == count) mesh->texCoords.push_back(source->texCoords[v]);
+            if (source->texCoords2.size() == count) mesh->texCoords2.push_back(source->texCoords2[v]);
+            if (source->tangents.size() == count) mesh->tangents.push_back(source->tangents[v]);
+            if (source->colors.size() == count * 4) mesh->colors.insert(mesh->colors.end(), &source->colors[v * 4], &source->colors[v * 4] + 4);
+            if (source->blendWeights.size() == count) mesh->blendWeights.push_back(source->blendWeights[v]);
+            if (source->blendIndices.size() == count * 4) mesh->blendIndices.insert(mesh->blendIndices.end(), &source->blendIndices[v * 4], &source->blendIndices[v * 4] + 4);
+        }
+        mesh->indices.push_back(remap[v]);
+    }
+    // triangles kept their order, so every submesh is still one range
+    for (u32 g = 0; g < source->m_subMeshes.size(); ++g)
+    {
+        u32 first = 0xFFFFFFFF, last = 0;
+        for (u32 t = 0; t < groups.size(); ++t)
+        {
+            if (groups[t] != g) continue;
+            first = std::min(first, t);
+            last = t + 1;
+        }
+        SubMesh subMesh = source->m_subMeshes[g];
+        subMesh.indexStart = first == 0xFFFFFFFF ? 0 : first * 3;
+        subMesh.indexCount = first == 0xFFFFFFFF ? 0 : (last - first) * 3;
+        mesh->m_subMeshes.push_back(subMesh);
+    }
+    mesh->m_hasSkin = source->m_hasSkin;
+    mesh->m_castsShadows = source->m_castsShadows;
+    mesh->flags = VBO_POSITION | VBO_NORMAL | VBO_COLOR | VBO_TANGENT | VBO_TEXCOORD0 | VBO_TEXCOORD1 |
+                  VBO_BLENDWEIGHTS | VBO_BLENDINDICES | VBO_INDICES;
+    mesh->isDirty = true;
+    mesh->CalculateBoundingBox();
+
+    const std::string meshName = name.empty() ? source->GetName() + "_simplified" : name;
+    mesh->SetName(meshName);
+    if (!Add(mesh, meshName))
+    {
+        LogError("[MESH] Simplify: mesh %s already exists", meshName.c_str());
+        delete mesh;
+        return nullptr;
+    }
+    LogInfo("[MESH] Simplify %s: %u -> %u triangles, %u -> %u vertices (error %f)", source->GetName().c_str(),
+            (u32)source->indices.size() / 3, (u32)idx.size() / 3, vertexCount, mesh->GetVertexCount(), sqrt(worst));
+    return mesh;
+}
+
+u32 MeshManager::GenerateLODs(Mesh *mesh, u32 levels, std::vector<Mesh *> &lods, float reduction, float targetError)
+{
+    if (!mesh) return 0;
+    u32 previous = mesh->GetIndexCount();
+    float ratio = 1.0f;
+    u32 added = 0;
+    for (u32 level = 1; level <= levels; ++level)
+    {
+        // always from the original: the quadrics of a simplified mesh lose detail
+        ratio *= reduction;
+        char name[128];
+        snprintf(name, sizeof(name), "%s_LOD%u", mesh->GetName().c_str(), level);
+        Mesh *lod = Simplify(mesh, ratio, targetError * (float)level, name);
+        if (!lod) break;
+        // the error limit stopped it, another level would be the same mesh
+        if (lod->GetIndexCount() * 10 > previous * 9)
+        {
+            Remove(lod);
+            break;
+        }
+        previous = lod->GetIndexCount();
+        lods.push_back(lod);
+        added++;
+    }
+    return added;
+}
+
+Mesh *MeshManager::Merge(const std::vector<Mesh *> &meshes, const std::string &name)
+{
+    if (meshes.empty() || !meshes[0])
+    {
+        LogError("[MESH] Merge: no meshes");
+        return nullptr;
+    }
+    for (u32 i = 0; i < meshes.size(); ++i)
+    {
+        if (!meshes[i] || !meshes[i]->IsCPUResident() || meshes[i]->m_vertexFormat != meshes[0]->m_vertexFormat)
+        {
+            LogError("[MESH] Merge %s: mesh %u has no CPU data or another vertex format", name.c_str(), i);
+            return nullptr;
+        }
+    }
+
+    Mesh *mesh = new Mesh(meshes[0]->m_vertexFormat, meshes[0]->m_material, false);
+    for (u32 i = 0; i < meshes.size(); ++i)
+    {
+        const Mesh *source = meshes[i];
+        const u32 base = (u32)mesh->positions.size();
+        const u32 count = (u32)source->positions.size();
+        const u32 indexStart = (u32)mesh->indices.size();
+
+        // streams only some sources have are padded so they stay per vertex
+        mesh->positions.insert(mesh->positions.end(), source->positions.begin(), source->positions.end());
+        if (source->normals.size() == count) mesh->normals.insert(mesh->normals.end(), source->normals.begin(), source->normals.end());
+        else mesh->normals.resize(base + count, Vec3(0.0f, 1.0f, 0.0f));
+        if (source->texCoords.size() == count) mesh->texCoords.insert(mesh->texCoords.end(), source->texCoords.begin(), source->texCoords.end());
+        else mesh->texCoords.resize(base + count, Vec2(0.0f, 0.0f));
+        if (source->texCoords2.size() == count) mesh->texCoords2.insert(mesh->texCoords2.end(), source->texCoords2.begin(), source->texCoords2.end());
+        else mesh->texCoords2.resize(base + count, Vec2(0.0f, 0.0f));
+        if (source->tangents.size() == count) mesh->tangents.insert(mesh->tangents.end(), source->tangents.begin(), source->tangents.end());
+        else mesh->tangents.resize(base + count, Vec4(1.0f, 0.0f, 0.0f, 1.0f));
+        if (source->colors.size() == count * 4) mesh->colors.insert(mesh->colors.end(), source->colors.begin(), source->colors.end());
+        else mesh->colors.resize((base + count) * 4, 255);
+        if (source->blendWeights.size() == count) mesh->blendWeights.insert(mesh->blendWeights.end(), source->blendWeights.begin(), source->blendWeights.end());
+        else mesh->blendWeights.resize(base + count, Vec4(1.0f, 0.0f, 0.0f, 0.0f));
+        if (source->blendIndices.size() == count * 4) mesh->blendIndices.insert(mesh->blendIndices.end(), source->blendIndices.begin(), source->blendIndices.end());
+        else mesh->blendIndices.resize((base + count) * 4, 0);
+        mesh->m_hasSkin = mesh->m_hasSkin || source->m_hasSkin;
+
+        for (u32 j = 0; j < source->indices.size(); ++j)
+        {
+            mesh->indices.push_back(base + source->indices[j]);
+        }
+        if (source->m_subMeshes.empty())
+        {
+            mesh->AddSubMesh(indexStart, (u32)source->indices.size(), source->m_material);
+        } else
+        {
+            for (u32 s = 0; s < source->m_subMeshes.size(); ++s)
+            {
+                const SubMesh &subMesh = source->m_subMeshes[s];
+                mesh->AddSubMesh(indexStart + subMesh.indexStart, subMesh.indexCount, subMesh.material);
+            }
+        }
+    }
+
+    // drop the padding of streams no source had
+    const u32 total = (u32)mesh->positions.size();
+    bool has[7] = {false, false, false, false, false, false, false};
+    for (u32 i = 0; i < meshes.size(); ++i)
+    {
+        const Mesh *source = meshes[i];
+        const u32 count = (u32)source->positions.size();
+        has[0] |= source->normals.size() == count && count > 0;
+        has[1] |= source->texCoords.size() == count && count > 0;
+        has[2] |= source->texCoords2.size() == count && count > 0;
+        has[3] |= source->tangents.size() == count && count > 0;
+        has[4] |= source->colors.size() == count * 4 && count > 0;
+        has[5] |= source->blendWeights.size() == count && count > 0;
+        has[6] |= source->blendIndices.size() == count * 4 && count > 0;
+    }
+    if (!has[0]) mesh->normals.clear();
+    if (!has[1]) mesh->texCoords.clear();
+    if (!has[2]) mesh->texCoords2.clear();
+    if (!has[3]) mesh->tangents.clear();
+    if (!has[4]) mesh->colors.clear();
+    if (!has[5]) mesh->blendWeights.clear();
+    if (!has[6]) mesh->blendIndices.clear();
+
+    mesh->m_castsShadows = meshes[0]->m_castsShadows;
+    mesh->flags = VBO_POSITION | VBO_NORMAL | VBO_COLOR | VBO_TANGENT | VBO_TEXCOORD0 | VBO_TEXCOORD1 |
+                  VBO_BLENDWEIGHTS | VBO_BLENDINDICES | VBO_INDICES;
+    mesh->isDirty = true;
+    mesh->CalculateBoundingBox();
+
+    mesh->SetName(name);
+    if (!Add(mesh, name))
+    {
+        LogError("[MESH] Merge: mesh %s already exists", name.c_str());
+        delete mesh;
+        return nullptr;
+    }
+    LogInfo("[MESH] Merge %s: %u meshes, %u vertices, %u submeshes", name.c_str(), (u32)meshes.size(), total, mesh->GetSubMeshCount());
+    return mesh;
+}
+
 Mesh *MeshManager::CreateCube(float size, const std::string &name)
 {
     VertexFormat::Element VertexElements[] = {
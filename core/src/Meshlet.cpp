@@ -0,0 +1,287 @@
+#include "pch.h"
+#include "Meshlet.hpp"
+
+MeshletSet::MeshletSet()
+{
+    m_indexCount = 0;
+}
+
+u32 MeshletSet::Build(const std::vector<Vec3> &positions, std::vector<unsigned int> &indices, std::vector<SubMesh> &subMeshes,
+                      u32 maxVertices, u32 maxTriangles)
+{
+    Clear();
+    if (indices.size() < 3 || positions.empty()) return 0;
+    maxVertices = std::max(maxVertices, 3u);
+    maxTriangles = std::max(maxTriangles, 1u);
+
+    const u32 vertexCount = (u32)positions.size();
+    const u32 triangleCount = (u32)indices.size() / 3;
+
+    // vertex -> triangles
+    std::vector<u32> offsets(vertexCount + 1, 0);
+    for (u32 i = 0; i < triangleCount * 3; ++i)
+    {
+        offsets[indices[i] + 1]++;
+    }
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<u32> adjacency(triangleCount * 3);
+    std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        for (u32 k = 0; k < 3; ++k)
+        {
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+        }
+    }
+
+    std::vector<Vec3> faceNormals(triangleCount);
+    std::vector<Vec3> faceCenters(triangleCount);
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        const Vec3 &a = positions[indices[t * 3]];
+        const Vec3 &b = positions[indices[t * 3 + 1]];
+        const Vec3 &c = positions[indices[t * 3 + 2]];
+        const Vec3 n = Vec3::Cross(b - a, c - a);
+        const float length = n.length();
+        faceNormals[t] = length > 1e-12f ? n * (1.0f / length) : Vec3(0.0f, 0.0f, 0.0f);
+        faceCenters[t] = (a + b + c) * (1.0f / 3.0f);
+    }
+
+    // clusters are built per submesh; triangles outside every submesh are one
+    // more group after the last range (clustered and culled like the rest)
+    const u32 leftover = (u32)subMeshes.size();
+    std::vector<u32> group(triangleCount, leftover);
+    for (u32 g = 0; g < subMeshes.size(); ++g)
+    {
+        const u32 first = subMeshes[g].indexStart / 3;
+        const u32 last = std::min(triangleCount, first + subMeshes[g].indexCount / 3);
+        for (u32 t = first; t < last; ++t) group[t] = g;
+    }
+    u32 groupCount = leftover;
+    for (u32 t = 0; t < triangleCount; ++t)
+    {
+        if (group[t] == leftover)
+        {
+            groupCount = leftover + 1;
+            break;
+        }
+    }
+
+    std::vector<unsigned int> ordered;
+    ordered.reserve(indices.size());
+    std::vector<u8> emitted(triangleCount, 0);
+    std::vector<u32> stamp(vertexCount, 0xFFFFFFFF);   // meshlet that owns the vertex
+    std::vector<u32> vertices;
+    std::vector<u32> triangles;
+    std::vector<u32> candidates;
+    std::vector<SubMesh> ranges = subMeshes;
+
+    for (u32 g = 0; g < groupCount; ++g)
+    {
+        const u32 groupStart = (u32)ordered.size();
+        u32 seed = g < subMeshes.size() ? subMeshes[g].indexStart / 3 : 0;
+        while (true)
+        {
+            while (seed < triangleCount && (emitted[seed] || group[seed] != g)) seed++;
+            if (seed == triangleCount) break;
+
+            const u32 id = (u32)m_meshlets.size();
+            vertices.clear();
+            triangles.clear();
+            candidates.clear();
+
+            // greedy growth: the neighbour that adds the fewest new vertices,
+            // then the closest one facing the same way (round, tight cones)
+            Vec3 centerSum(0.0f, 0.0f, 0.0f);
+            Vec3 normalSum(0.0f, 0.0f, 0.0f);
+            u32 next = seed;
+            while (next != 0xFFFFFFFF)
+            {
+                emitted[next] = 1;
+                triangles.push_back(next);
+                centerSum += faceCenters[next];
+                normalSum += faceNormals[next];
+                for (u32 k = 0; k < 3; ++k)
+                {
+                    const u32 v = indices[next * 3 + k];
+                    if (stamp[v] == id) continue;
+                    stamp[v] = id;
+                    vertices.push_back(v);
+                    for (u32 a = offsets[v]; a < offsets[v + 1]; ++a)
+                    {
+                        if (!emitted[adjacency[a]]) candidates.push_back(adjacency[a]);
+                    }
+                }
+                if (triangles.size() >= maxTriangles) break;
+
+                const Vec3 center = centerSum * (1.0f / (float)triangles.size());
+                const float normalLength = normalSum.length();
+                const Vec3 axis = normalLength > 1e-6f ? normalSum * (1.0f / normalLength) : Vec3(0.0f, 0.0f, 0.0f);
+                next = 0xFFFFFFFF;
+                u32 bestNew = 4;
+                float bestCost = FLT_MAX;
+                u32 write = 0;
+                for (u32 c = 0; c < candidates.size(); ++c)
+                {
+                    const u32 t = candidates[c];
+                    if (emitted[t] || group[t] != g) continue;
+                    candidates[write++] = t;
+                    const u32 added = (stamp[indices[t * 3]] != id) + (stamp[indices[t * 3 + 1]] != id) + (stamp[indices[t * 3 + 2]] != id);
+                    if (added > bestNew || vertices.size() + added > maxVertices) continue;
+                    const Vec3 d = faceCenters[t] - center;
+                    const float cost = Vec3::Dot(d, d) * (2.0f - Vec3::Dot(faceNormals[t], axis));
+                    if (added < bestNew || cost < bestCost)
+                    {
+                        bestNew = added;
+                        bestCost = cost;
+                        next = t;
+                    }
+                }
+                candidates.resize(write);
+            }
+
+            Meshlet meshlet;
+            meshlet.indexOffset = (u32)ordered.size();
+            meshlet.triangleCount = (u32)triangles.size();
+            meshlet.subMesh = g;
+
+            BoundingBox box;
+            box.Set(positions[vertices[0]], positions[vertices[0]]);
+            for (u32 v = 1; v < vertices.size(); ++v)
+            {
+                box.AddPoint(positions[vertices[v]]);
+            }
+            meshlet.center = (box.min + box.max) * 0.5f;
+            float radius = 0.0f;
+            for (u32 v = 0; v < vertices.size(); ++v)
+            {
+                radius = std::max(radius, (positions[vertices[v]] - meshlet.center).length());
+            }
+            meshlet.radius = radius;
+
+            Vec3 axis(0.0f, 0.0f, 0.0f);
+            for (u32 t = 0; t < triangles.size(); ++t)
+            {
+                axis += faceNormals[triangles[t]];
+                ordered.push_back(indices[triangles[t] * 3]);
+                ordered.push_back(indices[triangles[t] * 3 + 1]);
+                ordered.push_back(indices[triangles[t] * 3 + 2]);
+            }
+            const float axisLength = axis.length();
+            meshlet.coneAxis = axisLength > 1e-6f ? axis * (1.0f / axisLength) : Vec3(0.0f, 0.0f, 1.0f);
+            meshlet.coneCutoff = 1.0f;
+            if (axisLength > 1e-6f)
+            {
+                float minDot = 1.0f;
+                for (u32 t = 0; t < triangles.size(); ++t)
+                {
+                    minDot = std::min(minDot, Vec3::Dot(faceNormals[triangles[t]], meshlet.coneAxis));
+                }
+                // wider than ~84 degrees is never fully backfacing in practice
+                if (minDot > 0.1f)
+                {
+                    meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+                }
+            }
+            m_meshlets.push_back(meshlet);
+        }
+        if (g < ranges.size())
+        {
+            ranges[g].indexStart = groupStart;
+            ranges[g].indexCount = (u32)ordered.size() - groupStart;
+        }
+    }
+
+    indices.swap(ordered);
+    subMeshes.swap(ranges);
+    m_indexCount = (u32)indices.size();
+    return (u32)m_meshlets.size();
+}
+
+u32 MeshletSet::Cull(const Mat4 &modelView, const Mat4 &proj, bool backface, MeshletStats *stats)
+{
+    m_draws.clear();
+    // planes and eye in model space, so scaled models need no extra work
+    Frustum frustum;
+    frustum.build(modelView, proj);
+    const Vec3 eye = frustum.getOrigin();
+
+    u32 visible = 0;
+    u32 lastSubMesh = 0xFFFFFFFF;
+    u32 frustumCulled = 0, coneCulled = 0;
+    u32 frustumTriangles = 0, coneTriangles = 0;
+    for (u32 i = 0; i < m_meshlets.size(); ++i)
+    {
+        const Meshlet &meshlet = m_meshlets[i];
+        if (frustum.SphereInside(meshlet.center, meshlet.radius))
+        {
+            frustumCulled++;
+            frustumTriangles += meshlet.triangleCount;
+            continue;
+        }
+        if (backface && meshlet.coneCutoff < 1.0f)
+        {
+            const Vec3 dir = meshlet.center - eye;
+            if (Vec3::Dot(dir, meshlet.coneAxis) >= meshlet.coneCutoff * dir.length() + meshlet.radius)
+            {
+                coneCulled++;
+                coneTriangles += meshlet.triangleCount;
+                continue;
+            }
+        }
+        visible++;
+        // neighbours in the index buffer become one draw
+        const u32 count = meshlet.triangleCount * 3;
+        const size_t n = m_draws.size();
+        if (n > 0 && m_draws[n - 2] + m_draws[n - 1] == meshlet.indexOffset && meshlet.subMesh == lastSubMesh)
+        {
+            m_draws[n - 1] += count;
+        } else
+        {
+            m_draws.push_back(meshlet.indexOffset);
+            m_draws.push_back(count);
+        }
+        lastSubMesh = meshlet.subMesh;
+    }
+
+    if (stats)
+    {
+        stats->meshlets += (u32)m_meshlets.size();
+        stats->frustumCulled += frustumCulled;
+        stats->coneCulled += coneCulled;
+        stats->triangles += m_indexCount / 3;
+        stats->frustumTriangles += frustumTriangles;
+        stats->coneTriangles += coneTriangles;
+        stats->draws += (u32)m_draws.size() / 2;
+    }
+    return visible;
+}
+
+void MeshletSet::DrawAll(u32 indexCount)
+{
+    m_draws.clear();
+    m_draws.push_back(0);
+    m_draws.push_back(indexCount);
+}
+
+void MeshletSet::Clear()
+{
+    m_meshlets.clear();
+    m_draws.clear();
+    m_indexCount = 0;
+}
+
+void MeshletSet::Release()
+{
+    std::vector<Meshlet>().swap(m_meshlets);
+    std::vector<u32>().swap(m_draws);
+    m_indexCount = 0;
+}
+
+u64 MeshletSet::GetBytes() const
+{
+    return (u64)m_meshlets.capacity() * sizeof(Meshlet) + (u64)m_draws.capacity() * sizeof(u32);
+}
@@ -0,0 +1,720 @@
+#include "pch.h"
+#include "SDFFont.hpp"
+#include "Batch.hpp"
+#include "Texture.hpp"
+#include "Utils.hpp"
+#include "glad/glad.h"
+
+//*******************************************************
+// TrueType reading (big endian)
+//*******************************************************
+
+static u16 readU16(const u8 *p) { return (u16)((p[0] << 8) | p[1]); }
+static s16 readS16(const u8 *p) { return (s16)readU16(p); }
+static u32 readU32(const u8 *p) { return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3]; }
+static float readF2Dot14(const u8 *p) { return readS16(p) / 16384.0f; }
+
+static bool inside(const std::vector<u8> &data, u32 offset, u32 bytes)
+{
+    return offset <= data.size() && bytes <= data.size() - offset;
+}
+
+// child placed by parent: x' = a x + c y + e, y' = b x + d y + f
+static void combine(const float *parent, const float *child, float *out)
+{
+    out[0] = parent[0] * child[0] + parent[2] * child[1];
+    out[1] = parent[1] * child[0] + parent[3] * child[1];
+    out[2] = parent[0] * child[2] + parent[2] * child[3];
+    out[3] = parent[1] * child[2] + parent[3] * child[3];
+    out[4] = parent[0] * child[4] + parent[2] * child[5] + parent[4];
+    out[5] = parent[1] * child[4] + parent[3] * child[5] + parent[5];
+}
+
+SDFFont::SDFFont()
+{
+    m_cmap = 0;
+    m_cmapFormat = 0;
+    m_loca = 0;
+    m_glyf = 0;
+    m_hmtx = 0;
+    m_numGlyphs = 0;
+    m_numHMetrics = 0;
+    m_longLoca = false;
+    m_scale = 1.0f;
+    m_ascent = 0.0f;
+    m_descent = 0.0f;
+    m_lineGap = 0.0f;
+    m_batch = nullptr;
+    m_fontSize = 25.0f;
+    m_maxPages = SDF_MAX_PAGES;
+    m_evictions = 0;
+}
+
+SDFFont::~SDFFont()
+{
+    Release();
+}
+
+void SDFFont::Release()
+{
+    for (u32 i = 0; i < m_pages.size(); i++)
+    {
+        delete m_pages[i].texture;
+    }
+    m_pages.clear();
+    m_glyphs.clear();
+    m_lru.clear();
+    m_data.clear();
+    m_numGlyphs = 0;
+}
+
+bool SDFFont::Load(const char *fileName)
+{
+    unsigned int size = 0;
+    unsigned char *data = System::Instance().LoadFileData(fileName, &size);
+    if (!data)
+    {
+        return false;
+    }
+    bool result = LoadFromMemory(data, size);
+    free(data);
+    if (!result)
+    {
+        LogError("[SDFFONT] %s: not a TrueType font we can read", fileName);
+    }
+    return result;
+}
+
+bool SDFFont::LoadFromMemory(const u8 *data, u32 size)
+{
+    Release();
+    if (!data || size < 12)
+    {
+        return false;
+    }
+    m_data.assign(data, data + size);
+    if (!parseTables())
+    {
+        m_data.clear();
+        return false;
+    }
+    LogInfo("[SDFFONT] %u glyphs, baked at %d px", m_numGlyphs, SDF_GLYPH_SIZE);
+    return true;
+}
+
+u32 SDFFont::findTable(const char *tag, u32 minSize) const
+{
+    const u32 count = readU16(&m_data[4]);
+    for (u32 i = 0; i < count; i++)
+    {
+        const u32 record = 12 + i * 16;
+        if (!inside(m_data, record, 16)) return 0;
+        if (memcmp(&m_data[record], tag, 4) == 0)
+        {
+            const u32 offset = readU32(&m_data[record + 8]);
+            const u32 length = readU32(&m_data[record + 12]);
+            return length >= minSize && inside(m_data, offset, length) ? offset : 0;
+        }
+    }
+    return 0;
+}
+
+bool SDFFont::parseTables()
+{
+    const u32 version = readU32(&m_data[0]);
+    if (version != 0x00010000 && version != 0x74727565)  // 1.0 or 'true' (no CFF outlines)
+    {
+        return false;
+    }
+    // sizes up to the last field read below
+    const u32 head = findTable("head", 54);
+    const u32 hhea = findTable("hhea", 36);
+    const u32 maxp = findTable("maxp", 6);
+    const u32 cmap = findTable("cmap", 4);
+    m_loca = findTable("loca");
+    m_glyf = findTable("glyf");
+    m_hmtx = findTable("hmtx");
+    if (!head || !hhea || !maxp || !cmap || !m_loca || !m_glyf || !m_hmtx)
+    {
+        return false;
+    }
+
+    const float unitsPerEm = (float)readU16(&m_data[head + 18]);
+    m_longLoca = readS16(&m_data[head + 50]) != 0;
+    m_numGlyphs = readU16(&m_data[maxp + 4]);
+    const float ascent = (float)readS16(&m_data[hhea + 4]);
+    const float descent = (float)readS16(&m_data[hhea + 6]);
+    const float lineGap = (float)readS16(&m_data[hhea + 8]);
+    m_numHMetrics = readU16(&m_data[hhea + 34]);
+    if (unitsPerEm <= 0.0f || ascent - descent <= 0.0f || m_numHMetrics == 0)
+    {
+        return false;
+    }
+    m_scale = SDF_GLYPH_SIZE / (ascent - descent);
+    m_ascent = ascent * m_scale;
+    m_descent = descent * m_scale;
+    m_lineGap = lineGap * m_scale;
+
+    // unicode subtable: format 12 (full range) before format 4 (BMP)
+    m_cmap = 0;
+    m_cmapFormat = 0;
+    const u32 count = readU16(&m_data[cmap + 2]);
+    for (u32 i = 0; i < count; i++)
+    {
+        const u32 record = cmap + 4 + i * 8;
+        if (!inside(m_data, record, 8)) break;
+        const u16 platform = readU16(&m_data[record]);
+        const u16 encoding = readU16(&m_data[record + 2]);
+        const u32 table = cmap + readU32(&m_data[record + 4]);
+        if (!inside(m_data, table, 4)) continue;
+        const bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+        const u16 format = readU16(&m_data[table]);
+        if (!unicode || (format != 4 && format != 12)) continue;
+        if (m_cmapFormat != 12)
+        {
+            m_cmap = table;
+            m_cmapFormat = format;
+        }
+    }
+    return m_cmapFormat != 0;
+}
+
+u32 SDFFont::glyphIndex(int codepoint) const
+{
+    if (codepoint < 0) return 0;
+    const u8 *table = &m_data[m_cmap];
+    if (m_cmapFormat == 12)
+    {
+        const u32 groups = readU32(table + 12);
+        if (!inside(m_data, m_cmap + 16, groups * 12)) return 0;
+        u32 low = 0, high = groups;
+        while (low < high)
+        {
+            const u32 mid = (low + high) / 2;
+            const u8 *group = table + 16 + mid * 12;
+            if ((u32)codepoint < readU32(group)) high = mid;
+            else if ((u32)codepoint > readU32(group + 4)) low = mid + 1;
+            else return readU32(group + 8) + ((u32)codepoint - readU32(group));
+        }
+        return 0;
+    }
+
+    if (codepoint > 0xFFFF) return 0;
+    const u32 segments = readU16(table + 6) / 2;
+    if (!inside(m_data, m_cmap + 14, segments * 8 + 2)) return 0;
+    const u8 *endCodes = table + 14;
+    const u8 *startCodes = endCodes + segments * 2 + 2;
+    const u8 *deltas = startCodes + segments * 2;
+    const u8 *rangeOffsets = deltas + segments * 2;
+    for (u32 i = 0; i < segments; i++)
+    {
+        if (readU16(endCodes + i * 2) < codepoint) continue;
+        const u16 start = readU16(startCodes + i * 2);
+        if (codepoint < start) return 0;
+        const u16 delta = readU16(deltas + i * 2);
+        const u16 rangeOffset = readU16(rangeOffsets + i * 2);
+        if (rangeOffset == 0)
+        {
+            return (u16)(codepoint + delta);
+        }
+        const u32 address = (u32)(rangeOffsets + i * 2 - &m_data[0]) + rangeOffset + (codepoint - start) * 2;
+        if (!inside(m_data, address, 2)) return 0;
+        const u16 glyph = readU16(&m_data[address]);
+        return glyph ? (u16)(glyph + delta) : 0;
+    }
+    return 0;
+}
+
+bool SDFFont::glyphRange(u32 glyph, u32 &offset, u32 &length) const
+{
+    if (glyph >= m_numGlyphs) return false;
+    u32 start, end;
+    if (m_longLoca)
+    {
+        if (!inside(m_data, m_loca + glyph * 4, 8)) return false;
+        start = readU32(&m_data[m_loca + glyph * 4]);
+        end = readU32(&m_data[m_loca + glyph * 4 + 4]);
+    }
+    else
+    {
+        if (!inside(m_data, m_loca + glyph * 2, 4)) return false;
+        start = readU16(&m_data[m_loca + glyph * 2]) * 2;
+        end = readU16(&m_data[m_loca + glyph * 2 + 2]) * 2;
+    }
+    if (end <= start || !inside(m_data, m_glyf + start, end - start)) return false;
+    offset = m_glyf + start;
+    length = end - start;
+    return true;
+}
+
+float SDFFont::glyphAdvance(u32 glyph) const
+{
+    const u32 metric = std::min(glyph, m_numHMetrics - 1);
+    if (!inside(m_data, m_hmtx + metric * 4, 2)) return 0.0f;
+    return readU16(&m_data[m_hmtx + metric * 4]) * m_scale;
+}
+
+// Outline of a glyph as line segments, quadratic curves flattened
+void SDFFont::glyphEdges(u32 glyph, const float *transform, std::vector<Edge> &edges, int depth) const
+{
+    u32 offset, length;
+    if (depth > 8 || !glyphRange(glyph, offset, length) || length < 10) return;
+    const u8 *base = &m_data[offset];
+    const u8 *end = base + length;
+    const s16 contours = readS16(base);
+
+    if (contours < 0)
+    {
+        const u8 *p = base + 10;
+        u16 flags;
+        do
+        {
+            if (p + 4 > end) return;
+            flags = readU16(p);
+            const u16 child = readU16(p + 2);
+            p += 4;
+            float local[6] = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+            if (flags & 0x0001)
+            {
+                if (p + 4 > end) return;
+                local[4] = readS16(p);
+                local[5] = readS16(p + 2);
+                p += 4;
+            }
+            else
+            {
+                if (p + 2 > end) return;
+                local[4] = (s8)p[0];
+                local[5] = (s8)p[1];
+                p += 2;
+            }
+            // point matched components are placed at the origin
+            if (!(flags & 0x0002))
+            {
+                local[4] = local[5] = 0.0f;
+            }
+            if (flags & 0x0008)
+            {
+                if (p + 2 > end) return;
+                local[0] = local[3] = readF2Dot14(p);
+                p += 2;
+            }
+            else if (flags & 0x0040)
+            {
+                if (p + 4 > end) return;
+                local[0] = readF2Dot14(p);
+                local[3] = readF2Dot14(p + 2);
+                p += 4;
+            }
+            else if (flags & 0x0080)
+            {
+                if (p + 8 > end) return;
+                local[0] = readF2Dot14(p);
+                local[1] = readF2Dot14(p + 2);
+                local[2] = readF2Dot14(p + 4);
+                local[3] = readF2Dot14(p + 6);
+                p += 8;
+            }
+            float combined[6];
+            combine(transform, local, combined);
+            glyphEdges(child, combined, edges, depth + 1);
+        } while (flags & 0x0020);
+        return;
+    }
+
+    const u8 *endPoints = base + 10;
+    if (endPoints + contours * 2 + 2 > end) return;
+    const u32 pointCount = contours > 0 ? readU16(endPoints + (contours - 1) * 2) + 1u : 0u;
+    const u8 *p = endPoints + contours * 2;
+    p += 2 + readU16(p);    // instructions
+
+    struct Point
+    {
+        float x, y;
+        bool on;
+    };
+    std::vector<Point> points(pointCount);
+    std::vector<u8> flags(pointCount);
+    for (u32 i = 0; i < pointCount;)
+    {
+        if (p >= end) return;
+        const u8 flag = *p++;
+        flags[i++] = flag;
+        if (flag & 0x08)
+        {
+            if (p >= end) return;
+            for (u8 repeat = *p++; repeat > 0 && i < pointCount; repeat--)
+            {
+                flags[i++] = flag;
+            }
+        }
+    }
+    int x = 0;
+    for (u32 i = 0; i < pointCount; i++)
+    {
+        if (flags[i] & 0x02)
+        {
+            if (p >= end) return;
+            x += (flags[i] & 0x10) ? *p : -(int)*p;
+            p++;
+        }
+        else if (!(flags[i] & 0x10))
+        {
+            if (p + 2 > end) return;
+            x += readS16(p);
+            p += 2;
+        }
+        points[i].x = (float)x;
+        points[i].on = (flags[i] & 0x01) != 0;
+    }
+    int y = 0;
+    for (u32 i = 0; i < pointCount; i++)
+    {
+        if (flags[i] & 0x04)
+        {
+            if (p >= end) return;
+            y += (flags[i] & 0x20) ? *p : -(int)*p;
+            p++;
+        }
+        else if (!(flags[i] & 0x20))
+        {
+            if (p + 2 > end) return;
+            y += readS16(p);
+            p += 2;
+        }
+        points[i].y = (float)y;
+    }
+    for (u32 i = 0; i < pointCount; i++)
+    {
+        const float px = points[i].x, py = points[i].y;
+        points[i].x = transform[0] * px + transform[2] * py + transform[4];
+        points[i].y = transform[1] * px + transform[3] * py + transform[5];
+    }
+
+    auto line = [&edges](float x0, float y0, float x1, float y1)
+    {
+        Edge edge = {x0, y0, x1, y1};
+        edges.push_back(edge);
+    };
+    auto curve = [&line](float x0, float y0, float cx, float cy, float x1, float y1)
+    {
+        const float length = sqrtf((cx - x0) * (cx - x0) + (cy - y0) * (cy - y0))
+            + sqrtf((x1 - cx) * (x1 - cx) + (y1 - cy) * (y1 - cy));
+        const int steps = std::max(1, std::min(16, (int)(length * 0.5f)));
+        float lastX = x0, lastY = y0;
+        for (int s = 1; s <= steps; s++)
+        {
+            const float t = (float)s / steps;
+            const float a = (1.0f - t) * (1.0f - t), b = 2.0f * t * (1.0f - t), c = t * t;
+            const float nx = a * x0 + b * cx + c * x1;
+            const float ny = a * y0 + b * cy + c * y1;
+            line(lastX, lastY, nx, ny);
+            lastX = nx;
+            lastY = ny;
+        }
+    };
+
+    u32 first = 0;
+    for (s16 c = 0; c < contours; c++)
+    {
+        const u32 last = readU16(endPoints + c * 2);
+        if (last < first || last >= pointCount) return;
+        const Point *contour = &points[first];
+        u32 count = last - first + 1;
+        first = last + 1;
+        if (count < 2) continue;
+
+        // start on an on-curve point, or between two off-curve ones
+        float startX, startY;
+        u32 begin = 0;
+        if (contour[0].on)
+        {
+            startX = contour[0].x;
+            startY = contour[0].y;
+            begin = 1;
+        }
+        else if (contour[count - 1].on)
+        {
+            startX = contour[count - 1].x;
+            startY = contour[count - 1].y;
+            count--;
+        }
+        else
+        {
+            startX = (contour[0].x + contour[count - 1].x) * 0.5f;
+            startY = (contour[0].y + contour[count - 1].y) * 0.5f;
+        }
+
+        float curX = startX, curY = startY;
+        float ctrlX = 0.0f, ctrlY = 0.0f;
+        bool control = false;
+        for (u32 i = begin; i < count; i++)
+        {
+            const Point &point = contour[i];
+            if (point.on)
+            {
+                if (control) curve(curX, curY, ctrlX, ctrlY, point.x, point.y);
+                else line(curX, curY, point.x, point.y);
+                curX = point.x;
+                curY = point.y;
+                control = false;
+            }
+            else
+            {
+                if (control)
+                {
+                    const float midX = (ctrlX + point.x) * 0.5f, midY = (ctrlY + point.y) * 0.5f;
+                    curve(curX, curY, ctrlX, ctrlY, midX, midY);
+                    curX = midX;
+                    curY = midY;
+                }
+                ctrlX = point.x;
+                ctrlY = point.y;
+                control = true;
+            }
+        }
+        if (control) curve(curX, curY, ctrlX, ctrlY, startX, startY);
+        else line(curX, curY, startX, startY);
+    }
+}
+
+//*******************************************************
+// Atlas
+//*******************************************************
+
+bool SDFFont::addPage()
+{
+    Page page;
+    page.texture = new Texture2D();
+    page.texture->SetMinFilter(FilterMode::Linear);
+    page.texture->SetMagFilter(FilterMode::Linear);
+    page.texture->SetWrapS(WrapMode::ClampToEdge);
+    page.texture->SetWrapT(WrapMode::ClampToEdge);
+    std::vector<u8> empty((size_t)SDF_PAGE_SIZE * SDF_PAGE_SIZE, 0);
+    if (!page.texture->LoadFromMemory(empty.data(), 1, SDF_PAGE_SIZE, SDF_PAGE_SIZE))
+    {
+        delete page.texture;
+        return false;
+    }
+    page.packer.Reset(SDF_PAGE_SIZE);
+    m_pages.push_back(page);
+    LogInfo("[SDFFONT] page %u (%dx%d)", (u32)m_pages.size() - 1, SDF_PAGE_SIZE, SDF_PAGE_SIZE);
+    return true;
+}
+
+// every glyph of the page leaves the cache and the page packs from scratch
+void SDFFont::evictPage(s32 page)
+{
+    // quads already in the batch still point at the old glyphs
+    if (m_batch) m_batch->Render();
+    for (auto it = m_glyphs.begin(); it != m_glyphs.end();)
+    {
+        if (it->second.page == page)
+        {
+            m_lru.erase(it->second.use);
+            it = m_glyphs.erase(it);
+            m_evictions++;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    m_pages[page].packer.Reset();
+}
+
+// room in a page, a new page or the page of the least recently printed glyph
+bool SDFFont::allocRect(int width, int height, s32 &page, int &x, int &y)
+{
+    for (u32 i = 0; i < m_pages.size(); i++)
+    {
+        if (m_pages[i].packer.Pack(width, height, x, y))
+        {
+            page = (s32)i;
+            return true;
+        }
+    }
+    if ((int)m_pages.size() < m_maxPages && addPage())
+    {
+        page = (s32)m_pages.size() - 1;
+        return m_pages[page].packer.Pack(width, height, x, y);
+    }
+    if (m_lru.empty()) return false;
+
+    page = m_glyphs[m_lru.front()].page;
+    evictPage(page);
+    return m_pages[page].packer.Pack(width, height, x, y);
+}
+
+bool SDFFont::bakeGlyph(int codepoint, Glyph &glyph)
+{
+    const u32 index = glyphIndex(codepoint);
+    glyph.advance = glyphAdvance(index);
+    glyph.offsetX = glyph.offsetY = 0.0f;
+    glyph.width = glyph.height = 0;
+    glyph.page = -1;
+    glyph.x = glyph.y = 0;
+
+    // baked pixels, y down from the baseline
+    const float transform[6] = {m_scale, 0.0f, 0.0f, -m_scale, 0.0f, 0.0f};
+    m_edges.clear();
+    glyphEdges(index, transform, m_edges, 0);
+    if (m_edges.empty()) return true;
+
+    float minX = m_edges[0].x0, minY = m_edges[0].y0, maxX = minX, maxY = minY;
+    for (u32 i = 0; i < m_edges.size(); i++)
+    {
+        minX = std::min(minX, std::min(m_edges[i].x0, m_edges[i].x1));
+        minY = std::min(minY, std::min(m_edges[i].y0, m_edges[i].y1));
+        maxX = std::max(maxX, std::max(m_edges[i].x0, m_edges[i].x1));
+        maxY = std::max(maxY, std::max(m_edges[i].y0, m_edges[i].y1));
+    }
+    const int x0 = (int)floorf(minX) - SDF_SPREAD;
+    const int y0 = (int)floorf(minY) - SDF_SPREAD;
+    // one texel of border right and below keeps the neighbours out of linear filtering
+    const int width = std::min((int)ceilf(maxX) + SDF_SPREAD - x0, SDF_PAGE_SIZE - 1);
+    const int height = std::min((int)ceilf(maxY) + SDF_SPREAD - y0, SDF_PAGE_SIZE - 1);
+    const int stride = width + 1;
+
+    s32 page = -1;
+    int x = 0, y = 0;
+    if (!allocRect(stride, height + 1, page, x, y)) return false;
+
+    m_pixels.assign((size_t)stride * (height + 1), 0);
+    const float range = 1.0f / (2.0f * SDF_SPREAD);
+    for (int j = 0; j < height; j++)
+    {
+        const float py = y0 + j + 0.5f;
+        for (int i = 0; i < width; i++)
+        {
+            const float px = x0 + i + 0.5f;
+            float best = (float)(SDF_SPREAD * SDF_SPREAD) * 4.0f;
+            int winding = 0;
+            for (u32 e = 0; e < m_edges.size(); e++)
+            {
+                const Edge &edge = m_edges[e];
+                const float dx = edge.x1 - edge.x0, dy = edge.y1 - edge.y0;
+                const float lengthSq = dx * dx + dy * dy;
+                float t = lengthSq > 0.0f ? ((px - edge.x0) * dx + (py - edge.y0) * dy) / lengthSq : 0.0f;
+                t = Clamp(t, 0.0f, 1.0f);
+                const float ex = edge.x0 + t * dx - px, ey = edge.y0 + t * dy - py;
+                best = std::min(best, ex * ex + ey * ey);
+                // nonzero winding, ray towards +x
+                if ((edge.y0 <= py) != (edge.y1 <= py))
+                {
+                    const float cross = edge.x0 + (py - edge.y0) * dx / dy;
+                    if (cross > px) winding += (dy > 0.0f) ? 1 : -1;
+                }
+            }
+            const float distance = (winding != 0) ? sqrtf(best) : -sqrtf(best);
+            m_pixels[j * stride + i] = (u8)(Clamp(0.5f + distance * range, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, m_pages[page].texture->GetID());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, stride, height + 1, GL_RED, GL_UNSIGNED_BYTE, m_pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glyph.offsetX = (float)x0;
+    glyph.offsetY = (float)y0;
+    glyph.width = width;
+    glyph.height = height;
+    glyph.page = page;
+    glyph.x = x;
+    glyph.y = y;
+    return true;
+}
+
+SDFFont::Glyph *SDFFont::getGlyph(int codepoint)
+{
+    auto it = m_glyphs.find(codepoint);
+    if (it == m_glyphs.end())
+    {
+        Glyph glyph;
+        if (!bakeGlyph(codepoint, glyph)) return nullptr;
+        if (glyph.page >= 0) glyph.use = m_lru.insert(m_lru.end(), codepoint);
+        it = m_glyphs.emplace(codepoint, glyph).first;
+    }
+    else if (it->second.page >= 0)
+    {
+        // most recent at the back
+        m_lru.splice(m_lru.end(), m_lru, it->second.use);
+    }
+    return &it->second;
+}
+
+//*******************************************************
+// Text
+//*******************************************************
+
+float SDFFont::GetLineHeight() const
+{
+    return (m_ascent - m_descent + m_lineGap) * (m_fontSize / SDF_GLYPH_SIZE);
+}
+
+void SDFFont::Print(const char *text, float x, float y)
+{
+    if (m_data.empty() || !m_batch || !text) return;
+
+    const float scale = m_fontSize / SDF_GLYPH_SIZE;
+    const float lineHeight = GetLineHeight();
+    const float texel = 1.0f / SDF_PAGE_SIZE;
+    float penX = x;
+    float baseline = y + m_ascent * scale;
+
+    const int size = (int)strlen(text);
+    for (int i = 0; i < size;)
+    {
+        int bytes = 0;
+        const int codepoint = GetCodepointNext(&text[i], &bytes);
+        i += bytes;
+        if (codepoint == '\n')
+        {
+            penX = x;
+            baseline += lineHeight;
+            continue;
+        }
+        const Glyph *glyph = getGlyph(codepoint);
+        if (!glyph) continue;
+        if (glyph->page >= 0)
+        {
+            const float u0 = glyph->x * texel;
+            const float v0 = glyph->y * texel;
+            m_batch->DistanceFieldQuad(m_pages[glyph->page].texture->GetID(),
+                                       penX + glyph->offsetX * scale, baseline + glyph->offsetY * scale,
+                                       glyph->width * scale, glyph->height * scale,
+                                       u0, v0, u0 + glyph->width * texel, v0 + glyph->height * texel);
+        }
+        penX += glyph->advance * scale;
+    }
+}
+
+Vec2 SDFFont::GetTextSize(const char *text) const
+{
+    if (m_data.empty() || !text) return Vec2(0.0f, 0.0f);
+
+    const float scale = m_fontSize / SDF_GLYPH_SIZE;
+    float width = 0.0f;
+    float lineWidth = 0.0f;
+    int lines = 1;
+    const int size = (int)strlen(text);
+    for (int i = 0; i < size;)
+    {
+        int bytes = 0;
+        const int codepoint = GetCodepointNext(&text[i], &bytes);
+        i += bytes;
+        if (codepoint == '\n')
+        {
+            width = std::max(width, lineWidth);
+            lineWidth = 0.0f;
+            lines++;
+            continue;
+        }
+        // advances only: no need to bake
+        auto it = m_glyphs.find(codepoint);
+        lineWidth += (it != m_glyphs.end() ? it->second.advance : glyphAdvance(glyphIndex(codepoint))) * scale;
+    }
+    width = std::max(width, lineWidth);
+    return Vec2(width, (m_ascent - m_descent) * scale + (lines - 1) * GetLineHeight());
+}
@@ -4,8 +4,10 @@
 #include "Mesh.hpp"
 #include "Shader.hpp"
 #include "Texture.hpp"
+#include "Animation.hpp"
 #include "glad/glad.h"
 #include <algorithm>
+#include <float.h>
 
 
 static u32 IDS = 0;
@@ -17,6 +19,7 @@ SceneNode::SceneNode()
     _sortKey = 0.0f;
     _dirty = true;
     _transformed = true;
+    _type = SceneNodeTypes::Undefined;
     SetTransform( Vec3( 0.0f, 0.0f, 0.0f ), Vec3( 0.0f, 0.0f, 0.0f ), Vec3( 1.0f, 1.0f, 1.0f ) );
 }
 
@@ -27,6 +30,7 @@ SceneNode::SceneNode(const Vec3 &trans, const Vec3 &scale)
     _sortKey = 0.0f;
     _dirty = true;
     _transformed = true;
+    _type = SceneNodeTypes::Undefined;
     SetTransform( trans, Vec3( 0.0f, 0.0f, 0.0f ), scale );
 }
 
@@ -37,6 +41,7 @@ SceneNode::SceneNode(const Vec3 &trans, const Vec3 &rot, const Vec3 &scale)
     _sortKey = 0.0f;
     _dirty = true;
     _transformed = true;
+    _type = SceneNodeTypes::Undefined;
     SetTransform( trans, rot, scale );
 }
 
@@ -128,7 +133,8 @@ void SceneNode::SetTransform( Vec3 trans, Vec3 rot, Vec3 scale )
 	 
 	if( _type == SceneNodeTypes::Joint )
 	{
-		//((JointNode *)this)->_parentModel->_skinningDirty = true;
+		Joint *joint = (Joint *)this;
+		if( joint->_parentModel != 0x0 ) joint->_parentModel->_skinningDirty = true;
 	}
 	
 	_relTrans = Mat4::Scale( scale.x, scale.y, scale.z );
@@ -144,7 +150,8 @@ void SceneNode::SetTransform( const Mat4 &mat )
 	// Hack to avoid making setTransform virtual
 	if( _type == SceneNodeTypes::Joint )
 	{
-		//((JointNode *)this)->_parentModel->_skinningDirty = true;
+		Joint *joint = (Joint *)this;
+		if( joint->_parentModel != 0x0 ) joint->_parentModel->_skinningDirty = true;
 	}
 	
 	_relTrans = mat;
@@ -153,6 +160,30 @@ void SceneNode::SetTransform( const Mat4 &mat )
 }
 
 
+void SceneNode::SetTransformDeferred( const Mat4 &mat )
+{
+	if( _type == SceneNodeTypes::Joint )
+	{
+		Joint *joint = (Joint *)this;
+		if( joint->_parentModel != 0x0 ) joint->_parentModel->_skinningDirty = true;
+	}
+
+	_relTrans = mat;
+	_dirty = true;
+	_transformed = true;
+	invalidateCache();
+
+	SceneNode *node = _parent;
+	while( node != 0x0 )
+	{
+		node->_dirty = true;
+		node = node->_parent;
+	}
+
+	markChildrenDirty();
+}
+
+
 void SceneNode::GetTransMatrices( const float **relMat, const float **absMat ) const
 {
 	if( relMat != 0x0 )
@@ -449,6 +480,18 @@ void SceneNode::markDirty()
 
 // 	markChildrenDirty();
 // }
+//*****************************************************************************
+// Joint
+//*****************************************************************************
+
+Joint::Joint(Model *model, u32 index, const Mat4 &invBindMatrix)
+{
+    _type = SceneNodeTypes::Joint;
+    _parentModel = model;
+    _jointIndex = index;
+    _invBindMat = invBindMatrix;
+}
+
 //*****************************************************************************
 // Model
 //*****************************************************************************
@@ -482,10 +525,49 @@ Model::Model(SceneNode *parent)
 {
     _parent = parent;
     _type = SceneNodeTypes::Model;
+    _paletteUBO = 0;
+    _skinningDirty = false;
+    _paletteDirty = false;
+    _skinningMode = SKINNING_GPU;
+    _cpuSkinning = false;
+    _currentLOD = 0;
+    _lodHysteresis = 0.1f;
+    _cullScreenSize = 1.0f;
+    _screenSize = 0.0f;
+    _lodCulled = false;
+    _depthLOD = 0;
+    _depthCulled = false;
+    _boundsDirty = true;
 }
 
 Model::~Model() 
 {
+    releaseSkinning();
+    releaseInstances(_morphs);
+    if (_paletteUBO != 0)
+    {
+        glDeleteBuffers(1, &_paletteUBO);
+        _paletteUBO = 0;
+    }
+
+    // joints belong to the model: unlink them from the tree before deleting
+    for (auto joint : _joints)
+    {
+        for (auto child : joint->_children)
+        {
+            child->_parent = nullptr;
+        }
+        joint->_children.clear();
+    }
+    _children.erase(std::remove_if(_children.begin(), _children.end(),
+                                   [this](SceneNode *node) { return node->_type == SceneNodeTypes::Joint && ((Joint *)node)->_parentModel == this; }),
+                    _children.end());
+    for (auto joint : _joints)
+    {
+        delete joint;
+    }
+    _joints.clear();
+
     _meshes.clear();
     for (auto mat : _materials)
     {
@@ -498,47 +580,583 @@ void Model::AddMesh(Mesh *mesh)
 {
     if (!mesh)  return;
     _meshes.push_back(mesh); 
+    _boundsDirty = true;
 }
 
 void Model::Update(float dt) {}
 
+void Model::bindMaterial(u32 material)
+{
+    if (material < _materials.size() && _materials[material])
+    {
+        _materials[material]->Bind();
+    } else 
+    {
+        Material *mat = Scene::Instance().GetDefaultMaterial();
+        mat->Bind();
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+}
+
+void Model::drawMesh(Mesh *mesh, u32 vao, bool meshlets)
+{
+    if (mesh->isDirty)
+    {
+        mesh->Upload();
+    }
+    // one bind, one draw per material range
+    glBindVertexArray(vao);
+    if (mesh->m_subMeshes.empty())
+    {
+        bindMaterial(mesh->m_material);
+        if (meshlets) mesh->drawMeshlets(0, mesh->GetIndexCount());
+        else glDrawElements(GL_TRIANGLES, mesh->GetIndexCount(), GL_UNSIGNED_INT, 0);
+    } else
+    {
+        for (u32 s = 0; s < mesh->m_subMeshes.size(); ++s)
+        {
+            const SubMesh &subMesh = mesh->m_subMeshes[s];
+            if (subMesh.indexCount == 0) continue;
+            bindMaterial(subMesh.material);
+            if (meshlets) mesh->drawMeshlets(subMesh.indexStart, subMesh.indexCount);
+            else glDrawElements(GL_TRIANGLES, subMesh.indexCount, GL_UNSIGNED_INT, (void *)((size_t)subMesh.indexStart * sizeof(unsigned int)));
+        }
+    }
+    glBindVertexArray(0);
+}
+
 void Model::Render(Shader* shader) 
 {
     if (!shader) return;
+    selectLOD();
+    if (_lodCulled) return;
     shader->SetMatrix4("model", &_absTrans.x[0]);
-    for (auto mesh : _meshes)
+
+    // shaders with the palette block also expose "skinned" to switch it off
+    const bool skinShader = shader->HasUniformBlock("JointPalette");
+    const bool gpuSkin = IsSkinned() && _skinningMode == SKINNING_GPU && skinShader && bindPalette(shader);
+    if (skinShader)
     {
-        if (GetMaterialCount()) 
+        shader->SetInt("skinned", gpuSkin ? 1 : 0);
+    }
+    const bool morphShader = shader->ContainsUniform("morphWeights");
+
+    // meshlets only hold for the rest pose, skinned/morphed meshes draw whole
+    Mat4 view, proj;
+    const bool meshlets = !IsSkinned() && Scene::Instance().GetView(view, proj);
+    const Mat4 modelView = meshlets ? view * _absTrans : Mat4();
+    const bool backface = meshlets && glIsEnabled(GL_CULL_FACE);
+
+    // CPU skinned models only have skin buffers for LOD 0
+    if (_currentLOD > 0 && (gpuSkin || !IsSkinned()))
+    {
+        const LODLevel &level = _lods[_currentLOD - 1];
+        if (morphShader)
         {
-            if (mesh->m_material <= _materials.size()) 
-            {
-                Material *mat = _materials[mesh->m_material];
-                mat->Bind();
-            }
-        } else 
+            shader->SetFloat("morphWeights", 0.0f, 0.0f, 0.0f, 0.0f);
+        }
+        for (u32 i = 0; i < level.meshes.size(); ++i)
         {
-            Material *mat = Scene::Instance().GetDefaultMaterial();
-            mat->Bind();
+            Mesh *mesh = level.meshes[i];
+            if (!mesh) continue;
+            drawMesh(mesh, mesh->VAO, false);
+        }
+        return;
+    }
 
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, 0);
+    for (u32 i = 0; i < _meshes.size(); ++i)
+    {
+        Mesh *mesh = _meshes[i];
+        SkinInstance *morph = applyMorph(i);
+        if (morphShader && !bindMorph(i, shader))
+        {
+            shader->SetFloat("morphWeights", 0.0f, 0.0f, 0.0f, 0.0f);
+        }
+
+        if (!gpuSkin && i < _skins.size() && _skins[i] != nullptr)
+        {
+            uploadInstance(_skins[i], mesh);
+            drawMesh(mesh, _skins[i]->vao, false);
+        } else if (morph)
+        {
+            // GPU skinning reads the morphed rest pose from the copy too
+            uploadInstance(morph, mesh);
+            drawMesh(mesh, morph->vao, false);
+        } else if (meshlets && mesh->HasMeshlets() && mesh->GetMorphTargetCount() == 0)
+        {
+            mesh->CullMeshlets(modelView, proj, backface, &Scene::Instance()._meshletStats);
+            drawMesh(mesh, mesh->VAO, true);
+        } else
+        {
+            drawMesh(mesh, mesh->VAO, false);
+        }
+    }
+}
+
+//*****************************************************************************
+// Model skinning
+//*****************************************************************************
+
+Joint *Model::AddJoint(const std::string &name, const Mat4 &invBindMatrix, SceneNode *parent)
+{
+    if (_joints.size() >= MAX_SKIN_JOINTS)
+    {
+        LogError("[MODEL] %s: too many joints (max %u)", _name.c_str(), MAX_SKIN_JOINTS);
+        return nullptr;
+    }
+    Joint *joint = new Joint(this, (u32)_joints.size(), invBindMatrix);
+    joint->SetName(name);
+    if (parent == nullptr) parent = this;
+    parent->AddChild(joint);
 
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, 0);
+    _joints.push_back(joint);
+    _palette.push_back(Mat4());
+    _skinningDirty = true;
+    return joint;
+}
 
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, 0);
+Joint *Model::GetJoint(u32 index) const
+{
+    if (index < _joints.size())
+    {
+        return _joints[index];
+    }
+    return nullptr;
+}
+
+Joint *Model::FindJoint(const std::string &name) const
+{
+    for (auto joint : _joints)
+    {
+        if (joint->GetName() == name)
+        {
+            return joint;
+        }
+    }
+    return nullptr;
+}
+
+void Model::SetSkinningMode(SkinningMode mode)
+{
+    if (mode == _skinningMode) return;
+    _skinningMode = mode;
+    // normals are only skinned on the CPU path, rebuild the instance buffers
+    releaseSkinning();
+    _skinningDirty = true;
+}
+
+void Model::SetCPUSkinning(bool enable)
+{
+    if (enable == _cpuSkinning) return;
+    _cpuSkinning = enable;
+    if (!enable && _skinningMode == SKINNING_GPU)
+    {
+        releaseSkinning();
+    }
+    _skinningDirty = true;
+}
+
+void Model::UpdateSkinPalette()
+{
+    updateTree();
+    updatePalette();
+}
+
+void Model::updatePalette()
+{
+    // palette in model space, the shader still applies "model"
+    const Mat4 invModel = _absTrans.inverted();
+    Mat4 tmp;
+    for (u32 i = 0; i < _joints.size(); ++i)
+    {
+        Joint *joint = _joints[i];
+        Mat4::fastMult43(tmp, invModel, joint->_absTrans);
+        Mat4::fastMult43(_palette[i], tmp, joint->_invBindMat);
+    }
+    _paletteDirty = true;
+}
+
+Model::SkinInstance *Model::prepareSkin(u32 index)
+{
+    if (_skins.size() < _meshes.size())
+    {
+        _skins.resize(_meshes.size(), nullptr);
+    }
+    SkinInstance *skin = _skins[index];
+    if (skin == nullptr)
+    {
+        skin = new SkinInstance();
+        skin->vao = 0;
+        skin->positionVBO = 0;
+        skin->normalVBO = 0;
+        skin->needsUpload = false;
+        skin->morphDirty = false;
+        skin->morphed = false;
+        _skins[index] = skin;
+    }
+    // morph first, the skinning reads the morphed copy
+    applyMorph(index);
+    const u32 count = (u32)_meshes[index]->positions.size();
+    skin->positions.resize(count);
+    if (_skinningMode == SKINNING_CPU)
+    {
+        skin->normals.resize(count);
+    }
+    skin->needsUpload = true;
+    return skin;
+}
+
+void Model::skinMesh(u32 index, u32 begin, u32 end)
+{
+    SkinInstance *skin = _skins[index];
+    Vec3 *normals = skin->normals.empty() ? nullptr : skin->normals.data();
+    const Mesh *mesh = _meshes[index];
+    const SkinInstance *morph = index < _morphs.size() ? _morphs[index] : nullptr;
+    if (morph && morph->morphed)
+    {
+        const Vec3 *restNormals = morph->normals.empty() ? nullptr : morph->normals.data();
+        mesh->Skin(_palette.data(), (u32)_palette.size(), begin, end, morph->positions.data(), restNormals, skin->positions.data(), normals);
+    } else
+    {
+        mesh->Skin(_palette.data(), (u32)_palette.size(), begin, end, skin->positions.data(), normals);
+    }
+}
+
+void Model::uploadInstance(SkinInstance *skin, Mesh *mesh)
+{
+    if (mesh->isDirty)
+    {
+        mesh->Upload();
+    }
+
+    if (skin->vao == 0)
+    {
+        glGenBuffers(1, &skin->positionVBO);
+        if (!skin->normals.empty())
+        {
+            glGenBuffers(1, &skin->normalVBO);
+        }
+        skin->vao = mesh->CreateOverrideVAO(skin->positionVBO, skin->normalVBO);
+        skin->needsUpload = true;
+    }
+    if (!skin->needsUpload) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, skin->positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, skin->positions.size() * sizeof(Vec3), skin->positions.data(), GL_STREAM_DRAW);
+    if (skin->normalVBO != 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, skin->normalVBO);
+        glBufferData(GL_ARRAY_BUFFER, skin->normals.size() * sizeof(Vec3), skin->normals.data(), GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    skin->needsUpload = false;
+}
+
+void Model::releaseInstances(std::vector<SkinInstance *> &instances)
+{
+    for (auto skin : instances)
+    {
+        if (!skin) continue;
+        if (skin->vao != 0) glDeleteVertexArrays(1, &skin->vao);
+        if (skin->positionVBO != 0) glDeleteBuffers(1, &skin->positionVBO);
+        if (skin->normalVBO != 0) glDeleteBuffers(1, &skin->normalVBO);
+        delete skin;
+    }
+    instances.clear();
+}
+
+void Model::releaseSkinning()
+{
+    releaseInstances(_skins);
+}
+
+bool Model::bindPalette(Shader *shader)
+{
+    if (!shader->SetUniformBlock("JointPalette", SKIN_PALETTE_BINDING)) return false;
+
+    if (_paletteUBO == 0)
+    {
+        glGenBuffers(1, &_paletteUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, _paletteUBO);
+        glBufferData(GL_UNIFORM_BUFFER, MAX_SKIN_JOINTS * sizeof(Mat4), nullptr, GL_DYNAMIC_DRAW);
+        _paletteDirty = true;
+    }
+    if (_paletteDirty)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, _paletteUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, _palette.size() * sizeof(Mat4), _palette.data());
+        _paletteDirty = false;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, SKIN_PALETTE_BINDING, _paletteUBO);
+    return true;
+}
+
+//*****************************************************************************
+// Model LOD
+//*****************************************************************************
+
+u32 Model::AddLOD(const std::vector<Mesh *> &meshes, float screenSize)
+{
+    LODLevel level;
+    level.meshes = meshes;
+    level.screenSize = screenSize;
+    auto it = _lods.begin();
+    while (it != _lods.end() && it->screenSize > screenSize) ++it;
+    it = _lods.insert(it, level);
+    _currentLOD = 0;
+    _depthLOD = 0;
+    return (u32)(it - _lods.begin()) + 1;
+}
+
+u32 Model::GenerateLODs(u32 levels, float screenSize, float reduction, float targetError)
+{
+    std::vector<std::vector<Mesh *>> chains(_meshes.size());
+    u32 count = 0;
+    for (u32 i = 0; i < _meshes.size(); ++i)
+    {
+        MeshManager::Instance().GenerateLODs(_meshes[i], levels, chains[i], reduction, targetError);
+        count = std::max(count, (u32)chains[i].size());
+    }
+    for (u32 level = 0; level < count; ++level)
+    {
+        // slots that ran out of levels keep their coarsest mesh
+        std::vector<Mesh *> meshes(_meshes.size());
+        for (u32 i = 0; i < _meshes.size(); ++i)
+        {
+            meshes[i] = chains[i].empty() ? _meshes[i] : chains[i][std::min(level, (u32)chains[i].size() - 1)];
+        }
+        AddLOD(meshes, screenSize);
+        screenSize *= 0.5f;
+    }
+    return count;
+}
 
-            glActiveTexture(GL_TEXTURE3);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            
-            
+const BoundingBox &Model::localBounds()
+{
+    if (!_boundsDirty) return _localBounds;
+    bool first = true;
+    for (u32 i = 0; i < _meshes.size(); ++i)
+    {
+        Mesh *mesh = _meshes[i];
+        if (mesh->GetBoundingBox().min == mesh->GetBoundingBox().max && mesh->IsCPUResident())
+        {
+            mesh->CalculateBoundingBox();
         }
+        const BoundingBox box = mesh->GetBoundingBox();
+        if (first)
+        {
+            _localBounds = box;
+            first = false;
+        } else
+        {
+            _localBounds.Merge(box);
+        }
+    }
+    _boundsDirty = false;
+    return _localBounds;
+}
 
-        mesh->Render();
+void Model::selectLOD()
+{
+    Vec3 eye;
+    float pixelScale;
+    if (!Scene::Instance().GetLODView(eye, pixelScale) || _meshes.empty())
+    {
+        _currentLOD = 0;
+        _lodCulled = false;
+        return;
     }
+
+    BoundingBox box = localBounds();
+    box.Transform(_absTrans);
+    const Vec3 center = (box.min + box.max) * 0.5f;
+    const float radius = (box.max - box.min).length() * 0.5f;
+    const float distance = (center - eye).length();
+    _screenSize = distance > radius ? (2.0f * radius / distance) * pixelScale : FLT_MAX;
+    _lodCulled = _screenSize < _cullScreenSize;
+
+    _currentLOD = stepLOD(_currentLOD, _screenSize);
+}
+
+// coarser only once well below the threshold, finer once well above it
+u32 Model::stepLOD(u32 lod, float screenSize) const
+{
+    lod = std::min(lod, (u32)_lods.size());
+    while (lod < _lods.size() && screenSize < _lods[lod].screenSize * (1.0f - _lodHysteresis)) lod++;
+    while (lod > 0 && screenSize > _lods[lod - 1].screenSize * (1.0f + _lodHysteresis)) lod--;
+    return lod;
 }
 
+// same as selectLOD from the light of Scene::RenderDepth
+void Model::selectDepthLOD()
+{
+    const Scene &scene = Scene::Instance();
+    if (!scene._depthViewEnabled || _meshes.empty())
+    {
+        _depthLOD = 0;
+        _depthCulled = false;
+        return;
+    }
+
+    BoundingBox box = localBounds();
+    box.Transform(_absTrans);
+    // skinned bounds are the rest pose, only the size test holds for them
+    if (!IsSkinned() && scene._depthFrustum.BoxInside(box))
+    {
+        _depthCulled = true;
+        return;
+    }
+    const Vec3 center = (box.min + box.max) * 0.5f;
+    const float radius = (box.max - box.min).length() * 0.5f;
+    float screenSize = 2.0f * radius * scene._depthPixelScale;
+    if (!scene._depthOrtho)
+    {
+        const float distance = (center - scene._depthEye).length();
+        screenSize = distance > radius ? screenSize / distance : FLT_MAX;
+    }
+    _depthCulled = screenSize < _cullScreenSize;
+    _depthLOD = stepLOD(_depthLOD, screenSize);
+}
+
+//*****************************************************************************
+// Model morph targets
+//*****************************************************************************
+
+void Model::SetMorphWeight(u32 mesh, u32 target, float weight)
+{
+    if (mesh >= _meshes.size() || target >= _meshes[mesh]->GetMorphTargetCount())
+    {
+        LogWarning("[MODEL] %s: invalid morph target %u on mesh %u", _name.c_str(), target, mesh);
+        return;
+    }
+    if (_morphWeights.size() < _meshes.size())
+    {
+        _morphWeights.resize(_meshes.size());
+    }
+    std::vector<float> &weights = _morphWeights[mesh];
+    if (weights.size() < _meshes[mesh]->GetMorphTargetCount())
+    {
+        weights.resize(_meshes[mesh]->GetMorphTargetCount(), 0.0f);
+    }
+    if (weights[target] == weight) return;
+    weights[target] = weight;
+    if (mesh < _morphs.size() && _morphs[mesh] != nullptr)
+    {
+        _morphs[mesh]->morphDirty = true;
+    }
+    if (IsSkinned())
+    {
+        _skinningDirty = true;
+    }
+}
+
+float Model::GetMorphWeight(u32 mesh, u32 target) const
+{
+    if (mesh >= _morphWeights.size() || target >= _morphWeights[mesh].size()) return 0.0f;
+    return _morphWeights[mesh][target];
+}
+
+Model::SkinInstance *Model::applyMorph(u32 index)
+{
+    Mesh *mesh = _meshes[index];
+    if (mesh->GetMorphTargetCount() == 0 || mesh->GetMorphMode() != MORPH_CPU) return nullptr;
+    if (index >= _morphWeights.size() || _morphWeights[index].empty()) return nullptr;
+
+    if (_morphs.size() < _meshes.size())
+    {
+        _morphs.resize(_meshes.size(), nullptr);
+    }
+    SkinInstance *morph = _morphs[index];
+    if (morph == nullptr)
+    {
+        morph = new SkinInstance();
+        morph->vao = 0;
+        morph->positionVBO = 0;
+        morph->normalVBO = 0;
+        morph->needsUpload = false;
+        morph->morphDirty = true;
+        morph->morphed = false;
+        _morphs[index] = morph;
+    }
+    // the copy is rebuilt only when this model's weights change
+    if (morph->morphDirty)
+    {
+        morph->morphed = mesh->MorphInto(_morphWeights[index].data(), (u32)_morphWeights[index].size(),
+                                         morph->positions, morph->normals, morph->touched);
+        morph->morphDirty = false;
+        morph->needsUpload = true;
+    }
+    return morph->morphed ? morph : nullptr;
+}
+
+bool Model::bindMorph(u32 index, Shader *shader)
+{
+    Mesh *mesh = _meshes[index];
+    if (mesh->GetMorphTargetCount() == 0 || mesh->GetMorphMode() != MORPH_GPU) return false;
+
+    float weights[MAX_GPU_MORPH_TARGETS];
+    if (index < _morphWeights.size())
+    {
+        mesh->bindMorphStreams(_morphWeights[index].data(), (u32)_morphWeights[index].size(), weights);
+    } else
+    {
+        mesh->bindMorphStreams(nullptr, 0, weights);
+    }
+    shader->SetFloat("morphWeights", weights[0], weights[1], weights[2], weights[3]);
+    return true;
+}
+
+bool Model::CheckIntersection(const Vec3 &rayOrig, const Vec3 &rayDir, Vec3 &intsPos) const
+{
+    // raio em espaço do modelo
+    const Mat4 inv = _absTrans.inverted();
+    const Vec3 orig = Mat4::Transform(inv, rayOrig);
+    const Vec3 dir = Mat4::Transform(inv, rayOrig + rayDir) - orig;
+    const Ray ray(orig, dir);
+
+    float best = FLT_MAX;
+    bool hit = false;
+    for (u32 m = 0; m < _meshes.size(); ++m)
+    {
+        const Mesh *mesh = _meshes[m];
+        const std::vector<unsigned int> &idx = mesh->indices;
+        const Vec3 *pos = mesh->positions.data();
+        if (m < _skins.size() && _skins[m] != nullptr && !_skins[m]->positions.empty())
+        {
+            pos = _skins[m]->positions.data();
+        } else if (m < _morphs.size() && _morphs[m] != nullptr && _morphs[m]->morphed)
+        {
+            pos = _morphs[m]->positions.data();
+        }
+        if (idx.empty() || pos == nullptr) continue;
+
+        for (size_t i = 0; i + 2 < idx.size(); i += 3)
+        {
+            float t, u, v;
+            if (ray.Intersection(pos[idx[i]], pos[idx[i + 1]], pos[idx[i + 2]], t, u, v) && t < best)
+            {
+                best = t;
+                hit = true;
+            }
+        }
+    }
+    if (hit)
+    {
+        intsPos = Mat4::Transform(_absTrans, ray.pointAt(best));
+    }
+    return hit;
+}
 
 
 
@@ -596,6 +1214,23 @@ Model* Scene::CreateModel(const std::string& name)
     return model;
 }
 
+Animator* Scene::CreateAnimator(AnimationClip* clip, SceneNode* root)
+{
+    Animator *animator = new Animator(clip, root);
+    _animators.push_back(animator);
+    return animator;
+}
+
+void Scene::RemoveAnimator(Animator* animator)
+{
+    auto it = std::find(_animators.begin(), _animators.end(), animator);
+    if (it != _animators.end())
+    {
+        delete *it;
+        _animators.erase(it);
+    }
+}
+
 SceneNode* Scene::CreateNode(const std::string& name)
 {
     SceneNode *node = new SceneNode();
@@ -618,6 +1253,12 @@ void Scene::Clear()
     _nodes.clear();
     _nodes_to_add.clear();
     _nodes_to_remove.clear();
+
+    for (auto animator : _animators)
+    {
+        delete animator;
+    }
+    _animators.clear();
 }
 
 void Scene::Update(float dt) 
@@ -634,6 +1275,10 @@ void Scene::Update(float dt)
             [&nodeId](SceneNode* node) { return node->_id == nodeId; });
         if (it != _nodes.end())
         {
+            for (auto animator : _animators)
+            {
+                animator->Unbind(*it);
+            }
             delete *it;
             _nodes.erase(it);
         }
@@ -644,16 +1289,166 @@ void Scene::Update(float dt)
     {
         node->Update(dt);
     }
+
+    updateAnimators(dt);
+    updateSkinning();
+}
+
+void Scene::updateAnimators(float dt)
+{
+    _activeAnimators.clear();
+    for (auto animator : _animators)
+    {
+        if (animator->Advance(dt))
+        {
+            _activeAnimators.push_back(animator);
+        }
+    }
+    if (_activeAnimators.empty()) return;
+
+    // sampling touches only the animator (big ones are split in ranges),
+    // the node writes stay on this thread
+    const u32 ANIM_BATCH = 512;
+    _animJobs.clear();
+    for (auto animator : _activeAnimators)
+    {
+        const u32 count = animator->GetBoundCount();
+        for (u32 begin = 0; begin < count; begin += ANIM_BATCH)
+        {
+            AnimJob job;
+            job.animator = animator;
+            job.begin = begin;
+            job.end = std::min(begin + ANIM_BATCH, count);
+            _animJobs.push_back(job);
+        }
+    }
+    ThreadPool::Instance().ParallelFor((u32)_animJobs.size(), 1, [this](u32 begin, u32 end)
+    {
+        for (u32 i = begin; i < end; ++i)
+        {
+            const AnimJob &job = _animJobs[i];
+            job.animator->Sample(job.begin, job.end);
+        }
+    });
+    for (auto animator : _activeAnimators)
+    {
+        animator->Apply();
+    }
+    // rigid animated nodes need their _absTrans even without skinned models
+    UpdateNodes();
+}
+
+void Scene::gatherSkinned(SceneNode *node)
+{
+    if (node->_type == SceneNodeTypes::Model)
+    {
+        Model *model = (Model *)node;
+        if (model->IsSkinned() && model->_skinningDirty)
+        {
+            _skinnedModels.push_back(model);
+        }
+    }
+    // joints too: models attached to a bone (weapons, props) can be skinned
+    for (auto child : node->_children)
+    {
+        gatherSkinned(child);
+    }
+}
+
+void Scene::updateSkinning()
+{
+    _skinnedModels.clear();
+    for (auto node : _nodes)
+    {
+        gatherSkinned(node);
+    }
+    if (_skinnedModels.empty()) return;
+
+    // updateAnimators already did it this frame
+    if (_activeAnimators.empty())
+    {
+        UpdateNodes();
+    }
+
+    // palettes on this thread, vertices in batches over the worker threads
+    const u32 SKIN_BATCH = 2048;
+    _skinJobs.clear();
+    for (auto model : _skinnedModels)
+    {
+        model->updatePalette();
+        model->_skinningDirty = false;
+        // GPU mode only needs the palette, the vertices stay in the shader
+        if (model->_skinningMode == SKINNING_GPU && !model->_cpuSkinning) continue;
+        for (u32 i = 0; i < model->_meshes.size(); ++i)
+        {
+            Mesh *mesh = model->_meshes[i];
+            if (!mesh->HasSkin() || mesh->positions.empty()) continue;
+
+            model->prepareSkin(i);
+            const u32 count = (u32)mesh->positions.size();
+            for (u32 begin = 0; begin < count; begin += SKIN_BATCH)
+            {
+                SkinJob job;
+                job.model = model;
+                job.mesh = i;
+                job.begin = begin;
+                job.end = std::min(begin + SKIN_BATCH, count);
+                _skinJobs.push_back(job);
+            }
+        }
+    }
+
+    ThreadPool::Instance().ParallelFor((u32)_skinJobs.size(), 1, [this](u32 begin, u32 end)
+    {
+        for (u32 j = begin; j < end; ++j)
+        {
+            const SkinJob &job = _skinJobs[j];
+            job.model->skinMesh(job.mesh, job.begin, job.end);
+        }
+    });
 }
 
 
 void Model::RenderDepth(Shader* shader) 
 {
     if (!shader) return;
+    selectDepthLOD();
+    if (_depthCulled) return;
     shader->SetMatrix4("model", &_absTrans.x[0]);
-    for (auto mesh : _meshes)
+
+    // GPU skinned models cast their posed shadow with a depth shader that has
+    // the palette block; without it only SetCPUSkinning gives the pose
+    const bool skinShader = shader->HasUniformBlock("JointPalette");
+    const bool gpuSkin = IsSkinned() && _skinningMode == SKINNING_GPU && skinShader && bindPalette(shader);
+    if (skinShader)
+    {
+        shader->SetInt("skinned", gpuSkin ? 1 : 0);
+    }
+    if (_depthLOD > 0 && (gpuSkin || !IsSkinned()))
     {
-        if (mesh->CastsShadows())
+        const LODLevel &level = _lods[_depthLOD - 1];
+        for (u32 i = 0; i < level.meshes.size(); ++i)
+        {
+            Mesh *mesh = level.meshes[i];
+            if (mesh && mesh->CastsShadows()) mesh->Render();
+        }
+        return;
+    }
+    for (u32 i = 0; i < _meshes.size(); ++i)
+    {
+        Mesh *mesh = _meshes[i];
+        if (!mesh->CastsShadows()) continue;
+        SkinInstance *morph = applyMorph(i);
+
+        // CPU skinned positions work with any depth shader
+        SkinInstance *instance = (!gpuSkin && i < _skins.size() && _skins[i] != nullptr) ? _skins[i] : morph;
+        if (instance)
+        {
+            uploadInstance(instance, mesh);
+            glBindVertexArray(instance->vao);
+            glDrawElements(GL_TRIANGLES, mesh->GetIndexCount(), GL_UNSIGNED_INT, 0);
+            glBindVertexArray(0);
+        } else
         {
             mesh->Render();
         }
@@ -662,6 +1457,7 @@ void Model::RenderDepth(Shader* shader)
 
 void Scene::Render() 
 {
+    _meshletStats.Reset();
     for (auto node : _nodes)
     {
         node->Render( m_defaultShader );
@@ -681,6 +1477,19 @@ void Scene::RenderDepth(Shader* shader)
     glCullFace(GL_BACK);
 }
 
+void Scene::RenderDepth(Shader* shader, const Mat4 &lightView, const Mat4 &lightProj, float mapSize)
+{
+    _depthFrustum.build(lightView, lightProj);
+    const Mat4 light = lightView.inverted();
+    _depthEye = Vec3(light.c[3][0], light.c[3][1], light.c[3][2]);
+    // no w divide in an orthographic projection: the size does not fall with distance
+    _depthOrtho = lightProj.c[3][3] != 0.0f;
+    _depthPixelScale = lightProj.c[1][1] * mapSize * 0.5f;
+    _depthViewEnabled = true;
+    RenderDepth(shader);
+    _depthViewEnabled = false;
+}
+
 Scene &Scene::Instance()
 {
     static Scene instance;
@@ -704,7 +1513,38 @@ Scene::Scene()
 {
     m_defaultMaterial = new Material();
     m_defaultMaterial->SetTexture(0, TextureManager::Instance().GetDefault());
-    
+    _lodPixelScale = 0.0f;
+    _viewEnabled = false;
+    _depthPixelScale = 0.0f;
+    _depthOrtho = false;
+    _depthViewEnabled = false;
+}
+
+void Scene::SetView(const Mat4 &view, const Mat4 &proj, float viewportHeight)
+{
+    _view = view;
+    _proj = proj;
+    const Mat4 camera = view.inverted();
+    _lodEye = Vec3(camera.c[3][0], camera.c[3][1], camera.c[3][2]);
+    // perspective: NDC height of a sphere = diameter / distance * proj[1][1]
+    _lodPixelScale = proj.c[1][1] * viewportHeight * 0.5f;
+    _viewEnabled = true;
+}
+
+bool Scene::GetView(Mat4 &view, Mat4 &proj) const
+{
+    if (!_viewEnabled) return false;
+    view = _view;
+    proj = _proj;
+    return true;
+}
+
+bool Scene::GetLODView(Vec3 &eye, float &pixelScale) const
+{
+    if (!_viewEnabled) return false;
+    eye = _lodEye;
+    pixelScale = _lodPixelScale;
+    return true;
 }
 
 Scene::~Scene() 
@@ -62,6 +62,7 @@ void Shader::Release()
         glDeleteProgram(m_program);
     }
     m_program=0;
+    m_blocks.clear();
 }
 
 
@@ -202,6 +203,17 @@ bool Shader::addAttribute(const char *name)
     return true;
 }
 
+bool Shader::findUniform(const std::string &name) const
+{
+    return m_uniforms.find(name) != m_uniforms.end();
+}
+
+// sem log: usado para testar funcionalidades opcionais do shader
+bool Shader::ContainsUniform(const std::string &name) const
+{
+    return glGetUniformLocation(m_program, name.c_str()) != -1;
+}
+
 
 
 
@@ -251,6 +263,32 @@ void Shader::SetFloat(const std::string& name, float x, float y, float z, float
 }   
 
 
+u32 Shader::getUniformBlockIndex(const std::string& name)
+{
+    auto it = m_blocks.find(name);
+    if (it != m_blocks.end())
+    {
+        return it->second;
+    }
+    u32 index = glGetUniformBlockIndex(m_program, name.c_str());
+    m_blocks[name] = index;
+    return index;
+}
+
+bool Shader::HasUniformBlock(const std::string& name)
+{
+    return getUniformBlockIndex(name) != GL_INVALID_INDEX;
+}
+
+bool Shader::SetUniformBlock(const std::string& name, u32 binding)
+{
+    u32 index = getUniformBlockIndex(name);
+    if (index == GL_INVALID_INDEX) return false;
+    glUniformBlockBinding(m_program, index, binding);
+    return true;
+}
+
+
 void Shader::print()
 {
     LogInfo("[SHADER]  Id(%d) Num Attributes(%d)  Num Uniforms (%d)",m_program, m_numAttributes, m_numUniforms);
@@ -6,6 +6,7 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 #include "glad/glad.h"
+#include "Device.hpp"
 
 
 
@@ -243,6 +244,22 @@ Texture2D::Texture2D():Texture()
 
 }
 
+Texture2D::~Texture2D()
+{
+    Release();
+}
+
+void Texture2D::Release()
+{
+    // atlas views share the page texture, async loads the default one
+    if (m_atlased || m_placeholder)
+    {
+        id = 0;
+        return;
+    }
+    Texture::Release();
+}
+
 
 Texture2D::Texture2D(const Pixmap &pixmap):Texture()
 {
@@ -398,6 +415,10 @@ static unsigned char *LoadFileData(const char *fileName, unsigned int *bytesRead
 
 bool Texture2D::Load(const char* file_name)
 {
+    if (System::Instance().IsFileExtension(file_name, ".ktx") || System::Instance().IsFileExtension(file_name, ".ktx2"))
+    {
+        return LoadKTX(file_name);
+    }
  
     unsigned int bytesRead;
     unsigned char *fileData =  LoadFileData(file_name,&bytesRead);
@@ -476,6 +497,134 @@ Texture2D::Texture2D(const char* file_name):Texture()
     Load(file_name);
 }
 
+// compressed families the GPU can sample, queried once (needs a current context)
+static bool s_extensionsQueried = false;
+static bool s_hasS3TC = false;
+static bool s_hasS3TCsRGB = false;
+static bool s_hasRGTC = false;
+static bool s_hasBPTC = false;
+static bool s_hasASTC = false;
+
+static void queryCompressedExtensions()
+{
+    s_extensionsQueried = true;
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *name = (const char *)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (!name) continue;
+        if (strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) s_hasS3TC = true;
+        else if (strcmp(name, "GL_EXT_texture_compression_s3tc_srgb") == 0 || strcmp(name, "GL_EXT_texture_sRGB") == 0) s_hasS3TCsRGB = true;
+        else if (strcmp(name, "GL_EXT_texture_compression_rgtc") == 0 || strcmp(name, "GL_ARB_texture_compression_rgtc") == 0) s_hasRGTC = true;
+        else if (strcmp(name, "GL_EXT_texture_compression_bptc") == 0 || strcmp(name, "GL_ARB_texture_compression_bptc") == 0) s_hasBPTC = true;
+        else if (strcmp(name, "GL_KHR_texture_compression_astc_ldr") == 0 || strcmp(name, "GL_OES_texture_compression_astc") == 0) s_hasASTC = true;
+    }
+    LogInfo("TEXTURE2D: Compressed formats ETC2%s%s%s%s", s_hasASTC ? " ASTC" : "", s_hasS3TC ? " S3TC" : "",
+            s_hasRGTC ? " RGTC" : "", s_hasBPTC ? " BPTC" : "");
+}
+
+bool Texture2D::IsFormatSupported(TextureFormat format, bool srgb)
+{
+    if (!s_extensionsQueried)
+    {
+        queryCompressedExtensions();
+    }
+    switch (GetTextureFamily(format))
+    {
+        case TEXTURE_FAMILY_NONE: return format != TEXTURE_FORMAT_UNKNOWN;
+        case TEXTURE_FAMILY_ETC: return true;       // core in GLES 3
+        case TEXTURE_FAMILY_S3TC: return s_hasS3TC && (!srgb || s_hasS3TCsRGB);
+        case TEXTURE_FAMILY_RGTC: return s_hasRGTC;
+        case TEXTURE_FAMILY_BPTC: return s_hasBPTC;
+        case TEXTURE_FAMILY_ASTC: return s_hasASTC;
+    }
+    return false;
+}
+
+bool Texture2D::LoadKTX(const char* file_name)
+{
+    unsigned int bytesRead;
+    unsigned char *fileData = LoadFileData(file_name, &bytesRead);
+    if (!fileData)
+        return false;
+
+    CompressedImage image;
+    const bool parsed = ParseKTX(fileData, bytesRead, image);
+    free(fileData);
+    if (!parsed)
+    {
+        LogError("Texture2D: Failed to load KTX: %s", file_name);
+        return false;
+    }
+    return Load(image);
+}
+
+bool Texture2D::Load(const CompressedImage &image)
+{
+    if (image.levels.empty())
+    {
+        return false;
+    }
+    const bool supported = IsFormatSupported(image.format, image.srgb);
+    if (!supported && !CanDecodeTexture(image.format))
+    {
+        LogError("Texture2D: %s is not supported by the GPU and has no software decoder", GetTextureFormatName(image.format));
+        return false;
+    }
+
+    width = image.width;
+    height = image.height;
+    components = image.format == TEXTURE_FORMAT_RGB8 || image.format == TEXTURE_FORMAT_ETC1 || image.format == TEXTURE_FORMAT_ETC2_RGB
+               || image.format == TEXTURE_FORMAT_BC1 ? 3 : 4;
+    const u32 levels = (u32)image.levels.size();
+
+    createTexture();
+    // the file brings its own mips, a partial chain stops at the last one
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels - 1);
+
+    u32 bytes = 0;
+    if (supported)
+    {
+        const GLenum format = image.GetGLFormat();
+        for (u32 l = 0; l < levels; l++)
+        {
+            const CompressedLevel &level = image.levels[l];
+            if (image.IsCompressed())
+            {
+                glCompressedTexImage2D(GL_TEXTURE_2D, l, format, level.width, level.height, 0, level.size, image.GetLevelData(l));
+            }
+            else
+            {
+                glTexImage2D(GL_TEXTURE_2D, l, format, level.width, level.height, 0,
+                             image.format == TEXTURE_FORMAT_RGB8 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, image.GetLevelData(l));
+            }
+            bytes += level.size;
+        }
+    }
+    else
+    {
+        LogWarning("Texture2D: %s is not supported by the GPU, decoding to RGBA8", GetTextureFormatName(image.format));
+        std::vector<u8> rgba;
+        for (u32 l = 0; l < levels; l++)
+        {
+            const CompressedLevel &level = image.levels[l];
+            DecodeTextureLevel(image, l, rgba);
+            glTexImage2D(GL_TEXTURE_2D, l, image.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+            bytes += (u32)rgba.size();
+        }
+    }
+    if (levels == 1 && !(supported && image.IsCompressed()))
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    LogInfo("TEXTURE2D: [ID %i] %s texture (%d,%d) %u levels, %u KB", id, GetTextureFormatName(image.format), width, height, levels, bytes / 1024);
+    return true;
+}
+
 bool Texture2D::LoadFromMemory(const unsigned char *buffer, u16 components, int width, int height)
 {
    
@@ -535,6 +684,33 @@ bool Texture2D::LoadFromMemory(const unsigned char *buffer, u16 components, int
     return true;
 }
 
+bool Texture2D::LoadFloat(const float *data, u16 components, int width, int height)
+{
+    static const GLenum formats[4] = {GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F};
+    static const GLenum glFormats[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    if (components < 1 || components > 4)
+    {
+        LogError("TEXTURE2D: Invalid float texture components: %d", components);
+        return false;
+    }
+
+    this->components = components;
+    this->width = width;
+    this->height = height;
+
+    // float textures are data: no filtering, no mipmaps
+    MinificationFilter = FilterMode::Nearest;
+    MagnificationFilter = FilterMode::Nearest;
+    HorizontalWrap = WrapMode::ClampToEdge;
+    VerticalWrap = WrapMode::ClampToEdge;
+    createTexture(false);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, formats[components - 1], width, height, 0, glFormats[components - 1], GL_FLOAT, data);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    LogInfo("TEXTURE2D: [ID %i] Create float Texture2D (%d,%d) channels:%d", id, width, height, components);
+    return true;
+}
+
 
 
 
@@ -570,36 +746,37 @@ CubemapTexture::CubemapTexture(
 
 bool CubemapTexture::Load()
 {
-   
+    // the six faces decode in parallel, the GL calls stay on this thread
+    unsigned char *faces[6];
+    int widths[6], heights[6];
+    ThreadPool::Instance().ParallelFor(6, 1, [&](u32 begin, u32 end)
+    {
+        for (u32 i = begin; i < end; i++)
+        {
+            int bpp;
+            faces[i] = stbi_load(m_fileNames[i].c_str(), &widths[i], &heights[i], &bpp, 3);
+        }
+    });
 
     glGenTextures(1, &id);
     glBindTexture(GL_TEXTURE_CUBE_MAP, id);
 
     for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(types) ; i++) 
     {
-        int Width, Height;
-        void* pData = NULL;
-
-        int BPP;
-        unsigned char* image_data = stbi_load(m_fileNames[i].c_str(), &Width, &Height, &BPP, 0);
-
-        if (!image_data) 
+        if (!faces[i]) 
         {
             LogError("Can't load texture from '%s' - %s\n", m_fileNames[i].c_str(), stbi_failure_reason());
-
+            continue;
         }
 
-
-        pData = image_data;
-
-        glTexImage2D(types[i], 0, GL_RGB, Width, Height, 0, GL_RGB, GL_UNSIGNED_BYTE, pData);
+        glTexImage2D(types[i], 0, GL_RGB, widths[i], heights[i], 0, GL_RGB, GL_UNSIGNED_BYTE, faces[i]);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-        stbi_image_free(image_data);
+        stbi_image_free(faces[i]);
     }
 
     return true;
@@ -924,6 +1101,213 @@ void Pixmap::FlipHorizontal()
 }
 
 
+//*****************************************************************************
+// SkylinePacker
+//*****************************************************************************
+
+SkylinePacker::SkylinePacker(int size)
+{
+    Reset(size);
+}
+
+void SkylinePacker::Reset(int size)
+{
+    m_size = std::max(size, 0);
+    m_usedArea = 0;
+    m_nodes.clear();
+    Node node = {0, 0, m_size};
+    m_nodes.push_back(node);
+}
+
+// top of a width x height rect that starts at node index, -1 if it does not fit
+int SkylinePacker::fit(u32 index, int width, int height) const
+{
+    const int x = m_nodes[index].x;
+    if (x + width > m_size) return -1;
+    int y = m_nodes[index].y;
+    int remaining = width;
+    while (remaining > 0)
+    {
+        y = std::max(y, m_nodes[index].y);
+        if (y + height > m_size) return -1;
+        remaining -= m_nodes[index].width;
+        ++index;
+    }
+    return y;
+}
+
+bool SkylinePacker::Pack(int width, int height, int &x, int &y)
+{
+    if (width <= 0 || height <= 0) return false;
+    int bestIndex = -1;
+    int bestTop = INT_MAX;
+    int bestWidth = INT_MAX;
+    for (u32 i = 0; i < m_nodes.size(); ++i)
+    {
+        const int top = fit(i, width, height);
+        if (top < 0) continue;
+        // lowest bottom edge first, then the narrowest segment
+        if (top + height < bestTop || (top + height == bestTop && m_nodes[i].width < bestWidth))
+        {
+            bestIndex = (int)i;
+            bestTop = top + height;
+            bestWidth = m_nodes[i].width;
+            x = m_nodes[i].x;
+            y = top;
+        }
+    }
+    if (bestIndex < 0) return false;
+
+    Node node = {x, y + height, width};
+    m_nodes.insert(m_nodes.begin() + bestIndex, node);
+
+    // cut the nodes now under the new one
+    for (u32 i = bestIndex + 1; i < m_nodes.size(); ++i)
+    {
+        Node &previous = m_nodes[i - 1];
+        Node &current = m_nodes[i];
+        const int shrink = previous.x + previous.width - current.x;
+        if (shrink <= 0) break;
+        current.x += shrink;
+        current.width -= shrink;
+        if (current.width > 0) break;
+        m_nodes.erase(m_nodes.begin() + i);
+        --i;
+    }
+    for (u32 i = 0; i + 1 < m_nodes.size(); ++i)
+    {
+        if (m_nodes[i].y == m_nodes[i + 1].y)
+        {
+            m_nodes[i].width += m_nodes[i + 1].width;
+            m_nodes.erase(m_nodes.begin() + i + 1);
+            --i;
+        }
+    }
+    m_usedArea += width * height;
+    return true;
+}
+
+
+//*****************************************************************************
+// TextureAtlas
+//*****************************************************************************
+
+TextureAtlas::TextureAtlas(int pageSize, int padding)
+{
+    m_pageSize = pageSize;
+    m_padding = std::max(padding, 0);
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    Clear();
+}
+
+void TextureAtlas::Clear()
+{
+    for (u32 i = 0; i < m_pages.size(); ++i)
+    {
+        delete m_pages[i].texture;
+    }
+    m_pages.clear();
+}
+
+float TextureAtlas::GetOccupancy() const
+{
+    if (m_pages.empty()) return 0.0f;
+    double used = 0.0;
+    for (u32 i = 0; i < m_pages.size(); ++i)
+    {
+        used += m_pages[i].packer.GetUsedArea();
+    }
+    return (float)(used / ((double)m_pageSize * m_pageSize * m_pages.size()));
+}
+
+bool TextureAtlas::addPage()
+{
+    Page page;
+    page.texture = new Texture2D();
+    page.texture->SetMinFilter(FilterMode::Linear);
+    page.texture->SetWrapS(WrapMode::ClampToEdge);
+    page.texture->SetWrapT(WrapMode::ClampToEdge);
+    if (!page.texture->LoadFromMemory(nullptr, 4, m_pageSize, m_pageSize))
+    {
+        delete page.texture;
+        return false;
+    }
+    // LoadFromMemory without pixels only creates the texture object
+    glBindTexture(GL_TEXTURE_2D, page.texture->GetID());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_pageSize, m_pageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    page.packer.Reset(m_pageSize);
+    m_pages.push_back(page);
+    LogInfo("ATLAS: page %u (%dx%d)", (u32)m_pages.size() - 1, m_pageSize, m_pageSize);
+    return true;
+}
+
+Texture2D *TextureAtlas::Add(const Pixmap &pixmap)
+{
+    if (!pixmap.pixels || pixmap.width <= 0 || pixmap.height <= 0)
+    {
+        LogError("ATLAS: empty image");
+        return nullptr;
+    }
+    const int width = pixmap.width + m_padding * 2;
+    const int height = pixmap.height + m_padding * 2;
+    if (width > m_pageSize || height > m_pageSize)
+    {
+        LogWarning("ATLAS: image %dx%d does not fit a %d page", pixmap.width, pixmap.height, m_pageSize);
+        return nullptr;
+    }
+
+    int x = 0;
+    int y = 0;
+    u32 page = 0;
+    while (page < m_pages.size() && !m_pages[page].packer.Pack(width, height, x, y))
+    {
+        ++page;
+    }
+    if (page == m_pages.size())
+    {
+        if (!addPage() || !m_pages[page].packer.Pack(width, height, x, y)) return nullptr;
+    }
+
+    // RGBA copy with the border pixels repeated into the padding
+    std::vector<u8> texels((size_t)width * height * 4);
+    for (int py = 0; py < height; ++py)
+    {
+        const int sy = Clamp(py - m_padding, 0, pixmap.height - 1);
+        for (int px = 0; px < width; ++px)
+        {
+            const int sx = Clamp(px - m_padding, 0, pixmap.width - 1);
+            const Color color = pixmap.GetPixelColor((u32)sx, (u32)sy);
+            u8 *texel = &texels[((size_t)py * width + px) * 4];
+            texel[0] = color.r;
+            texel[1] = color.g;
+            texel[2] = color.b;
+            texel[3] = color.a;
+        }
+    }
+    Texture2D *pageTexture = m_pages[page].texture;
+    glBindTexture(GL_TEXTURE_2D, pageTexture->GetID());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Texture2D *view = new Texture2D();
+    view->id = pageTexture->GetID();
+    view->width = pixmap.width;
+    view->height = pixmap.height;
+    view->components = 4;
+    view->m_atlased = true;
+    const float size = (float)m_pageSize;
+    view->m_atlasUV.Set((x + m_padding) / size, (y + m_padding) / size, pixmap.width / size, pixmap.height / size);
+    return view;
+}
+
+
+
 //*****************************************************************************
 // TextureManager
 //*****************************************************************************
@@ -947,6 +1331,11 @@ TextureManager::TextureManager()
 {
     LogInfo("TextureManager: Create");
      m_texturePath = "assets/textures";
+     m_defaultTexture = nullptr;
+     m_atlas = nullptr;
+     m_uploadBytes = TEXTURE_UPLOAD_BYTES;
+     m_uploadMilliseconds = TEXTURE_UPLOAD_MS;
+     m_lastUploadBytes = 0;
      
 }
 
@@ -960,6 +1349,13 @@ TextureManager::~TextureManager()
 
 void TextureManager::Clear()
 {
+    // jobs still decoding or uploading keep their own reference
+    for (u32 i = 0; i < m_asyncLoads.size(); i++)
+    {
+        m_asyncLoads[i]->cancelled = true;
+    }
+    m_asyncLoads.clear();
+
      if (m_defaultTexture)
     {
         delete m_defaultTexture;
@@ -978,6 +1374,10 @@ void TextureManager::Clear()
     }
 
     m_textures.clear();
+
+    // views first, they only borrow the pages
+    delete m_atlas;
+    m_atlas = nullptr;
 }
 
 void TextureManager::FlipTextureOnLoad(bool flip)
@@ -1120,6 +1520,53 @@ Texture2D *TextureManager::Get(const unsigned char *buffer, u16 components, int
     return texture;
 }
 
+TextureAtlas *TextureManager::GetAtlas()
+{
+    if (!m_atlas)
+    {
+        m_atlas = new TextureAtlas();
+    }
+    return m_atlas;
+}
+
+Texture2D *TextureManager::AddToAtlas(const Pixmap &pixmap, const char *name)
+{
+    auto it = m_textures.find(name);
+    if (it != m_textures.end())
+    {
+        return it->second;
+    }
+    Texture2D *texture = nullptr;
+    TextureAtlas *atlas = GetAtlas();
+    if (pixmap.width * 2 <= atlas->GetPageSize() && pixmap.height * 2 <= atlas->GetPageSize())
+    {
+        texture = atlas->Add(pixmap);
+    }
+    if (!texture)
+    {
+        texture = Create(pixmap);
+        if (!texture) return m_defaultTexture;
+    }
+    m_textures.emplace(name, texture);
+    m_loadedTextures.push_back(texture);
+    return texture;
+}
+
+Texture2D *TextureManager::LoadToAtlas(const char *file_name)
+{
+    auto it = m_textures.find(file_name);
+    if (it != m_textures.end())
+    {
+        return it->second;
+    }
+    Pixmap pixmap;
+    if (!pixmap.Load(file_name))
+    {
+        return m_defaultTexture;
+    }
+    return AddToAtlas(pixmap, file_name);
+}
+
 bool TextureManager::Add(Texture2D *texture, const char *name)
 {
     if (m_textures.find(name) != m_textures.end())
@@ -1140,17 +1587,18 @@ bool TextureManager::Remove(const char *file_name)
     {
         texture = it->second;
         m_textures.erase(it);
-        delete texture;
-        return true;
-    }
-
-    for (auto it = m_loadedTextures.begin(); it != m_loadedTextures.end(); it++)
-    {
-        if (*it == texture)
+        cancelAsync(texture);
+        // GetTexture(id) must not hand out the freed pointer
+        for (auto loaded = m_loadedTextures.begin(); loaded != m_loadedTextures.end(); loaded++)
         {
-            m_loadedTextures.erase(it);
-            return true;
+            if (*loaded == texture)
+            {
+                m_loadedTextures.erase(loaded);
+                break;
+            }
         }
+        delete texture;
+        return true;
     }
 
     return false;
@@ -1209,7 +1657,7 @@ Texture2D *TextureManager::Load(const char *name)
         if (texture->Load(path.c_str()))
         {
             m_textures.emplace (path,texture);
-            m_loadedTextures.push_back(it->second);
+            m_loadedTextures.push_back(texture);
         } else 
         {
             delete texture;
@@ -1236,7 +1684,7 @@ Texture2D *TextureManager::Load(const std::string &filename, const std::string &
         if (texture->Load(path.c_str()))
         {
             m_textures.emplace (name,texture);
-            m_loadedTextures.push_back(it->second);
+            m_loadedTextures.push_back(texture);
         } else 
         {
             delete texture;
@@ -1247,6 +1695,44 @@ Texture2D *TextureManager::Load(const std::string &filename, const std::string &
     return texture;
 }
 
+Texture2D *TextureManager::LoadCompressed(const char *name)
+{
+    struct Variant
+    {
+        const char *suffix;
+        TextureFormat format;
+    };
+    static const Variant variants[] =
+    {
+        {".astc", TEXTURE_FORMAT_ASTC},
+        {".bc7", TEXTURE_FORMAT_BC7},
+        {".bc3", TEXTURE_FORMAT_BC3},
+        {".bc1", TEXTURE_FORMAT_BC1},
+        {".etc2", TEXTURE_FORMAT_ETC2_RGB},
+    };
+    static const char *extensions[] = {".ktx2", ".ktx"};
+
+    for (u32 pass = 0; pass < 2; pass++)
+    {
+        for (const Variant &variant : variants)
+        {
+            // first what the GPU samples, then what the software decoder can read
+            if (pass == 0 && !Texture2D::IsFormatSupported(variant.format)) continue;
+            if (pass == 1 && !CanDecodeTexture(variant.format)) continue;
+            for (const char *extension : extensions)
+            {
+                std::string file = std::string(name) + variant.suffix + extension;
+                if (System::Instance().FileExists((m_texturePath + file).c_str()))
+                {
+                    return Load(file.c_str());
+                }
+            }
+        }
+    }
+    LogError("TextureManager: No compressed variant of %s", name);
+    return m_defaultTexture;
+}
+
 bool TextureManager::LoadTexture(const char *name)
 {
     
@@ -1278,3 +1764,273 @@ bool TextureManager::LoadTexture(const char *name)
 
     return false;
 }
+
+//*******************************************************
+// Async loading
+//*******************************************************
+
+enum
+{
+    ASYNC_DECODING = 0,
+    ASYNC_DECODED = 1,
+    ASYNC_FAILED = 2,
+    ASYNC_UPLOADING = 3     // on the GpuUploader
+};
+
+Texture2D *TextureManager::LoadAsync(const char *name)
+{
+    std::string path = m_texturePath + name;
+    auto it = m_textures.find(path);
+    if (it != m_textures.end())
+    {
+        return it->second;
+    }
+    if (System::Instance().IsFileExtension(name, ".ktx") || System::Instance().IsFileExtension(name, ".ktx2"))
+    {
+        // already GPU ready, nothing to decode on the pool
+        return Load(name);
+    }
+    if (!m_defaultTexture)
+    {
+        LogError("TextureManager: LoadAsync before Init: %s", path.c_str());
+        return nullptr;
+    }
+
+    Texture2D *texture = new Texture2D();
+    texture->id = m_defaultTexture->GetID();
+    texture->width = m_defaultTexture->GetWidth();
+    texture->height = m_defaultTexture->GetHeight();
+    texture->m_placeholder = true;
+    texture->m_loading = true;
+    m_textures.emplace(path, texture);
+    m_loadedTextures.push_back(texture);
+
+    std::shared_ptr<AsyncLoad> load = std::make_shared<AsyncLoad>();
+    load->path = path;
+    load->texture = texture;
+    load->state = ASYNC_DECODING;
+    load->width = 0;
+    load->height = 0;
+    load->components = 0;
+    load->level = -1;
+    load->row = 0;
+    load->id = 0;
+    load->cancelled = false;
+    m_asyncLoads.push_back(load);
+
+    ThreadPool::Instance().Submit([load]()
+    {
+        unsigned int bytesRead = 0;
+        unsigned char *fileData = LoadFileData(load->path.c_str(), &bytesRead);
+        unsigned char *data = fileData ? stbi_load_from_memory(fileData, bytesRead, &load->width, &load->height, &load->components, 0) : nullptr;
+        free(fileData);
+        if (!data || load->components < 1 || load->components > 4)
+        {
+            stbi_image_free(data);
+            load->state = ASYNC_FAILED;
+            return;
+        }
+
+        int width = load->width;
+        int height = load->height;
+        load->levels.resize(1);
+        load->levels[0].assign(data, data + (size_t)width * height * load->components);
+        stbi_image_free(data);
+        while (width > 1 || height > 1)
+        {
+            load->levels.emplace_back();
+            DownsampleImage(load->levels[load->levels.size() - 2].data(), width, height, load->components, load->levels.back());
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+        load->level = (int)load->levels.size() - 1;
+        load->state = ASYNC_DECODED;
+    });
+    return texture;
+}
+
+void TextureManager::cancelAsync(Texture2D *texture)
+{
+    for (u32 i = 0; i < m_asyncLoads.size(); i++)
+    {
+        if (m_asyncLoads[i]->texture == texture)
+        {
+            m_asyncLoads[i]->cancelled = true;
+            m_asyncLoads.erase(m_asyncLoads.begin() + i);
+            return;
+        }
+    }
+}
+
+// uploads rows of the current level until maxBytes, true when every level is in
+bool TextureManager::uploadAsync(AsyncLoad &load, u32 &bytes, u32 maxBytes)
+{
+    static const GLenum formats[4] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+    static const GLenum glFormats[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    Texture2D *texture = load.texture;
+    const int levels = (int)load.levels.size();
+
+    if (texture->m_placeholder)
+    {
+        // own storage for the whole chain, sampled from the uploaded mips only
+        texture->m_placeholder = false;
+        texture->id = 0;
+        texture->components = load.components;
+        texture->createTexture(load.components == 2);
+        glTexStorage2D(GL_TEXTURE_2D, levels, formats[load.components - 1], load.width, load.height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+    }
+    else
+    {
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    }
+
+    while (load.level >= 0)
+    {
+        const int width = std::max(load.width >> load.level, 1);
+        const int height = std::max(load.height >> load.level, 1);
+        const u32 rowBytes = (u32)width * load.components;
+        int rows = height - load.row;
+        if (bytes > 0 || (u32)rows * rowBytes > maxBytes)
+        {
+            // at least one row per frame
+            const u32 left = bytes < maxBytes ? maxBytes - bytes : 0;
+            rows = std::min(rows, std::max((int)(left / rowBytes), bytes == 0 ? 1 : 0));
+        }
+        if (rows == 0) break;
+
+        glTexSubImage2D(GL_TEXTURE_2D, load.level, 0, load.row, width, rows, glFormats[load.components - 1], GL_UNSIGNED_BYTE,
+                        &load.levels[load.level][(size_t)load.row * rowBytes]);
+        bytes += (u32)rows * rowBytes;
+        load.row += rows;
+        if (load.row < height) break;
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, load.level);
+        std::vector<u8>().swap(load.levels[load.level]);
+        load.level--;
+        load.row = 0;
+        texture->width = load.width;
+        texture->height = load.height;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return load.level < 0;
+}
+
+void TextureManager::UpdateAsync()
+{
+    m_lastUploadBytes = 0;
+    if (m_asyncLoads.empty()) return;
+
+    const u64 start = SDL_GetPerformanceCounter();
+    const double toMilliseconds = 1000.0 / (double)SDL_GetPerformanceFrequency();
+    u32 bytes = 0;
+    for (u32 i = 0; i < m_asyncLoads.size();)
+    {
+        AsyncLoad &load = *m_asyncLoads[i];
+        const u32 state = load.state;
+        if (state == ASYNC_DECODED && GpuUploader::Instance().IsThreaded())
+        {
+            submitAsync(m_asyncLoads[i]);
+            i++;
+            continue;
+        }
+        if (state == ASYNC_DECODING || state == ASYNC_UPLOADING)
+        {
+            i++;
+            continue;
+        }
+        if (state == ASYNC_FAILED)
+        {
+            LogError("Texture2D: Failed to load image: %s", load.path.c_str());
+            load.texture->m_loading = false;
+            m_asyncLoads.erase(m_asyncLoads.begin() + i);
+            continue;
+        }
+
+        const bool done = uploadAsync(load, bytes, m_uploadBytes);
+        if (done)
+        {
+            finishAsync(load);
+            m_asyncLoads.erase(m_asyncLoads.begin() + i);
+        }
+        else
+        {
+            i++;
+        }
+        if (bytes >= m_uploadBytes || (SDL_GetPerformanceCounter() - start) * toMilliseconds >= m_uploadMilliseconds)
+        {
+            break;
+        }
+    }
+    m_lastUploadBytes = bytes;
+}
+
+void TextureManager::finishAsync(AsyncLoad &load)
+{
+    load.texture->m_loading = false;
+    LogInfo("TEXTURE2D: [ID %i] Async texture %s (%d,%d) bpp:%d", load.texture->GetID(), load.path.c_str(), load.width, load.height, load.components);
+}
+
+// the whole chain in one go on the loader thread, swapped in once its fence signals
+void TextureManager::submitAsync(const std::shared_ptr<AsyncLoad> &load)
+{
+    load->state = ASYNC_UPLOADING;
+    Texture2D *texture = load->texture;
+    const GLint wrapS = texture->HorizontalWrap;
+    const GLint wrapT = texture->VerticalWrap;
+    const GLint minFilter = texture->MinificationFilter;
+    const GLint magFilter = texture->MagnificationFilter;
+    const float anisotropy = texture->MaxAnisotropic;
+
+    GpuUploader::Instance().Submit([load, wrapS, wrapT, minFilter, magFilter, anisotropy]()
+    {
+        static const GLenum formats[4] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+        static const GLenum glFormats[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+        GLuint id = 0;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (load->components == 2)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_GREEN);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+        if (anisotropy > 0.0f)
+        {
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+        }
+        const int levels = (int)load->levels.size();
+        glTexStorage2D(GL_TEXTURE_2D, levels, formats[load->components - 1], load->width, load->height);
+        for (int level = levels - 1; level >= 0; level--)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, std::max(load->width >> level, 1), std::max(load->height >> level, 1),
+                            glFormats[load->components - 1], GL_UNSIGNED_BYTE, load->levels[level].data());
+            std::vector<u8>().swap(load->levels[level]);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        load->id = id;
+    },
+    [this, load]()
+    {
+        if (load->cancelled)
+        {
+            glDeleteTextures(1, &load->id);
+            return;
+        }
+        Texture2D *texture = load->texture;
+        texture->m_placeholder = false;
+        texture->id = load->id;
+        texture->width = load->width;
+        texture->height = load->height;
+        texture->components = load->components;
+        finishAsync(*load);
+        cancelAsync(texture);
+    });
+}
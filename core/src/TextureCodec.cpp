@@ -0,0 +1,1206 @@
+#include "pch.h"
+#include "TextureCodec.hpp"
+#include "Texture.hpp"
+#include "Utils.hpp"
+
+//*******************************************************
+// formats
+//*******************************************************
+
+struct FormatInfo
+{
+    const char *name;
+    TextureFamily family;
+    int blockWidth;
+    int blockHeight;
+    int blockBytes;
+    u32 gl;             // GL internal format, linear and sRGB
+    u32 glSRGB;
+};
+
+// same order as TextureFormat
+static const FormatInfo formatInfo[] =
+{
+    {"unknown",     TEXTURE_FAMILY_NONE, 1, 1, 0,  0,      0},
+    {"RGBA8",       TEXTURE_FAMILY_NONE, 1, 1, 4,  0x8058, 0x8C43},     // GL_RGBA8, GL_SRGB8_ALPHA8
+    {"RGB8",        TEXTURE_FAMILY_NONE, 1, 1, 3,  0x8051, 0x8C41},     // GL_RGB8, GL_SRGB8
+    {"ETC1",        TEXTURE_FAMILY_ETC,  4, 4, 8,  0x9274, 0x9275},     // GL_COMPRESSED_RGB8_ETC2
+    {"ETC2 RGB",    TEXTURE_FAMILY_ETC,  4, 4, 8,  0x9274, 0x9275},
+    {"ETC2 RGB A1", TEXTURE_FAMILY_ETC,  4, 4, 8,  0x9276, 0x9277},     // GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2
+    {"ETC2 RGBA",   TEXTURE_FAMILY_ETC,  4, 4, 16, 0x9278, 0x9279},     // GL_COMPRESSED_RGBA8_ETC2_EAC
+    {"BC1",         TEXTURE_FAMILY_S3TC, 4, 4, 8,  0x83F0, 0x8C4C},     // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    {"BC1 A1",      TEXTURE_FAMILY_S3TC, 4, 4, 8,  0x83F1, 0x8C4D},
+    {"BC3",         TEXTURE_FAMILY_S3TC, 4, 4, 16, 0x83F3, 0x8C4F},     // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    {"BC4",         TEXTURE_FAMILY_RGTC, 4, 4, 8,  0x8DBB, 0x8DBB},     // GL_COMPRESSED_RED_RGTC1
+    {"BC5",         TEXTURE_FAMILY_RGTC, 4, 4, 16, 0x8DBD, 0x8DBD},     // GL_COMPRESSED_RG_RGTC2
+    {"BC7",         TEXTURE_FAMILY_BPTC, 4, 4, 16, 0x8E8C, 0x8E8D},     // GL_COMPRESSED_RGBA_BPTC_UNORM
+    {"ASTC",        TEXTURE_FAMILY_ASTC, 4, 4, 16, 0x93B0, 0x93D0},     // GL_COMPRESSED_RGBA_ASTC_4x4_KHR + block size
+};
+
+// ASTC LDR block sizes, in GL/Vulkan enum order
+static const int astcBlocks[14][2] =
+{
+    {4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6},
+    {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}
+};
+
+static void setFormat(CompressedImage &image, TextureFormat format, bool srgb)
+{
+    const FormatInfo &info = formatInfo[format];
+    image.format = format;
+    image.srgb = srgb;
+    image.blockWidth = info.blockWidth;
+    image.blockHeight = info.blockHeight;
+    image.blockBytes = info.blockBytes;
+}
+
+static void setASTC(CompressedImage &image, u32 block, bool srgb)
+{
+    setFormat(image, TEXTURE_FORMAT_ASTC, srgb);
+    image.blockWidth = astcBlocks[block][0];
+    image.blockHeight = astcBlocks[block][1];
+}
+
+const char *GetTextureFormatName(TextureFormat format)
+{
+    return formatInfo[format].name;
+}
+
+TextureFamily GetTextureFamily(TextureFormat format)
+{
+    return formatInfo[format].family;
+}
+
+CompressedImage::CompressedImage()
+{
+    Clear();
+}
+
+void CompressedImage::Clear()
+{
+    setFormat(*this, TEXTURE_FORMAT_UNKNOWN, false);
+    width = 0;
+    height = 0;
+    levels.clear();
+    data.clear();
+}
+
+u32 CompressedImage::GetGLFormat() const
+{
+    const FormatInfo &info = formatInfo[format];
+    u32 gl = srgb ? info.glSRGB : info.gl;
+    if (format == TEXTURE_FORMAT_ASTC)
+    {
+        for (u32 i = 0; i < 14; i++)
+        {
+            if (astcBlocks[i][0] == blockWidth && astcBlocks[i][1] == blockHeight)
+            {
+                return gl + i;
+            }
+        }
+    }
+    return gl;
+}
+
+u32 CompressedImage::GetLevelSize(int width, int height) const
+{
+    const u32 blocksX = (u32)(width + blockWidth - 1) / blockWidth;
+    const u32 blocksY = (u32)(height + blockHeight - 1) / blockHeight;
+    return blocksX * blocksY * (u32)blockBytes;
+}
+
+//*******************************************************
+// KTX
+//*******************************************************
+
+static const u8 KTX1_ID[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+static const u8 KTX2_ID[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+const u32 KTX_MAX_SIZE = 16384;
+
+static u32 readU32(const u8 *p)
+{
+    return (u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static u64 readU64(const u8 *p)
+{
+    return (u64)readU32(p) | ((u64)readU32(p + 4) << 32);
+}
+
+static void writeU32(std::vector<u8> &out, u32 value)
+{
+    out.push_back((u8)value);
+    out.push_back((u8)(value >> 8));
+    out.push_back((u8)(value >> 16));
+    out.push_back((u8)(value >> 24));
+}
+
+static void writeU64(std::vector<u8> &out, u64 value)
+{
+    writeU32(out, (u32)value);
+    writeU32(out, (u32)(value >> 32));
+}
+
+static bool formatFromGL(u32 glType, u32 glFormat, u32 internalFormat, CompressedImage &image)
+{
+    if (glType != 0)
+    {
+        // uncompressed, GL_UNSIGNED_BYTE RGB/RGBA only
+        if (glType != 0x1401) return false;
+        const bool srgb = internalFormat == 0x8C43 || internalFormat == 0x8C41;
+        if (glFormat == 0x1908) setFormat(image, TEXTURE_FORMAT_RGBA8, srgb);
+        else if (glFormat == 0x1907) setFormat(image, TEXTURE_FORMAT_RGB8, srgb);
+        else return false;
+        return true;
+    }
+    if (internalFormat == 0x8D64)       // GL_ETC1_RGB8_OES
+    {
+        setFormat(image, TEXTURE_FORMAT_ETC1, false);
+        return true;
+    }
+    if (internalFormat >= 0x93B0 && internalFormat <= 0x93BD)
+    {
+        setASTC(image, internalFormat - 0x93B0, false);
+        return true;
+    }
+    if (internalFormat >= 0x93D0 && internalFormat <= 0x93DD)
+    {
+        setASTC(image, internalFormat - 0x93D0, true);
+        return true;
+    }
+    for (u32 i = TEXTURE_FORMAT_ETC2_RGB; i < TEXTURE_FORMAT_ASTC; i++)
+    {
+        if (formatInfo[i].gl == internalFormat || formatInfo[i].glSRGB == internalFormat)
+        {
+            setFormat(image, (TextureFormat)i, formatInfo[i].glSRGB == internalFormat && formatInfo[i].gl != internalFormat);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool formatFromVulkan(u32 vkFormat, CompressedImage &image)
+{
+    if (vkFormat >= 157 && vkFormat <= 184)     // VK_FORMAT_ASTC_4x4_UNORM_BLOCK..12x12 SRGB
+    {
+        setASTC(image, (vkFormat - 157) / 2, (vkFormat & 1) == 0);
+        return true;
+    }
+    switch (vkFormat)
+    {
+        case 37:  setFormat(image, TEXTURE_FORMAT_RGBA8, false); break;      // VK_FORMAT_R8G8B8A8_UNORM
+        case 43:  setFormat(image, TEXTURE_FORMAT_RGBA8, true); break;
+        case 23:  setFormat(image, TEXTURE_FORMAT_RGB8, false); break;       // VK_FORMAT_R8G8B8_UNORM
+        case 29:  setFormat(image, TEXTURE_FORMAT_RGB8, true); break;
+        case 131: setFormat(image, TEXTURE_FORMAT_BC1, false); break;        // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        case 132: setFormat(image, TEXTURE_FORMAT_BC1, true); break;
+        case 133: setFormat(image, TEXTURE_FORMAT_BC1_A1, false); break;
+        case 134: setFormat(image, TEXTURE_FORMAT_BC1_A1, true); break;
+        case 137: setFormat(image, TEXTURE_FORMAT_BC3, false); break;
+        case 138: setFormat(image, TEXTURE_FORMAT_BC3, true); break;
+        case 139: setFormat(image, TEXTURE_FORMAT_BC4, false); break;
+        case 141: setFormat(image, TEXTURE_FORMAT_BC5, false); break;
+        case 145: setFormat(image, TEXTURE_FORMAT_BC7, false); break;
+        case 146: setFormat(image, TEXTURE_FORMAT_BC7, true); break;
+        case 147: setFormat(image, TEXTURE_FORMAT_ETC2_RGB, false); break;   // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+        case 148: setFormat(image, TEXTURE_FORMAT_ETC2_RGB, true); break;
+        case 149: setFormat(image, TEXTURE_FORMAT_ETC2_RGB_A1, false); break;
+        case 150: setFormat(image, TEXTURE_FORMAT_ETC2_RGB_A1, true); break;
+        case 151: setFormat(image, TEXTURE_FORMAT_ETC2_RGBA, false); break;
+        case 152: setFormat(image, TEXTURE_FORMAT_ETC2_RGBA, true); break;
+        default: return false;
+    }
+    return true;
+}
+
+static bool checkHeader(u32 width, u32 height, u32 depth, u32 layers, u32 faces, u32 levels)
+{
+    if (width == 0 || height == 0 || width > KTX_MAX_SIZE || height > KTX_MAX_SIZE)
+    {
+        LogError("[KTX] Invalid size %ux%u", width, height);
+        return false;
+    }
+    if (depth > 1 || layers > 1 || faces != 1)
+    {
+        LogError("[KTX] Only 2D textures (depth %u, layers %u, faces %u)", depth, layers, faces);
+        return false;
+    }
+    if (levels > 15)
+    {
+        LogError("[KTX] Invalid mip count %u", levels);
+        return false;
+    }
+    return true;
+}
+
+// appends one level, size bytes of tightly packed blocks/rows
+static void addLevel(CompressedImage &image, int width, int height, const u8 *data, u32 size)
+{
+    CompressedLevel level;
+    level.width = width;
+    level.height = height;
+    level.offset = (u32)image.data.size();
+    level.size = size;
+    image.levels.push_back(level);
+    image.data.insert(image.data.end(), data, data + size);
+}
+
+static bool parseKTX1(const u8 *data, u32 size, CompressedImage &image)
+{
+    if (size < 64)
+    {
+        LogError("[KTX] Truncated header");
+        return false;
+    }
+    const u32 endianness = readU32(data + 12);
+    const bool swap = endianness == 0x01020304;
+    if (!swap && endianness != 0x04030201)
+    {
+        LogError("[KTX] Invalid endianness");
+        return false;
+    }
+    u32 header[13];
+    for (u32 i = 0; i < 13; i++)
+    {
+        const u32 value = readU32(data + 12 + i * 4);
+        header[i] = swap ? ((value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24)) : value;
+    }
+    const u32 glType = header[1];
+    const u32 glFormat = header[3];
+    const u32 internalFormat = header[4];
+    const u32 levels = std::max(header[11], 1u);
+    if (!checkHeader(header[6], header[7], header[8], header[9], header[10], levels)) return false;
+    if (!formatFromGL(glType, glFormat, internalFormat, image))
+    {
+        LogError("[KTX] Unsupported format 0x%04X (type 0x%04X)", internalFormat, glType);
+        return false;
+    }
+    image.width = (int)header[6];
+    image.height = (int)header[7];
+
+    u64 offset = 64 + (u64)header[12];
+    for (u32 l = 0; l < levels; l++)
+    {
+        if (offset + 4 > size) break;
+        u32 imageSize = readU32(data + offset);
+        if (swap) imageSize = (imageSize >> 24) | ((imageSize >> 8) & 0xFF00) | ((imageSize << 8) & 0xFF0000) | (imageSize << 24);
+        offset += 4;
+        if (offset + imageSize > size) break;
+
+        const int w = std::max(image.width >> l, 1);
+        const int h = std::max(image.height >> l, 1);
+        const u32 expected = image.GetLevelSize(w, h);
+        const u32 rowBytes = (u32)w * image.blockBytes;
+        const u32 paddedRow = (rowBytes + 3) & ~3u;
+        if (!image.IsCompressed() && paddedRow != rowBytes && imageSize >= paddedRow * h)
+        {
+            // KTX 1 rows are 4 byte aligned, GL gets them tight
+            CompressedLevel level;
+            level.width = w;
+            level.height = h;
+            level.offset = (u32)image.data.size();
+            level.size = expected;
+            image.levels.push_back(level);
+            for (int y = 0; y < h; y++)
+            {
+                const u8 *row = data + offset + (u64)y * paddedRow;
+                image.data.insert(image.data.end(), row, row + rowBytes);
+            }
+        }
+        else
+        {
+            if (imageSize < expected) break;
+            addLevel(image, w, h, data + offset, expected);
+        }
+        offset += (imageSize + 3) & ~3u;
+    }
+    if (image.levels.size() != levels)
+    {
+        LogError("[KTX] Truncated data, %u of %u levels", (u32)image.levels.size(), levels);
+        return false;
+    }
+    return true;
+}
+
+static bool parseKTX2(const u8 *data, u32 size, CompressedImage &image)
+{
+    if (size < 80)
+    {
+        LogError("[KTX2] Truncated header");
+        return false;
+    }
+    const u32 vkFormat = readU32(data + 12);
+    const u32 width = readU32(data + 20);
+    const u32 height = readU32(data + 24);
+    const u32 levels = std::max(readU32(data + 40), 1u);
+    const u32 supercompression = readU32(data + 44);
+    if (!checkHeader(width, height, readU32(data + 28), readU32(data + 32), readU32(data + 36), levels)) return false;
+    if (supercompression != 0)
+    {
+        LogError("[KTX2] Supercompression %u not supported, save without Basis/zstd", supercompression);
+        return false;
+    }
+    if (!formatFromVulkan(vkFormat, image))
+    {
+        LogError("[KTX2] Unsupported VkFormat %u", vkFormat);
+        return false;
+    }
+    if (80 + (u64)levels * 24 > size)
+    {
+        LogError("[KTX2] Truncated level index");
+        return false;
+    }
+    image.width = (int)width;
+    image.height = (int)height;
+
+    for (u32 l = 0; l < levels; l++)
+    {
+        const u8 *index = data + 80 + l * 24;
+        const u64 offset = readU64(index);
+        const u64 length = readU64(index + 8);
+        const int w = std::max(image.width >> l, 1);
+        const int h = std::max(image.height >> l, 1);
+        const u32 expected = image.GetLevelSize(w, h);
+        if (length < expected || offset + length > size)
+        {
+            LogError("[KTX2] Level %u out of the file", l);
+            return false;
+        }
+        addLevel(image, w, h, data + offset, expected);
+    }
+    return true;
+}
+
+bool ParseKTX(const u8 *data, u32 size, CompressedImage &image)
+{
+    image.Clear();
+    bool result = false;
+    if (data && size >= 12 && memcmp(data, KTX2_ID, 12) == 0)
+    {
+        result = parseKTX2(data, size, image);
+    }
+    else if (data && size >= 12 && memcmp(data, KTX1_ID, 12) == 0)
+    {
+        result = parseKTX1(data, size, image);
+    }
+    else
+    {
+        LogError("[KTX] Not a KTX file");
+    }
+    if (!result)
+    {
+        image.Clear();
+    }
+    return result;
+}
+
+static void writeKTX1(const CompressedImage &image, std::vector<u8> &file)
+{
+    u32 glType = 0;
+    u32 glTypeSize = 1;
+    u32 glFormat = 0;
+    u32 baseFormat = 0x1908;            // GL_RGBA
+    switch (image.format)
+    {
+        case TEXTURE_FORMAT_RGBA8: glType = 0x1401; glFormat = 0x1908; break;
+        case TEXTURE_FORMAT_RGB8: glType = 0x1401; glFormat = baseFormat = 0x1907; break;
+        case TEXTURE_FORMAT_ETC1:
+        case TEXTURE_FORMAT_ETC2_RGB:
+        case TEXTURE_FORMAT_BC1: baseFormat = 0x1907; break;      // GL_RGB
+        case TEXTURE_FORMAT_BC4: baseFormat = 0x1903; break;      // GL_RED
+        case TEXTURE_FORMAT_BC5: baseFormat = 0x8227; break;      // GL_RG
+        default: break;
+    }
+    u32 internalFormat = image.GetGLFormat();
+    if (image.format == TEXTURE_FORMAT_ETC1) internalFormat = 0x8D64;
+
+    file.clear();
+    file.insert(file.end(), KTX1_ID, KTX1_ID + 12);
+    writeU32(file, 0x04030201);
+    writeU32(file, glType);
+    writeU32(file, glTypeSize);
+    writeU32(file, glFormat);
+    writeU32(file, internalFormat);
+    writeU32(file, baseFormat);
+    writeU32(file, (u32)image.width);
+    writeU32(file, (u32)image.height);
+    writeU32(file, 0);                  // depth
+    writeU32(file, 0);                  // array elements
+    writeU32(file, 1);                  // faces
+    writeU32(file, (u32)image.levels.size());
+    writeU32(file, 0);                  // key/value bytes
+
+    for (u32 l = 0; l < image.levels.size(); l++)
+    {
+        const CompressedLevel &level = image.levels[l];
+        const u8 *data = image.GetLevelData(l);
+        const u32 rowBytes = (u32)level.width * image.blockBytes;
+        if (!image.IsCompressed() && (rowBytes & 3) != 0)
+        {
+            const u32 paddedRow = (rowBytes + 3) & ~3u;
+            writeU32(file, paddedRow * level.height);
+            for (int y = 0; y < level.height; y++)
+            {
+                file.insert(file.end(), data + (size_t)y * rowBytes, data + (size_t)(y + 1) * rowBytes);
+                file.resize(file.size() + paddedRow - rowBytes, 0);
+            }
+        }
+        else
+        {
+            writeU32(file, level.size);
+            file.insert(file.end(), data, data + level.size);
+        }
+        file.resize((file.size() + 3) & ~(size_t)3, 0);
+    }
+}
+
+static u32 vulkanFormat(const CompressedImage &image)
+{
+    const u32 srgb = image.srgb ? 1 : 0;
+    switch (image.format)
+    {
+        case TEXTURE_FORMAT_RGBA8: return 37 + srgb * 6;
+        case TEXTURE_FORMAT_RGB8: return 23 + srgb * 6;
+        case TEXTURE_FORMAT_ETC1:
+        case TEXTURE_FORMAT_ETC2_RGB: return 147 + srgb;
+        case TEXTURE_FORMAT_ETC2_RGB_A1: return 149 + srgb;
+        case TEXTURE_FORMAT_ETC2_RGBA: return 151 + srgb;
+        case TEXTURE_FORMAT_BC1: return 131 + srgb;
+        case TEXTURE_FORMAT_BC1_A1: return 133 + srgb;
+        case TEXTURE_FORMAT_BC3: return 137 + srgb;
+        case TEXTURE_FORMAT_BC4: return 139;
+        case TEXTURE_FORMAT_BC5: return 141;
+        case TEXTURE_FORMAT_BC7: return 145 + srgb;
+        case TEXTURE_FORMAT_ASTC:
+            for (u32 i = 0; i < 14; i++)
+            {
+                if (astcBlocks[i][0] == image.blockWidth && astcBlocks[i][1] == image.blockHeight) return 157 + i * 2 + srgb;
+            }
+            return 0;
+        default: return 0;
+    }
+}
+
+// basic data format descriptor: color model, transfer and one sample per
+// channel (per 64 bit half of the block when compressed)
+static void writeDFD(const CompressedImage &image, std::vector<u8> &file)
+{
+    u8 model = 0;
+    u8 channels[4] = {0, 0, 0, 0};
+    u32 count = 1;
+    switch (image.format)
+    {
+        case TEXTURE_FORMAT_RGBA8: model = 1; channels[1] = 1; channels[2] = 2; channels[3] = 15; count = 4; break;
+        case TEXTURE_FORMAT_RGB8: model = 1; channels[1] = 1; channels[2] = 2; count = 3; break;
+        case TEXTURE_FORMAT_ETC1: model = 160; break;
+        case TEXTURE_FORMAT_ETC2_RGB:
+        case TEXTURE_FORMAT_ETC2_RGB_A1: model = 161; channels[0] = 2; break;
+        case TEXTURE_FORMAT_ETC2_RGBA: model = 161; channels[0] = 15; channels[1] = 2; count = 2; break;
+        case TEXTURE_FORMAT_BC1: model = 128; break;
+        case TEXTURE_FORMAT_BC1_A1: model = 128; channels[0] = 1; break;
+        case TEXTURE_FORMAT_BC3: model = 130; channels[0] = 15; count = 2; break;
+        case TEXTURE_FORMAT_BC4: model = 131; break;
+        case TEXTURE_FORMAT_BC5: model = 132; channels[1] = 1; count = 2; break;
+        case TEXTURE_FORMAT_BC7: model = 134; break;
+        case TEXTURE_FORMAT_ASTC: model = 162; break;
+        default: break;
+    }
+    const u32 sampleBits = image.IsCompressed() ? (u32)image.blockBytes * 8 / count : 8;
+
+    writeU32(file, 4 + 24 + 16 * count);    // dfdTotalSize
+    writeU32(file, 0);                      // Khronos basic descriptor
+    writeU32(file, 2 | ((24 + 16 * count) << 16));
+    writeU32(file, model | (1 << 8) | ((image.srgb ? 2u : 1u) << 16));     // BT709 primaries, sRGB or linear
+    file.push_back((u8)(image.blockWidth - 1));
+    file.push_back((u8)(image.blockHeight - 1));
+    file.push_back(0);
+    file.push_back(0);
+    file.push_back((u8)image.blockBytes);   // bytesPlane0..7
+    file.resize(file.size() + 7, 0);
+    for (u32 i = 0; i < count; i++)
+    {
+        const u32 qualifiers = (image.srgb && channels[i] == 15) ? 0x10 : 0;    // alpha stays linear
+        writeU32(file, (i * sampleBits) | ((sampleBits - 1) << 16) | ((channels[i] | qualifiers) << 24));
+        writeU32(file, 0);                  // sample position
+        writeU32(file, 0);                  // lower
+        writeU32(file, image.IsCompressed() ? 0xFFFFFFFF : 255);
+    }
+}
+
+// levels are stored smallest first, each aligned to lcm(block bytes, 4)
+static bool writeKTX2(const CompressedImage &image, std::vector<u8> &file)
+{
+    const u32 vkFormat = vulkanFormat(image);
+    if (vkFormat == 0)
+    {
+        LogError("[KTX2] No VkFormat for %s", GetTextureFormatName(image.format));
+        return false;
+    }
+    const u32 levels = (u32)image.levels.size();
+
+    std::vector<u8> dfd;
+    writeDFD(image, dfd);
+    const u32 dfdOffset = 80 + levels * 24;
+
+    u32 alignment = (u32)image.blockBytes;
+    while (alignment % 4) alignment += image.blockBytes;
+
+    std::vector<u64> offsets(levels);
+    u64 end = dfdOffset + dfd.size();
+    for (u32 l = levels; l-- > 0;)
+    {
+        end = (end + alignment - 1) / alignment * alignment;
+        offsets[l] = end;
+        end += image.levels[l].size;
+    }
+
+    file.clear();
+    file.insert(file.end(), KTX2_ID, KTX2_ID + 12);
+    writeU32(file, vkFormat);
+    writeU32(file, 1);                  // typeSize
+    writeU32(file, (u32)image.width);
+    writeU32(file, (u32)image.height);
+    writeU32(file, 0);                  // depth
+    writeU32(file, 0);                  // layers
+    writeU32(file, 1);                  // faces
+    writeU32(file, levels);
+    writeU32(file, 0);                  // no supercompression
+    writeU32(file, dfdOffset);
+    writeU32(file, (u32)dfd.size());
+    writeU32(file, 0);                  // key/value data
+    writeU32(file, 0);
+    writeU64(file, 0);                  // supercompression global data
+    writeU64(file, 0);
+    for (u32 l = 0; l < levels; l++)
+    {
+        writeU64(file, offsets[l]);
+        writeU64(file, image.levels[l].size);
+        writeU64(file, image.levels[l].size);
+    }
+    file.insert(file.end(), dfd.begin(), dfd.end());
+    for (u32 l = levels; l-- > 0;)
+    {
+        file.resize(offsets[l], 0);
+        const u8 *data = image.GetLevelData(l);
+        file.insert(file.end(), data, data + image.levels[l].size);
+    }
+    return true;
+}
+
+bool WriteKTX(const CompressedImage &image, std::vector<u8> &file, bool ktx2)
+{
+    if (image.format == TEXTURE_FORMAT_UNKNOWN || image.levels.empty())
+    {
+        LogError("[KTX] Nothing to write");
+        return false;
+    }
+    if (ktx2)
+    {
+        return writeKTX2(image, file);
+    }
+    writeKTX1(image, file);
+    return true;
+}
+
+//*******************************************************
+// decoders
+//*******************************************************
+
+static const int etcModifiers[8][4] =
+{
+    {2, 8, -2, -8}, {5, 17, -5, -17}, {9, 29, -9, -29}, {13, 42, -13, -42},
+    {18, 60, -18, -60}, {24, 80, -24, -80}, {33, 106, -33, -106}, {47, 183, -47, -183}
+};
+
+static const int etcDistances[8] = {3, 6, 11, 16, 23, 32, 41, 64};
+
+static const int eacModifiers[16][8] =
+{
+    {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+    {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+    {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+    {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+    {-2, -6, -8, -10, 1, 5, 7, 9}, {-2, -5, -8, -10, 1, 4, 7, 9},
+    {-2, -4, -8, -10, 1, 3, 7, 9}, {-2, -5, -7, -10, 1, 4, 6, 9},
+    {-3, -4, -7, -10, 2, 3, 6, 9}, {-1, -2, -3, -10, 0, 1, 2, 9},
+    {-4, -6, -8, -9, 3, 5, 7, 8}, {-3, -5, -7, -9, 2, 4, 6, 8}
+};
+
+static inline u8 clamp8(int value)
+{
+    return (u8)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline int extend4(int v) { return (v << 4) | v; }
+static inline int extend5(int v) { return (v << 3) | (v >> 2); }
+static inline int extend6(int v) { return (v << 2) | (v >> 4); }
+static inline int extend7(int v) { return (v << 1) | (v >> 6); }
+static inline int signed3(int v) { v &= 7; return v >= 4 ? v - 8 : v; }
+
+static inline void setPixel(u8 *out, int x, int y, int r, int g, int b, int a)
+{
+    u8 *p = out + (y * 4 + x) * 4;
+    p[0] = clamp8(r);
+    p[1] = clamp8(g);
+    p[2] = clamp8(b);
+    p[3] = (u8)a;
+}
+
+// T and H modes: each pixel index picks one of the four paint colors
+static void paintBlock(u8 *out, u32 msb, u32 lsb, const int paint[4][3], bool opaque)
+{
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            const int i = x * 4 + y;
+            const int index = (((msb >> i) & 1) << 1) | ((lsb >> i) & 1);
+            if (!opaque && index == 2) setPixel(out, x, y, 0, 0, 0, 0);
+            else setPixel(out, x, y, paint[index][0], paint[index][1], paint[index][2], 255);
+        }
+    }
+}
+
+// 8 bytes of ETC1/ETC2 RGB to a 4x4 RGBA block (row major). With
+// punchthrough the differential bit means opaque and index 2 is transparent.
+static void decodeETC2Block(const u8 *src, u8 *out, bool punchthrough)
+{
+    const u32 msb = ((u32)src[4] << 8) | src[5];
+    const u32 lsb = ((u32)src[6] << 8) | src[7];
+    const bool diff = (src[3] & 2) != 0;
+    const bool opaque = !punchthrough || diff;
+    int base[2][3];
+
+    if (!diff && !punchthrough)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            base[0][c] = extend4(src[c] >> 4);
+            base[1][c] = extend4(src[c] & 15);
+        }
+    }
+    else
+    {
+        // differential, an overflowing second color selects the ETC2 modes
+        int color[3], delta[3];
+        for (int c = 0; c < 3; c++)
+        {
+            color[c] = src[c] >> 3;
+            delta[c] = signed3(src[c]);
+        }
+        int paint[4][3];
+        if (color[0] + delta[0] < 0 || color[0] + delta[0] > 31)
+        {
+            // T mode
+            const int c1[3] = {extend4(((src[0] >> 1) & 0xC) | (src[0] & 3)), extend4(src[1] >> 4), extend4(src[1] & 15)};
+            const int c2[3] = {extend4(src[2] >> 4), extend4(src[2] & 15), extend4(src[3] >> 4)};
+            const int d = etcDistances[(((src[3] >> 2) & 3) << 1) | (src[3] & 1)];
+            for (int c = 0; c < 3; c++)
+            {
+                paint[0][c] = c1[c];
+                paint[1][c] = c2[c] + d;
+                paint[2][c] = c2[c];
+                paint[3][c] = c2[c] - d;
+            }
+            paintBlock(out, msb, lsb, paint, opaque);
+            return;
+        }
+        if (color[1] + delta[1] < 0 || color[1] + delta[1] > 31)
+        {
+            // H mode
+            const int c1[3] = {extend4((src[0] >> 3) & 15), extend4(((src[0] << 1) & 0xE) | ((src[1] >> 4) & 1)),
+                               extend4((src[1] & 8) | ((src[1] << 1) & 6) | (src[2] >> 7))};
+            const int c2[3] = {extend4((src[2] >> 3) & 15), extend4(((src[2] << 1) & 0xE) | (src[3] >> 7)), extend4((src[3] >> 3) & 15)};
+            int index = (src[3] & 4) | ((src[3] << 1) & 2);
+            if (((c1[0] << 16) | (c1[1] << 8) | c1[2]) >= ((c2[0] << 16) | (c2[1] << 8) | c2[2])) index |= 1;
+            const int d = etcDistances[index];
+            for (int c = 0; c < 3; c++)
+            {
+                paint[0][c] = c1[c] + d;
+                paint[1][c] = c1[c] - d;
+                paint[2][c] = c2[c] + d;
+                paint[3][c] = c2[c] - d;
+            }
+            paintBlock(out, msb, lsb, paint, opaque);
+            return;
+        }
+        if (color[2] + delta[2] < 0 || color[2] + delta[2] > 31)
+        {
+            // planar: origin, horizontal and vertical colors, always opaque
+            const int o[3] = {extend6((src[0] >> 1) & 0x3F), extend7(((src[0] & 1) << 6) | ((src[1] >> 1) & 0x3F)),
+                              extend6(((src[1] & 1) << 5) | (src[2] & 0x18) | ((src[2] << 1) & 6) | (src[3] >> 7))};
+            const int h[3] = {extend6(((src[3] >> 1) & 0x3E) | (src[3] & 1)), extend7(src[4] >> 1),
+                              extend6(((src[4] & 1) << 5) | (src[5] >> 3))};
+            const int v[3] = {extend6(((src[5] & 7) << 3) | (src[6] >> 5)), extend7(((src[6] & 0x1F) << 2) | (src[7] >> 6)),
+                              extend6(src[7] & 0x3F)};
+            for (int y = 0; y < 4; y++)
+            {
+                for (int x = 0; x < 4; x++)
+                {
+                    int rgb[3];
+                    for (int c = 0; c < 3; c++)
+                    {
+                        rgb[c] = (x * (h[c] - o[c]) + y * (v[c] - o[c]) + 4 * o[c] + 2) >> 2;
+                    }
+                    setPixel(out, x, y, rgb[0], rgb[1], rgb[2], 255);
+                }
+            }
+            return;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            base[0][c] = extend5(color[c]);
+            base[1][c] = extend5(color[c] + delta[c]);
+        }
+    }
+
+    const bool flip = (src[3] & 1) != 0;
+    const int tables[2] = {src[3] >> 5, (src[3] >> 2) & 7};
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            const int i = x * 4 + y;
+            const int index = (((msb >> i) & 1) << 1) | ((lsb >> i) & 1);
+            const int sub = flip ? (y >= 2) : (x >= 2);
+            if (!opaque && index == 2)
+            {
+                setPixel(out, x, y, 0, 0, 0, 0);
+                continue;
+            }
+            const int modifier = (!opaque && index == 0) ? 0 : etcModifiers[tables[sub]][index];
+            setPixel(out, x, y, base[sub][0] + modifier, base[sub][1] + modifier, base[sub][2] + modifier, 255);
+        }
+    }
+}
+
+// EAC 8 bit alpha into channel 3 of a 4x4 RGBA block
+static void decodeEACBlock(const u8 *src, u8 *out)
+{
+    const int base = src[0];
+    const int multiplier = src[1] >> 4;
+    const int *table = eacModifiers[src[1] & 15];
+    u64 bits = 0;
+    for (int i = 2; i < 8; i++) bits = (bits << 8) | src[i];
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            const int index = (int)(bits >> (45 - 3 * (x * 4 + y))) & 7;
+            out[(y * 4 + x) * 4 + 3] = clamp8(base + table[index] * multiplier);
+        }
+    }
+}
+
+static void decodeBC1Block(const u8 *src, u8 *out, bool fourColors, bool alpha)
+{
+    const u32 c0 = src[0] | (src[1] << 8);
+    const u32 c1 = src[2] | (src[3] << 8);
+    int palette[4][4];
+    const u32 colors[2] = {c0, c1};
+    for (int i = 0; i < 2; i++)
+    {
+        palette[i][0] = extend5((colors[i] >> 11) & 31);
+        palette[i][1] = extend6((colors[i] >> 5) & 63);
+        palette[i][2] = extend5(colors[i] & 31);
+        palette[i][3] = 255;
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        if (fourColors || c0 > c1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = (!fourColors && c0 <= c1 && alpha) ? 0 : 255;
+
+    const u32 indices = readU32(src + 4);
+    for (int i = 0; i < 16; i++)
+    {
+        const int *color = palette[(indices >> (2 * i)) & 3];
+        u8 *p = out + i * 4;
+        p[0] = (u8)color[0];
+        p[1] = (u8)color[1];
+        p[2] = (u8)color[2];
+        if (alpha) p[3] = (u8)color[3];
+    }
+}
+
+// BC4 block (also the BC3 alpha and the BC5 channels) into one channel
+static void decodeBC4Block(const u8 *src, u8 *out, int channel)
+{
+    int values[8];
+    values[0] = src[0];
+    values[1] = src[1];
+    if (values[0] > values[1])
+    {
+        for (int i = 2; i < 8; i++) values[i] = ((8 - i) * values[0] + (i - 1) * values[1]) / 7;
+    }
+    else
+    {
+        for (int i = 2; i < 6; i++) values[i] = ((6 - i) * values[0] + (i - 1) * values[1]) / 5;
+        values[6] = 0;
+        values[7] = 255;
+    }
+    u64 bits = 0;
+    for (int i = 7; i >= 2; i--) bits = (bits << 8) | src[i];
+    for (int i = 0; i < 16; i++)
+    {
+        out[i * 4 + channel] = (u8)values[(bits >> (3 * i)) & 7];
+    }
+}
+
+bool CanDecodeTexture(TextureFormat format)
+{
+    return format != TEXTURE_FORMAT_UNKNOWN && format != TEXTURE_FORMAT_BC7 && format != TEXTURE_FORMAT_ASTC;
+}
+
+bool DecodeTextureLevel(const CompressedImage &image, u32 level, std::vector<u8> &rgba)
+{
+    if (!CanDecodeTexture(image.format) || level >= image.levels.size())
+    {
+        return false;
+    }
+    const CompressedLevel &info = image.levels[level];
+    const u8 *src = image.GetLevelData(level);
+    const int width = info.width;
+    const int height = info.height;
+    rgba.resize((size_t)width * height * 4);
+
+    if (!image.IsCompressed())
+    {
+        const int components = image.blockBytes;
+        for (size_t i = 0; i < (size_t)width * height; i++)
+        {
+            rgba[i * 4 + 0] = src[i * components + 0];
+            rgba[i * 4 + 1] = src[i * components + 1];
+            rgba[i * 4 + 2] = src[i * components + 2];
+            rgba[i * 4 + 3] = components == 4 ? src[i * components + 3] : 255;
+        }
+        return true;
+    }
+
+    u8 block[16 * 4];
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    for (int by = 0; by < blocksY; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            memset(block, 0, sizeof(block));
+            for (int i = 0; i < 16; i++) block[i * 4 + 3] = 255;
+            switch (image.format)
+            {
+                case TEXTURE_FORMAT_ETC1:
+                case TEXTURE_FORMAT_ETC2_RGB: decodeETC2Block(src, block, false); break;
+                case TEXTURE_FORMAT_ETC2_RGB_A1: decodeETC2Block(src, block, true); break;
+                case TEXTURE_FORMAT_ETC2_RGBA: decodeETC2Block(src + 8, block, false); decodeEACBlock(src, block); break;
+                case TEXTURE_FORMAT_BC1: decodeBC1Block(src, block, false, false); break;
+                case TEXTURE_FORMAT_BC1_A1: decodeBC1Block(src, block, false, true); break;
+                case TEXTURE_FORMAT_BC3: decodeBC1Block(src + 8, block, true, false); decodeBC4Block(src, block, 3); break;
+                case TEXTURE_FORMAT_BC4: decodeBC4Block(src, block, 0); break;
+                case TEXTURE_FORMAT_BC5: decodeBC4Block(src, block, 0); decodeBC4Block(src + 8, block, 1); break;
+                default: break;
+            }
+            src += image.blockBytes;
+
+            const int w = std::min(4, width - bx * 4);
+            const int h = std::min(4, height - by * 4);
+            for (int y = 0; y < h; y++)
+            {
+                memcpy(&rgba[(((size_t)by * 4 + y) * width + bx * 4) * 4], block + y * 16, (size_t)w * 4);
+            }
+        }
+    }
+    return true;
+}
+
+//*******************************************************
+// ETC2 encoder
+//*******************************************************
+
+// best modifier of each pixel for one table, the squared error of the subblock
+static u32 fitTable(const u8 *block, const u8 *pixels, const int *base, int table, u8 *indices)
+{
+    u32 total = 0;
+    for (int p = 0; p < 8; p++)
+    {
+        const u8 *color = block + pixels[p] * 4;
+        u32 best = 0xFFFFFFFF;
+        for (int index = 0; index < 4; index++)
+        {
+            const int modifier = etcModifiers[table][index];
+            const int dr = clamp8(base[0] + modifier) - color[0];
+            const int dg = clamp8(base[1] + modifier) - color[1];
+            const int db = clamp8(base[2] + modifier) - color[2];
+            const u32 error = (u32)(dr * dr + dg * dg + db * db);
+            if (error < best)
+            {
+                best = error;
+                indices[p] = (u8)index;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+static u32 fitSubblock(const u8 *block, const u8 *pixels, const int *base, int &table, u8 *indices)
+{
+    u32 best = 0xFFFFFFFF;
+    u8 candidate[8];
+    for (int t = 0; t < 8; t++)
+    {
+        const u32 error = fitTable(block, pixels, base, t, candidate);
+        if (error < best)
+        {
+            best = error;
+            table = t;
+            memcpy(indices, candidate, 8);
+        }
+    }
+    return best;
+}
+
+// individual or differential mode, both flips; the block is 4x4 RGBA row major
+static void encodeETC1Block(const u8 *block, u8 *out)
+{
+    u32 bestError = 0xFFFFFFFF;
+    for (int flip = 0; flip < 2; flip++)
+    {
+        u8 pixels[2][8];
+        int count[2] = {0, 0};
+        float average[2][3] = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+        for (int y = 0; y < 4; y++)
+        {
+            for (int x = 0; x < 4; x++)
+            {
+                const int sub = flip ? (y >= 2) : (x >= 2);
+                pixels[sub][count[sub]++] = (u8)(y * 4 + x);
+                for (int c = 0; c < 3; c++) average[sub][c] += block[(y * 4 + x) * 4 + c] / 8.0f;
+            }
+        }
+
+        for (int diff = 1; diff >= 0; diff--)
+        {
+            int quantized[2][3];
+            int base[2][3];
+            bool valid = true;
+            for (int s = 0; s < 2; s++)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    quantized[s][c] = (int)(average[s][c] * (diff ? 31.0f : 15.0f) / 255.0f + 0.5f);
+                    base[s][c] = diff ? extend5(quantized[s][c]) : extend4(quantized[s][c]);
+                }
+            }
+            if (diff)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    const int delta = quantized[1][c] - quantized[0][c];
+                    if (delta < -4 || delta > 3) valid = false;
+                }
+            }
+            if (!valid) continue;
+
+            int tables[2] = {0, 0};
+            u8 indices[2][8];
+            const u32 error = fitSubblock(block, pixels[0], base[0], tables[0], indices[0])
+                            + fitSubblock(block, pixels[1], base[1], tables[1], indices[1]);
+            if (error >= bestError) continue;
+            bestError = error;
+
+            for (int c = 0; c < 3; c++)
+            {
+                out[c] = diff ? (u8)((quantized[0][c] << 3) | ((quantized[1][c] - quantized[0][c]) & 7))
+                              : (u8)((quantized[0][c] << 4) | quantized[1][c]);
+            }
+            out[3] = (u8)((tables[0] << 5) | (tables[1] << 2) | (diff << 1) | flip);
+            u32 msb = 0, lsb = 0;
+            for (int s = 0; s < 2; s++)
+            {
+                for (int p = 0; p < 8; p++)
+                {
+                    const int i = (pixels[s][p] & 3) * 4 + (pixels[s][p] >> 2);    // column major
+                    msb |= (u32)(indices[s][p] >> 1) << i;
+                    lsb |= (u32)(indices[s][p] & 1) << i;
+                }
+            }
+            out[4] = (u8)(msb >> 8);
+            out[5] = (u8)msb;
+            out[6] = (u8)(lsb >> 8);
+            out[7] = (u8)lsb;
+        }
+    }
+}
+
+static void encodeEACBlock(const u8 *block, u8 *out)
+{
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        low = std::min(low, (int)block[i * 4 + 3]);
+        high = std::max(high, (int)block[i * 4 + 3]);
+    }
+
+    u32 bestError = 0xFFFFFFFF;
+    for (int t = 0; t < 16; t++)
+    {
+        const int *table = eacModifiers[t];
+        const int span = table[7] - table[3];
+        const int center = (int)((high - low) / (float)span + 0.5f);
+        for (int m = std::max(center - 1, 1); m <= std::min(center + 1, 15); m++)
+        {
+            const int base = clamp8((int)((low + high) * 0.5f - (table[3] + table[7]) * m * 0.5f + 0.5f));
+            u32 error = 0;
+            u64 bits = 0;
+            for (int x = 0; x < 4; x++)
+            {
+                for (int y = 0; y < 4; y++)
+                {
+                    const int alpha = block[(y * 4 + x) * 4 + 3];
+                    int best = 0x7FFFFFFF, bestIndex = 0;
+                    for (int index = 0; index < 8; index++)
+                    {
+                        const int d = clamp8(base + table[index] * m) - alpha;
+                        if (d * d < best)
+                        {
+                            best = d * d;
+                            bestIndex = index;
+                        }
+                    }
+                    error += (u32)best;
+                    bits = (bits << 3) | (u64)bestIndex;
+                }
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                out[0] = (u8)base;
+                out[1] = (u8)((m << 4) | t);
+                for (int i = 0; i < 6; i++) out[2 + i] = (u8)(bits >> (40 - 8 * i));
+            }
+        }
+    }
+}
+
+void EncodeETC2(const u8 *pixels, int width, int height, int components, bool alpha, std::vector<u8> &blocks)
+{
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    const int blockBytes = alpha ? 16 : 8;
+    blocks.resize((size_t)blocksX * blocksY * blockBytes);
+
+    u8 block[16 * 4];
+    u8 *out = blocks.data();
+    for (int by = 0; by < blocksY; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            // edge blocks repeat the last row/column
+            for (int y = 0; y < 4; y++)
+            {
+                for (int x = 0; x < 4; x++)
+                {
+                    const int sx = std::min(bx * 4 + x, width - 1);
+                    const int sy = std::min(by * 4 + y, height - 1);
+                    const u8 *p = pixels + ((size_t)sy * width + sx) * components;
+                    u8 *q = block + (y * 4 + x) * 4;
+                    if (components < 3)
+                    {
+                        q[0] = q[1] = q[2] = p[0];
+                        q[3] = components == 2 ? p[1] : 255;
+                    }
+                    else
+                    {
+                        q[0] = p[0];
+                        q[1] = p[1];
+                        q[2] = p[2];
+                        q[3] = components == 4 ? p[3] : 255;
+                    }
+                }
+            }
+            if (alpha)
+            {
+                encodeEACBlock(block, out);
+                encodeETC1Block(block, out + 8);
+            }
+            else
+            {
+                encodeETC1Block(block, out);
+            }
+            out += blockBytes;
+        }
+    }
+}
+
+bool EncodeETC2(const Pixmap &pixmap, bool mipmaps, CompressedImage &image)
+{
+    image.Clear();
+    if (!pixmap.pixels || pixmap.width <= 0 || pixmap.height <= 0 || pixmap.components < 1 || pixmap.components > 4)
+    {
+        LogError("[ETC2] Invalid pixmap");
+        return false;
+    }
+    const int components = pixmap.components;
+    int width = pixmap.width;
+    int height = pixmap.height;
+    bool alpha = false;
+    if (components == 2 || components == 4)
+    {
+        const size_t count = (size_t)width * height;
+        for (size_t i = 0; i < count && !alpha; i++)
+        {
+            alpha = pixmap.pixels[i * components + components - 1] != 255;
+        }
+    }
+    setFormat(image, alpha ? TEXTURE_FORMAT_ETC2_RGBA : TEXTURE_FORMAT_ETC2_RGB, false);
+    image.width = width;
+    image.height = height;
+
+    std::vector<u8> level(pixmap.pixels, pixmap.pixels + (size_t)width * height * components);
+    std::vector<u8> next;
+    std::vector<u8> blocks;
+    for (;;)
+    {
+        EncodeETC2(level.data(), width, height, components, alpha, blocks);
+        addLevel(image, width, height, blocks.data(), (u32)blocks.size());
+        if (!mipmaps || (width == 1 && height == 1)) break;
+        DownsampleImage(level.data(), width, height, components, next);
+        level.swap(next);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    return true;
+}
+
+void DownsampleImage(const u8 *src, int width, int height, int components, std::vector<u8> &dst)
+{
+    const int w = std::max(width / 2, 1);
+    const int h = std::max(height / 2, 1);
+    dst.resize((size_t)w * h * components);
+    for (int y = 0; y < h; y++)
+    {
+        const int y0 = std::min(y * 2, height - 1);
+        const int y1 = std::min(y * 2 + 1, height - 1);
+        for (int x = 0; x < w; x++)
+        {
+            const int x0 = std::min(x * 2, width - 1);
+            const int x1 = std::min(x * 2 + 1, width - 1);
+            for (int c = 0; c < components; c++)
+            {
+                const int sum = src[((size_t)y0 * width + x0) * components + c] + src[((size_t)y0 * width + x1) * components + c]
+                              + src[((size_t)y1 * width + x0) * components + c] + src[((size_t)y1 * width + x1) * components + c];
+                dst[((size_t)y * w + x) * components + c] = (u8)((sum + 2) / 4);
+            }
+        }
+    }
+}
@@ -1,6 +1,8 @@
 
 #include "pch.h"
 #include "Utils.hpp"
+#include <atomic>
+#include <memory>
 
 #if defined(PLATFORM_DESKTOP) && defined(_WIN32) && (defined(_MSC_VER) || defined(__TINYC__))
 
@@ -656,3 +658,159 @@ bool System::ScanDirectoryFiles(const char *basePath,   std::vector<std::string>
  
  
 
+
+
+//************************************************************************************************
+// ThreadPool
+//************************************************************************************************
+
+ThreadPool &ThreadPool::Instance()
+{
+    static ThreadPool instance;
+    return instance;
+}
+
+ThreadPool *ThreadPool::InstancePtr()
+{
+    return &Instance();
+}
+
+ThreadPool::ThreadPool()
+{
+    m_running = 0;
+    m_quit = false;
+}
+
+ThreadPool::~ThreadPool()
+{
+    Shutdown();
+}
+
+void ThreadPool::Init(u32 threadCount)
+{
+    if (!m_threads.empty()) return;
+
+    if (threadCount == 0)
+    {
+        u32 cores = (u32)std::thread::hardware_concurrency();
+        threadCount = cores > 1 ? cores - 1 : 1;
+    }
+    m_quit = false;
+    for (u32 i = 0; i < threadCount; ++i)
+    {
+        m_threads.emplace_back(&ThreadPool::workerLoop, this);
+    }
+    LogInfo("[THREADPOOL] %u workers", threadCount);
+}
+
+void ThreadPool::Shutdown()
+{
+    if (m_threads.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto &t : m_threads)
+    {
+        t.join();
+    }
+    m_threads.clear();
+    m_jobs.clear();
+}
+
+void ThreadPool::workerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_quit || !m_jobs.empty(); });
+            if (m_quit && m_jobs.empty()) return;
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            m_running++;
+        }
+        job();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running--;
+            if (m_running == 0 && m_jobs.empty()) m_idle.notify_all();
+        }
+    }
+}
+
+void ThreadPool::Submit(const std::function<void()> &job)
+{
+    if (m_threads.empty()) Init();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+    m_wake.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_jobs.empty() && m_running == 0; });
+}
+
+void ThreadPool::ParallelFor(u32 count, u32 minBatch, const std::function<void(u32, u32)> &fn)
+{
+    if (count == 0) return;
+    if (minBatch == 0) minBatch = 1;
+    if (m_threads.empty()) Init();
+
+    const u32 workers = (u32)m_threads.size() + 1;
+    u32 batch = (count + workers * 4 - 1) / (workers * 4);
+    if (batch < minBatch) batch = minBatch;
+    const u32 chunks = (count + batch - 1) / batch;
+
+    if (chunks <= 1)
+    {
+        fn(0, count);
+        return;
+    }
+
+    // shared with the helpers: a helper may only start after we returned
+    struct Range
+    {
+        std::atomic<u32> next;
+        std::atomic<u32> done;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    std::shared_ptr<Range> range = std::make_shared<Range>();
+    range->next = 0;
+    range->done = 0;
+
+    const std::function<void(u32, u32)> *work = &fn;
+    auto run = [range, work, batch, count, chunks]()
+    {
+        for (;;)
+        {
+            u32 chunk = range->next.fetch_add(1);
+            if (chunk >= chunks) return;
+            u32 begin = chunk * batch;
+            u32 end = begin + batch < count ? begin + batch : count;
+            (*work)(begin, end);
+            if (range->done.fetch_add(1) + 1 == chunks)
+            {
+                std::lock_guard<std::mutex> lock(range->mutex);
+                range->finished.notify_all();
+            }
+        }
+    };
+
+    u32 helpers = chunks - 1 < (u32)m_threads.size() ? chunks - 1 : (u32)m_threads.size();
+    for (u32 i = 0; i < helpers; ++i)
+    {
+        Submit(run);
+    }
+    run();
+
+    std::unique_lock<std::mutex> lock(range->mutex);
+    range->finished.wait(lock, [&range, chunks] { return range->done.load() == chunks; });
+}
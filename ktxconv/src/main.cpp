@@ -0,0 +1,47 @@
+#include "Utils.hpp"
+#include "Texture.hpp"
+#include "TextureCodec.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+// ktxconv input.png output.ktx|output.ktx2 [-nomips]
+// Offline ETC2 (RGB, or RGBA EAC when the image has alpha) with the mip chain
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        printf("usage: ktxconv input.png output.ktx|output.ktx2 [-nomips]\n");
+        return 1;
+    }
+    bool mipmaps = true;
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-nomips") == 0) mipmaps = false;
+    }
+
+    Pixmap pixmap;
+    if (!pixmap.Load(argv[1]))
+    {
+        LogError("ktxconv: Failed to load %s", argv[1]);
+        return 1;
+    }
+
+    CompressedImage image;
+    if (!EncodeETC2(pixmap, mipmaps, image))
+    {
+        return 1;
+    }
+    const bool ktx2 = System::Instance().IsFileExtension(argv[2], ".ktx2");
+    std::vector<u8> file;
+    if (!WriteKTX(image, file, ktx2) || !System::Instance().SaveFileData(argv[2], file.data(), (unsigned int)file.size()))
+    {
+        LogError("ktxconv: Failed to write %s", argv[2]);
+        return 1;
+    }
+
+    LogInfo("ktxconv: %s %dx%d %s, %u levels, %u KB (RGBA8 %u KB)", argv[2], image.width, image.height,
+            GetTextureFormatName(image.format), (u32)image.levels.size(), (u32)file.size() / 1024,
+            (u32)(image.width * image.height * 4) / 1024);
+    return 0;
+}
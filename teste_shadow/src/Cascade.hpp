@@ -6,6 +6,8 @@ struct Cascade
 {
     float splitDepth;
     Mat4 viewProjMatrix;
+    Mat4 viewMatrix;        // light view/ortho, for Scene::RenderDepth
+    Mat4 projMatrix;
 
 };
 const int SHADOW_MAP_CASCADE_COUNT = 4;
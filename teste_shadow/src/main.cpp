@@ -100,6 +100,8 @@ void updateCascades_(float nearClip, float farClip, const Vec3& lightDirInput, c
        // LogInfo("Cascade %d splitDist: %f, splitDepth: %f, minX: %f, maxX: %f, minY: %f, maxY: %f, minZ: %f, maxZ: %f",
       //          i, splitDist, cascades[i].splitDepth, minX, maxX, minY, maxY, minZ, maxZ);
         cascades[i].viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
+        cascades[i].viewMatrix = lightViewMatrix;
+        cascades[i].projMatrix = lightOrthoMatrix;
 
         lastSplitDist = cascadeSplits[i];
     }
@@ -211,6 +213,8 @@ void updateCascades(float nearClip, float farClip, const Vec3 & lightPos, const
             cascades[i].splitDepth = (nearClip + splitDist * clipRange) ;
           //  LogInfo("Cascade %d splitDepth: %f   orginZ: %f", i, cascades[i].splitDepth,   orgin_z);
 			cascades[i].viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
+			cascades[i].viewMatrix = lightViewMatrix;
+			cascades[i].projMatrix = lightOrthoMatrix;
 
 			lastSplitDist = cascadeSplits[i];
 		}
@@ -850,7 +854,7 @@ int main()
         {
             shadowManager.BeginShadowPass(i);
             depthShader->SetMatrix4("lightSpaceMatrix", cascades[i].viewProjMatrix.x);
-            scene.RenderDepth(depthShader);
+            scene.RenderDepth(depthShader, cascades[i].viewMatrix, cascades[i].projMatrix, (float)SHADOW_HEIGHT);
             shadowManager.EndShadowPass();
         }
         glViewport(0,0,device.GetWidth(),device.GetHeight());
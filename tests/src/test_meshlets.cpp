@@ -0,0 +1,130 @@
+#include "Meshlet.hpp"
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK_EQ(a, b) \
+    do { \
+        const long long va = (long long)(a), vb = (long long)(b); \
+        if (va != vb) { printf("%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #a, va, vb); failures++; } \
+    } while (0)
+
+// n x n quads on z = const, facing +z (or -z when flipped)
+static u32 addPatch(std::vector<Vec3> &positions, std::vector<unsigned int> &indices, const Vec3 &origin, float size, u32 n, bool flip)
+{
+    const u32 base = (u32)positions.size();
+    for (u32 y = 0; y <= n; ++y)
+    {
+        for (u32 x = 0; x <= n; ++x)
+        {
+            positions.push_back(origin + Vec3(size * x / n, size * y / n, 0.0f));
+        }
+    }
+    for (u32 y = 0; y < n; ++y)
+    {
+        for (u32 x = 0; x < n; ++x)
+        {
+            const u32 a = base + y * (n + 1) + x;
+            const u32 b = a + 1;
+            const u32 c = a + n + 1;
+            const u32 d = c + 1;
+            if (flip)
+            {
+                indices.insert(indices.end(), {a, c, b, b, c, d});
+            } else
+            {
+                indices.insert(indices.end(), {a, b, c, b, d, c});
+            }
+        }
+    }
+    return n * n * 2;
+}
+
+int main()
+{
+    std::vector<Vec3> positions;
+    std::vector<unsigned int> indices;
+    std::vector<SubMesh> subMeshes;
+
+    // camera at z = 5 looking down -z: one patch in view facing it, one in
+    // view facing away, one behind the camera
+    const u32 visible = addPatch(positions, indices, Vec3(-1.5f, -0.5f, 0.0f), 1.0f, 4, false);
+    const u32 backfacing = addPatch(positions, indices, Vec3(0.5f, -0.5f, 0.0f), 1.0f, 4, true);
+    const u32 behind = addPatch(positions, indices, Vec3(-0.5f, -0.5f, 10.0f), 1.0f, 6, false);
+    const u32 triangles = visible + backfacing + behind;
+
+    MeshletSet meshlets;
+    const u32 count = meshlets.Build(positions, indices, subMeshes, 64, 8);
+    CHECK_EQ(count, 4 + 4 + 9);
+    CHECK_EQ(indices.size(), triangles * 3);
+    CHECK_EQ(meshlets.GetIndexCount(), triangles * 3);
+
+    const Mat4 view = Mat4::LookAt(Vec3(0.0f, 0.0f, 5.0f), Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, 1.0f, 0.0f));
+    const Mat4 proj = Mat4::Perspective(45.0, 1.0, 0.1, 100.0);
+
+    MeshletStats stats;
+    CHECK_EQ(meshlets.Cull(view, proj, true, &stats), 4);
+    CHECK_EQ(stats.meshlets, count);
+    CHECK_EQ(stats.triangles, triangles);
+    CHECK_EQ(stats.frustumTriangles, behind);
+    CHECK_EQ(stats.coneTriangles, backfacing);
+    CHECK_EQ(stats.frustumCulled, 9);
+    CHECK_EQ(stats.coneCulled, 4);
+
+    // the visible clusters are contiguous: one draw
+    CHECK_EQ(stats.draws, 1);
+    CHECK_EQ(meshlets.GetDraws().size(), 2);
+    CHECK_EQ(meshlets.GetDraws()[1], visible * 3);
+
+    // without the cone test only the frustum rejects
+    stats.Reset();
+    CHECK_EQ(meshlets.Cull(view, proj, false, &stats), 8);
+    CHECK_EQ(stats.frustumTriangles, behind);
+    CHECK_EQ(stats.coneTriangles, 0);
+
+    // turned around the camera sees only the patch behind it
+    stats.Reset();
+    const Mat4 back = Mat4::LookAt(Vec3(0.0f, 0.0f, 5.0f), Vec3(0.0f, 0.0f, 10.0f), Vec3(0.0f, 1.0f, 0.0f));
+    meshlets.Cull(back, proj, true, &stats);
+    CHECK_EQ(stats.frustumTriangles, visible + backfacing);
+    CHECK_EQ(stats.coneTriangles, behind);
+
+    // a submesh over the first patch only: the other triangles are still
+    // clustered, after the range, and go through the same culling
+    positions.clear();
+    indices.clear();
+    addPatch(positions, indices, Vec3(-1.5f, -0.5f, 0.0f), 1.0f, 4, false);
+    addPatch(positions, indices, Vec3(0.5f, -0.5f, 0.0f), 1.0f, 4, true);
+    addPatch(positions, indices, Vec3(-0.5f, -0.5f, 10.0f), 1.0f, 6, false);
+    SubMesh partial = {0, visible * 3, 0};
+    subMeshes.push_back(partial);
+
+    MeshletSet grouped;
+    CHECK_EQ(grouped.Build(positions, indices, subMeshes, 64, 8), 4 + 4 + 9);
+    CHECK_EQ(indices.size(), triangles * 3);
+    CHECK_EQ(subMeshes[0].indexStart, 0);
+    CHECK_EQ(subMeshes[0].indexCount, visible * 3);
+
+    stats.Reset();
+    CHECK_EQ(grouped.Cull(view, proj, true, &stats), 4);
+    CHECK_EQ(stats.frustumTriangles, behind);
+    CHECK_EQ(stats.coneTriangles, backfacing);
+
+    stats.Reset();
+    CHECK_EQ(grouped.Cull(view, proj, false, &stats), 8);
+    u32 drawn = 0;
+    for (u32 i = 0; i < grouped.GetDraws().size(); i += 2)
+    {
+        drawn += grouped.GetDraws()[i + 1];
+    }
+    CHECK_EQ(drawn, (visible + backfacing) * 3);
+
+    if (failures)
+    {
+        printf("test_meshlets: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_meshlets: ok\n");
+    return 0;
+}
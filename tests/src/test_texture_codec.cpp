@@ -0,0 +1,268 @@
+#include "TextureCodec.hpp"
+#include "Texture.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+    } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        const long long va = (long long)(a), vb = (long long)(b); \
+        if (va != vb) { printf("%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #a, va, vb); failures++; } \
+    } while (0)
+
+static bool sameImage(const CompressedImage &a, const CompressedImage &b)
+{
+    if (a.format != b.format || a.srgb != b.srgb || a.width != b.width || a.height != b.height) return false;
+    if (a.levels.size() != b.levels.size()) return false;
+    for (u32 l = 0; l < a.levels.size(); l++)
+    {
+        if (a.levels[l].width != b.levels[l].width || a.levels[l].height != b.levels[l].height) return false;
+        if (a.levels[l].size != b.levels[l].size) return false;
+        if (memcmp(a.GetLevelData(l), b.GetLevelData(l), a.levels[l].size) != 0) return false;
+    }
+    return true;
+}
+
+// smooth color and alpha ramps, what ETC2 is meant for
+static void fillGradient(Pixmap &pixmap)
+{
+    for (int y = 0; y < pixmap.height; y++)
+    {
+        for (int x = 0; x < pixmap.width; x++)
+        {
+            const u8 r = (u8)(x * 255 / (pixmap.width - 1));
+            const u8 g = (u8)(y * 255 / (pixmap.height - 1));
+            const u8 b = (u8)(128 + 100 * sinf(x * 0.1f) * cosf(y * 0.1f));
+            const u8 a = (u8)(255 - (x + y) * 255 / (pixmap.width + pixmap.height - 2));
+            pixmap.SetPixel(x, y, r, g, b, a);
+        }
+    }
+}
+
+static double psnr(const u8 *a, const u8 *b, size_t pixels, int channel)
+{
+    double error = 0.0;
+    for (size_t i = 0; i < pixels; i++)
+    {
+        const double d = (double)a[i * 4 + channel] - (double)b[i * 4 + channel];
+        error += d * d;
+    }
+    error /= (double)pixels;
+    return error > 0.0 ? 10.0 * log10(255.0 * 255.0 / error) : 99.0;
+}
+
+static void testKTXRoundTrip(const CompressedImage &image)
+{
+    for (int ktx2 = 0; ktx2 < 2; ktx2++)
+    {
+        std::vector<u8> file;
+        CHECK(WriteKTX(image, file, ktx2 != 0));
+        CompressedImage parsed;
+        CHECK(ParseKTX(file.data(), (u32)file.size(), parsed));
+        CHECK(sameImage(image, parsed));
+
+        // every cut inside the header, the level index or the data is rejected
+        const u32 cuts[] = {0, 11, 12, 40, 63, 79, 100, (u32)file.size() / 2, (u32)file.size() - 1};
+        for (u32 size : cuts)
+        {
+            if (size >= file.size()) continue;
+            CompressedImage truncated;
+            CHECK(!ParseKTX(file.data(), size, truncated));
+            CHECK(truncated.levels.empty() && truncated.data.empty());
+        }
+    }
+}
+
+static void testKTX()
+{
+    Pixmap pixmap(40, 24, 4);
+    fillGradient(pixmap);
+    CompressedImage etc;
+    CHECK(EncodeETC2(pixmap, true, etc));
+    CHECK_EQ(etc.format, TEXTURE_FORMAT_ETC2_RGBA);
+    CHECK_EQ(etc.levels.size(), 6);
+    testKTXRoundTrip(etc);
+
+    // odd rows: KTX1 pads them to 4 bytes, KTX2 keeps them tight
+    CompressedImage rgb;
+    rgb.format = TEXTURE_FORMAT_RGB8;
+    rgb.srgb = true;
+    rgb.blockWidth = 1;
+    rgb.blockHeight = 1;
+    rgb.blockBytes = 3;
+    rgb.width = 5;
+    rgb.height = 3;
+    for (int l = 0; l < 3; l++)
+    {
+        const int w = l == 0 ? 5 : l == 1 ? 2 : 1;
+        const int h = l == 0 ? 3 : 1;
+        CompressedLevel level = {w, h, (u32)rgb.data.size(), (u32)(w * h * 3)};
+        rgb.levels.push_back(level);
+        for (u32 i = 0; i < level.size; i++) rgb.data.push_back((u8)(rgb.data.size() * 7));
+    }
+    testKTXRoundTrip(rgb);
+
+    // KTX2 header fields
+    std::vector<u8> file;
+    CHECK(WriteKTX(etc, file, true));
+    CHECK_EQ(file[12], 151);                    // VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK
+    u64 first = 0, last = 0;
+    memcpy(&first, file.data() + 80, 8);
+    memcpy(&last, file.data() + 80 + (etc.levels.size() - 1) * 24, 8);
+    CHECK(last < first);                        // smallest level first
+    CHECK_EQ(first % 16, 0);
+
+    // bad headers
+    CompressedImage bad;
+    std::vector<u8> copy = file;
+    copy[5] = '3';
+    CHECK(!ParseKTX(copy.data(), (u32)copy.size(), bad));
+    copy = file;
+    copy[44] = 2;                               // zstd
+    CHECK(!ParseKTX(copy.data(), (u32)copy.size(), bad));
+    copy = file;
+    copy[12] = 200;                             // unknown VkFormat
+    CHECK(!ParseKTX(copy.data(), (u32)copy.size(), bad));
+    copy = file;
+    copy[36] = 6;                               // cube map
+    CHECK(!ParseKTX(copy.data(), (u32)copy.size(), bad));
+    copy = file;
+    memset(copy.data() + 20, 0, 4);             // width 0
+    CHECK(!ParseKTX(copy.data(), (u32)copy.size(), bad));
+
+    CHECK(WriteKTX(etc, file, false));
+    copy = file;
+    copy[12] = 0x05;                            // endianness
+    CHECK(!ParseKTX(copy.data(), (u32)copy.size(), bad));
+    copy = file;
+    copy[12 + 4 * 4] = 0x01;                    // unknown internal format
+    CHECK(!ParseKTX(copy.data(), (u32)copy.size(), bad));
+    CHECK(!ParseKTX(nullptr, 0, bad));
+}
+
+static void testETC2()
+{
+    Pixmap pixmap(64, 64, 4);
+    fillGradient(pixmap);
+    CompressedImage image;
+    CHECK(EncodeETC2(pixmap, false, image));
+    std::vector<u8> rgba;
+    CHECK(DecodeTextureLevel(image, 0, rgba));
+    CHECK_EQ(rgba.size(), 64 * 64 * 4);
+    for (int c = 0; c < 4; c++)
+    {
+        const double db = psnr(pixmap.pixels, rgba.data(), 64 * 64, c);
+        if (db < 36.0)
+        {
+            printf("ETC2 channel %d: %.2f dB\n", c, db);
+            failures++;
+        }
+    }
+
+    // opaque input gives ETC2 RGB
+    Pixmap opaque(16, 8, 3);
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 16; x++) opaque.SetPixel(x, y, (u8)(x * 16), (u8)(y * 32), 90, 255);
+    CHECK(EncodeETC2(opaque, true, image));
+    CHECK_EQ(image.format, TEXTURE_FORMAT_ETC2_RGB);
+    CHECK_EQ(image.levels.size(), 5);
+    CHECK(DecodeTextureLevel(image, 4, rgba));
+    CHECK_EQ(rgba.size(), 4);
+}
+
+static CompressedImage singleBlock(TextureFormat format, int blockBytes, const u8 *block)
+{
+    CompressedImage image;
+    image.format = format;
+    image.blockWidth = 4;
+    image.blockHeight = 4;
+    image.blockBytes = blockBytes;
+    image.width = 4;
+    image.height = 4;
+    image.data.assign(block, block + blockBytes);
+    CompressedLevel level = {4, 4, 0, (u32)blockBytes};
+    image.levels.push_back(level);
+    return image;
+}
+
+static void checkPixel(const std::vector<u8> &rgba, int i, int r, int g, int b, int a)
+{
+    if (rgba[i * 4] != r || rgba[i * 4 + 1] != g || rgba[i * 4 + 2] != b || rgba[i * 4 + 3] != a)
+    {
+        printf("pixel %d: %d %d %d %d, expected %d %d %d %d\n", i, rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2], rgba[i * 4 + 3], r, g, b, a);
+        failures++;
+    }
+}
+
+static void testBC()
+{
+    std::vector<u8> rgba;
+
+    // red > blue: four colors, every row uses indices 0 1 2 3
+    const u8 bc1[8] = {0x00, 0xF8, 0x1F, 0x00, 0xE4, 0xE4, 0xE4, 0xE4};
+    CHECK(DecodeTextureLevel(singleBlock(TEXTURE_FORMAT_BC1, 8, bc1), 0, rgba));
+    for (int y = 0; y < 4; y++)
+    {
+        checkPixel(rgba, y * 4 + 0, 255, 0, 0, 255);
+        checkPixel(rgba, y * 4 + 1, 0, 0, 255, 255);
+        checkPixel(rgba, y * 4 + 2, 170, 0, 85, 255);
+        checkPixel(rgba, y * 4 + 3, 85, 0, 170, 255);
+    }
+
+    // blue <= red: three colors, index 3 is transparent black with BC1 A1
+    const u8 bc1a[8] = {0x1F, 0x00, 0x00, 0xF8, 0xE4, 0xE4, 0xE4, 0xE4};
+    CHECK(DecodeTextureLevel(singleBlock(TEXTURE_FORMAT_BC1_A1, 8, bc1a), 0, rgba));
+    checkPixel(rgba, 0, 0, 0, 255, 255);
+    checkPixel(rgba, 1, 255, 0, 0, 255);
+    checkPixel(rgba, 2, 127, 0, 127, 255);
+    checkPixel(rgba, 3, 0, 0, 0, 0);
+    CHECK(DecodeTextureLevel(singleBlock(TEXTURE_FORMAT_BC1, 8, bc1a), 0, rgba));
+    checkPixel(rgba, 3, 0, 0, 0, 255);
+
+    // BC3: 8 alpha steps from 245 to 0, indices 0..7 twice; the color half
+    // is always four colors (white/black), 0xE4 rows
+    u8 bc3[16] = {245, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF, 0x00, 0x00, 0xE4, 0xE4, 0xE4, 0xE4};
+    u64 bits = 0;
+    for (int i = 0; i < 16; i++) bits |= (u64)(i & 7) << (3 * i);
+    for (int i = 0; i < 6; i++) bc3[2 + i] = (u8)(bits >> (8 * i));
+    CHECK(DecodeTextureLevel(singleBlock(TEXTURE_FORMAT_BC3, 16, bc3), 0, rgba));
+    const int alpha8[8] = {245, 0, 210, 175, 140, 105, 70, 35};
+    const int gray[4] = {255, 0, 170, 85};
+    for (int i = 0; i < 16; i++)
+    {
+        checkPixel(rgba, i, gray[i & 3], gray[i & 3], gray[i & 3], alpha8[i & 7]);
+    }
+
+    // a0 <= a1: 6 steps plus 0 and 255
+    bc3[0] = 0;
+    bc3[1] = 250;
+    CHECK(DecodeTextureLevel(singleBlock(TEXTURE_FORMAT_BC3, 16, bc3), 0, rgba));
+    const int alpha6[8] = {0, 250, 50, 100, 150, 200, 0, 255};
+    for (int i = 0; i < 16; i++)
+    {
+        CHECK_EQ(rgba[i * 4 + 3], alpha6[i & 7]);
+    }
+}
+
+int main()
+{
+    testKTX();
+    testETC2();
+    testBC();
+
+    if (failures)
+    {
+        printf("test_texture_codec: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_texture_codec: ok\n");
+    return 0;
+}